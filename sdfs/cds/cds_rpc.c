@@ -34,6 +34,7 @@ typedef enum {
         CDS_NULL = 400,
         CDS_WRITE,
         CDS_READ,
+        CDS_CHAIN_WRITE,
         CDS_MAX,
 } cds_op_t;
 
@@ -277,36 +278,17 @@ err_ret:
         return ret;
 }
 
-int cds_rpc_write(const nid_t *nid, const io_t *io, const buffer_t *_buf)
+static int __cds_rpc_write(const char *name, const nid_t *nid, msg_t *req,
+                           uint32_t count, const io_t *io, const buffer_t *_buf)
 {
         int ret;
-        char *buf = mem_cache_calloc1(MEM_CACHE_4K, PAGE_SIZE);
-        uint32_t count;
-        msg_t *req;
-
-        ret = network_connect(nid, NULL, 1, 0);
-        if (unlikely(ret))
-                GOTO(err_ret, ret);
-        
-        ANALYSIS_BEGIN(0);
-
-        YASSERT(_buf->len == io->size);
-        //YASSERT(io->offset <= YFS_CHK_LEN_MAX);
-
-        req = (void *)buf;
-        req->op = CDS_WRITE;
-        req->chkid = io->id;
-        _opaque_encode(&req->buf, &count, net_getnid(), sizeof(nid_t), io,
-                       sizeof(*io), NULL);
-
-        req->buflen = count;
 
         DBUG("write %u\n", sizeof(*req) + count + _buf->len);
         
 #if ENABLE_CORERPC
         if (likely(ng.daemon)) {
                 DBUG("corenet write\n");
-                ret = corerpc_postwait("cds_rpc_write", nid,
+                ret = corerpc_postwait(name, nid,
                                        req, sizeof(*req) + count, _buf,
                                        NULL, MSG_CORENET, io->size, _get_timeout());
                 if (unlikely(ret)) {
@@ -314,14 +296,15 @@ int cds_rpc_write(const nid_t *nid, const io_t *io, const buffer_t *_buf)
                         GOTO(err_ret, ret);
                 }
         }  else {
-                ret = rpc_request_wait1("cds_rpc_write", nid,
+                ret = rpc_request_wait1(name, nid,
                                         req, sizeof(*req) + count, _buf,
                                         MSG_REPLICA, 0, _get_timeout());
                 if (unlikely(ret))
                         GOTO(err_ret, ret);
         }
 #else
-        ret = rpc_request_wait1("cds_rpc_write", nid,
+        (void) io;
+        ret = rpc_request_wait1(name, nid,
                                 req, sizeof(*req) + count, _buf,
                                 MSG_REPLICA, 0, _get_timeout());
         if (unlikely(ret))
@@ -329,6 +312,39 @@ int cds_rpc_write(const nid_t *nid, const io_t *io, const buffer_t *_buf)
         
 #endif
 
+        return 0;
+err_ret:
+        return ret;
+}
+
+int cds_rpc_write(const nid_t *nid, const io_t *io, const buffer_t *_buf)
+{
+        int ret;
+        char *buf = mem_cache_calloc1(MEM_CACHE_4K, PAGE_SIZE);
+        uint32_t count;
+        msg_t *req;
+
+        ret = network_connect(nid, NULL, 1, 0);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+        
+        ANALYSIS_BEGIN(0);
+
+        YASSERT(_buf->len == io->size);
+        //YASSERT(io->offset <= YFS_CHK_LEN_MAX);
+
+        req = (void *)buf;
+        req->op = CDS_WRITE;
+        req->chkid = io->id;
+        _opaque_encode(&req->buf, &count, net_getnid(), sizeof(nid_t), io,
+                       sizeof(*io), NULL);
+
+        req->buflen = count;
+
+        ret = __cds_rpc_write("cds_rpc_write", nid, req, count, io, _buf);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
         DBUG("write return\n");
         
         ANALYSIS_QUEUE(0, IO_WARN, NULL);
@@ -341,12 +357,147 @@ err_ret:
         return ret;
 }
 
+typedef struct {
+        const nid_t *chain;
+        int count;
+        const io_t *io;
+        const buffer_t *buf;
+        task_t task;
+        int running;
+        int waiting;
+        int retval;
+} chain_ctx_t;
+
+static void __cds_chain_forward(void *arg)
+{
+        chain_ctx_t *ctx = arg;
+
+        ctx->retval = cds_rpc_chain_write(ctx->chain, ctx->count, ctx->io, ctx->buf);
+        ctx->running = 0;
+        if (ctx->waiting)
+                schedule_resume(&ctx->task, 0, NULL);
+}
+
+/*
+ * chain replication: write locally while the payload is forwarded to the
+ * rest of the chain, reply once both are done, so the tail acks first
+ */
+static int __cds_srv_chain_write(const sockid_t *sockid, const msgid_t *msgid, buffer_t *_buf)
+{
+        int ret;
+        msg_t *req;
+        char *buf = mem_cache_calloc1(MEM_CACHE_4K, PAGE_SIZE);
+        uint32_t buflen, chainlen;
+        const nid_t *writer, *chain;
+        const io_t *io;
+        chain_ctx_t ctx;
+
+        req = (void *)buf;
+        mbuffer_get(_buf, req, sizeof(*req));
+        buflen = req->buflen;
+        ret = mbuffer_popmsg(_buf, req, buflen + sizeof(*req));
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
+        _opaque_decode(req->buf, buflen, &writer, NULL, &io, NULL,
+                       &chain, &chainlen, NULL);
+
+        DBUG("chain write chunk "CHKID_FORMAT", off %llu, len %u:%u, next %u\n",
+              CHKID_ARG(&req->chkid), (LLU)io->offset, io->size, _buf->len,
+              chainlen / (uint32_t)sizeof(nid_t));
+
+        YASSERT(_buf->len == io->size);
+
+        ctx.running = 0;
+        ctx.waiting = 0;
+        ctx.retval = 0;
+        if (chainlen) {
+                ctx.chain = chain;
+                ctx.count = chainlen / sizeof(nid_t);
+                ctx.io = io;
+                ctx.buf = _buf;
+                ctx.task = schedule_task_get();
+                ctx.running = 1;
+                schedule_task_new("chain_forward", __cds_chain_forward, &ctx, -1);
+        }
+
+        ret = replica_write(io, _buf);
+
+        if (ctx.running) {
+                ctx.waiting = 1;
+                schedule_yield("chain_wait", NULL, NULL);
+        }
+
+        if (unlikely(ret)) {
+                GOTO(err_ret, ret);
+        }
+
+        if (unlikely(ctx.retval)) {
+                ret = ctx.retval;
+                GOTO(err_ret, ret);
+        }
+
+        if (sockid->type == SOCKID_CORENET) {
+                corerpc_reply(sockid, msgid, NULL, 0);
+        } else {
+                rpc_reply(sockid, msgid, NULL, 0);
+        }
+
+        mem_cache_free(MEM_CACHE_4K, buf);
+
+        return 0;
+err_ret:
+        mem_cache_free(MEM_CACHE_4K, buf);
+        return ret;
+}
+
+int cds_rpc_chain_write(const nid_t *chain, int count, const io_t *io, const buffer_t *_buf)
+{
+        int ret;
+        char *buf = mem_cache_calloc1(MEM_CACHE_4K, PAGE_SIZE);
+        uint32_t len;
+        msg_t *req;
+        const nid_t *nid = &chain[0];
+
+        YASSERT(count > 0 && count <= YFS_CHK_REP_MAX);
+
+        ret = network_connect(nid, NULL, 1, 0);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+        
+        ANALYSIS_BEGIN(0);
+
+        YASSERT(_buf->len == io->size);
+
+        req = (void *)buf;
+        req->op = CDS_CHAIN_WRITE;
+        req->chkid = io->id;
+        _opaque_encode(&req->buf, &len, net_getnid(), sizeof(nid_t), io,
+                       sizeof(*io), &chain[1], sizeof(nid_t) * (count - 1), NULL);
+
+        req->buflen = len;
+
+        ret = __cds_rpc_write("cds_rpc_chain_write", nid, req, len, io, _buf);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
+        ANALYSIS_QUEUE(0, IO_WARN, NULL);
+
+        mem_cache_free(MEM_CACHE_4K, buf);
+
+        return 0;
+err_ret:
+        mem_cache_free(MEM_CACHE_4K, buf);
+        return ret;
+}
+
 int cds_rpc_init()
 {
         DINFO("replica rpc init\n");
 
         __request_set_handler(CDS_READ, __cds_srv_read, "cds_srv_read");
         __request_set_handler(CDS_WRITE, __cds_srv_write, "cds_srv_write");
+        __request_set_handler(CDS_CHAIN_WRITE, __cds_srv_chain_write, "cds_srv_chain_write");
         
         if (ng.daemon) {
                 rpc_request_register(MSG_REPLICA, __request_handler, NULL);
@@ -21,5 +21,6 @@ static inline void io_init(io_t *io, const chkid_t *chkid,
 int cds_rpc_init();
 int cds_rpc_read(const nid_t *nid, const io_t *io, buffer_t *_buf);
 int cds_rpc_write(const nid_t *nid, const io_t *io, const buffer_t *_buf);
+int cds_rpc_chain_write(const nid_t *chain, int count, const io_t *io, const buffer_t *_buf);
 
 #endif
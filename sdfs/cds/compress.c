@@ -0,0 +1,648 @@
+
+#include <sys/stat.h>
+#include <linux/falloc.h>
+#include <fcntl.h>
+#include <zlib.h>
+#include <errno.h>
+
+#define DBG_SUBSYS S_YFSCDS
+
+#include "sdfs_lib.h"
+#include "ylib.h"
+#include "compress.h"
+#include "replica.h"
+#include "net_global.h"
+#include "configure.h"
+#include "schedule.h"
+#include "md_lib.h"
+#include "io_analysis.h"
+#include "dbg.h"
+
+#define COMPRESS_VOLUME_MAX 64
+#define COMPRESS_VOLUME_TTL 10
+#define COMPRESS_CHUNK_MAX (64 * 1024)
+
+#define COMPRESS_RAW ((uint32_t)COMPRESS_BLOCK)
+
+typedef struct {
+        uint64_t volid;
+        time_t update;
+        int mode;
+} compress_volume_t;
+
+/* whether a chunk has a map, slots are replaced on collision */
+typedef struct {
+        chkid_t id;
+        uint64_t snapvers;
+        uint32_t gen;
+        int used;
+        int exist;
+} compress_chunk_t;
+
+static compress_volume_t __compress_volume__[COMPRESS_VOLUME_MAX];
+static pthread_mutex_t __compress_volume_lock__ = PTHREAD_MUTEX_INITIALIZER;
+static compress_chunk_t __compress_chunk__[COMPRESS_CHUNK_MAX];
+static sy_spinlock_t __compress_chunk_lock__;
+static pthread_once_t __compress_chunk_once__ = PTHREAD_ONCE_INIT;
+static int __seq__ = 0;
+
+static int __compress_mode__(va_list ap)
+{
+        int ret;
+        uint64_t volid = va_arg(ap, uint64_t);
+        int *_mode = va_arg(ap, int *);
+        volid_t _volid = {volid, 0};
+        fileid_t fileid;
+        char value[MAX_NAME_LEN];
+        size_t size;
+
+        va_end(ap);
+
+        id2vid(volid, &fileid);
+        size = sizeof(value) - 1;
+        ret = md_getxattr(&_volid, &fileid, USS_SYSTEM_ATTR_COMPRESS, value, &size);
+        if (ret) {
+                *_mode = COMPRESS_NULL;
+                return 0;
+        }
+
+        value[size] = '\0';
+        if (strcmp(value, "fast") == 0) {
+                *_mode = COMPRESS_FAST;
+        } else if (strcmp(value, "best") == 0) {
+                *_mode = COMPRESS_BEST;
+        } else {
+                *_mode = COMPRESS_NONE;
+        }
+
+        return 0;
+}
+
+int compress_mode(uint64_t volid)
+{
+        int ret, mode;
+        time_t now = gettime();
+        compress_volume_t *ent = &__compress_volume__[volid % COMPRESS_VOLUME_MAX];
+
+        pthread_mutex_lock(&__compress_volume_lock__);
+        if (ent->volid == volid && now - ent->update < COMPRESS_VOLUME_TTL) {
+                mode = ent->mode;
+                pthread_mutex_unlock(&__compress_volume_lock__);
+                return mode;
+        }
+        pthread_mutex_unlock(&__compress_volume_lock__);
+
+        ret = schedule_newthread(SCHE_THREAD_REPLICA, ++__seq__, FALSE,
+                                 "compress_mode", -1, __compress_mode__,
+                                 volid, &mode);
+        if (ret) {
+                DWARN("volume %ju compress mode, ret %u\n", volid, ret);
+                return COMPRESS_NULL;
+        }
+
+        pthread_mutex_lock(&__compress_volume_lock__);
+        ent->volid = volid;
+        ent->update = now;
+        ent->mode = mode;
+        pthread_mutex_unlock(&__compress_volume_lock__);
+
+        return mode;
+}
+
+static void __compress_mappath(char *mappath, const char *path)
+{
+        snprintf(mappath, MAX_PATH_LEN, "%s.zmap", path);
+}
+
+static void __compress_chunk_init()
+{
+        sy_spin_init(&__compress_chunk_lock__);
+}
+
+static compress_chunk_t *__compress_chunk(const chkid_t *chkid, uint64_t snapvers)
+{
+        return &__compress_chunk__[(chkid->id * 31 + chkid->idx + snapvers)
+                                   % COMPRESS_CHUNK_MAX];
+}
+
+/*
+ * only the thread a chunk is hashed to creates its map, it records the
+ * result unconditionally.  a lookup on the core records what it found only
+ * if nothing was recorded in the slot meanwhile.
+ */
+static void __compress_chunk_set(const chkid_t *chkid, uint64_t snapvers,
+                                 int exist, const uint32_t *gen)
+{
+        compress_chunk_t *ent = __compress_chunk(chkid, snapvers);
+
+        sy_spin_lock(&__compress_chunk_lock__);
+
+        if (gen == NULL || ent->gen == *gen) {
+                ent->id = *chkid;
+                ent->snapvers = snapvers;
+                ent->used = 1;
+                ent->exist = exist;
+                ent->gen++;
+        }
+
+        sy_spin_unlock(&__compress_chunk_lock__);
+}
+
+/* a chunk is compressed iff it has a map, whatever its volume says now */
+static int __compress_exist(const chkid_t *chkid, uint64_t snapvers, const char *path)
+{
+        int exist;
+        uint32_t gen;
+        char mappath[MAX_PATH_LEN];
+        compress_chunk_t *ent = __compress_chunk(chkid, snapvers);
+
+        pthread_once(&__compress_chunk_once__, __compress_chunk_init);
+
+        sy_spin_lock(&__compress_chunk_lock__);
+
+        if (ent->used && ent->snapvers == snapvers && !chkid_cmp(&ent->id, chkid)) {
+                exist = ent->exist;
+                sy_spin_unlock(&__compress_chunk_lock__);
+                return exist;
+        }
+
+        gen = ent->gen;
+        sy_spin_unlock(&__compress_chunk_lock__);
+
+        __compress_mappath(mappath, path);
+        exist = access(mappath, F_OK) == 0;
+
+        __compress_chunk_set(chkid, snapvers, exist, &gen);
+
+        return exist;
+}
+
+static off_t __compress_off(uint32_t ent, int blk)
+{
+        return (off_t)blk * COMPRESS_BLOCK + ((ent & COMPRESS_ALT) ? YFS_CHK_LEN_MAX : 0);
+}
+
+static int __compress_map_load(int fd, uint32_t *map)
+{
+        int ret;
+
+        memset(map, 0x0, sizeof(*map) * COMPRESS_BLOCK_MAX);
+        ret = pread(fd, map, sizeof(*map) * COMPRESS_BLOCK_MAX, 0);
+        if (ret < 0) {
+                ret = errno;
+                GOTO(err_ret, ret);
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+/* decode one block into a COMPRESS_BLOCK sized buffer */
+static int __compress_block_load(int fd, const uint32_t *map, int blk,
+                                 char *block, char *zbuf)
+{
+        int ret;
+        uint32_t zlen;
+        uLongf len;
+        off_t off = __compress_off(map[blk], blk);
+
+        if (map[blk] == 0) {
+                memset(block, 0x0, COMPRESS_BLOCK);
+                return 0;
+        }
+
+        if (!(map[blk] & COMPRESS_ZIP)) {
+                memset(block, 0x0, COMPRESS_BLOCK);
+                ret = pread(fd, block, COMPRESS_BLOCK, off);
+                if (ret < 0) {
+                        ret = errno;
+                        GOTO(err_ret, ret);
+                }
+
+                return 0;
+        }
+
+        zlen = map[blk] & ~(COMPRESS_ZIP | COMPRESS_ALT);
+        ret = pread(fd, zbuf, zlen, off);
+        if (ret < 0) {
+                ret = errno;
+                GOTO(err_ret, ret);
+        }
+
+        if (ret != (int)zlen) {
+                ret = EIO;
+                GOTO(err_ret, ret);
+        }
+
+        len = COMPRESS_BLOCK;
+        ret = uncompress((Bytef *)block, &len, (Bytef *)zbuf, zlen);
+        if (ret != Z_OK || len != COMPRESS_BLOCK) {
+                DERROR("block %u uncompress fail, ret %d len %lu\n", blk, ret, len);
+                ret = EIO;
+                GOTO(err_ret, ret);
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+/* the block goes to the slot its current mapping does not use */
+static int __compress_block_store(int fd, uint32_t *map, int blk, const char *block,
+                                  char *zbuf, int mode, uint64_t *stored)
+{
+        int ret;
+        uLongf zlen;
+        uint32_t alt = map[blk] ? (~map[blk] & COMPRESS_ALT) : 0;
+        off_t off = __compress_off(alt, blk);
+
+        if (mode != COMPRESS_NONE) {
+                zlen = compressBound(COMPRESS_BLOCK);
+                ret = compress2((Bytef *)zbuf, &zlen, (const Bytef *)block,
+                                COMPRESS_BLOCK, mode == COMPRESS_BEST ? 9 : 1);
+                if (ret != Z_OK) {
+                        DWARN("block %u compress fail, ret %d\n", blk, ret);
+                        zlen = COMPRESS_BLOCK;
+                }
+        } else {
+                zlen = COMPRESS_BLOCK;
+        }
+
+        if (zlen + COMPRESS_SAVE_MIN > COMPRESS_BLOCK) {
+                ret = pwrite(fd, block, COMPRESS_BLOCK, off);
+                if (ret < 0) {
+                        ret = errno;
+                        GOTO(err_ret, ret);
+                }
+
+                map[blk] = COMPRESS_RAW | alt;
+                *stored += COMPRESS_BLOCK;
+                return 0;
+        }
+
+        ret = pwrite(fd, zbuf, zlen, off);
+        if (ret < 0) {
+                ret = errno;
+                GOTO(err_ret, ret);
+        }
+
+        ret = fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                        off + zlen, COMPRESS_BLOCK - zlen);
+        if (ret < 0) {
+                ret = errno;
+                DWARN("punch block %u, %s\n", blk, strerror(ret));
+        }
+
+        map[blk] = COMPRESS_ZIP | alt | (uint32_t)zlen;
+        *stored += zlen;
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+/*
+ * ENOSYS: the chunk is a plain file, or it does not exist yet and the volume
+ * stores new chunks uncompressed, the caller takes the normal path
+ */
+static int __compress_open(const char *path, int mode, int *_fd, int *_mapfd)
+{
+        int ret, fd, mapfd;
+        char mappath[MAX_PATH_LEN];
+        struct stat stbuf;
+
+        __compress_mappath(mappath, path);
+
+        mapfd = open(mappath, O_RDWR);
+        if (mapfd < 0) {
+                ret = errno;
+                if (ret != ENOENT)
+                        GOTO(err_ret, ret);
+
+                if (mode == COMPRESS_NULL || mode == COMPRESS_NONE) {
+                        ret = ENOSYS;
+                        goto err_ret;
+                }
+
+                ret = stat(path, &stbuf);
+                if (ret == 0 && stbuf.st_size) {
+                        ret = ENOSYS;
+                        goto err_ret;
+                }
+
+                ret = path_validate(path, YLIB_NOTDIR, YLIB_DIRCREATE);
+                if (ret)
+                        GOTO(err_ret, ret);
+
+                mapfd = open(mappath, O_RDWR | O_CREAT, 0600);
+                if (mapfd < 0) {
+                        ret = errno;
+                        GOTO(err_ret, ret);
+                }
+        }
+
+        fd = open(path, O_RDWR | O_CREAT, 0600);
+        if (fd < 0) {
+                ret = errno;
+                GOTO(err_map, ret);
+        }
+
+        *_fd = fd;
+        *_mapfd = mapfd;
+
+        return 0;
+err_map:
+        close(mapfd);
+err_ret:
+        return ret;
+}
+
+static int __compress_write__(va_list ap)
+{
+        int ret, fd, mapfd, blk, first, last, dirty = 0;
+        const chkid_t *chkid = va_arg(ap, const chkid_t *);
+        uint64_t snapvers = va_arg(ap, uint64_t);
+        const char *path = va_arg(ap, const char *);
+        uint64_t offset = va_arg(ap, uint64_t);
+        uint32_t size = va_arg(ap, uint32_t);
+        const char *data = va_arg(ap, const char *);
+        int mode = va_arg(ap, int);
+        uint64_t *stored = va_arg(ap, uint64_t *);
+        uint32_t map[COMPRESS_BLOCK_MAX], old[COMPRESS_BLOCK_MAX], boff, len;
+        char *block, *zbuf;
+        uint64_t pos;
+
+        va_end(ap);
+
+        ret = __compress_open(path, mode, &fd, &mapfd);
+        __compress_chunk_set(chkid, snapvers, ret != ENOSYS, NULL);
+        if (ret)
+                goto err_ret;
+
+        ret = __compress_map_load(mapfd, map);
+        if (ret)
+                GOTO(err_fd, ret);
+
+        ret = ymalloc((void **)&block, COMPRESS_BLOCK + compressBound(COMPRESS_BLOCK));
+        if (ret)
+                GOTO(err_fd, ret);
+
+        zbuf = block + COMPRESS_BLOCK;
+        first = offset / COMPRESS_BLOCK;
+        last = (offset + size - 1) / COMPRESS_BLOCK;
+        YASSERT(last < COMPRESS_BLOCK_MAX);
+        memcpy(&old[first], &map[first], sizeof(*map) * (last - first + 1));
+
+        /* a compressed volume stays compressed, "none" only stores raw slots */
+        if (mode == COMPRESS_NULL)
+                mode = COMPRESS_NONE;
+
+        pos = offset;
+        for (blk = first; blk <= last; blk++) {
+                boff = pos % COMPRESS_BLOCK;
+                len = _min(COMPRESS_BLOCK - boff, offset + size - pos);
+
+                if (len != COMPRESS_BLOCK) {
+                        ret = __compress_block_load(fd, map, blk, block, zbuf);
+                        if (ret)
+                                GOTO(err_free, ret);
+                }
+
+                memcpy(block + boff, data + (pos - offset), len);
+
+                ret = __compress_block_store(fd, map, blk, block, zbuf, mode, stored);
+                if (ret)
+                        GOTO(err_free, ret);
+
+                dirty = 1;
+                pos += len;
+        }
+
+        /*
+         * with io_sync the write must be durable when it returns, like
+         * O_SYNC on a plain chunk.  a block is not overwritten in place, so
+         * that takes two syncs: the map is switched to the new slots only
+         * once they are durable, and the old slots are released only once
+         * the map is, a crash leaves either mapping with its data.  without
+         * io_sync neither is synced, as on a plain chunk.
+         */
+        if (cdsconf.io_sync) {
+                ret = fdatasync(fd);
+                if (ret < 0) {
+                        ret = errno;
+                        GOTO(err_free, ret);
+                }
+        }
+
+        ret = pwrite(mapfd, &map[first], sizeof(*map) * (last - first + 1),
+                     sizeof(*map) * first);
+        if (ret < 0) {
+                ret = errno;
+                GOTO(err_free, ret);
+        }
+
+        if (cdsconf.io_sync) {
+                ret = fdatasync(mapfd);
+                if (ret < 0) {
+                        ret = errno;
+                        GOTO(err_free, ret);
+                }
+        }
+
+        for (blk = first; blk <= last; blk++) {
+                if (old[blk] == 0)
+                        continue;
+
+                ret = fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                                __compress_off(old[blk], blk), COMPRESS_BLOCK);
+                if (ret < 0) {
+                        ret = errno;
+                        DWARN("punch block %u, %s\n", blk, strerror(ret));
+                }
+        }
+
+        yfree((void **)&block);
+        close(mapfd);
+        close(fd);
+
+        return 0;
+err_free:
+        yfree((void **)&block);
+err_fd:
+        if (dirty) {
+                DERROR("%s write fail at %ju, ret %u\n", path, offset, ret);
+        }
+        close(mapfd);
+        close(fd);
+err_ret:
+        return ret;
+}
+
+static int __compress_read__(va_list ap)
+{
+        int ret, fd, mapfd, blk, first, last;
+        const chkid_t *chkid = va_arg(ap, const chkid_t *);
+        uint64_t snapvers = va_arg(ap, uint64_t);
+        const char *path = va_arg(ap, const char *);
+        uint64_t offset = va_arg(ap, uint64_t);
+        uint32_t size = va_arg(ap, uint32_t);
+        char *data = va_arg(ap, char *);
+        uint32_t map[COMPRESS_BLOCK_MAX], boff, len;
+        char *block, *zbuf;
+        uint64_t pos;
+
+        va_end(ap);
+
+        ret = __compress_open(path, COMPRESS_NULL, &fd, &mapfd);
+        __compress_chunk_set(chkid, snapvers, ret != ENOSYS, NULL);
+        if (ret)
+                goto err_ret;
+
+        ret = __compress_map_load(mapfd, map);
+        if (ret)
+                GOTO(err_fd, ret);
+
+        ret = ymalloc((void **)&block, COMPRESS_BLOCK + compressBound(COMPRESS_BLOCK));
+        if (ret)
+                GOTO(err_fd, ret);
+
+        zbuf = block + COMPRESS_BLOCK;
+        first = offset / COMPRESS_BLOCK;
+        last = (offset + size - 1) / COMPRESS_BLOCK;
+        YASSERT(last < COMPRESS_BLOCK_MAX);
+
+        pos = offset;
+        for (blk = first; blk <= last; blk++) {
+                boff = pos % COMPRESS_BLOCK;
+                len = _min(COMPRESS_BLOCK - boff, offset + size - pos);
+
+                if (map[blk] & COMPRESS_ZIP) {
+                        ret = __compress_block_load(fd, map, blk, block, zbuf);
+                        if (ret)
+                                GOTO(err_free, ret);
+
+                        memcpy(data + (pos - offset), block + boff, len);
+                } else if (map[blk]) {
+                        memset(data + (pos - offset), 0x0, len);
+                        ret = pread(fd, data + (pos - offset), len,
+                                    __compress_off(map[blk], blk) + boff);
+                        if (ret < 0) {
+                                ret = errno;
+                                GOTO(err_free, ret);
+                        }
+                } else {
+                        memset(data + (pos - offset), 0x0, len);
+                }
+
+                pos += len;
+        }
+
+        yfree((void **)&block);
+        close(mapfd);
+        close(fd);
+
+        return 0;
+err_free:
+        yfree((void **)&block);
+err_fd:
+        close(mapfd);
+        close(fd);
+err_ret:
+        return ret;
+}
+
+int IO_FUNC compress_write(const io_t *io, const buffer_t *buf, int mode)
+{
+        int ret;
+        char path[MAX_PATH_LEN];
+        char *data;
+        uint64_t stored = 0;
+
+        YASSERT(buf->len == io->size);
+
+        chkid2path(&io->id, io->snapvers, path);
+
+        if ((mode == COMPRESS_NULL || mode == COMPRESS_NONE)
+            && !__compress_exist(&io->id, io->snapvers, path))
+                return -ENOSYS;
+
+        ret = ymalloc((void **)&data, io->size);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        mbuffer_get(buf, data, io->size);
+
+        /* one chunk is always handled by the same thread */
+        ret = schedule_newthread(SCHE_THREAD_REPLICA, io->id.id + io->id.idx, FALSE,
+                                 "compress_write", -1, __compress_write__,
+                                 &io->id, io->snapvers, path, io->offset, io->size, data, mode, &stored);
+        if (ret)
+                goto err_free;
+
+        io_analysis_compress(io->size, stored);
+        yfree((void **)&data);
+
+        return io->size;
+err_free:
+        yfree((void **)&data);
+err_ret:
+        return -ret;
+}
+
+int IO_FUNC compress_read(const io_t *io, buffer_t *buf)
+{
+        int ret;
+        char path[MAX_PATH_LEN];
+        char *data;
+
+        YASSERT(buf->len == 0);
+
+        chkid2path(&io->id, io->snapvers, path);
+
+        if (!__compress_exist(&io->id, io->snapvers, path))
+                return -ENOSYS;
+
+        ret = ymalloc((void **)&data, io->size);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = schedule_newthread(SCHE_THREAD_REPLICA, io->id.id + io->id.idx, FALSE,
+                                 "compress_read", -1, __compress_read__,
+                                 &io->id, io->snapvers, path, io->offset, io->size, data);
+        if (ret)
+                goto err_free;
+
+        ret = mbuffer_appendmem(buf, data, io->size);
+        if (ret)
+                GOTO(err_free, ret);
+
+        yfree((void **)&data);
+
+        return io->size;
+err_free:
+        yfree((void **)&data);
+err_ret:
+        return -ret;
+}
+
+int compress_unlink(const char *path)
+{
+        int ret;
+        char mappath[MAX_PATH_LEN];
+
+        __compress_mappath(mappath, path);
+
+        ret = unlink(mappath);
+        if (ret < 0) {
+                ret = errno;
+                if (ret == ENOENT)
+                        return 0;
+
+                GOTO(err_ret, ret);
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
@@ -0,0 +1,37 @@
+#ifndef __COMPRESS_H__
+#define __COMPRESS_H__
+
+#include "sdfs_lib.h"
+#include "ylib.h"
+#include "chk_proto.h"
+
+/*
+ * per volume chunk compression, USS_SYSTEM_ATTR_COMPRESS on the volume root:
+ * "none", "fast" or "best".  a chunk created while the volume compresses is
+ * stored as fixed COMPRESS_BLOCK slots, each holding the deflated block at its
+ * head with the unused tail punched out, plus a map file of stored lengths.
+ * such chunks stay in that layout whatever the volume is switched to later,
+ * a chunk is compressed iff its map exists.  an overwritten block goes to
+ * the other of its two slots and the map is switched after the data is
+ * durable.
+ */
+
+#define COMPRESS_BLOCK (64 * 1024)
+#define COMPRESS_BLOCK_MAX ((int)(YFS_CHK_LEN_MAX / COMPRESS_BLOCK))
+#define COMPRESS_SAVE_MIN (4 * 1024)    /* store raw unless this much is saved */
+#define COMPRESS_ZIP ((uint32_t)1 << 31)
+#define COMPRESS_ALT ((uint32_t)1 << 30)  /* block in the slot past YFS_CHK_LEN_MAX */
+
+typedef enum {
+        COMPRESS_NULL = -1,     /* never configured, plain chunk files */
+        COMPRESS_NONE = 0,
+        COMPRESS_FAST,
+        COMPRESS_BEST,
+} compress_mode_t;
+
+int compress_mode(uint64_t volid);
+int IO_FUNC compress_read(const io_t *io, buffer_t *buf);
+int IO_FUNC compress_write(const io_t *io, const buffer_t *buf, int mode);
+int compress_unlink(const char *path);
+
+#endif
@@ -0,0 +1,1266 @@
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <linux/fs.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define DBG_SUBSYS S_YFSCDS
+
+#include "sdfs_lib.h"
+#include "ylib.h"
+#include "jnl_proto.h"
+#include "extent.h"
+#include "net_global.h"
+#include "configure.h"
+#include "schedule.h"
+#include "diskio.h"
+#include "aio.h"
+#include "bh.h"
+#include "dbg.h"
+
+#define EXTENT_OP_ALLOC 1
+#define EXTENT_OP_FREE  2
+
+#define EXTENT_CKPT_MAGIC 0x65787463
+#define EXTENT_CKPT_BATCH 1024
+
+#define SECTOR_SIZE 512
+
+typedef struct {
+        chkid_t chkid;
+        uint64_t snapvers;
+} extent_key_t;
+
+typedef struct {
+        extent_key_t key;
+        int count;
+        uint32_t addr[EXTENT_CHUNK_MAX];
+} extent_chunk_t;
+
+/* journal record, the index is rebuilt from it at startup */
+typedef struct {
+        uint32_t op;
+        uint32_t idx;
+        uint32_t addr;
+        uint32_t __pad__;
+        extent_key_t key;
+} extent_rec_t;
+
+typedef struct {
+        int fd;
+        int fd_direct;
+        uint64_t base;
+        uint32_t used;
+        uint8_t bitmap[EXTENT_PER_FILE / CHAR_BIT];
+} extent_file_t;
+
+typedef struct {
+        pthread_mutex_t lock;
+        hashtable_t tab;
+        jnl_handle_t jnl;
+        char home[MAX_PATH_LEN];
+        int raw;
+        int file_count;
+        int cursor;
+        uint32_t count;
+        int64_t ckpt_lsn;
+        extent_file_t file[EXTENT_FILE_MAX];
+} extent_store_t;
+
+static extent_store_t *__extent__ = NULL;
+static char __extent_zero_buf__[EXTENT_SIZE] __attribute__((aligned(SECTOR_SIZE)));
+
+static uint32_t __extent_key(const void *_key)
+{
+        const extent_key_t *key = _key;
+
+        return key->chkid.id + key->chkid.idx;
+}
+
+static int __extent_cmp(const void *_v1, const void *_v2)
+{
+        const extent_chunk_t *ent = _v1;
+        const extent_key_t *key = _v2;
+
+        if (ent->key.snapvers != key->snapvers)
+                return 1;
+
+        return chkid_cmp(&ent->key.chkid, &key->chkid);
+}
+
+static void __extent_bit_set(extent_file_t *file, uint32_t slot, int used)
+{
+        if (used) {
+                YASSERT((file->bitmap[slot / CHAR_BIT] & (1 << (slot % CHAR_BIT))) == 0);
+                file->bitmap[slot / CHAR_BIT] |= (1 << (slot % CHAR_BIT));
+                file->used++;
+        } else {
+                YASSERT(file->bitmap[slot / CHAR_BIT] & (1 << (slot % CHAR_BIT)));
+                file->bitmap[slot / CHAR_BIT] &= ~(1 << (slot % CHAR_BIT));
+                file->used--;
+        }
+}
+
+static int __extent_open(extent_file_t *file, const char *path, uint64_t base)
+{
+        int ret, fd, fd_direct;
+
+        fd = open(path, O_RDWR | (cdsconf.io_sync ? O_SYNC : 0));
+        if (fd < 0) {
+                ret = errno;
+                goto err_ret;
+        }
+
+        fd_direct = open(path, O_RDWR | O_DIRECT);
+        if (fd_direct < 0) {
+                ret = errno;
+                GOTO(err_fd, ret);
+        }
+
+        file->fd = fd;
+        file->fd_direct = fd_direct;
+        file->base = base;
+        file->used = 0;
+        memset(file->bitmap, 0x0, sizeof(file->bitmap));
+
+        return 0;
+err_fd:
+        close(fd);
+err_ret:
+        return ret;
+}
+
+static int __extent_newfile(extent_store_t *store)
+{
+        int ret, fd;
+        char path[MAX_PATH_LEN];
+
+        if (store->raw || store->file_count == EXTENT_FILE_MAX) {
+                ret = ENOSPC;
+                GOTO(err_ret, ret);
+        }
+
+        snprintf(path, MAX_PATH_LEN, "%s/%u", store->home, store->file_count);
+
+        fd = open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0) {
+                ret = errno;
+                GOTO(err_ret, ret);
+        }
+
+        ret = posix_fallocate(fd, 0, EXTENT_FILE_SIZE);
+        if (ret) {
+                DWARN("fallocate %s fail, ret %u\n", path, ret);
+                GOTO(err_unlink, ret);
+        }
+
+        close(fd);
+
+        ret = __extent_open(&store->file[store->file_count], path, 0);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        DINFO("extent file %s created\n", path);
+
+        store->file_count++;
+
+        return 0;
+err_unlink:
+        close(fd);
+        unlink(path);
+err_ret:
+        return ret;
+}
+
+static int __extent_alloc_addr(extent_store_t *store, uint32_t *addr)
+{
+        int ret, i, f;
+        uint32_t slot;
+        extent_file_t *file;
+
+        for (i = 0; i < store->file_count; i++) {
+                f = (store->cursor + i) % store->file_count;
+                file = &store->file[f];
+                if (file->used == EXTENT_PER_FILE)
+                        continue;
+
+                for (slot = 0; slot < EXTENT_PER_FILE; slot++) {
+                        if ((file->bitmap[slot / CHAR_BIT] & (1 << (slot % CHAR_BIT))) == 0)
+                                break;
+                }
+
+                YASSERT(slot < EXTENT_PER_FILE);
+                __extent_bit_set(file, slot, 1);
+                store->cursor = f;
+                *addr = f * EXTENT_PER_FILE + slot;
+
+                return 0;
+        }
+
+        ret = __extent_newfile(store);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        f = store->file_count - 1;
+        __extent_bit_set(&store->file[f], 0, 1);
+        store->cursor = f;
+        *addr = f * EXTENT_PER_FILE;
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static void __extent_free_addr(extent_store_t *store, uint32_t addr)
+{
+        YASSERT(addr / EXTENT_PER_FILE < (uint32_t)store->file_count);
+
+        __extent_bit_set(&store->file[addr / EXTENT_PER_FILE],
+                         addr % EXTENT_PER_FILE, 0);
+}
+
+static int __extent_chunk_get(extent_store_t *store, const extent_key_t *key,
+                              extent_chunk_t **_ent)
+{
+        int ret, i;
+        extent_chunk_t *ent;
+
+        ent = hash_table_find(store->tab, (void *)key);
+        if (ent) {
+                *_ent = ent;
+                return 0;
+        }
+
+        ret = ymalloc((void **)&ent, sizeof(*ent));
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ent->key = *key;
+        ent->count = 0;
+        for (i = 0; i < EXTENT_CHUNK_MAX; i++) {
+                ent->addr[i] = EXTENT_NULL;
+        }
+
+        ret = hash_table_insert(store->tab, (void *)ent, (void *)&ent->key, 0);
+        if (ret)
+                GOTO(err_free, ret);
+
+        store->count++;
+
+        *_ent = ent;
+
+        return 0;
+err_free:
+        yfree((void **)&ent);
+err_ret:
+        return ret;
+}
+
+static void __extent_chunk_free(extent_store_t *store, const extent_key_t *key,
+                                int release)
+{
+        int ret, i;
+        extent_chunk_t *ent;
+
+        ret = hash_table_remove(store->tab, (void *)key, (void **)&ent);
+        if (ret)
+                return;
+
+        for (i = 0; release && i < EXTENT_CHUNK_MAX; i++) {
+                if (ent->addr[i] != EXTENT_NULL)
+                        __extent_free_addr(store, ent->addr[i]);
+        }
+
+        store->count--;
+        yfree((void **)&ent);
+}
+
+/*
+ * the checkpoint is copied while allocation goes on, so it may already
+ * hold some of the records replayed over it. replay only sets the index,
+ * the bitmaps are rebuilt from it once the journal is applied
+ */
+static int __extent_replay(const void *buf, int len, int64_t off, void *arg)
+{
+        int ret;
+        const extent_rec_t *rec = buf;
+        extent_store_t *store = arg;
+        extent_chunk_t *ent;
+
+        (void) off;
+
+        if (len != sizeof(*rec)) {
+                ret = EIO;
+                GOTO(err_ret, ret);
+        }
+
+        if (rec->op == EXTENT_OP_ALLOC) {
+                if (rec->idx >= (uint32_t)EXTENT_CHUNK_MAX
+                    || rec->addr / EXTENT_PER_FILE >= (uint32_t)store->file_count) {
+                        ret = EIO;
+                        DERROR("bad extent "CHKID_FORMAT" idx %u addr %u\n",
+                               CHKID_ARG(&rec->key.chkid), rec->idx, rec->addr);
+                        GOTO(err_ret, ret);
+                }
+
+                ret = __extent_chunk_get(store, &rec->key, &ent);
+                if (ret)
+                        GOTO(err_ret, ret);
+
+                ent->addr[rec->idx] = rec->addr;
+        } else if (rec->op == EXTENT_OP_FREE) {
+                __extent_chunk_free(store, &rec->key, 0);
+        } else {
+                ret = EIO;
+                GOTO(err_ret, ret);
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static int __extent_log(extent_store_t *store, uint32_t op, const extent_key_t *key,
+                        uint32_t idx, uint32_t addr)
+{
+        extent_rec_t rec;
+
+        memset(&rec, 0x0, sizeof(rec));
+        rec.op = op;
+        rec.idx = idx;
+        rec.addr = addr;
+        rec.key = *key;
+
+        return jnl_append1(&store->jnl, (void *)&rec, sizeof(rec));
+}
+
+/*
+ * an extent is cleared before it is handed out, a freed one still holds
+ * the data of its last chunk
+ */
+static int __extent_clear(uint32_t addr)
+{
+        int ret;
+        uint64_t off, range[2];
+        extent_file_t *file;
+
+        file = &__extent__->file[addr / EXTENT_PER_FILE];
+        off = file->base + (uint64_t)(addr % EXTENT_PER_FILE) * EXTENT_SIZE;
+
+        if (__extent__->raw) {
+                range[0] = off;
+                range[1] = EXTENT_SIZE;
+                ret = ioctl(file->fd, BLKZEROOUT, range);
+        } else {
+                ret = fallocate(file->fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE,
+                                off, EXTENT_SIZE);
+        }
+
+        if (ret == 0)
+                return 0;
+
+        ret = errno;
+        if (ret != EOPNOTSUPP && ret != ENOTTY && ret != EINVAL)
+                GOTO(err_ret, ret);
+
+        ret = pwrite(file->fd, __extent_zero_buf__, EXTENT_SIZE, off);
+        if (ret != EXTENT_SIZE) {
+                ret = ret < 0 ? errno : EIO;
+                GOTO(err_ret, ret);
+        }
+
+        return 0;
+err_ret:
+        DWARN("extent %u clear fail, ret %u\n", addr, ret);
+        return ret;
+}
+
+static int __extent_alloc__(va_list ap)
+{
+        int ret;
+        const extent_key_t *key = va_arg(ap, const extent_key_t *);
+        uint32_t idx = va_arg(ap, uint32_t);
+        uint32_t *_addr = va_arg(ap, uint32_t *);
+        extent_store_t *store = __extent__;
+        extent_chunk_t *ent;
+        uint32_t addr;
+
+        va_end(ap);
+
+        ret = pthread_mutex_lock(&store->lock);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = __extent_chunk_get(store, key, &ent);
+        if (ret)
+                GOTO(err_lock, ret);
+
+        if (ent->addr[idx] != EXTENT_NULL) {
+                *_addr = ent->addr[idx];
+                pthread_mutex_unlock(&store->lock);
+                return 0;
+        }
+
+        ret = __extent_alloc_addr(store, &addr);
+        if (ret)
+                GOTO(err_lock, ret);
+
+        pthread_mutex_unlock(&store->lock);
+
+        /*
+         * allocations of a chunk run in one replica thread, so nobody
+         * else takes this slot while it is cleared unlocked
+         */
+        ret = __extent_clear(addr);
+
+        pthread_mutex_lock(&store->lock);
+
+        if (ret) {
+                __extent_free_addr(store, addr);
+                GOTO(err_lock, ret);
+        }
+
+        /* lookup again, the chunk may have been unlinked and recreated */
+        ret = __extent_chunk_get(store, key, &ent);
+        if (ret) {
+                __extent_free_addr(store, addr);
+                GOTO(err_lock, ret);
+        }
+
+        YASSERT(ent->addr[idx] == EXTENT_NULL);
+
+        /* the record is durable before any data lands in the extent */
+        ret = __extent_log(store, EXTENT_OP_ALLOC, key, idx, addr);
+        if (ret) {
+                __extent_free_addr(store, addr);
+                GOTO(err_lock, ret);
+        }
+
+        ent->addr[idx] = addr;
+        ent->count++;
+
+        pthread_mutex_unlock(&store->lock);
+
+        *_addr = addr;
+
+        return 0;
+err_lock:
+        pthread_mutex_unlock(&store->lock);
+err_ret:
+        return ret;
+}
+
+static int __extent_get(const chkid_t *chkid, uint64_t snapvers, uint32_t idx,
+                        int flag, uint32_t *addr)
+{
+        int ret;
+        extent_key_t key;
+        extent_chunk_t *ent;
+        extent_store_t *store = __extent__;
+
+        YASSERT(idx < (uint32_t)EXTENT_CHUNK_MAX);
+
+        key.chkid = *chkid;
+        key.snapvers = snapvers;
+
+        ret = pthread_mutex_lock(&store->lock);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ent = hash_table_find(store->tab, (void *)&key);
+        *addr = ent ? ent->addr[idx] : EXTENT_NULL;
+
+        pthread_mutex_unlock(&store->lock);
+
+        if (*addr != EXTENT_NULL) {
+                return 0;
+        }
+
+        /* ENODATA is a hole of an existing chunk */
+        if (!(flag & O_CREAT)) {
+                return ent ? ENODATA : ENOENT;
+        }
+
+        ret = schedule_newthread(SCHE_THREAD_REPLICA, __extent_key(&key), FALSE,
+                                 "extent_alloc", -1, __extent_alloc__,
+                                 &key, idx, addr);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static void __callback(void *_iocb, void *_retval)
+{
+        struct iocb *iocb = _iocb;
+        task_t *task = (void *)iocb->aio_data;
+        int *retval = _retval;
+
+        schedule_resume(task, *retval, NULL);
+}
+
+static int __extent_io(uint32_t addr, uint32_t eoff, const buffer_t *buf,
+                       uint32_t boff, uint32_t len, int write)
+{
+        int ret, i, iov_count, direct;
+        task_t task;
+        struct iocb iocb;
+        struct iovec iov[Y_MSG_MAX / BUFFER_SEG_SIZE + 1];
+        extent_file_t *file;
+        uint64_t off;
+
+        file = &__extent__->file[addr / EXTENT_PER_FILE];
+        off = file->base + (uint64_t)(addr % EXTENT_PER_FILE) * EXTENT_SIZE + eoff;
+
+        iov_count = Y_MSG_MAX / BUFFER_SEG_SIZE + 1;
+        mbuffer_trans2(iov, &iov_count, boff, len, buf);
+
+        direct = cdsconf.io_sync && off % SECTOR_SIZE == 0 && len % SECTOR_SIZE == 0;
+        for (i = 0; direct && i < iov_count; i++) {
+                if (iov[i].iov_len % SECTOR_SIZE
+                    || (uint64_t)iov[i].iov_base % SECTOR_SIZE)
+                        direct = 0;
+        }
+
+        if (write) {
+                io_prep_pwritev(&iocb, direct ? file->fd_direct : file->fd,
+                                iov, iov_count, off);
+        } else {
+                io_prep_preadv(&iocb, direct ? file->fd_direct : file->fd,
+                               iov, iov_count, off);
+        }
+
+        iocb.aio_reqprio = 0;
+        task = schedule_task_get();
+        iocb.aio_data = (__u64)&task;
+
+        if (direct) {
+                ret = aio_commit(&iocb, 0);
+        } else {
+                ret = diskio_submit(&iocb, __callback);
+                if (ret)
+                        GOTO(err_ret, ret);
+
+                ret = schedule_yield("aio_commit", NULL, NULL);
+        }
+        if (ret < 0) {
+                ret = -ret;
+                GOTO(err_ret, ret);
+        }
+
+        if (ret != (int)len) {
+                DWARN("extent %u off %ju ret %d len %u\n", addr, off, ret, len);
+                ret = EIO;
+                GOTO(err_ret, ret);
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static void __extent_zero(const buffer_t *buf, uint32_t boff, uint32_t len)
+{
+        int i, iov_count;
+        struct iovec iov[Y_MSG_MAX / BUFFER_SEG_SIZE + 1];
+
+        iov_count = Y_MSG_MAX / BUFFER_SEG_SIZE + 1;
+        mbuffer_trans2(iov, &iov_count, boff, len, buf);
+
+        for (i = 0; i < iov_count; i++) {
+                memset(iov[i].iov_base, 0x0, iov[i].iov_len);
+        }
+}
+
+int IO_FUNC extent_read(const io_t *io, buffer_t *buf)
+{
+        int ret;
+        uint32_t addr, idx, eoff, len, boff;
+        uint64_t off;
+
+        YASSERT(buf->len == 0);
+        mbuffer_init(buf, io->size);
+
+        off = io->offset;
+        boff = 0;
+        while (boff < io->size) {
+                idx = off / EXTENT_SIZE;
+                eoff = off % EXTENT_SIZE;
+                len = _min(io->size - boff, EXTENT_SIZE - eoff);
+
+                ret = __extent_get(&io->id, io->snapvers, idx, 0, &addr);
+                if (ret) {
+                        if (ret == ENODATA) {
+                                __extent_zero(buf, boff, len);
+                        } else
+                                GOTO(err_free, ret);
+                } else {
+                        ret = __extent_io(addr, eoff, buf, boff, len, 0);
+                        if (ret)
+                                GOTO(err_free, ret);
+                }
+
+                off += len;
+                boff += len;
+        }
+
+        return io->size;
+err_free:
+        mbuffer_free(buf);
+        return -ret;
+}
+
+int IO_FUNC extent_write(const io_t *io, const buffer_t *buf)
+{
+        int ret;
+        uint32_t addr, idx, eoff, len, boff;
+        uint64_t off;
+        buffer_t tmp;
+
+        mbuffer_init(&tmp, 0);
+        mbuffer_clone1(&tmp, buf);
+
+        off = io->offset;
+        boff = 0;
+        while (boff < io->size) {
+                idx = off / EXTENT_SIZE;
+                eoff = off % EXTENT_SIZE;
+                len = _min(io->size - boff, EXTENT_SIZE - eoff);
+
+                ret = __extent_get(&io->id, io->snapvers, idx, O_CREAT, &addr);
+                if (ret)
+                        GOTO(err_free, ret);
+
+                ret = __extent_io(addr, eoff, &tmp, boff, len, 1);
+                if (ret)
+                        GOTO(err_free, ret);
+
+                off += len;
+                boff += len;
+        }
+
+        mbuffer_free(&tmp);
+
+        return io->size;
+err_free:
+        mbuffer_free(&tmp);
+        return -ret;
+}
+
+int extent_unlink(const chkid_t *chkid, uint64_t snapvers)
+{
+        int ret;
+        extent_key_t key;
+        extent_store_t *store = __extent__;
+
+        key.chkid = *chkid;
+        key.snapvers = snapvers;
+
+        ret = pthread_mutex_lock(&store->lock);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        if (hash_table_find(store->tab, (void *)&key) == NULL) {
+                ret = ENOENT;
+                goto err_lock;
+        }
+
+        ret = __extent_log(store, EXTENT_OP_FREE, &key, 0, EXTENT_NULL);
+        if (ret)
+                GOTO(err_lock, ret);
+
+        __extent_chunk_free(store, &key, 1);
+
+        pthread_mutex_unlock(&store->lock);
+
+        return 0;
+err_lock:
+        pthread_mutex_unlock(&store->lock);
+err_ret:
+        return ret;
+}
+
+static int __extent_load_raw(extent_store_t *store, const char *dev)
+{
+        int ret, fd, i;
+        uint64_t size;
+
+        fd = open(dev, O_RDONLY);
+        if (fd < 0) {
+                ret = errno;
+                GOTO(err_ret, ret);
+        }
+
+        ret = ioctl(fd, BLKGETSIZE64, &size);
+        if (ret < 0) {
+                ret = errno;
+                GOTO(err_fd, ret);
+        }
+
+        close(fd);
+
+        store->raw = 1;
+        store->file_count = _min(size / EXTENT_FILE_SIZE, EXTENT_FILE_MAX);
+        if (store->file_count == 0) {
+                ret = ENOSPC;
+                GOTO(err_ret, ret);
+        }
+
+        ret = __extent_open(&store->file[0], dev, 0);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        for (i = 1; i < store->file_count; i++) {
+                store->file[i] = store->file[0];
+                store->file[i].base = (uint64_t)i * EXTENT_FILE_SIZE;
+        }
+
+        DINFO("extent device %s, size %ju, count %u\n", dev, size, store->file_count);
+
+        return 0;
+err_fd:
+        close(fd);
+err_ret:
+        return ret;
+}
+
+static int __extent_load_file(extent_store_t *store)
+{
+        int ret;
+        char path[MAX_PATH_LEN];
+
+        while (store->file_count < EXTENT_FILE_MAX) {
+                snprintf(path, MAX_PATH_LEN, "%s/%u", store->home, store->file_count);
+
+                ret = __extent_open(&store->file[store->file_count], path, 0);
+                if (ret) {
+                        if (ret == ENOENT)
+                                break;
+                        else
+                                GOTO(err_ret, ret);
+                }
+
+                store->file_count++;
+        }
+
+        DINFO("extent home %s, count %u\n", store->home, store->file_count);
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+/*
+ * checkpoint of the chunk -> extent index, so startup maps it and replays
+ * only the journal written after it instead of the whole journal.
+ */
+typedef struct {
+        uint32_t magic;
+        uint32_t crc;
+        uint32_t count;
+        uint32_t __pad__;
+        int64_t lsn;
+} extent_ckpt_t;
+
+typedef struct {
+        extent_chunk_t *array;
+        uint32_t count;
+        uint32_t max;
+} extent_snap_t;
+
+static uint32_t __extent_ckpt_crc(const extent_ckpt_t *ckpt,
+                                  const extent_chunk_t *array)
+{
+        uint32_t crc;
+        extent_ckpt_t head;
+
+        head = *ckpt;
+        head.crc = 0;
+
+        crc32_init(crc);
+        crc32_stream(&crc, (void *)&head, sizeof(head));
+        crc32_stream(&crc, (void *)array, sizeof(*array) * ckpt->count);
+
+        return crc32_stream_finish(crc);
+}
+
+/*
+ * copy the buckets [begin, end) of the index, the lock is only held for
+ * one batch so allocation is not stalled by a large index. EAGAIN if the
+ * table was resized since the copy started
+ */
+static int __extent_snap(extent_store_t *store, extent_snap_t *snap,
+                         uint32_t size, uint32_t begin, uint32_t end)
+{
+        int ret;
+        uint32_t i, count, max;
+        hashtable_entry_t hent;
+
+        while (1) {
+                ret = pthread_mutex_lock(&store->lock);
+                if (ret)
+                        GOTO(err_ret, ret);
+
+                if (store->tab->size != size) {
+                        pthread_mutex_unlock(&store->lock);
+                        return EAGAIN;
+                }
+
+                count = 0;
+                for (i = begin; i < end; i++) {
+                        for (hent = store->tab->entries[i]; hent; hent = hent->next)
+                                count++;
+                }
+
+                if (snap->count + count <= snap->max)
+                        break;
+
+                pthread_mutex_unlock(&store->lock);
+
+                max = _max(snap->max * 2, snap->count + count);
+                ret = yrealloc((void **)&snap->array, sizeof(*snap->array) * snap->max,
+                               sizeof(*snap->array) * max);
+                if (ret)
+                        GOTO(err_ret, ret);
+
+                snap->max = max;
+        }
+
+        for (i = begin; i < end; i++) {
+                for (hent = store->tab->entries[i]; hent; hent = hent->next) {
+                        snap->array[snap->count] = *(extent_chunk_t *)hent->value;
+                        snap->count++;
+                }
+        }
+
+        pthread_mutex_unlock(&store->lock);
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static int __extent_ckpt_write(const char *path, const extent_ckpt_t *ckpt,
+                               const extent_chunk_t *array)
+{
+        int ret, fd;
+        char tmp[MAX_PATH_LEN];
+
+        snprintf(tmp, MAX_PATH_LEN, "%s.tmp", path);
+
+        fd = open(tmp, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+        if (fd < 0) {
+                ret = errno;
+                GOTO(err_ret, ret);
+        }
+
+        ret = _write(fd, ckpt, sizeof(*ckpt));
+        if (ret < 0) {
+                ret = -ret;
+                GOTO(err_fd, ret);
+        }
+
+        if (ckpt->count) {
+                ret = _write(fd, array, sizeof(*array) * ckpt->count);
+                if (ret < 0) {
+                        ret = -ret;
+                        GOTO(err_fd, ret);
+                }
+        }
+
+        ret = fsync(fd);
+        if (ret < 0) {
+                ret = errno;
+                GOTO(err_fd, ret);
+        }
+
+        close(fd);
+
+        ret = rename(tmp, path);
+        if (ret < 0) {
+                ret = errno;
+                GOTO(err_ret, ret);
+        }
+
+        return 0;
+err_fd:
+        close(fd);
+        unlink(tmp);
+err_ret:
+        return ret;
+}
+
+/*
+ * the previous checkpoint is kept as a fallback, so journal files are
+ * only dropped once they are older than both
+ */
+static void __extent_ckpt_trim(extent_store_t *store, int64_t lsn)
+{
+        int no;
+        char path[MAX_PATH_LEN];
+
+        for (no = lsn / MAX_JNL_LEN - 1; no >= 0; no--) {
+                snprintf(path, MAX_PATH_LEN, "%s/jnl/%d", store->home, no);
+                if (unlink(path) < 0)
+                        break;
+
+                DINFO("extent journal %s dropped\n", path);
+        }
+}
+
+static int __extent_checkpoint(void *arg)
+{
+        int ret;
+        char path[MAX_PATH_LEN], old[MAX_PATH_LEN];
+        extent_store_t *store = arg;
+        extent_ckpt_t ckpt, prev;
+        extent_snap_t snap;
+        uint32_t i, size;
+        int fd;
+
+        ANALYSIS_BEGIN(0);
+
+        snap.array = NULL;
+        snap.max = 0;
+retry:
+        ret = pthread_mutex_lock(&store->lock);
+        if (ret)
+                GOTO(err_free, ret);
+
+        if (store->jnl.offset == store->ckpt_lsn) {
+                pthread_mutex_unlock(&store->lock);
+                goto out;
+        }
+
+        /* records after lsn are replayed over the copy */
+        ckpt.lsn = store->jnl.offset;
+        size = store->tab->size;
+
+        pthread_mutex_unlock(&store->lock);
+
+        snap.count = 0;
+        for (i = 0; i < size; i += EXTENT_CKPT_BATCH) {
+                ret = __extent_snap(store, &snap, size, i,
+                                    _min(i + EXTENT_CKPT_BATCH, size));
+                if (ret) {
+                        if (ret == EAGAIN)
+                                goto retry;
+                        else
+                                GOTO(err_free, ret);
+                }
+        }
+
+        ckpt.magic = EXTENT_CKPT_MAGIC;
+        ckpt.count = snap.count;
+        ckpt.__pad__ = 0;
+        ckpt.crc = __extent_ckpt_crc(&ckpt, snap.array);
+
+        snprintf(path, MAX_PATH_LEN, "%s/checkpoint", store->home);
+        snprintf(old, MAX_PATH_LEN, "%s/checkpoint.old", store->home);
+
+        prev.lsn = 0;
+        fd = open(path, O_RDONLY);
+        if (fd >= 0) {
+                if (_read(fd, &prev, sizeof(prev)) != sizeof(prev))
+                        prev.lsn = 0;
+
+                close(fd);
+                rename(path, old);
+        }
+
+        ret = __extent_ckpt_write(path, &ckpt, snap.array);
+        if (ret)
+                GOTO(err_free, ret);
+
+        store->ckpt_lsn = ckpt.lsn;
+        __extent_ckpt_trim(store, _min(prev.lsn, ckpt.lsn));
+
+        DINFO("extent checkpoint chunk %u lsn %ju\n", ckpt.count, ckpt.lsn);
+
+        ANALYSIS_END(0, 1000 * 1000, NULL);
+out:
+        if (snap.array)
+                yfree((void **)&snap.array);
+
+        return 0;
+err_free:
+        if (snap.array)
+                yfree((void **)&snap.array);
+        return ret;
+}
+
+static int __extent_ckpt_apply(extent_store_t *store, const extent_chunk_t *array,
+                               uint32_t count)
+{
+        int ret, i;
+        uint32_t n;
+        const extent_chunk_t *rec;
+        extent_chunk_t *ent;
+
+        for (n = 0; n < count; n++) {
+                rec = &array[n];
+
+                ret = __extent_chunk_get(store, &rec->key, &ent);
+                if (ret)
+                        GOTO(err_ret, ret);
+
+                for (i = 0; i < EXTENT_CHUNK_MAX; i++) {
+                        if (rec->addr[i] == EXTENT_NULL)
+                                continue;
+
+                        if (rec->addr[i] / EXTENT_PER_FILE >= (uint32_t)store->file_count) {
+                                ret = EINVAL;
+                                DERROR("bad extent "CHKID_FORMAT" idx %u addr %u\n",
+                                       CHKID_ARG(&rec->key.chkid), i, rec->addr[i]);
+                                GOTO(err_ret, ret);
+                        }
+
+                        ent->addr[i] = rec->addr[i];
+                }
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static int __extent_ckpt_load(extent_store_t *store, const char *path, int64_t *lsn)
+{
+        int ret, fd;
+        struct stat stbuf;
+        void *addr;
+        const extent_ckpt_t *ckpt;
+        const extent_chunk_t *array;
+
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+                ret = errno;
+                goto err_ret;
+        }
+
+        ret = fstat(fd, &stbuf);
+        if (ret < 0) {
+                ret = errno;
+                GOTO(err_fd, ret);
+        }
+
+        if (stbuf.st_size < (off_t)sizeof(*ckpt)) {
+                ret = EIO;
+                GOTO(err_fd, ret);
+        }
+
+        addr = mmap(NULL, stbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+                ret = errno;
+                GOTO(err_fd, ret);
+        }
+
+        ckpt = addr;
+        array = addr + sizeof(*ckpt);
+
+        if (ckpt->magic != EXTENT_CKPT_MAGIC
+            || (uint64_t)stbuf.st_size != sizeof(*ckpt) + sizeof(*array) * ckpt->count
+            || ckpt->crc != __extent_ckpt_crc(ckpt, array)) {
+                ret = EIO;
+                DWARN("checkpoint %s corrupted\n", path);
+                GOTO(err_unmap, ret);
+        }
+
+        ret = __extent_ckpt_apply(store, array, ckpt->count);
+        if (ret)
+                GOTO(err_unmap, ret);
+
+        *lsn = ckpt->lsn;
+
+        DINFO("checkpoint %s chunk %u lsn %ju\n", path, ckpt->count, ckpt->lsn);
+
+        munmap(addr, stbuf.st_size);
+        close(fd);
+
+        return 0;
+err_unmap:
+        munmap(addr, stbuf.st_size);
+err_fd:
+        close(fd);
+err_ret:
+        return ret;
+}
+
+static int __extent_ckpt_init(extent_store_t *store, int64_t *lsn)
+{
+        int ret;
+        char path[MAX_PATH_LEN];
+
+        snprintf(path, MAX_PATH_LEN, "%s/checkpoint", store->home);
+        ret = __extent_ckpt_load(store, path, lsn);
+        if (ret == 0)
+                return 0;
+        else if (ret != ENOENT && ret != EIO)
+                GOTO(err_ret, ret);
+
+        snprintf(path, MAX_PATH_LEN, "%s/checkpoint.old", store->home);
+        ret = __extent_ckpt_load(store, path, lsn);
+        if (ret == 0)
+                return 0;
+        else if (ret != ENOENT)
+                GOTO(err_ret, ret);
+
+        *lsn = 0;
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static int __extent_rebuild(extent_store_t *store)
+{
+        int ret, i;
+        uint32_t n, addr, slot;
+        hashtable_entry_t hent;
+        extent_chunk_t *ent;
+        extent_file_t *file;
+
+        for (n = 0; n < store->tab->size; n++) {
+                for (hent = store->tab->entries[n]; hent; hent = hent->next) {
+                        ent = hent->value;
+                        ent->count = 0;
+
+                        for (i = 0; i < EXTENT_CHUNK_MAX; i++) {
+                                addr = ent->addr[i];
+                                if (addr == EXTENT_NULL)
+                                        continue;
+
+                                file = &store->file[addr / EXTENT_PER_FILE];
+                                slot = addr % EXTENT_PER_FILE;
+                                if (file->bitmap[slot / CHAR_BIT] & (1 << (slot % CHAR_BIT))) {
+                                        ret = EIO;
+                                        DERROR("extent %u of "CHKID_FORMAT" used twice\n",
+                                               addr, CHKID_ARG(&ent->key.chkid));
+                                        GOTO(err_ret, ret);
+                                }
+
+                                __extent_bit_set(file, slot, 1);
+                                ent->count++;
+                        }
+                }
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+/*
+ * the store lives in disk/0 only and holds chunks outside the per chunk
+ * files, which the tier mover and volume compression work on, so a node
+ * with more disk levels or tier_move set does not start with it
+ */
+static int __extent_check()
+{
+        int ret;
+        char path[MAX_PATH_LEN];
+        struct stat stbuf;
+
+        snprintf(path, MAX_PATH_LEN, "%s/disk/1", ng.home);
+        ret = stat(path, &stbuf);
+        if (ret == 0) {
+                ret = EINVAL;
+                DERROR("extent_store needs a single disk level, %s exists\n", path);
+                GOTO(err_ret, ret);
+        }
+
+        if (cdsconf.tier_move) {
+                ret = EINVAL;
+                DERROR("extent_store and tier_move can not be both set\n");
+                GOTO(err_ret, ret);
+        }
+
+        DINFO("extent store keeps chunks uncompressed whatever the volume sets\n");
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+int extent_init()
+{
+        int ret;
+        int64_t lsn;
+        char path[MAX_PATH_LEN];
+        extent_store_t *store;
+
+        YASSERT(__extent__ == NULL);
+
+        ret = __extent_check();
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = ymalloc((void **)&store, sizeof(*store));
+        if (ret)
+                GOTO(err_ret, ret);
+
+        memset(store, 0x0, sizeof(*store));
+
+        ret = pthread_mutex_init(&store->lock, NULL);
+        if (ret)
+                GOTO(err_free, ret);
+
+        store->tab = hash_create_table(__extent_cmp, __extent_key, "extent");
+        if (store->tab == NULL) {
+                ret = ENOMEM;
+                GOTO(err_free, ret);
+        }
+
+        snprintf(store->home, MAX_PATH_LEN, "%s/disk/0/extent", ng.home);
+        ret = path_validate(store->home, YLIB_ISDIR, YLIB_DIRCREATE);
+        if (ret)
+                GOTO(err_free, ret);
+
+        if (strlen(cdsconf.extent_device)) {
+                ret = __extent_load_raw(store, cdsconf.extent_device);
+        } else {
+                ret = __extent_load_file(store);
+        }
+        if (ret)
+                GOTO(err_free, ret);
+
+        snprintf(path, MAX_PATH_LEN, "%s/jnl", store->home);
+        ret = jnl_open(path, &store->jnl, O_SYNC);
+        if (ret)
+                GOTO(err_free, ret);
+
+        ret = __extent_ckpt_init(store, &lsn);
+        if (ret)
+                GOTO(err_free, ret);
+
+        ret = jnl_iterator(&store->jnl, lsn, __extent_replay, store);
+        if (ret)
+                GOTO(err_free, ret);
+
+        ret = __extent_rebuild(store);
+        if (ret)
+                GOTO(err_free, ret);
+
+        store->ckpt_lsn = lsn;
+
+        DINFO("extent store loaded, chunk %u, replay %ju -> %ju\n",
+              store->count, lsn, store->jnl.offset);
+
+        __extent__ = store;
+
+        ret = bh_register("extent_checkpoint", __extent_checkpoint, store,
+                          cdsconf.extent_checkpoint);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        return 0;
+err_free:
+        yfree((void **)&store);
+err_ret:
+        return ret;
+}
@@ -0,0 +1,27 @@
+#ifndef __EXTENT_H__
+#define __EXTENT_H__
+
+#include "sdfs_lib.h"
+#include "ylib.h"
+#include "chk_proto.h"
+
+/*
+ * chunks packed as 1M extents inside large preallocated container files,
+ * or carved out of a raw block device, instead of one file per chunk.
+ * only for a node with a single disk level and tier_move off, chunks are
+ * never compressed.
+ */
+
+#define EXTENT_SIZE (1024 * 1024)
+#define EXTENT_PER_FILE 4096
+#define EXTENT_FILE_SIZE ((uint64_t)EXTENT_SIZE * EXTENT_PER_FILE)
+#define EXTENT_FILE_MAX 16384
+#define EXTENT_CHUNK_MAX ((int)(YFS_CHK_LEN_MAX / EXTENT_SIZE))
+#define EXTENT_NULL ((uint32_t)-1)
+
+int extent_init();
+int IO_FUNC extent_read(const io_t *io, buffer_t *buf);
+int IO_FUNC extent_write(const io_t *io, const buffer_t *buf);
+int extent_unlink(const chkid_t *chkid, uint64_t snapvers);
+
+#endif
@@ -12,6 +12,9 @@
 #include "nodeid.h"
 #include "md_lib.h"
 #include "diskio.h"
+#include "extent.h"
+#include "compress.h"
+#include "../yfs/cds/tier.h"
 #include "io_analysis.h"
 #include "aio.h"
 #include "core.h"
@@ -224,11 +227,18 @@ err_ret:
 
 int IO_FUNC __replica_write__(const io_t *io, const buffer_t *buf)
 {
-        int ret;
+        int ret, mode;
 
         ret = io_analysis(ANALYSIS_IO_WRITE, io->size);
         if (ret)
                 GOTO(err_ret, ret);
+
+        tier_heat(&io->id, io->snapvers);
+
+        /* refused while a tier move copies the chunk, the writer reloads it */
+        ret = tier_write_begin(&io->id);
+        if (ret)
+                goto err_ret;
         
         CORE_ANALYSIS_BEGIN(1);
         
@@ -236,26 +246,53 @@ int IO_FUNC __replica_write__(const io_t *io, const buffer_t *buf)
 
         DBUG("write "CHKID_FORMAT"\n", CHKID_ARG(&io->id));
 
+        if (cdsconf.extent_store) {
+                ret = extent_write(io, buf);
+                if (ret < 0) {
+                        ret = -ret;
+                        GOTO(err_tier, ret);
+                }
+
+                goto out;
+        }
+
+        /* the mode only picks the layout of a new chunk */
+        mode = compress_mode(io->id.volid);
+        ret = compress_write(io, buf, mode);
+        if (ret != -ENOSYS) {
+                if (ret < 0) {
+                        ret = -ret;
+                        GOTO(err_tier, ret);
+                }
+
+                goto out;
+        }
+
         if (cdsconf.io_sync && io->offset % SECTOR_SIZE == 0 &&
             io->size % SECTOR_SIZE == 0) {
                 ret = __replica_write_direct(io, buf);
                 if (ret < 0) {
                         ret = -ret;
-                        GOTO(err_ret, ret);
+                        GOTO(err_tier, ret);
                 }
         } else {
                 ret = __replica_write_sync(io, buf, cdsconf.io_sync ? O_SYNC : 0);
                 if (ret < 0) {
                         ret = -ret;
-                        GOTO(err_ret, ret);
+                        GOTO(err_tier, ret);
                 }
         }
 
+out:
+        tier_write_end(&io->id);
+
         DBUG("write "CHKID_FORMAT" finish\n", CHKID_ARG(&io->id));
         
         CORE_ANALYSIS_UPDATE(1, IO_WARN, "write");       
         
         return 0;
+err_tier:
+        tier_write_end(&io->id);
 err_ret:
         return ret;
 }
@@ -372,6 +409,8 @@ int IO_FUNC __replica_read__(const io_t *io, buffer_t *buf)
         ret = io_analysis(ANALYSIS_IO_READ, io->size);
         if (ret)
                 GOTO(err_ret, ret);
+
+        tier_heat(&io->id, io->snapvers);
         
         CORE_ANALYSIS_BEGIN(1);
         
@@ -380,11 +419,18 @@ int IO_FUNC __replica_read__(const io_t *io, buffer_t *buf)
         DBUG("read "CHKID_FORMAT" offset %ju size %u\n",
               CHKID_ARG(&io->id), io->offset, io->size);
 
-        if (cdsconf.io_sync && io->offset % SECTOR_SIZE == 0 &&
-            io->size % SECTOR_SIZE == 0) {
-                ret = __replica_read_direct(io, buf);
+        if (cdsconf.extent_store) {
+                ret = extent_read(io, buf);
         } else {
-                ret = __replica_read_sync(io, buf, 0);
+                ret = compress_read(io, buf);
+                if (ret == -ENOSYS) {
+                        if (cdsconf.io_sync && io->offset % SECTOR_SIZE == 0 &&
+                            io->size % SECTOR_SIZE == 0) {
+                                ret = __replica_read_direct(io, buf);
+                        } else {
+                                ret = __replica_read_sync(io, buf, 0);
+                        }
+                }
         }
         if (ret < 0) {
                 ret = -ret;
@@ -473,5 +519,19 @@ struct sche_thread_ops replica_ops = {
 
 int replica_init()
 {
-        return sche_thread_ops_register(&replica_ops, replica_ops.type, 32);
+        int ret;
+
+        ret = sche_thread_ops_register(&replica_ops, replica_ops.type, 32);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        if (cdsconf.extent_store) {
+                ret = extent_init();
+                if (ret)
+                        GOTO(err_ret, ret);
+        }
+
+        return 0;
+err_ret:
+        return ret;
 }
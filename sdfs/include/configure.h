@@ -35,6 +35,9 @@
 #define PAGE_SIZE_32K (1024*32)
 #define DEFAULT_STACK_SIZE (BUF_SIZE_512K)
 #define KEEP_STACK_SIZE (1024)
+#define STACK_GUARD_SIZE (PAGE_SIZE_4K)
+#define TASK_MAX_DEF (8192)
+#define TASK_MAX_LIMIT (INT16_MAX + 1)         /* task_t.taskid is int16_t */
 #define MAX_MSG_SIZE (512)
 #define UUID_LEN        (64)
 
@@ -84,6 +87,10 @@ struct nfsconf_t
         int nlm_port;
         int rsize;
         int wsize;
+        int readdir_cache;
+        int readdir_timeout;
+        int access_cache;
+        int access_timeout;
         struct nfsconf_export_t nfs_export[1024];
 };
 
@@ -113,7 +120,6 @@ struct mdsconf_t
         int redis_baseport;
         int redis_sharding;
         int redis_replica;
-        int redis_thread;
         int size_on_md;
         int ac_timeout;
 };
@@ -128,6 +134,13 @@ struct cdsconf_t
         int io_sync;
         int cds_polling;
         int aio_thread;
+        int extent_store;
+        int extent_checkpoint;
+        char extent_device[MAXSIZE];
+        int tier_move;
+        int tier_hot;
+        int tier_cold;
+        int tier_rate;
 };
 
 struct logconf_t
@@ -167,6 +180,9 @@ struct gloconf_t
         int testing;
         int rpc_timeout;
         int lease_timeout;
+        int write_lease;
+        int inline_size;
+        int corenet_stripe;
         int hb_timeout;
         int hb_retry;
         char nfs_srv[MAXSIZE];
@@ -199,6 +215,10 @@ struct gloconf_t
         int valgrind;
         int polling_core;
         int polling_timeout;
+        int task_max;
+        int qos_client_iops;
+        int qos_client_bw;
+        int qos_burst;
         int aio_core;
 
         int sdevents_threads;
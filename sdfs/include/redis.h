@@ -37,6 +37,8 @@ extern int kget(const volid_t *volid, const fileid_t *fid, void *buf, size_t *si
 
 extern int klock(const volid_t *volid, const fileid_t *fileid, int ttl, int block);
 extern int kunlock(const volid_t *volid, const fileid_t *fileid);
+extern int klease(const volid_t *volid, const fileid_t *fileid, int op,
+                  const char *owner, int ttl);
 extern int hiter(const volid_t *volid, const fileid_t *fid, const char *match, func2_t func, void *ctx);
 extern int rm_push(const nid_t *nid, int _hash, const chkid_t *chkid);
 extern int rm_pop(const nid_t *nid, int _hash, chkid_t *array, int *count);
@@ -48,6 +50,12 @@ extern int hset(const volid_t *volid, const fileid_t *fid, const char *name, con
 extern int hget(const volid_t *volid, const fileid_t *fid, const char *name, char *buf, size_t *len);
 extern int hdel(const volid_t *volid, const fileid_t *fid, const char *name);
 extern int hlen(const volid_t *volid, const fileid_t *fid, uint64_t *count);
+extern int hget_count(const volid_t *volid, const fileid_t *fid, const char *name,
+                      char *buf, size_t *len, const char *counter, int64_t *count);
+extern int hset_count(const volid_t *volid, const fileid_t *fid, const char *counter,
+                      const char *name, const void *buf, uint32_t size, int flag, uint64_t max);
+extern int hdel_count(const volid_t *volid, const fileid_t *fid, const char *counter,
+                      const char *name);
 extern redisReply *hscan(const volid_t *volid, const fileid_t *fid, const char *match, uint64_t cursor, uint64_t count);
 extern redisReply *scan(int redis_id, uint32_t cursor);
 
@@ -119,6 +119,7 @@ extern int ly_write(const char *path, const char *buf, size_t size, yfs_off_t of
 extern int ly_release(int fd);
 
 extern int ly_truncate(const char *path, off_t length);
+extern int ly_close(const char *path);
 extern int ly_symlink(const char *link_target, const char *link_name);
 extern int ly_readlink(const char *link, char *buf, size_t *buflen);
 
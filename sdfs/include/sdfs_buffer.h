@@ -41,6 +41,7 @@ typedef struct {
         mem_handler_t handler;
         char is_attach;
         char use_memcache;
+        char is_inline;         /* data follows the seg in its mem_cache slot */
         void *base_ptr;
 } seg_t;
 
@@ -135,5 +136,8 @@ int mbuffer_dump(const buffer_t *buf, uint32_t len, const char *s);
 int mbuffer_part_clone(const buffer_t *buf, uint32_t offset, int size, buffer_t *dist);
 
 int mbuffer_droptail(buffer_t *buf, uint32_t len);
+void mbuffer_pool_drain();
+int mbuffer_pool_count();
+uint64_t mbuffer_copied();
 
 #endif
@@ -108,6 +108,12 @@
 #define USS_SYSTEM_ATTR_SYMLINK "uss_symtem_symlink"
 #define USS_SYSTEM_ATTR_ENGINE "uss_system_engine"
 #define USS_SYSTEM_ATTR_TIER "uss_system_tier"
+#define USS_SYSTEM_ATTR_REPLICATION "uss_system_replication"
+#define USS_SYSTEM_ATTR_COMPRESS "uss_system_compress"
+#define USS_SYSTEM_ATTR_QOS "uss_system_qos"
+
+#define MD_INLINE_MAX (64 * 1024)
+#define CORENET_STRIPE_MAX 8
 
 typedef enum {
         TIER_SSD = 0,
@@ -115,6 +121,7 @@ typedef enum {
         TIER_ALL,
 } tier_type_t;
 #define TIER_NULL (-1)
+#define TIER_STRICT 0x100     /* no fallback to the other tier */
 
 typedef uint64_t yfs_off_t;
 typedef uint64_t yfs_size_t;
@@ -246,7 +253,6 @@ typedef struct {
 
 #define ENABLE_REDIS_PIPELINE 0
 
-#define ENABLE_LOCK_FREE_LIST 0
 
 #define ENABLE_ATTR_QUEUE 1
 
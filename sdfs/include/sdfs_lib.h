@@ -17,6 +17,8 @@
 #include "sdfs_share.h"
 #include "sdfs_worm.h"
 
+struct md_proto;
+
 typedef struct {
         fileid_t fileid;
         uint16_t d_type;
@@ -195,24 +197,31 @@ int sdfs_rmdir(sdfs_ctx_t *ctx, const fileid_t *parent, const char *name);
 
 //file
 int sdfs_read(sdfs_ctx_t *ctx, const fileid_t *fileid, buffer_t *_buf, uint32_t size, uint64_t offset);//coroutine
+int sdfs_read_md(sdfs_ctx_t *ctx, const struct md_proto *md, buffer_t *_buf,
+                 uint32_t size, uint64_t offset);//coroutine, md from sdfs_getmd
 int sdfs_read_async(sdfs_ctx_t *ctx, const fileid_t *fileid, buffer_t *buf, uint32_t size,
                     uint64_t off, int (*callback)(void *, int), void *obj); // async io
 int sdfs_read_sync(sdfs_ctx_t *ctx, const fileid_t *fileid, buffer_t *buf, uint32_t size, uint64_t off); //sync io
 
 int sdfs_write(sdfs_ctx_t *ctx, const fileid_t *fileid, const buffer_t *_buf, uint32_t size, uint64_t offset);//coroutine
+int sdfs_write_md(sdfs_ctx_t *ctx, struct md_proto *md, const buffer_t *_buf,
+                  uint32_t size, uint64_t offset);//coroutine, md updated to post-op attr
 int sdfs_write_async(sdfs_ctx_t *ctx, const fileid_t *fileid, const buffer_t *buf, uint32_t size,
                      uint64_t off, int (*callback)(void *, int), void *obj);//async io
 int sdfs_write_sync(sdfs_ctx_t *ctx, const fileid_t *fileid, const buffer_t *buf, uint32_t size,
                     uint64_t off);// sync io
 int sdfs_truncate(sdfs_ctx_t *ctx, const fileid_t *fileid, uint64_t length);
+int sdfs_release(sdfs_ctx_t *ctx, const fileid_t *fileid);
 int sdfs_link2node(sdfs_ctx_t *ctx, const fileid_t *old, const fileid_t *, const char *);
 int sdfs_unlink(sdfs_ctx_t *ctx, const fileid_t *parent, const char *name);
 int sdfs_setlock(sdfs_ctx_t *ctx, const fileid_t *fileid, const sdfs_lock_t *lock);
 int sdfs_getlock(sdfs_ctx_t *ctx, const fileid_t *fileid, sdfs_lock_t *lock);
+int sdfs_lock_wait(sdfs_ctx_t *ctx, const fileid_t *fileid, suseconds_t usec);
 
 
 //node
 int sdfs_getattr(sdfs_ctx_t *ctx, const fileid_t *fileid, struct stat *stbuf);
+int sdfs_getmd(sdfs_ctx_t *ctx, const fileid_t *fileid, struct md_proto *md);
 int sdfs_setattr(sdfs_ctx_t *ctx, const fileid_t *fileid, const setattr_t *setattr, int force);
 int sdfs_chmod(sdfs_ctx_t *ctx, const fileid_t *fileid, mode_t mode);
 int sdfs_chown(sdfs_ctx_t *ctx, const fileid_t *fileid, uid_t uid, gid_t gid);
@@ -0,0 +1,204 @@
+#include <sys/time.h>
+
+#include "ylib.h"
+#include "sdfs_buffer.h"
+#include "mem_cache.h"
+#include "sysutil.h"
+#include "dbg.h"
+
+#define HEAD_SIZE 40
+
+typedef struct {
+        const char *name;
+        void (*fn)(int count);
+} bench_t;
+
+static void __bench_appendmem(int count)
+{
+        int i;
+        buffer_t buf;
+        char head[HEAD_SIZE];
+
+        memset(head, 0x1, sizeof(head));
+        mbuffer_init(&buf, 0);
+        for (i = 0; i < count; i++) {
+                mbuffer_appendmem(&buf, head, sizeof(head));
+                mbuffer_free(&buf);
+        }
+}
+
+static void __bench_popmsg(int count)
+{
+        int i;
+        buffer_t buf;
+        char head[HEAD_SIZE];
+
+        memset(head, 0x1, sizeof(head));
+        mbuffer_init(&buf, 0);
+        for (i = 0; i < count; i++) {
+                mbuffer_appendmem(&buf, head, sizeof(head));
+                mbuffer_appendzero(&buf, BUFFER_SEG_SIZE);
+                mbuffer_popmsg(&buf, head, sizeof(head));
+                mbuffer_free(&buf);
+        }
+}
+
+static void __bench_pop(int count)
+{
+        int i;
+        buffer_t buf, newbuf;
+
+        mbuffer_init(&buf, BUFFER_SEG_SIZE * 4);
+        mbuffer_init(&newbuf, 0);
+        for (i = 0; i < count; i++) {
+                /* one whole seg spliced and one boundary split */
+                mbuffer_pop(&buf, &newbuf, BUFFER_SEG_SIZE + HEAD_SIZE);
+                mbuffer_merge(&buf, &newbuf);
+        }
+
+        mbuffer_free(&buf);
+}
+
+static void __bench_split(int count)
+{
+        int i;
+        uint64_t copied;
+        buffer_t buf, newbuf;
+
+        copied = mbuffer_copied();
+        mbuffer_init(&buf, 0);
+        mbuffer_init(&newbuf, 0);
+        for (i = 0; i < count; i++) {
+                /* a payload behind the rpc head of a receive seg */
+                mbuffer_appendzero(&buf, BUFFER_SEG_SIZE);
+                mbuffer_pop(&buf, NULL, HEAD_SIZE);
+                mbuffer_pop(&buf, &newbuf, BUFFER_SEG_SIZE / 2);
+                YASSERT(newbuf.len == BUFFER_SEG_SIZE / 2);
+                mbuffer_free(&newbuf);
+                mbuffer_free(&buf);
+        }
+
+        YASSERT(mbuffer_copied() == copied);
+}
+
+static void __bench_reference(int count)
+{
+        int i;
+        buffer_t buf, ref;
+        char head[HEAD_SIZE];
+
+        memset(head, 0x1, sizeof(head));
+        mbuffer_init(&buf, BUFFER_SEG_SIZE);
+        mbuffer_appendmem_head(&buf, head, sizeof(head));
+        mbuffer_init(&ref, 0);
+        for (i = 0; i < count; i++) {
+                mbuffer_reference(&ref, &buf);
+                mbuffer_free(&ref);
+        }
+
+        mbuffer_free(&buf);
+}
+
+#define POOL_TEST 16
+
+/* freed segs go back to the pool of this thread, drain empties it */
+static void __test_pool()
+{
+        int i;
+        buffer_t array[POOL_TEST * 64];
+        char head[HEAD_SIZE];
+
+        memset(head, 0x1, sizeof(head));
+        mbuffer_pool_drain();
+        YASSERT(mbuffer_pool_count() == 0);
+
+        for (i = 0; i < POOL_TEST; i++) {
+                mbuffer_init(&array[i], 0);
+                mbuffer_appendmem(&array[i], head, sizeof(head));
+        }
+
+        YASSERT(mbuffer_pool_count() == 0);
+
+        for (i = 0; i < POOL_TEST; i++) {
+                mbuffer_free(&array[i]);
+        }
+
+        YASSERT(mbuffer_pool_count() == POOL_TEST);
+
+        /* reused before mem_cache is asked again */
+        for (i = 0; i < POOL_TEST; i++) {
+                mbuffer_init(&array[i], 0);
+                mbuffer_appendmem(&array[i], head, sizeof(head));
+        }
+
+        YASSERT(mbuffer_pool_count() == 0);
+
+        for (i = 0; i < POOL_TEST; i++) {
+                mbuffer_free(&array[i]);
+        }
+
+        /* the pool is bounded, the rest goes back to mem_cache */
+        for (i = 0; i < POOL_TEST * 64; i++) {
+                mbuffer_init(&array[i], 0);
+                mbuffer_appendmem(&array[i], head, sizeof(head));
+        }
+
+        for (i = 0; i < POOL_TEST * 64; i++) {
+                mbuffer_free(&array[i]);
+        }
+
+        YASSERT(mbuffer_pool_count() > 0);
+        YASSERT(mbuffer_pool_count() < POOL_TEST * 64);
+
+        mbuffer_pool_drain();
+        YASSERT(mbuffer_pool_count() == 0);
+}
+
+int main(int argc, char **argv)
+{
+        int ret, i, count;
+        int64_t used;
+        struct timeval t1, t2;
+        bench_t array[] = {
+                {"appendmem", __bench_appendmem},
+                {"popmsg", __bench_popmsg},
+                {"pop+merge", __bench_pop},
+                {"pop split", __bench_split},
+                {"reference", __bench_reference},
+        };
+
+        if (argc == 1) {
+                count = 1000 * 1000;
+        } else if (argc == 2) {
+                count = atoi(argv[1]);
+        } else {
+                fprintf(stderr, "Usage: ./test_buffer count\n");
+                EXIT(1);
+        }
+
+        ret = mem_cache_init();
+        if (ret) {
+                fprintf(stderr, "mem_cache_init ret %u\n", ret);
+                EXIT(ret);
+        }
+
+        printf("seg %llu count %d\n", (LLU)sizeof(seg_t), count);
+
+        __test_pool();
+
+        for (i = 0; i < (int)(sizeof(array) / sizeof(array[0])); i++) {
+                _gettimeofday(&t1, NULL);
+                array[i].fn(count);
+                _gettimeofday(&t2, NULL);
+
+                used = _time_used(&t1, &t2);
+                printf("%-12s %10.1f ns/op\n", array[i].name,
+                       (double)used * 1000 / count);
+        }
+
+        YASSERT(mbuffer_pool_count() > 0);
+        mbuffer_pool_drain();
+        YASSERT(mbuffer_pool_count() == 0);
+
+        return 0;
+}
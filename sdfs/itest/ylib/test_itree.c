@@ -0,0 +1,113 @@
+#include <sys/time.h>
+
+#include "ylib.h"
+#include "itree.h"
+#include "dbg.h"
+
+#define NODE_MAX 4096
+#define RANGE_MAX 100000
+
+typedef struct {
+        itree_node_t node;
+        int used;
+} item_t;
+
+typedef struct {
+        uint64_t start;
+        uint64_t end;
+        int count;
+        uint64_t last;
+} check_t;
+
+static item_t __items__[NODE_MAX];
+
+static int __overlap(itree_node_t *node, void *arg)
+{
+        check_t *check = arg;
+
+        YASSERT(node->start < check->end && node->end > check->start);
+        YASSERT(node->start >= check->last);
+
+        check->last = node->start;
+        check->count++;
+
+        return 0;
+}
+
+static int __count(uint64_t start, uint64_t end)
+{
+        int i, count = 0;
+
+        for (i = 0; i < NODE_MAX; i++) {
+                if (__items__[i].used && __items__[i].node.start < end
+                    && __items__[i].node.end > start)
+                        count++;
+        }
+
+        return count;
+}
+
+static int __height(const itree_node_t *node)
+{
+        int lh, rh;
+
+        if (node == NULL)
+                return 0;
+
+        lh = __height(node->left);
+        rh = __height(node->right);
+        YASSERT(lh - rh <= 1 && rh - lh <= 1);
+        YASSERT(node->height == (lh > rh ? lh : rh) + 1);
+
+        return node->height;
+}
+
+int main(int argc, char **argv)
+{
+        int i, idx, loop;
+        uint64_t start, len;
+        itree_t tree;
+        check_t check;
+
+        if (argc == 1) {
+                loop = 1000 * 100;
+        } else if (argc == 2) {
+                loop = atoi(argv[1]);
+        } else {
+                fprintf(stderr, "Usage: ./test_itree loop\n");
+                EXIT(1);
+        }
+
+        srandom(0);
+        itree_init(&tree);
+
+        for (i = 0; i < loop; i++) {
+                idx = random() % NODE_MAX;
+                if (__items__[idx].used) {
+                        itree_remove(&tree, &__items__[idx].node);
+                        __items__[idx].used = 0;
+                } else {
+                        start = random() % RANGE_MAX;
+                        len = random() % 5 ? (uint64_t)random() % 100 + 1 : UINT64_MAX - start;
+                        itree_insert(&tree, &__items__[idx].node, start, start + len);
+                        __items__[idx].used = 1;
+                }
+
+                if (i % 100)
+                        continue;
+
+                __height(tree.root);
+
+                check.start = random() % RANGE_MAX;
+                check.end = check.start + random() % 1000 + 1;
+                check.count = 0;
+                check.last = 0;
+                itree_overlap(&tree, check.start, check.end, __overlap, &check);
+
+                YASSERT(check.count == __count(check.start, check.end));
+        }
+
+        printf("itree %d nodes, %d loops ok\n", tree.count, loop);
+
+        return 0;
+}
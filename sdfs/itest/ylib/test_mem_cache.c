@@ -0,0 +1,191 @@
+#include <sys/time.h>
+#include <pthread.h>
+
+#include "ylib.h"
+#include "mem_cache.h"
+#include "variable.h"
+#include "dbg.h"
+
+#define THREAD_MAX 4
+#define RING_SIZE 1024
+#define BATCH 64
+
+/*
+ * each thread allocates on its own core cache and hands the objects to the
+ * next thread, which frees them into its cache.  full magazines then move
+ * from the freeing thread to the allocating one through the depot.
+ */
+
+typedef struct {
+        sy_spinlock_t lock;
+        int head;
+        int tail;
+        void *array[RING_SIZE];
+} ring_t;
+
+typedef struct {
+        int idx;
+        int count;
+        ring_t ring;
+} worker_t;
+
+static worker_t __worker__[THREAD_MAX];
+static pthread_barrier_t __barrier__;
+
+static int __ring_push(ring_t *ring, void *obj)
+{
+        int ret;
+
+        sy_spin_lock(&ring->lock);
+
+        if (ring->head - ring->tail == RING_SIZE) {
+                ret = EAGAIN;
+        } else {
+                ring->array[ring->head++ % RING_SIZE] = obj;
+                ret = 0;
+        }
+
+        sy_spin_unlock(&ring->lock);
+
+        return ret;
+}
+
+static void *__ring_pop(ring_t *ring)
+{
+        void *obj = NULL;
+
+        sy_spin_lock(&ring->lock);
+
+        if (ring->head != ring->tail)
+                obj = ring->array[ring->tail++ % RING_SIZE];
+
+        sy_spin_unlock(&ring->lock);
+
+        return obj;
+}
+
+/* frees what the previous thread sent, returns how many */
+static int __worker_free(worker_t *worker)
+{
+        int count = 0;
+        uint64_t *obj;
+
+        while ((obj = __ring_pop(&worker->ring))) {
+                YASSERT(obj[0] == (uint64_t)(worker->idx + THREAD_MAX - 1) % THREAD_MAX);
+                YASSERT(obj[1] == ~obj[2]);
+                mem_cache_free(MEM_CACHE_128, obj);
+                count++;
+        }
+
+        return count;
+}
+
+static void *__worker(void *arg)
+{
+        int ret, i, sent = 0, freed = 0;
+        uint64_t *obj;
+        worker_t *worker = arg, *next = &__worker__[(worker->idx + 1) % THREAD_MAX];
+
+        ret = variable_newthread();
+        YASSERT(ret == 0);
+
+        ret = mem_cache_private_init();
+        YASSERT(ret == 0);
+
+        while (sent < worker->count) {
+                for (i = 0; i < BATCH && sent < worker->count; i++) {
+                        obj = mem_cache_calloc(MEM_CACHE_128, 0);
+                        YASSERT(obj);
+
+                        obj[0] = worker->idx;
+                        obj[1] = sent;
+                        obj[2] = ~obj[1];
+
+                        while (__ring_push(&next->ring, obj)) {
+                                freed += __worker_free(worker);
+                        }
+
+                        sent++;
+                }
+
+                freed += __worker_free(worker);
+        }
+
+        while (freed < worker->count) {
+                freed += __worker_free(worker);
+        }
+
+        /* everything is freed, main checks the counters */
+        pthread_barrier_wait(&__barrier__);
+        pthread_barrier_wait(&__barrier__);
+
+        mem_cache_private_destroy();
+        variable_exit();
+
+        return NULL;
+}
+
+int main(int argc, char **argv)
+{
+        int ret, i, count;
+        pthread_t th[THREAD_MAX];
+        mem_cache_stat_t stat;
+        struct timeval t1, t2;
+
+        if (argc == 1) {
+                count = 1000 * 1000;
+        } else if (argc == 2) {
+                count = atoi(argv[1]);
+        } else {
+                fprintf(stderr, "Usage: ./test_mem_cache count\n");
+                EXIT(1);
+        }
+
+        ret = variable_init();
+        YASSERT(ret == 0);
+
+        ret = mem_cache_init();
+        if (ret) {
+                fprintf(stderr, "mem_cache_init ret %u\n", ret);
+                EXIT(ret);
+        }
+
+        ret = pthread_barrier_init(&__barrier__, NULL, THREAD_MAX + 1);
+        YASSERT(ret == 0);
+
+        _gettimeofday(&t1, NULL);
+
+        for (i = 0; i < THREAD_MAX; i++) {
+                __worker__[i].idx = i;
+                __worker__[i].count = count;
+                sy_spin_init(&__worker__[i].ring.lock);
+
+                ret = pthread_create(&th[i], NULL, __worker, &__worker__[i]);
+                YASSERT(ret == 0);
+        }
+
+        pthread_barrier_wait(&__barrier__);
+
+        _gettimeofday(&t2, NULL);
+
+        mem_cache_stat(MEM_CACHE_128, &stat);
+        printf("threads %d count %d used %llu us, total %llu cached %llu"
+               " alloc %llu free %llu remote %llu\n", THREAD_MAX, count,
+               (LLU)_time_used(&t1, &t2), (LLU)stat.total, (LLU)stat.cached,
+               (LLU)stat.alloc, (LLU)stat.free, (LLU)stat.remote);
+
+        YASSERT(stat.alloc == (uint64_t)count * THREAD_MAX);
+        YASSERT(stat.free == stat.alloc);
+        YASSERT(stat.remote == stat.free);
+
+        /* nothing is in use, every object is back in a magazine */
+        YASSERT(stat.cached == stat.total);
+
+        pthread_barrier_wait(&__barrier__);
+
+        for (i = 0; i < THREAD_MAX; i++) {
+                pthread_join(th[i], NULL);
+        }
+
+        return 0;
+}
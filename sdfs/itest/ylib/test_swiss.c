@@ -0,0 +1,207 @@
+#include <sys/time.h>
+
+#include "ylib.h"
+#include "swiss.h"
+#include "htable.h"
+#include "dbg.h"
+
+#define KEY_MAX (1024 * 64)
+#define BENCH_MAX (1024 * 1024)
+
+typedef struct {
+        uint64_t id;
+        uint64_t volid;
+        uint64_t idx;
+} tkey_t;
+
+typedef struct {
+        tkey_t key;
+        int used;
+} item_t;
+
+static item_t *__items__;
+static int *__order__;
+
+static uint64_t __now()
+{
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+
+        return (uint64_t)tv.tv_sec * 1000 * 1000 + tv.tv_usec;
+}
+
+static void __count(void *arg, void *value)
+{
+        (void) value;
+        (*(int *)arg)++;
+}
+
+static void __check(int loop)
+{
+        int ret, i, idx, count, used = 0;
+        item_t *item;
+        swiss_t *tab;
+        void *value;
+
+        ret = swiss_create(&tab, "test", sizeof(tkey_t));
+        YASSERT(ret == 0);
+
+        for (i = 0; i < KEY_MAX; i++) {
+                __items__[i].key.id = i;
+                __items__[i].key.volid = i % 7;
+                __items__[i].key.idx = 0;
+                __items__[i].used = 0;
+        }
+
+        for (i = 0; i < loop; i++) {
+                /* grow to all keys, then shrink back to a few */
+                idx = random() % ((i / (loop / 8)) % 2 ? KEY_MAX : KEY_MAX / 64);
+                item = &__items__[idx];
+
+                if (random() % 2) {
+                        ret = swiss_insert(tab, &item->key, item, 0);
+                        YASSERT(ret == (item->used ? EEXIST : 0));
+                        used += !item->used;
+                        item->used = 1;
+                } else {
+                        ret = swiss_remove(tab, &item->key, &value);
+                        YASSERT(ret == (item->used ? 0 : ENOENT));
+                        YASSERT(ret || value == item);
+                        used -= item->used;
+                        item->used = 0;
+                }
+
+                item = &__items__[random() % KEY_MAX];
+                value = swiss_find(tab, &item->key);
+                YASSERT(value == (item->used ? item : NULL));
+                YASSERT(tab->count == (uint32_t)used);
+        }
+
+        count = 0;
+        swiss_iterator(tab, __count, &count);
+        YASSERT(count == used);
+
+        swiss_destroy(tab, NULL, NULL);
+
+        printf("swiss %d keys, %d loops ok\n", used, loop);
+}
+
+static int __hash_cmp(const void *v1, const void *v2)
+{
+        return memcmp(&((const item_t *)v1)->key, v2, sizeof(tkey_t));
+}
+
+static int __htable_cmp(const void *key, const void *value)
+{
+        return memcmp(&((const item_t *)value)->key, key, sizeof(tkey_t)) == 0;
+}
+
+static uint32_t __hash_key(const void *key)
+{
+        return hash_mem(key, sizeof(tkey_t));
+}
+
+static void __bench(int count)
+{
+        int ret, i, j, tmp;
+        uint64_t begin, insert, find, remove;
+        swiss_t *tab;
+        hashtable_t hash;
+        htable_t *htab;
+        void *value;
+
+        ret = ymalloc((void **)&__order__, sizeof(*__order__) * count);
+        YASSERT(ret == 0);
+
+        /* random keys looked up in random order, far beyond the cpu cache */
+        for (i = 0; i < count; i++) {
+                __items__[i].key.id = random();
+                __items__[i].key.volid = random() % 16;
+                __items__[i].key.idx = 0;
+                __order__[i] = i;
+        }
+
+        for (i = count - 1; i > 0; i--) {
+                j = random() % (i + 1);
+                tmp = __order__[i];
+                __order__[i] = __order__[j];
+                __order__[j] = tmp;
+        }
+
+        ret = swiss_create(&tab, "bench", sizeof(tkey_t));
+        YASSERT(ret == 0);
+
+        begin = __now();
+        for (i = 0; i < count; i++)
+                swiss_insert(tab, &__items__[i].key, &__items__[i], 0);
+        insert = __now();
+        for (i = 0; i < count; i++)
+                YASSERT(swiss_find(tab, &__items__[__order__[i]].key));
+        find = __now();
+        for (i = 0; i < count; i++)
+                swiss_remove(tab, &__items__[i].key, &value);
+        remove = __now();
+
+        printf("swiss      insert %ju find %ju remove %ju usec\n",
+               insert - begin, find - insert, remove - find);
+        swiss_destroy(tab, NULL, NULL);
+
+        hash = hash_create_table(__hash_cmp, __hash_key, "bench");
+        YASSERT(hash);
+
+        begin = __now();
+        for (i = 0; i < count; i++)
+                hash_table_insert(hash, &__items__[i], &__items__[i].key, 0);
+        insert = __now();
+        for (i = 0; i < count; i++)
+                YASSERT(hash_table_find(hash, &__items__[__order__[i]].key));
+        find = __now();
+        for (i = 0; i < count; i++)
+                hash_table_remove(hash, &__items__[i].key, &value);
+        remove = __now();
+
+        printf("hash_table insert %ju find %ju remove %ju usec\n",
+               insert - begin, find - insert, remove - find);
+        hash_destroy_table(hash, NULL, NULL);
+
+        ret = htable_create(&htab, 1024 * 16, __htable_cmp, __hash_key);
+        YASSERT(ret == 0);
+
+        begin = __now();
+        for (i = 0; i < count; i++)
+                htable_insert(htab, &__items__[i].key, &__items__[i]);
+        insert = __now();
+        for (i = 0; i < count; i++)
+                YASSERT(htable_get(htab, &__items__[__order__[i]].key, &value) == 0);
+        find = __now();
+        for (i = 0; i < count; i++)
+                htable_drop(htab, &__items__[i].key, &value);
+        remove = __now();
+
+        printf("htable     insert %ju find %ju remove %ju usec\n",
+               insert - begin, find - insert, remove - find);
+}
+
+int main(int argc, char **argv)
+{
+        int ret, loop;
+
+        if (argc == 1) {
+                loop = 1000 * 1000;
+        } else if (argc == 2) {
+                loop = atoi(argv[1]);
+        } else {
+                fprintf(stderr, "Usage: ./test_swiss loop\n");
+                EXIT(1);
+        }
+
+        ret = ymalloc((void **)&__items__, sizeof(*__items__) * BENCH_MAX);
+        YASSERT(ret == 0);
+
+        srandom(0);
+        __check(loop);
+        __bench(BENCH_MAX);
+
+        return 0;
+}
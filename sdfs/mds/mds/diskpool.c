@@ -24,6 +24,9 @@
 #include "net_global.h"
 #include "network.h"
 #include "bmap.h"
+#include "bh.h"
+#include "mond_rpc.h"
+#include "mond_kv.h"
 #include "dbg.h"
 
 #define YFS_MDS_DISKPOOL_GROUP_DEF 9
@@ -362,6 +365,64 @@ int diskpool_destroy(struct disk_pool *dp, int group)
         return 0;
 }
 
+/*
+ * export "<diskid> <free MB> <load B/s>" per live disk through the mond kv,
+ * clients weight chunk placement with it (see sdfs/allocator.c)
+ */
+static int __diskpool_publish(void *arg)
+{
+        int ret, stat, grp, len;
+        struct disk_pool *dp = arg;
+        struct disk_info *di;
+        uint64_t avail;
+        char *buf;
+
+        ret = ymalloc((void **)&buf, MON_ENTRY_MAX);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        len = 0;
+        for (stat = 0; stat < DISK_STAT_DEAD; stat++) {
+                for (grp = 0; grp < dp->group; grp++) {
+                        ret = sy_rwlock_rdlock(&dp->stat_rwlock[stat][grp]);
+                        if (ret)
+                                GOTO(err_free, ret);
+
+                        list_for_each_entry(di, &dp->stat_list[stat][grp], list) {
+                                if (len + MAX_NAME_LEN > MON_ENTRY_MAX)
+                                        break;
+
+                                avail = (uint64_t)di->diskinfo.ds_bsize * di->diskinfo.ds_bavail;
+                                avail = avail > (uint64_t)mdsconf.disk_keep
+                                        ? avail - mdsconf.disk_keep : 0;
+                                if (stat == DISK_STAT_OVERLOAD)
+                                        avail = 0;
+
+                                len += snprintf(buf + len, MAX_NAME_LEN, "%u %llu %llu\n",
+                                                di->diskid.id, (LLU)avail / (1024 * 1024),
+                                                (LLU)di->load);
+                        }
+
+                        sy_rwlock_unlock(&dp->stat_rwlock[stat][grp]);
+                }
+        }
+
+        if (len == 0)
+                goto out;
+
+        ret = mond_kv_set(MOND_DISKSTAT, buf, len + 1);
+        if (ret)
+                GOTO(err_free, ret);
+
+out:
+        yfree((void **)&buf);
+        return 0;
+err_free:
+        yfree((void **)&buf);
+err_ret:
+        return ret;
+}
+
 int diskpool_init(struct disk_pool *dp)
 {
         int ret, group, i, j;
@@ -438,6 +499,10 @@ int diskpool_init(struct disk_pool *dp)
                 GOTO(err_ret, ret);
         }
 
+        ret = bh_register("diskstat", __diskpool_publish, dp, DISKPOOL_STAT_INTERVAL);
+        if (ret)
+                GOTO(err_ret, ret);
+
         return 0;
 err_list:
         (void) diskpool_destroy(dp, i--);
@@ -863,6 +928,35 @@ err_ret:
         return ret;
 }
 
+int diskpool_load(const diskid_t *diskid, uint64_t load)
+{
+        int ret, grp;
+        struct disk_pool *dp;
+        struct disk_info *di;
+
+        dp = &mds_info.diskpool;
+
+        grp = diskid->id % dp->group;
+
+        ret = sy_rwlock_rdlock(&dp->disk_rwlock[grp]);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = skiplist_get(dp->disk_list[grp], (void *)diskid, (void **)&di);
+        if (ret)
+                GOTO(err_lock, ret);
+
+        di->load = load;
+
+        sy_rwlock_unlock(&dp->disk_rwlock[grp]);
+
+        return 0;
+err_lock:
+        sy_rwlock_unlock(&dp->disk_rwlock[grp]);
+err_ret:
+        return ret;
+}
+
 /**
  * @param infobuf
  * @param infobuflen
@@ -16,6 +16,8 @@
 #include "ylock.h"
 #include "ynet_rpc.h"
 
+#define DISKPOOL_STAT_INTERVAL 5
+
 struct disk_chkinfo {
         chkid_t chkid;
 };
@@ -33,6 +35,7 @@ struct disk_info {
 
         time_t dead_time;       /* the time when it goes dead */
         time_t lasthb_time;     /* the time getting last heart beat message */
+        uint64_t load;          /* io bytes per second, reported with heart beat */
 
         char net[NET_HANDLE_LEN];
 
@@ -89,6 +92,7 @@ extern int diskpool_dead(const diskid_t *);
 extern int diskpool_hb(const diskid_t *, uint32_t, const diskinfo_stat_diff_t *,
                        uint32_t volreptnum,
                        const volrept_t *chkrept, const uuid_t *nodeid);
+int diskpool_load(const diskid_t *diskid, uint64_t load);
 extern int diskpool_rept(diskid_t *, uint32_t chkreptnum, chkjnl_t *);
 extern int diskpool_disk2netinfo_multi(int disk_num, net_handle_t *disks,
                                        char **info, uint32_t *infolen, uint32_t *reps);
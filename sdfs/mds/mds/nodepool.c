@@ -81,12 +81,13 @@ err_ret:
  * 所以这里先关掉重试。重试应该放在最外层才合适？ */
 int nodepool_get(uint32_t reps, net_handle_t *disks, int hardend, uint32_t tier)
 {
-        int ret = 0;
+        int ret = 0, strict = tier & TIER_STRICT;
 
+        tier &= ~TIER_STRICT;
         if (tier == TIER_SSD) {
                 ret = nodepool_get_ssd(reps, disks, hardend);
                 if (ret) {
-                        if (ret == ENOSPC) {/*try get node from hdd if ssd no space left*/
+                        if (ret == ENOSPC && !strict) {/*try get node from hdd if ssd no space left*/
                                 ret = nodepool_get_hdd(reps, disks, hardend);
                                 if (ret)
                                         GOTO(err_ret, ret);
@@ -44,27 +44,21 @@ static int dir_newrec(const volid_t *volid, const fileid_t *parent, const char *
 {
         dir_entry_t ent;
         int ret;
-        uint64_t count;
 
         ANALYSIS_BEGIN(0);
         
         DBUG(""FID_FORMAT"/"FID_FORMAT" name %s\n", FID_ARG(parent), FID_ARG(fileid), name);
 
-        ret = hlen(volid, parent, &count);
-        if (ret)
-                GOTO(err_ret, ret);
-
-        if (count > MAX_SUB_FILES) {
-                ret = EPERM;
-                DWARN("limt max sub files %llu", (LLU)MAX_SUB_FILES);
-                GOTO(err_ret, ret);
-        }
-
         ent.fileid = *fileid;
         ent.d_type = type;
 
-        ret = hset(volid, parent, name, &ent, sizeof(dir_entry_t), flag);
+        ret = hset_count(volid, parent, SDFS_COUNT, name, &ent, sizeof(dir_entry_t),
+                         flag, MAX_SUB_FILES);
         if (ret) {
+                if (ret == EPERM) {
+                        DWARN("limt max sub files %llu", (LLU)MAX_SUB_FILES);
+                }
+
                 DBUG(""FID_FORMAT" / "FID_FORMAT" name %s\n", FID_ARG(parent),
                      FID_ARG(fileid), name);
                 GOTO(err_ret, ret);
@@ -81,7 +75,7 @@ static int dir_unlink(const volid_t *volid, const fileid_t *parent, const char *
 {
         int ret;
 
-        ret = hdel(volid, parent, name);
+        ret = hdel_count(volid, parent, SDFS_COUNT, name);
         if (ret)
                 GOTO(err_ret, ret);
         
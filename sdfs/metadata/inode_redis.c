@@ -22,6 +22,7 @@
 static inodeop_t *inodeop = &__inodeop__;
 
 static int __inode_childcount(const volid_t *volid, const fileid_t *fid, uint64_t *_count);
+static int __inode_hlencount(const volid_t *volid, const fileid_t *fileid, int64_t *_count);
 static int __inode_remove(const volid_t *volid, const fileid_t *fileid, md_proto_t *_md);
 
 static int __md_set(const volid_t *volid, const md_proto_t *md, int flag)
@@ -44,6 +45,32 @@ err_ret:
         return ret;
 }
 
+/*
+ * a dir gets its md and a zero child counter in one step, max 0 keeps the
+ * md itself out of the count
+ */
+static int __md_create(const volid_t *volid, const md_proto_t *md)
+{
+        int ret;
+
+        if (!S_ISDIR(stype(md->fileid.type))) {
+                return __md_set(volid, md, O_EXCL);
+        }
+
+        ret = hset_count(volid, &md->fileid, SDFS_COUNT, SDFS_MD, md, md->md_size,
+                         O_EXCL, 0);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        if (mdsconf.ac_timeout) {
+                attr_cache_update(volid, &md->fileid, md);
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
 static int __inode_setlock(const volid_t *volid, const fileid_t *fileid,
                            const void *opaque, size_t len, int flag)
 {
@@ -82,6 +109,54 @@ err_ret:
         return ret;
 }
 
+static int __inode_setlockver(const volid_t *volid, const fileid_t *fileid,
+                              uint64_t version)
+{
+        int ret;
+
+        if (fileid->type != ftype_file) {
+                ret = EPERM;
+                GOTO(err_ret, ret);
+        }
+
+        ret = hset(volid, fileid, SDFS_LOCK_VERSION, &version, sizeof(version), 0);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static int __inode_getlockver(const volid_t *volid, const fileid_t *fileid,
+                              uint64_t *version)
+{
+        int ret;
+        size_t len;
+        char buf[MAX_NAME_LEN];
+
+        if (fileid->type != ftype_file) {
+                ret = EPERM;
+                GOTO(err_ret, ret);
+        }
+
+        len = MAX_NAME_LEN;
+        ret = hget(volid, fileid, SDFS_LOCK_VERSION, buf, &len);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        if (len != sizeof(*version)) {
+                ret = EIO;
+                GOTO(err_ret, ret);
+        }
+
+        memcpy(version, buf, sizeof(*version));
+
+        return 0;
+err_ret:
+        return ret;
+}
+
 static void __inode_getxattrid(const fileid_t *fileid, fileid_t *xattrid, int flag)
 {
         (void) flag;
@@ -115,7 +190,7 @@ static int __inode_create(const volid_t *volid, const fileid_t *parent,
         if (ret)
                 GOTO(err_ret, ret);
 
-        ret = __md_set(volid, md, O_EXCL);
+        ret = __md_create(volid, md);
         if (ret)
                 GOTO(err_ret, ret);
 
@@ -135,13 +210,17 @@ static int __md_get(const volid_t *volid, const fileid_t *fileid, md_proto_t *md
         int ret;
         size_t len;
         char buf[MAX_BUF_LEN] = {0};
-        uint64_t count;
+        int64_t count = 0;
 
         DBUG("getattr "CHKID_FORMAT"\n", CHKID_ARG(fileid));
         
         //DWARN("--------------pipeline test--------------------\n");
         len = MAX_BUF_LEN;
-        ret = hget(volid, fileid, SDFS_MD, buf, &len);
+        if (S_ISDIR(stype(fileid->type))) {
+                ret = hget_count(volid, fileid, SDFS_MD, buf, &len, SDFS_COUNT, &count);
+        } else {
+                ret = hget(volid, fileid, SDFS_MD, buf, &len);
+        }
         if (ret) {
                 if (ret == ENOENT) {
                         memset(md, 0x0, sizeof(*md));
@@ -155,9 +234,11 @@ static int __md_get(const volid_t *volid, const fileid_t *fileid, md_proto_t *md
         YASSERT(md->md_size == len);
 
         if (S_ISDIR(stype(fileid->type))) {
-                ret = __inode_childcount(volid, fileid, &count);
-                if (ret)
-                        GOTO(err_ret, ret);
+                if (unlikely(count == -1)) {
+                        ret = __inode_hlencount(volid, fileid, &count);
+                        if (ret)
+                                GOTO(err_ret, ret);
+                }
 
                 md->at_nlink = count + 2;
         }
@@ -201,6 +282,47 @@ err_ret:
         return ret;
 }
 
+/* need lock, drop the inline bytes past size so a later extend reads zero */
+static int __inode_inline_trim(const volid_t *volid, const fileid_t *fileid,
+                               uint64_t size)
+{
+        int ret;
+        char *data;
+        size_t len;
+
+        ret = ymalloc((void **)&data, MD_INLINE_MAX);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        len = MD_INLINE_MAX;
+        ret = hget(volid, fileid, SDFS_INLINE, data, &len);
+        if (ret) {
+                if (ret == ENOENT) {
+                        goto out;
+                } else
+                        GOTO(err_free, ret);
+        }
+
+        if (len <= size)
+                goto out;
+
+        if (size) {
+                ret = hset(volid, fileid, SDFS_INLINE, data, size, 0);
+        } else {
+                ret = hdel(volid, fileid, SDFS_INLINE);
+        }
+        if (ret)
+                GOTO(err_free, ret);
+
+out:
+        yfree((void **)&data);
+        return 0;
+err_free:
+        yfree((void **)&data);
+err_ret:
+        return ret;
+}
+
 static int __inode_setattr(const volid_t *volid, const fileid_t *fileid,
                            const setattr_t *setattr, int force)
 {
@@ -227,6 +349,12 @@ static int __inode_setattr(const volid_t *volid, const fileid_t *fileid,
         DBUG(CHKID_FORMAT" nlink %d, size %ju\n", CHKID_ARG(fileid),
               md->at_nlink, md->at_size);
         YASSERT(md->at_mode);
+
+        if ((md->status & __S_INLINE) && setattr->size.set_it) {
+                ret = __inode_inline_trim(volid, fileid, md->at_size);
+                if (ret)
+                        GOTO(err_lock, ret);
+        }
         
         ret = __md_set(volid, md, 0);
         if (ret)
@@ -427,21 +555,50 @@ err_ret:
         return ret;
 }
 
-static int __inode_childcount(const volid_t *volid, const fileid_t *fileid, uint64_t *_count)
+/*
+ * dirs created before SDFS_COUNT have no counter, count them the old way,
+ * the counter is rebuilt by the next newrec/unlink
+ */
+static int __inode_hlencount(const volid_t *volid, const fileid_t *fileid, int64_t *_count)
 {
         int ret;
         uint64_t count;
 
+        ret = hlen(volid, fileid, &count);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        *_count = count ? count - 1 : 0;
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static int __inode_childcount(const volid_t *volid, const fileid_t *fileid, uint64_t *_count)
+{
+        int ret;
+        size_t len;
+        int64_t count;
+        char buf[MAX_BUF_LEN];
+
         if (!S_ISDIR(stype(fileid->type))) {
                 ret = ENOTDIR;
                 GOTO(err_ret, ret);
         }
-        
-        ret = hlen(volid, fileid, &count);
+
+        len = MAX_BUF_LEN;
+        ret = hget_count(volid, fileid, SDFS_MD, buf, &len, SDFS_COUNT, &count);
         if (ret)
                 GOTO(err_ret, ret);
 
-        *_count = count - 1;
+        if (unlikely(count == -1)) {
+                ret = __inode_hlencount(volid, fileid, &count);
+                if (ret)
+                        GOTO(err_ret, ret);
+        }
+
+        *_count = count;
 
         return 0;
 err_ret:
@@ -593,7 +750,7 @@ static int __inode_mkvol(const volid_t *volid, const fileid_t *fileid, const set
         if (ret)
                 GOTO(err_ret, ret);
 
-        ret = __md_set(volid, md, O_EXCL);
+        ret = __md_create(volid, md);
         if (ret)
                 GOTO(err_ret, ret);
 
@@ -621,6 +778,144 @@ err_ret:
         return ret;
 }
 
+static int __inode_inline_read(const volid_t *volid, const fileid_t *fileid,
+                               void *buf, size_t *len)
+{
+        int ret;
+
+        ret = hget(volid, fileid, SDFS_INLINE, buf, len);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+/*
+ * EFBIG: the file is not inline any more or would outgrow inline_size,
+ * the caller moves it to chunks
+ */
+static int __inode_inline_write(const volid_t *volid, const fileid_t *fileid,
+                                const void *buf, uint32_t size, uint64_t offset)
+{
+        int ret;
+        char _md[MAX_BUF_LEN] = {0};
+        md_proto_t *md;
+        char *data;
+        size_t len;
+        uint64_t end = offset + size;
+
+        if (end > (uint64_t)gloconf.inline_size) {
+                ret = EFBIG;
+                goto err_ret;
+        }
+
+        ret = ymalloc((void **)&data, MD_INLINE_MAX);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = klock(volid, fileid, 10, 1);
+        if (ret)
+                GOTO(err_free, ret);
+
+        md = (void *)_md;
+        ret = __inode_getattr(volid, fileid, md);
+        if (ret)
+                GOTO(err_lock, ret);
+
+        if (!(md->status & __S_INLINE)) {
+                ret = EFBIG;
+                goto err_lock;
+        }
+
+        len = MD_INLINE_MAX;
+        ret = hget(volid, fileid, SDFS_INLINE, data, &len);
+        if (ret) {
+                if (ret == ENOENT) {
+                        len = 0;
+                } else
+                        GOTO(err_lock, ret);
+        }
+
+        /* bytes past at_size were truncated away */
+        len = len < md->at_size ? len : md->at_size;
+        if (len < end) {
+                memset(data + len, 0x0, end - len);
+                len = end;
+        }
+
+        memcpy(data + offset, buf, size);
+
+        ret = hset(volid, fileid, SDFS_INLINE, data, len, 0);
+        if (ret)
+                GOTO(err_lock, ret);
+
+        if (md->at_size < end) {
+#if ENABLE_QUOTA
+                ret = quota_space_increase(&md->parent, md->at_uid,
+                                           md->at_gid, end - md->at_size);
+                if (ret)
+                        GOTO(err_lock, ret);
+#endif
+
+                md->at_size = end;
+                md->chknum = _get_chknum(md->at_size, md->split);
+                md->md_version++;
+                ret = __md_set(volid, md, 0);
+                if (ret)
+                        GOTO(err_lock, ret);
+        }
+
+        ret = kunlock(volid, fileid);
+        if (ret)
+                GOTO(err_free, ret);
+
+        yfree((void **)&data);
+
+        return 0;
+err_lock:
+        kunlock(volid, fileid);
+err_free:
+        yfree((void **)&data);
+err_ret:
+        return ret;
+}
+
+/* need lock */
+static int __inode_inline_clear(const volid_t *volid, const fileid_t *fileid)
+{
+        int ret;
+        char buf[MAX_BUF_LEN] = {0};
+        md_proto_t *md;
+
+        md = (void *)buf;
+        ret = __inode_getattr(volid, fileid, md);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        if (!(md->status & __S_INLINE))
+                return 0;
+
+        md->status &= ~__S_INLINE;
+        md->md_version++;
+        ret = __md_set(volid, md, 0);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = hdel(volid, fileid, SDFS_INLINE);
+        if (ret) {
+                if (ret == ENOENT) {
+                        //pass
+                } else
+                        GOTO(err_ret, ret);
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
 inodeop_t __inodeop__ = {
         .create = __inode_create,
         .getattr = __inode_getattr,
@@ -640,4 +935,9 @@ inodeop_t __inodeop__ = {
         .remove = __inode_remove,
         .setlock = __inode_setlock,
         .getlock = __inode_getlock,
+        .setlockver = __inode_setlockver,
+        .getlockver = __inode_getlockver,
+        .inline_read = __inode_inline_read,
+        .inline_write = __inode_inline_write,
+        .inline_clear = __inode_inline_clear,
 };
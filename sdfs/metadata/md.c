@@ -144,6 +144,10 @@ int md_init()
 
         __mdid__ = array;
 
+        ret = md_lock_init();
+        if(ret)
+                GOTO(err_ret, ret);
+
         return 0;
 err_ret:
         return ret;
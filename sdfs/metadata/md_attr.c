@@ -141,6 +141,10 @@ void md_attr_inherit(md_proto_t *md, const md_proto_t *parent, const ec_t *ec, u
                 repnum = gloconf.chunk_rep;
         }
 
+        md->status &= ~__S_INLINE;
+        if (gloconf.inline_size && S_ISREG(mode) && md->plugin != PLUGIN_EC_ISA)
+                md->status |= __S_INLINE;
+
         if (parent && parent->repnum) {
                 if (md->plugin == PLUGIN_EC_ISA && S_ISREG(mode)) {
                         md->repnum = md->m;
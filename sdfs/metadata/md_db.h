@@ -8,6 +8,9 @@
 
 #define SDFS_MD "__system_md__"
 #define SDFS_LOCK "__system_lock__"
+#define SDFS_LOCK_VERSION "__system_lockver__"   /* moved by every write of SDFS_LOCK, see md_lock.c */
+#define SDFS_INLINE "__system_inline__"   /* data of a small file, see __S_INLINE */
+#define SDFS_COUNT "__system_count__"   /* dirent count of a dir, kept with every newrec/unlink */
 #define SDFS_MD_SYSTEM "__system"
 
 
@@ -55,6 +58,12 @@ typedef struct {
         int (*mkvol)(const volid_t *volid, const fileid_t *_fileid, const setattr_t *setattr);
         int (*setlock)(const volid_t *volid, const fileid_t *fileid, const void *opaque, size_t len, int flag);
         int (*getlock)(const volid_t *volid, const fileid_t *fileid, void *opaque, size_t *len);
+        int (*setlockver)(const volid_t *volid, const fileid_t *fileid, uint64_t version);
+        int (*getlockver)(const volid_t *volid, const fileid_t *fileid, uint64_t *version);
+        int (*inline_read)(const volid_t *volid, const fileid_t *fileid, void *buf, size_t *len);
+        int (*inline_write)(const volid_t *volid, const fileid_t *fileid, const void *buf,
+                            uint32_t size, uint64_t offset);
+        int (*inline_clear)(const volid_t *volid, const fileid_t *fileid);
 } inodeop_t;
 
 typedef struct {
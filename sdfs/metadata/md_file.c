@@ -97,227 +97,19 @@ err_ret:
         return ret;
 }
 
-static int __md_lock_collision__(const sdfs_lock_t *lock1, const sdfs_lock_t *lock2)
+int md_inline_read(const volid_t *volid, const fileid_t *fileid, void *buf, size_t *len)
 {
-        uint64_t begin1, end1, begin2, end2;
-
-        begin1 = lock1->start;
-        begin2 = lock2->start;
-
-        end1 = (lock1->length == 0) ? UINT64_MAX : (lock1->start + lock1->length);
-        end2 = (lock2->length == 0) ? UINT64_MAX : (lock2->start + lock2->length);
-
-        if (end1 <= begin2 || end2 <= begin1) {
-                return 0;
-        }
-
-        if (lock1->type != SDFS_WRLOCK && lock2->type != SDFS_WRLOCK) {
-                return 0;
-        }
-
-        
-        DINFO("type %d,%d, sid %d,%d, owner 0x%u,0x%u, start %ju,%ju, end %ju,%ju\n",
-              lock1->type, lock2->type,
-              lock1->sid, lock2->sid,
-              lock1->owner, lock2->owner,
-              lock1->start, lock2->start,
-              lock1->length, lock2->length);
-        
-        return 1;
-}
-
-static int __md_lock_collision(const sdfs_lock_t *lock, const char *buf, size_t size)
-{
-        uint64_t left;
-        const sdfs_lock_t *pos;
-
-        left = size;
-        pos = (void *)buf;
-        while (left) {
-                YASSERT(left >= SDFS_LOCK_SIZE(pos));
-
-                if (__md_lock_collision__(lock, pos)) {
-                        return 1;
-                }
-
-                left -= SDFS_LOCK_SIZE(pos);
-                pos = (void *)pos + SDFS_LOCK_SIZE(pos);
-        }
-
-        return 0;
+        return inodeop->inline_read(volid, fileid, buf, len);
 }
 
-static int __md_lock(const volid_t *volid, const fileid_t *fileid, const sdfs_lock_t *lock)
+int md_inline_write(const volid_t *volid, const fileid_t *fileid, const void *buf,
+                    uint32_t size, uint64_t offset)
 {
-        int ret;
-        char buf[MAX_BUF_LEN] = {0};
-        size_t size = MAX_BUF_LEN;
-
-        ret = klock(volid, fileid, 10, 1);
-        if (ret)
-                GOTO(err_ret, ret);
-
-        ret = inodeop->getlock(volid, fileid, buf, &size);
-        if (ret) {
-                if (ret == ENOENT) {
-                        ret = inodeop->setlock(volid, fileid, lock, SDFS_LOCK_SIZE(lock), O_CREAT);
-                        if (ret)
-                                GOTO(err_lock, ret);
-
-                        goto out;
-                } else
-                        GOTO(err_lock, ret);
-        }
-
-        
-        if (__md_lock_collision(lock, buf, size)) {
-                ret = EWOULDBLOCK;
-                GOTO(err_lock, ret);
-        }
-
-        if (size + SDFS_LOCK_SIZE(lock) > MAX_BUF_LEN) {
-                ret = EFBIG;
-                GOTO(err_lock, ret);
-        }
-
-        memcpy(buf + size, lock, SDFS_LOCK_SIZE(lock));
-
-        ret = inodeop->setlock(volid, fileid, buf, size + SDFS_LOCK_SIZE(lock), 0);
-        if (ret)
-                GOTO(err_lock, ret);
-        
-out:
-        kunlock(volid, fileid);
-
-        return 0;
-err_lock:
-        kunlock(volid, fileid);
-err_ret:
-        return ret;
+        return inodeop->inline_write(volid, fileid, buf, size, offset);
 }
 
-static sdfs_lock_t *__md_lock_find(const sdfs_lock_t *lock, char *buf, size_t size)
+int md_inline_clear(const volid_t *volid, const fileid_t *fileid)
 {
-        uint64_t left;
-        sdfs_lock_t *pos;
-
-        left = size;
-        pos = (void *)buf;
-        while (left) {
-                YASSERT(left >= SDFS_LOCK_SIZE(pos));
-
-                if (sdfs_lock_equal(NULL, lock, NULL, pos)) {
-                        return pos;
-                }
-
-                left -= SDFS_LOCK_SIZE(pos);
-                pos = (void *)pos + SDFS_LOCK_SIZE(pos);
-        }
-
-        return NULL;
+        return inodeop->inline_clear(volid, fileid);
 }
 
-static int __md_unlock(const volid_t *volid, const fileid_t *fileid, const sdfs_lock_t *lock)
-{
-        int ret;
-        char buf[MAX_BUF_LEN] = {0};
-        size_t size = MAX_BUF_LEN;
-        sdfs_lock_t *pos;
-
-        ret = klock(volid, fileid, 10, 1);
-        if (ret)
-                GOTO(err_ret, ret);
-
-        ret = inodeop->getlock(volid, fileid, buf, &size);
-        if (ret) {
-                GOTO(err_lock, ret);
-        }
-
-        pos = __md_lock_find(lock, buf, size);
-        if (pos == NULL) {
-                ret = ENOENT;
-                GOTO(err_lock, ret);
-        }
-        
-        YASSERT(lock->opaquelen == pos->opaquelen);
-
-        //ARRAY_POP(*pos, SDFS_LOCK_SIZE(pos), size - (pos - buf));
-        memmove(pos, (void *)pos + SDFS_LOCK_SIZE(pos),
-                size - ((void *)pos - (void *)buf) - SDFS_LOCK_SIZE(pos));
-
-        ret = inodeop->setlock(volid, fileid, buf, size - SDFS_LOCK_SIZE(lock), 0);
-        if (ret)
-                GOTO(err_lock, ret);
-        
-        kunlock(volid, fileid);
-
-        return 0;
-err_lock:
-        kunlock(volid, fileid);
-err_ret:
-        return ret;
-}
-
-int md_setlock(const volid_t *volid, const fileid_t *fileid, const sdfs_lock_t *lock)
-{
-        if (lock->type == SDFS_UNLOCK) {
-                return __md_unlock(volid, fileid, lock);
-        } else {
-                return __md_lock(volid, fileid, lock);
-        }
-}
-
-static sdfs_lock_t *__md_lock_find_collision(const sdfs_lock_t *lock, char *buf, size_t size)
-{
-        uint64_t left;
-        sdfs_lock_t *pos;
-
-        left = size;
-        pos = (void *)buf;
-        while (left) {
-                YASSERT(left == SDFS_LOCK_SIZE(pos));
-
-                if (__md_lock_collision__(lock, pos)) {
-                        return pos;
-                }
-
-                left -= SDFS_LOCK_SIZE(pos);
-                pos = (void *)pos + SDFS_LOCK_SIZE(pos);
-        }
-
-        return NULL;
-}
-
-
-int md_getlock(const volid_t *volid, const fileid_t *fileid, sdfs_lock_t *lock)
-{
-        int ret;
-        char buf[MAX_BUF_LEN] = {0};
-        size_t size = MAX_BUF_LEN;
-        sdfs_lock_t *pos;
-
-        ret = klock(volid, fileid, 10, 1);
-        if (ret)
-                GOTO(err_ret, ret);
-
-        ret = inodeop->getlock(volid, fileid, buf, &size);
-        if (ret) {
-                GOTO(err_lock, ret);
-        }
-
-        pos = __md_lock_find_collision(lock, buf, size);
-        if (pos == NULL) {
-                ret = ENOENT;
-                GOTO(err_lock, ret);
-        }
-
-        memcpy(lock, pos, SDFS_LOCK_SIZE(pos));
-
-        kunlock(volid, fileid);
-
-        return 0;
-err_lock:
-        kunlock(volid, fileid);
-err_ret:
-        return ret;
-}
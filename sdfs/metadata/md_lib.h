@@ -73,6 +73,10 @@ int md_chkupdate(const chkinfo_t *chkinfo, const nid_t *nid);
 int md_create(const volid_t *volid, const fileid_t *parent, const char *name, const setattr_t *setattr,
               fileid_t *fileid);
 int md_extend(const volid_t *volid, const fileid_t *fileid, size_t size);
+int md_inline_read(const volid_t *volid, const fileid_t *fileid, void *buf, size_t *len);
+int md_inline_write(const volid_t *volid, const fileid_t *fileid, const void *buf,
+                    uint32_t size, uint64_t offset);
+int md_inline_clear(const volid_t *volid, const fileid_t *fileid);//need lock
 int md_id2name(const volid_t *volid, const fileid_t *parent, uint64_t id, char *name, int size);
 int md_truncate(const volid_t *volid, const fileid_t *fileid, uint64_t length);
 int md_symlink(const volid_t *volid, const fileid_t *parent, const char *link_name, const char *link_target,
@@ -88,6 +92,8 @@ int md_initroot();
 int md_system_volid(uint64_t *id);
 int md_getlock(const volid_t *volid, const fileid_t *fileid, sdfs_lock_t *lock);
 int md_setlock(const volid_t *volid, const fileid_t *fileid, const sdfs_lock_t *lock);
+int md_lock_wait(const volid_t *volid, const fileid_t *fileid, suseconds_t usec);
+int md_lock_init();
 
 /*quota.c*/
 extern int md_create_quota(quota_t *quota);
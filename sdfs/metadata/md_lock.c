@@ -0,0 +1,870 @@
+#include <sys/types.h>
+#include <string.h>
+#include <errno.h>
+
+#define DBG_SUBSYS S_YFSMDC
+
+#include "ylib.h"
+#include "itree.h"
+#include "timer.h"
+#include "schedule.h"
+#include "redis.h"
+#include "md_proto.h"
+#include "md_lib.h"
+#include "md_db.h"
+#include "dbg.h"
+
+/*
+ * posix byte range locks, kept per file in an interval tree.
+ *
+ * the packed lock record of the file in redis stays the copy shared by all
+ * servers, read and written under klock, in the layout older servers read.
+ * every write moves a small version field next to it first; while the
+ * version is the one the tree was loaded or written at, the cached tree is
+ * used as it is and the record is not read.
+ * requests racing on one file are applied in one round: the first one
+ * commits the queued others with its own and hands out their results.
+ * tasks waiting for a blocked range sleep on the file and are woken by a
+ * local unlock, the timeout of md_lock_wait covers remote unlocks.
+ */
+
+#define MD_LOCK_SHARD 64
+#define MD_LOCK_HASH 64
+
+typedef struct __md_lock_ent {
+        itree_node_t node;
+        struct __md_lock_ent *next;
+        sdfs_lock_t lock;
+} md_lock_ent_t;
+
+typedef struct {
+        struct list_head hook;
+        task_t task;
+        const sdfs_lock_t *lock;
+        md_lock_ent_t *ent;             /* preallocated for a lock, or the split of an unlock */
+        int retval;
+} md_lock_req_t;
+
+typedef struct {
+        struct list_head hook;
+        task_t task;
+        timer_entry_t timer;
+        fileid_t fileid;
+        int queued;
+        int ref;
+} md_lock_waiter_t;
+
+typedef struct {
+        struct list_head hook;
+        fileid_t fileid;
+        volid_t volid;
+        itree_t tree;
+        uint64_t version;               /* lock version the tree matches, 0 if unknown */
+        uint32_t size;                  /* bytes the record takes */
+        int committing;
+        int ref;
+        struct list_head queue;         /* md_lock_req_t for the next round */
+        struct list_head wait;          /* md_lock_waiter_t */
+} md_lock_file_t;
+
+typedef struct {
+        sy_spinlock_t lock;
+        struct list_head hash[MD_LOCK_HASH];
+} md_lock_shard_t;
+
+static md_lock_shard_t *__md_lock__ = NULL;
+static inodeop_t *inodeop = &__inodeop__;
+
+static inline uint64_t __md_lock_end(const sdfs_lock_t *lock)
+{
+        if (lock->length == 0 || lock->start + lock->length < lock->start)
+                return UINT64_MAX;
+
+        return lock->start + lock->length;
+}
+
+static md_lock_shard_t *__md_lock_shard(const fileid_t *fileid)
+{
+        return &__md_lock__[(uint32_t)fileid_hash(fileid) % MD_LOCK_SHARD];
+}
+
+static struct list_head *__md_lock_bucket(md_lock_shard_t *shard, const fileid_t *fileid)
+{
+        return &shard->hash[((uint32_t)fileid_hash(fileid) / MD_LOCK_SHARD) % MD_LOCK_HASH];
+}
+
+/* with the shard locked */
+static md_lock_file_t *__md_lock_file(md_lock_shard_t *shard, const fileid_t *fileid)
+{
+        struct list_head *pos, *bucket = __md_lock_bucket(shard, fileid);
+        md_lock_file_t *file;
+
+        list_for_each(pos, bucket) {
+                file = (void *)pos;
+                if (fileid_cmp(&file->fileid, fileid) == 0)
+                        return file;
+        }
+
+        return NULL;
+}
+
+static int __md_lock_file_get(md_lock_shard_t *shard, const volid_t *volid,
+                              const fileid_t *fileid, md_lock_file_t **_file)
+{
+        int ret;
+        md_lock_file_t *file, *newfile;
+
+        ret = ymalloc((void **)&newfile, sizeof(*newfile));
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = sy_spin_lock(&shard->lock);
+        if (ret)
+                GOTO(err_free, ret);
+
+        file = __md_lock_file(shard, fileid);
+        if (file == NULL) {
+                file = newfile;
+                newfile = NULL;
+
+                memset(file, 0x0, sizeof(*file));
+                file->fileid = *fileid;
+                file->volid = *volid;
+                itree_init(&file->tree);
+                INIT_LIST_HEAD(&file->queue);
+                INIT_LIST_HEAD(&file->wait);
+                list_add(&file->hook, __md_lock_bucket(shard, fileid));
+        }
+
+        file->ref++;
+        *_file = file;
+
+        sy_spin_unlock(&shard->lock);
+
+        if (newfile)
+                yfree((void **)&newfile);
+
+        return 0;
+err_free:
+        yfree((void **)&newfile);
+err_ret:
+        return ret;
+}
+
+static void __md_lock_free(md_lock_ent_t *list)
+{
+        md_lock_ent_t *ent;
+
+        while (list) {
+                ent = list;
+                list = ent->next;
+                yfree((void **)&ent);
+        }
+}
+
+/* with the shard locked, returns the nodes to free once it is unlocked */
+static md_lock_ent_t *__md_lock_clear(itree_t *tree)
+{
+        md_lock_ent_t *ent, *list = NULL;
+
+        while (tree->root) {
+                ent = (void *)tree->root;
+                itree_remove(tree, &ent->node);
+                ent->next = list;
+                list = ent;
+        }
+
+        return list;
+}
+
+static void __md_lock_file_put(md_lock_shard_t *shard, md_lock_file_t *file)
+{
+        md_lock_ent_t *list = NULL;
+
+        sy_spin_lock(&shard->lock);
+
+        YASSERT(file->ref > 0);
+        file->ref--;
+        if (file->ref || file->tree.count) {
+                sy_spin_unlock(&shard->lock);
+                return;
+        }
+
+        YASSERT(list_empty(&file->queue) && list_empty(&file->wait));
+        list_del(&file->hook);
+        list = __md_lock_clear(&file->tree);
+
+        sy_spin_unlock(&shard->lock);
+
+        __md_lock_free(list);
+        yfree((void **)&file);
+}
+
+static int __md_lock_alloc(const sdfs_lock_t *lock, md_lock_ent_t **_ent)
+{
+        int ret;
+        md_lock_ent_t *ent;
+
+        ret = ymalloc((void **)&ent, sizeof(*ent) + lock->opaquelen);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        memcpy(&ent->lock, lock, SDFS_LOCK_SIZE(lock));
+        ent->next = NULL;
+        *_ent = ent;
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+/* 0 if the file has no version yet */
+static int __md_lock_version(const volid_t *volid, const fileid_t *fileid, uint64_t *version)
+{
+        int ret;
+
+        ret = inodeop->getlockver(volid, fileid, version);
+        if (ret) {
+                if (ret == ENOENT) {
+                        *version = 0;
+                } else
+                        GOTO(err_ret, ret);
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static int __md_lock_build(const char *pos, size_t left, itree_t *tree, uint32_t *_size)
+{
+        int ret;
+        const sdfs_lock_t *lock;
+        md_lock_ent_t *ent;
+
+        itree_init(tree);
+        *_size = 0;
+        while (left) {
+                lock = (void *)pos;
+                YASSERT(left >= SDFS_LOCK_SIZE(lock));
+
+                ret = __md_lock_alloc(lock, &ent);
+                if (ret)
+                        GOTO(err_free, ret);
+
+                itree_insert(tree, &ent->node, lock->start, __md_lock_end(lock));
+                *_size += SDFS_LOCK_SIZE(lock);
+
+                left -= SDFS_LOCK_SIZE(lock);
+                pos += SDFS_LOCK_SIZE(lock);
+        }
+
+        return 0;
+err_free:
+        __md_lock_free(__md_lock_clear(tree));
+        return ret;
+}
+
+typedef struct {
+        const sdfs_lock_t *lock;
+        md_lock_ent_t *found;
+        char *buf;
+} md_lock_ctx_t;
+
+static int __md_lock_conflict(itree_node_t *node, void *arg)
+{
+        md_lock_ctx_t *ctx = arg;
+        md_lock_ent_t *ent = (void *)node;
+
+        if (ctx->lock->type != SDFS_WRLOCK && ent->lock.type != SDFS_WRLOCK)
+                return 0;
+
+        DBUG("type %d,%d, sid %ju,%ju, start %ju,%ju, length %ju,%ju\n",
+             ctx->lock->type, ent->lock.type, ctx->lock->sid, ent->lock.sid,
+             ctx->lock->start, ent->lock.start, ctx->lock->length, ent->lock.length);
+
+        ctx->found = ent;
+        return 1;
+}
+
+static int __md_lock_owned(itree_node_t *node, void *arg)
+{
+        md_lock_ctx_t *ctx = arg;
+        md_lock_ent_t *ent = (void *)node;
+
+        if (sdfs_lock_equal(NULL, ctx->lock, NULL, &ent->lock)) {
+                ent->next = ctx->found;
+                ctx->found = ent;
+        }
+
+        return 0;
+}
+
+static int __md_lock_pack(itree_node_t *node, void *arg)
+{
+        md_lock_ctx_t *ctx = arg;
+        const sdfs_lock_t *lock = &((md_lock_ent_t *)node)->lock;
+
+        memcpy(ctx->buf, lock, SDFS_LOCK_SIZE(lock));
+        ctx->buf += SDFS_LOCK_SIZE(lock);
+
+        return 0;
+}
+
+/*
+ * with the shard locked, the owner's locks lose the unlocked range, a lock
+ * that covers it with bytes left on both sides is split in two.  removed
+ * nodes are chained to *_list
+ */
+static int __md_lock_unlock(md_lock_file_t *file, md_lock_req_t *req, md_lock_ent_t **_list)
+{
+        int ret, split = 0;
+        const sdfs_lock_t *lock = req->lock;
+        uint64_t start = lock->start, end = __md_lock_end(lock), _end;
+        md_lock_ent_t *ent, *right;
+        sdfs_lock_t *held;
+        md_lock_ctx_t ctx;
+
+        ctx.lock = lock;
+        ctx.found = NULL;
+
+        itree_overlap(&file->tree, start, end, __md_lock_owned, &ctx);
+        if (ctx.found == NULL) {
+                ret = ENOENT;
+                goto err_ret;
+        }
+
+        for (ent = ctx.found; ent; ent = ent->next) {
+                if (ent->lock.start < start && __md_lock_end(&ent->lock) > end)
+                        split++;
+        }
+
+        /* checked before anything moves, the request fails as a whole */
+        if (split && file->size + split * SDFS_LOCK_SIZE(lock) > MAX_BUF_LEN) {
+                ret = EFBIG;
+                goto err_ret;
+        }
+
+        while (ctx.found) {
+                ent = ctx.found;
+                ctx.found = ent->next;
+                ent->next = NULL;
+                held = &ent->lock;
+                _end = __md_lock_end(held);
+
+                itree_remove(&file->tree, &ent->node);
+
+                if (held->start >= start && _end <= end) {
+                        file->size -= SDFS_LOCK_SIZE(held);
+                        ent->next = *_list;
+                        *_list = ent;
+                        continue;
+                }
+
+                if (held->start < start && _end > end) {
+                        right = req->ent;
+                        req->ent = NULL;
+                        if (right == NULL) {
+                                /* only an owner holding overlapped read locks gets here twice */
+                                ret = __md_lock_alloc(held, &right);
+                                if (ret)
+                                        UNIMPLEMENTED(__DUMP__);
+                        }
+
+                        YASSERT(right->lock.opaquelen == held->opaquelen);
+                        memcpy(&right->lock, held, SDFS_LOCK_SIZE(held));
+                        right->lock.start = end;
+                        right->lock.length = held->length ? _end - end : 0;
+                        itree_insert(&file->tree, &right->node, end, _end);
+                        file->size += SDFS_LOCK_SIZE(held);
+                }
+
+                if (held->start < start) {
+                        held->length = start - held->start;
+                        itree_insert(&file->tree, &ent->node, held->start, start);
+                } else {
+                        held->length = held->length ? _end - end : 0;
+                        held->start = end;
+                        itree_insert(&file->tree, &ent->node, end, _end);
+                }
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+/* with the shard locked, removed nodes are chained to *_list */
+static int __md_lock_apply(md_lock_file_t *file, md_lock_req_t *req, md_lock_ent_t **_list)
+{
+        int ret;
+        const sdfs_lock_t *lock = req->lock;
+        md_lock_ent_t *ent;
+        md_lock_ctx_t ctx;
+
+        ctx.lock = lock;
+        ctx.found = NULL;
+
+        if (lock->type == SDFS_UNLOCK) {
+                ret = __md_lock_unlock(file, req, _list);
+                if (ret)
+                        goto err_ret;
+        } else {
+                if (itree_overlap(&file->tree, lock->start, __md_lock_end(lock),
+                                  __md_lock_conflict, &ctx)) {
+                        ret = EWOULDBLOCK;
+                        goto err_ret;
+                }
+
+                if (file->size + SDFS_LOCK_SIZE(lock) > MAX_BUF_LEN) {
+                        ret = EFBIG;
+                        goto err_ret;
+                }
+
+                ent = req->ent;
+                req->ent = NULL;
+                itree_insert(&file->tree, &ent->node, lock->start, __md_lock_end(lock));
+                file->size += SDFS_LOCK_SIZE(lock);
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static void __md_lock_wakeup(md_lock_shard_t *shard, md_lock_file_t *file)
+{
+        struct list_head list, *pos, *n;
+        md_lock_waiter_t *waiter;
+
+        INIT_LIST_HEAD(&list);
+
+        sy_spin_lock(&shard->lock);
+
+        list_for_each_safe(pos, n, &file->wait) {
+                waiter = (void *)pos;
+                list_del(&waiter->hook);
+                list_add_tail(&waiter->hook, &list);
+                waiter->queued = 0;
+        }
+
+        sy_spin_unlock(&shard->lock);
+
+        list_for_each_safe(pos, n, &list) {
+                waiter = (void *)pos;
+                schedule_resume(&waiter->task, 0, NULL);
+        }
+}
+
+/*
+ * one round: check the version, load the record only if the tree is behind
+ * it, apply the queued requests to the tree and write the record back once
+ */
+static void __md_lock_commit(md_lock_shard_t *shard, md_lock_file_t *file,
+                             struct list_head *batch)
+{
+        int ret, build, changed = 0, unlocked = 0;
+        char buf[MAX_BUF_LEN];
+        size_t size = MAX_BUF_LEN;
+        uint64_t version;
+        uint32_t treesize = 0;
+        struct list_head *_req;
+        md_lock_req_t *req;
+        md_lock_ent_t *list = NULL;
+        md_lock_ctx_t ctx;
+        itree_t tree;
+
+        ret = klock(&file->volid, &file->fileid, 10, 1);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = __md_lock_version(&file->volid, &file->fileid, &version);
+        if (ret)
+                GOTO(err_lock, ret);
+
+        list_for_each(_req, batch) {
+                req = (void *)_req;
+                if (req->ent == NULL) {
+                        ret = __md_lock_alloc(req->lock, &req->ent);
+                        if (ret)
+                                GOTO(err_lock, ret);
+                }
+        }
+
+        build = (version == 0 || version != file->version);
+        if (build) {
+                ret = inodeop->getlock(&file->volid, &file->fileid, buf, &size);
+                if (ret) {
+                        if (ret == ENOENT) {
+                                size = 0;
+                        } else
+                                GOTO(err_lock, ret);
+                }
+
+                ret = __md_lock_build(buf, size, &tree, &treesize);
+                if (ret)
+                        GOTO(err_lock, ret);
+        }
+
+        sy_spin_lock(&shard->lock);
+
+        if (build) {
+                list = __md_lock_clear(&file->tree);
+                file->tree = tree;
+                file->size = treesize;
+        }
+
+        list_for_each(_req, batch) {
+                req = (void *)_req;
+                req->retval = __md_lock_apply(file, req, &list);
+                if (req->retval == 0) {
+                        changed = 1;
+                        if (req->lock->type == SDFS_UNLOCK)
+                                unlocked = 1;
+                }
+        }
+
+        if (changed) {
+                ctx.buf = buf;
+                itree_iterator(&file->tree, __md_lock_pack, &ctx);
+                size = ctx.buf - buf;
+                YASSERT(size == file->size);
+        }
+
+        file->version = version;
+
+        sy_spin_unlock(&shard->lock);
+
+        __md_lock_free(list);
+
+        if (changed) {
+                /*
+                 * the version moves first, a record left unwritten by a
+                 * failure then only costs the others a reload
+                 */
+                version++;
+                ret = inodeop->setlockver(&file->volid, &file->fileid, version);
+                if (ret == 0)
+                        ret = inodeop->setlock(&file->volid, &file->fileid, buf, size, 0);
+                if (ret) {
+                        /* the tree is ahead of the record now, load it again next time */
+                        sy_spin_lock(&shard->lock);
+                        file->version = 0;
+                        sy_spin_unlock(&shard->lock);
+                        GOTO(err_lock, ret);
+                }
+
+                sy_spin_lock(&shard->lock);
+                file->version = version;
+                sy_spin_unlock(&shard->lock);
+        }
+
+        kunlock(&file->volid, &file->fileid);
+
+        if (unlocked)
+                __md_lock_wakeup(shard, file);
+
+        return;
+err_lock:
+        kunlock(&file->volid, &file->fileid);
+err_ret:
+        list_for_each(_req, batch) {
+                req = (void *)_req;
+                req->retval = ret;
+        }
+}
+
+static int __md_setlock(const volid_t *volid, const fileid_t *fileid, const sdfs_lock_t *lock)
+{
+        int ret, leader;
+        md_lock_shard_t *shard = __md_lock_shard(fileid);
+        md_lock_file_t *file;
+        md_lock_req_t req, *pos;
+        struct list_head batch, *_req, *n;
+
+        ret = __md_lock_file_get(shard, volid, fileid, &file);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        req.lock = lock;
+        req.ent = NULL;
+        req.retval = 0;
+
+        while (1) {
+                ret = sy_spin_lock(&shard->lock);
+                if (ret)
+                        GOTO(err_put, ret);
+
+                leader = !file->committing;
+                if (leader || schedule_running())
+                        break;
+
+                /* a thread can not be handed its result, wait for the round */
+                sy_spin_unlock(&shard->lock);
+                usleep(1000);
+        }
+
+        if (!leader) {
+                req.task = schedule_task_get();
+                list_add_tail(&req.hook, &file->queue);
+                sy_spin_unlock(&shard->lock);
+
+                ret = schedule_yield("md_lock", NULL, NULL);
+                if (ret)
+                        GOTO(err_put, ret);
+
+                goto out;
+        }
+
+        file->committing = 1;
+        INIT_LIST_HEAD(&batch);
+        list_add_tail(&req.hook, &batch);
+
+        sy_spin_unlock(&shard->lock);
+
+        while (1) {
+                __md_lock_commit(shard, file, &batch);
+
+                sy_spin_lock(&shard->lock);
+
+                list_for_each_safe(_req, n, &batch) {
+                        pos = (void *)_req;
+                        list_del(&pos->hook);
+                        if (pos != &req) {
+                                if (pos->ent)
+                                        yfree((void **)&pos->ent);
+                                schedule_resume(&pos->task, pos->retval, NULL);
+                        }
+                }
+
+                if (list_empty(&file->queue)) {
+                        file->committing = 0;
+                        sy_spin_unlock(&shard->lock);
+                        break;
+                }
+
+                list_splice_init(&file->queue, &batch);
+                sy_spin_unlock(&shard->lock);
+        }
+
+        if (req.ent)
+                yfree((void **)&req.ent);
+
+        ret = req.retval;
+        if (ret)
+                goto err_put;
+
+out:
+        __md_lock_file_put(shard, file);
+
+        return 0;
+err_put:
+        __md_lock_file_put(shard, file);
+err_ret:
+        return ret;
+}
+
+int md_setlock(const volid_t *volid, const fileid_t *fileid, const sdfs_lock_t *lock)
+{
+        return __md_setlock(volid, fileid, lock);
+}
+
+static const sdfs_lock_t *__md_lock_scan(const sdfs_lock_t *lock, const char *pos, size_t left)
+{
+        const sdfs_lock_t *tmp;
+
+        while (left) {
+                tmp = (void *)pos;
+                YASSERT(left >= SDFS_LOCK_SIZE(tmp));
+
+                if (__md_lock_end(lock) > tmp->start && __md_lock_end(tmp) > lock->start
+                    && (lock->type == SDFS_WRLOCK || tmp->type == SDFS_WRLOCK))
+                        return tmp;
+
+                left -= SDFS_LOCK_SIZE(tmp);
+                pos += SDFS_LOCK_SIZE(tmp);
+        }
+
+        return NULL;
+}
+
+/*
+ * no klock: the cached tree answers when it is at the current version and
+ * no round is running, else a single read of the record is scanned
+ */
+int md_getlock(const volid_t *volid, const fileid_t *fileid, sdfs_lock_t *lock)
+{
+        int ret;
+        char buf[MAX_BUF_LEN];
+        size_t size = MAX_BUF_LEN;
+        uint64_t version;
+        const sdfs_lock_t *found;
+        md_lock_shard_t *shard = __md_lock_shard(fileid);
+        md_lock_file_t *file;
+        md_lock_ctx_t ctx;
+
+        ret = __md_lock_version(volid, fileid, &version);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = sy_spin_lock(&shard->lock);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        file = __md_lock_file(shard, fileid);
+        if (version && file && file->version == version && !file->committing) {
+                ctx.lock = lock;
+                ctx.found = NULL;
+                itree_overlap(&file->tree, lock->start, __md_lock_end(lock),
+                              __md_lock_conflict, &ctx);
+                if (ctx.found == NULL) {
+                        sy_spin_unlock(&shard->lock);
+                        ret = ENOENT;
+                        goto err_ret;
+                }
+
+                found = &ctx.found->lock;
+                memcpy(lock, found, SDFS_LOCK_SIZE(found));
+                sy_spin_unlock(&shard->lock);
+
+                return 0;
+        }
+
+        sy_spin_unlock(&shard->lock);
+
+        ret = inodeop->getlock(volid, fileid, buf, &size);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        found = __md_lock_scan(lock, buf, size);
+        if (found == NULL) {
+                ret = ENOENT;
+                goto err_ret;
+        }
+
+        memcpy(lock, found, SDFS_LOCK_SIZE(found));
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static void __md_lock_wait_timeout(void *arg)
+{
+        int resume = 0, free;
+        md_lock_waiter_t *waiter = arg;
+        md_lock_shard_t *shard = __md_lock_shard(&waiter->fileid);
+
+        sy_spin_lock(&shard->lock);
+
+        if (waiter->queued) {
+                list_del(&waiter->hook);
+                waiter->queued = 0;
+                resume = 1;
+        }
+
+        waiter->ref--;
+        free = (waiter->ref == 0);
+
+        sy_spin_unlock(&shard->lock);
+
+        if (resume)
+                schedule_resume(&waiter->task, ETIMEDOUT, NULL);
+
+        if (free)
+                yfree((void **)&waiter);
+}
+
+/*
+ * wait until a lock of the file is released here, or usec passed.
+ * the caller retries its lock either way
+ */
+int md_lock_wait(const volid_t *volid, const fileid_t *fileid, suseconds_t usec)
+{
+        int ret, free;
+        md_lock_shard_t *shard = __md_lock_shard(fileid);
+        md_lock_file_t *file;
+        md_lock_waiter_t *waiter;
+
+        if (!schedule_running()) {
+                usleep(usec);
+                return 0;
+        }
+
+        ret = __md_lock_file_get(shard, volid, fileid, &file);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = ymalloc((void **)&waiter, sizeof(*waiter));
+        if (ret)
+                GOTO(err_put, ret);
+
+        waiter->task = schedule_task_get();
+        waiter->fileid = *fileid;
+        waiter->queued = 1;
+        waiter->ref = 2;
+
+        sy_spin_lock(&shard->lock);
+        list_add_tail(&waiter->hook, &file->wait);
+        sy_spin_unlock(&shard->lock);
+
+        ret = timer_add("md_lock_wait", &waiter->timer, waiter, __md_lock_wait_timeout, usec);
+        if (ret)
+                UNIMPLEMENTED(__DUMP__);
+
+        ret = schedule_yield("md_lock_wait", NULL, waiter);
+        if (ret && ret != ETIMEDOUT) {
+                UNIMPLEMENTED(__DUMP__);
+        }
+
+        ret = timer_del(&waiter->timer);
+
+        sy_spin_lock(&shard->lock);
+
+        if (ret == 0)
+                waiter->ref--;
+
+        waiter->ref--;
+        free = (waiter->ref == 0);
+
+        sy_spin_unlock(&shard->lock);
+
+        if (free)
+                yfree((void **)&waiter);
+
+        __md_lock_file_put(shard, file);
+
+        return 0;
+err_put:
+        __md_lock_file_put(shard, file);
+err_ret:
+        return ret;
+}
+
+int md_lock_init()
+{
+        int ret, i, j;
+        md_lock_shard_t *array;
+
+        ret = ymalloc((void **)&array, sizeof(*array) * MD_LOCK_SHARD);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        for (i = 0; i < MD_LOCK_SHARD; i++) {
+                ret = sy_spin_init(&array[i].lock);
+                if (ret)
+                        GOTO(err_free, ret);
+
+                for (j = 0; j < MD_LOCK_HASH; j++) {
+                        INIT_LIST_HEAD(&array[i].hash[j]);
+                }
+        }
+
+        __md_lock__ = array;
+
+        return 0;
+err_free:
+        yfree((void **)&array);
+err_ret:
+        return ret;
+}
@@ -14,6 +14,7 @@
 #include "redis.h"
 #include "schedule.h"
 #include "attr_queue.h"
+#include "lease.h"
 #include "dbg.h"
 
 static dirop_t *dirop = &__dirop__;
@@ -63,6 +64,12 @@ int md_getattr(const volid_t *volid, const fileid_t *fileid, md_proto_t *md)
         }
 #endif
 
+        if (!ng.daemon && gloconf.write_lease) {
+                ret = lease_update(fileid, md);
+                if (ret)
+                        GOTO(err_ret, ret);
+        }
+
 #if 0
         if (mdsconf.size_on_md && S_ISREG(md->at_mode)) {
                 ret = __md_getsize(md);
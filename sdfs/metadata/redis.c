@@ -288,6 +288,228 @@ int hlen(const volid_t *volid, const fileid_t *fileid, uint64_t *count)
         return ret;
 }
 
+static int __hget_count__(const volid_t *volid, const fileid_t *fileid, const char *name,
+                          char *value, size_t *size, const char *counter, int64_t *count)
+{
+        int ret, retry = 0;
+        char key[MAX_PATH_LEN];
+        redis_handler_t handler;
+
+        id2key(ftype(fileid), fileid, key);
+
+retry:
+        ret = redis_conn_get(volid, fileid->sharding, __redis_workerid__, &handler);
+        if(ret)
+                GOTO(err_ret, ret);
+
+        ret = redis_hget_count(handler.conn, key, name, value, size, counter, count);
+        if(ret) {
+                if (ret == ECONNRESET) {
+                        redis_conn_close(&handler);
+                        redis_conn_release(&handler);
+                        USLEEP_RETRY(err_ret, ret, retry, retry, 100, (100 * 1000));
+                }
+
+                GOTO(err_release, ret);
+        }
+
+        redis_conn_release(&handler);
+
+        return 0;
+err_release:
+        redis_conn_release(&handler);
+err_ret:
+        return ret;
+}
+
+static int __hget_count(va_list ap)
+{
+        const volid_t *volid = va_arg(ap, const volid_t *);
+        const fileid_t *fileid = va_arg(ap, const fileid_t *);
+        const char *name = va_arg(ap, const char *);
+        char *value = va_arg(ap, char *);
+        size_t *size = va_arg(ap, size_t *);
+        const char *counter = va_arg(ap, const char *);
+        int64_t *count = va_arg(ap, int64_t *);
+
+        va_end(ap);
+
+        return __hget_count__(volid, fileid, name, value, size, counter, count);
+}
+
+/*
+ * fetch a field together with the counter of a counted hash in one round trip,
+ * *count is -1 if the hash has no counter yet
+ */
+int hget_count(const volid_t *volid, const fileid_t *fileid, const char *name,
+               char *value, size_t *size, const char *counter, int64_t *count)
+{
+        int ret;
+
+        volid_t _volid = {fileid->volid, 0};
+        if (unlikely(volid == NULL)) {
+                volid = &_volid;
+        }
+
+        ANALYSIS_BEGIN(0);
+
+        if (__use_co__) {
+                ret = co_hget_count(volid, fileid, name, value, size, counter, count);
+        } else if (__use_pipeline__) {
+                ret = pipeline_hget_count(volid, fileid, name, value, size, counter, count);
+        } else {
+                ret = __redis_request(fileid_hash(fileid), "hget_count", __hget_count,
+                                      volid, fileid, name, value, size, counter, count);
+        }
+
+        ANALYSIS_QUEUE(0, IO_WARN, NULL);
+
+        return ret;
+}
+
+static int __hset_count__(const volid_t *volid, const fileid_t *fileid, const char *counter,
+                          const char *name, const void *value, uint32_t size,
+                          int flag, uint64_t max)
+{
+        int ret, retry = 0;
+        char key[MAX_PATH_LEN];
+        redis_handler_t handler;
+
+        id2key(ftype(fileid), fileid, key);
+
+retry:
+        ret = redis_conn_get(volid, fileid->sharding, __redis_workerid__, &handler);
+        if(ret)
+                GOTO(err_ret, ret);
+
+        ret = redis_hset_count(handler.conn, key, counter, name, value, size, flag, max);
+        if(ret) {
+                if (ret == ECONNRESET) {
+                        redis_conn_close(&handler);
+                        redis_conn_release(&handler);
+                        USLEEP_RETRY(err_ret, ret, retry, retry, 100, (100 * 1000));
+                }
+
+                GOTO(err_release, ret);
+        }
+
+        redis_conn_release(&handler);
+
+        return 0;
+err_release:
+        redis_conn_release(&handler);
+err_ret:
+        return ret;
+}
+
+static int __hset_count(va_list ap)
+{
+        const volid_t *volid = va_arg(ap, const volid_t *);
+        const fileid_t *fileid = va_arg(ap, const fileid_t *);
+        const char *counter = va_arg(ap, const char *);
+        const char *name = va_arg(ap, const char *);
+        const char *value = va_arg(ap, const char *);
+        uint32_t size = va_arg(ap, uint32_t);
+        int flag = va_arg(ap, int);
+        uint64_t max = va_arg(ap, uint64_t);
+
+        va_end(ap);
+
+        return __hset_count__(volid, fileid, counter, name, value, size, flag, max);
+}
+
+/*
+ * set a field and move the counter with it, EPERM if the counter is over max
+ */
+int hset_count(const volid_t *volid, const fileid_t *fileid, const char *counter,
+               const char *name, const void *value, uint32_t size, int flag, uint64_t max)
+{
+        int ret;
+
+        volid_t _volid = {fileid->volid, 0};
+        if (unlikely(volid == NULL)) {
+                volid = &_volid;
+        }
+
+        ANALYSIS_BEGIN(0);
+
+        if (__use_co__) {
+                ret = co_hset_count(volid, fileid, counter, name, value, size, flag, max);
+        } else if (__use_pipeline__) {
+                ret = pipeline_hset_count(volid, fileid, counter, name, value, size, flag, max);
+        } else {
+                ret = __redis_request(fileid_hash(fileid), "hset_count", __hset_count,
+                                      volid, fileid, counter, name, value, size, flag, max);
+        }
+
+        ANALYSIS_QUEUE(0, IO_WARN, NULL);
+
+        return ret;
+}
+
+static int __hdel_count__(const volid_t *volid, const fileid_t *fileid,
+                          const char *counter, const char *name)
+{
+        int ret, retry = 0;
+        char key[MAX_PATH_LEN];
+        redis_handler_t handler;
+
+        id2key(ftype(fileid), fileid, key);
+retry:
+        ret = redis_conn_get(volid, fileid->sharding, __redis_workerid__, &handler);
+        if(ret)
+                GOTO(err_ret, ret);
+
+        ret = redis_hdel_count(handler.conn, key, counter, name);
+        if(ret) {
+                if (ret == ECONNRESET) {
+                        redis_conn_close(&handler);
+                        redis_conn_release(&handler);
+                        USLEEP_RETRY(err_ret, ret, retry, retry, 100, (100 * 1000));
+                }
+
+                GOTO(err_release, ret);
+        }
+
+        redis_conn_release(&handler);
+
+        return 0;
+err_release:
+        redis_conn_release(&handler);
+err_ret:
+        return ret;
+}
+
+static int __hdel_count(va_list ap)
+{
+        const volid_t *volid = va_arg(ap, const volid_t *);
+        const fileid_t *fileid = va_arg(ap, const fileid_t *);
+        const char *counter = va_arg(ap, const char *);
+        const char *name = va_arg(ap, const char *);
+
+        va_end(ap);
+
+        return __hdel_count__(volid, fileid, counter, name);
+}
+
+int hdel_count(const volid_t *volid, const fileid_t *fileid, const char *counter,
+               const char *name)
+{
+        volid_t _volid = {fileid->volid, 0};
+        if (unlikely(volid == NULL)) {
+                volid = &_volid;
+        }
+
+        if (__use_co__) {
+                return co_hdel_count(volid, fileid, counter, name);
+        } else if (__use_pipeline__) {
+                return pipeline_hdel_count(volid, fileid, counter, name);
+        } else {
+                return __redis_request(fileid_hash(fileid), "hdel_count", __hdel_count,
+                                       volid, fileid, counter, name);
+        }
+}
+
 redisReply *__hscan__(const volid_t *volid, const fileid_t *fileid,
                       const char *match, uint64_t cursor, uint64_t count)
 {
@@ -779,6 +1001,84 @@ int kunlock(const volid_t *volid, const fileid_t *fileid)
 #endif
 }
 
+static int __klease__(const volid_t *volid, const fileid_t *fileid, int op,
+                      const char *owner, int ttl)
+{
+        int ret, retry = 0;
+        redis_handler_t handler;
+        char key[MAX_PATH_LEN], revoke[MAX_PATH_LEN];
+
+        snprintf(key, MAX_NAME_LEN, "lease:"CHKID_FORMAT, CHKID_ARG(fileid));
+        snprintf(revoke, MAX_NAME_LEN, "lease:"CHKID_FORMAT":revoke", CHKID_ARG(fileid));
+
+retry:
+        ret = redis_conn_get(volid, fileid->sharding, __redis_workerid__, &handler);
+        if(ret)
+                GOTO(err_ret, ret);
+
+        ret = redis_lease(handler.conn, key, revoke, op, owner, ttl);
+        if(ret) {
+                if (ret == ECONNRESET) {
+                        redis_conn_close(&handler);
+                        redis_conn_release(&handler);
+                        USLEEP_RETRY(err_ret, ret, retry, retry, 100, (100 * 1000));
+                }
+
+                GOTO(err_release, ret);
+        }
+
+        redis_conn_release(&handler);
+
+        return 0;
+err_release:
+        redis_conn_release(&handler);
+err_ret:
+        return ret;
+}
+
+static int __klease(va_list ap)
+{
+        const volid_t *volid = va_arg(ap, const volid_t *);
+        const fileid_t *fileid = va_arg(ap, const fileid_t *);
+        int op = va_arg(ap, int);
+        const char *owner = va_arg(ap, const char *);
+        int ttl = va_arg(ap, int);
+
+        va_end(ap);
+
+        return __klease__(volid, fileid, op, owner, ttl);
+}
+
+/*
+ * grant/renew or release the write lease of a file for owner,
+ * EAGAIN if it is held by another owner, ESTALE if ours was revoked
+ */
+int klease(const volid_t *volid, const fileid_t *fileid, int op,
+           const char *owner, int ttl)
+{
+        int ret;
+
+        volid_t _volid = {fileid->volid, 0};
+        if (unlikely(volid == NULL)) {
+                volid = &_volid;
+        }
+
+        ANALYSIS_BEGIN(0);
+
+        if (__use_co__) {
+                ret = co_klease(volid, fileid, op, owner, ttl);
+        } else if (__use_pipeline__) {
+                ret = pipeline_klease(volid, fileid, op, owner, ttl);
+        } else {
+                ret = __redis_request(fileid_hash(fileid), "klease", __klease,
+                                      volid, fileid, op, owner, ttl);
+        }
+
+        ANALYSIS_QUEUE(0, IO_WARN, NULL);
+
+        return ret;
+}
+
 static int __hiter__(const volid_t *volid, const fileid_t *fileid,
                      const char *match, func2_t func, void *ctx)
 {
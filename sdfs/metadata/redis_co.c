@@ -1,644 +1,426 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <poll.h>
 #include <string.h>
+#include <unistd.h>
 #include <stdarg.h>
-#include <sys/eventfd.h>
 #include <errno.h>
 
 #define DBG_SUBSYS S_LIBYLIB
 
 #include "ylib.h"
-#include "plock.h"
 #include "net_global.h"
 #include "redis.h"
 #include "redis_util.h"
 #include "redis_conn.h"
 #include "schedule.h"
+#include "corenet.h"
 #include "variable.h"
 #include "dbg.h"
 
-#if ENABLE_LOCK_FREE_LIST
-#include <ll.h>
-#endif
+/*
+ * every core owns its redis connections, one per (volume, sharding).
+ * a request is appended to the connection's output buffer and the task
+ * yields; the core poller flushes all commands queued in one loop with a
+ * single write.  replies are read by the poller on a polling core, else the
+ * socket sits in the core's epoll and its callback resumes the tasks in
+ * reply order, the core never blocks on redis.
+ */
 
-typedef struct redis_co_ctx {
+typedef struct {
         struct list_head hook;
-        int retval;
-        fileid_t fileid;
-        volid_t volid;
-        const char *format;
-        va_list ap;
-        redisReply *reply;
         task_t task;
-        void *co;
-#if ENABLE_LOCK_FREE_LIST
-        uint32_t magic;
-        LL_ENTRY(redis_co_ctx)entry;
-#endif
+        redisReply *reply;
 } redis_co_ctx_t;
 
-#if ENABLE_LOCK_FREE_LIST
-LL_HEAD(co_list, redis_co_ctx);
-LL_GENERATE(co_list, redis_co_ctx, entry);
-#endif
-
-typedef struct {
-        struct list_head list;
-        fileid_t fileid;
-        volid_t volid;
-        int finished;
-} arg2_t;
-
 typedef struct {
         struct list_head hook;
-        redis_handler_t *handler_array;
-        arg2_t *array;
+        struct list_head wait;
+        volid_t volid;
         int count;
-        task_t task;
-} arg1_t;
+        int dirty;
+        int broken;                     /* set by the epoll callbacks, reset by the poller */
+        time_t ltime;                   /* last reply, or the first request waiting for one */
+        sockid_t sockid;                /* in the core's epoll, sd -1 if not */
+        redis_handler_t handler;
+} co_conn_t;
 
 typedef struct {
-        plock_t plock;
-        int eventfd;
-#if ENABLE_LOCK_FREE_LIST
-        struct co_list list;
-#else
-        sy_spinlock_t lock;
-        struct list_head queue2;
-        struct list_head res1;
-        struct list_head res2;
-#endif
-        int running;
         int polling;
-        struct list_head queue1;
+        struct list_head conn_list;
 } co_t;
 
 __thread int __use_co__ = 0;
 
-static int __redis_co_run(void *ctx, struct list_head *list);
-static void __redis_co_recv(co_t *co, arg2_t *array,
-                            redis_handler_t *handler_array, int count);
-
-static void *__redis_co_worker(void *arg)
+static void __redis_co_reset(co_conn_t *conn, int retval)
 {
-        co_t *co = arg;
-        struct list_head list, *pos, *n;
-        arg1_t *arg1 = NULL;
-
-        DINFO("co worker start %u\n", co->running);
-
-        __use_co__ = 1;        
-        while (co->running) {
-                eventfd_poll(co->eventfd, 1, NULL);
-
-                if (co->running == 0) {
-                        DINFO("destroyed\n");
-                        break;
-                }
-
-#if ENABLE_LOCK_FREE_LIST
-                INIT_LIST_HEAD(&list);
-
-                redis_co_ctx_t *ctx = NULL;
+        redis_co_ctx_t *ctx;
 
-                while (1) {
-                        ctx = LL_FIRST(co_list, &co->list);
-                        if (ctx == NULL)
-                                break;
-                        
-                        //assert(o->satelite == i);
-                        LL_UNLINK(co_list, &co->list, ctx);
-                        DBUG("------------release 0x%o-------------\n", ctx->magic);
-                        list_add_tail(&ctx->hook, &list);
-                }
+        DWARN("redis (%d, %d) reset, ret %d\n", conn->handler.sharding,
+              conn->handler.idx, retval);
 
-#else
-                int ret;
-                if (list_empty(&co->queue2)) {
-                        continue;
-                }
+        list_del(&conn->hook);
 
-                INIT_LIST_HEAD(&list);
+        if (conn->sockid.sd != -1) {
+                corenet_tcp_close(&conn->sockid);
+        }
 
-                ret = sy_spin_lock(&co->lock);
-                if (ret)
-                        UNIMPLEMENTED(__DUMP__);
+        while (!list_empty(&conn->wait)) {
+                ctx = (void *)conn->wait.next;
+                list_del(&ctx->hook);
+                ctx->reply = NULL;
+                schedule_resume(&ctx->task, retval, NULL);
+        }
 
-                list_splice_init(&co->queue2, &list);
+        redis_conn_close(&conn->handler);
+        redis_conn_release(&conn->handler);
+        yfree((void **)&conn);
+}
 
-                sy_spin_unlock(&co->lock);
-#endif
+static int __redis_co_recv(co_conn_t *conn, int *resume);
 
-                list_for_each_safe(pos, n, &list) {
-                        arg1 = (void *)pos;
-                        __redis_co_recv(co, arg1->array, arg1->handler_array, arg1->count);
-                }
+/*
+ * runs in a corenet task that holds the node, so a failed connection is
+ * only marked here and reset by the poller
+ */
+static void __redis_co_event(void *arg)
+{
+        int ret, resume = 0;
+        co_conn_t *conn = arg;
 
-                if (co->polling) {
-                        ret = sy_spin_lock(&co->lock);
-                        if (ret)
-                                UNIMPLEMENTED(__DUMP__);
-                        
-                        list_add_tail(&arg1->hook, &co->res2);
+        if (conn->broken)
+                return;
 
-                        sy_spin_unlock(&co->lock);
-                } else {
-                        schedule_resume(&arg1->task, 0, NULL);
-                }
+        /* every reply is taken, only a close or an error is left to read */
+        if (list_empty(&conn->wait)) {
+                conn->broken = ECONNRESET;
+                return;
         }
 
-        pthread_exit(NULL);
+        ret = __redis_co_recv(conn, &resume);
+        if (unlikely(ret)) {
+                conn->broken = ret;
+        }
 }
 
-int redis_co_init(int polling)
+/*
+ * corenet gets a dup of the socket: it may close its fd at any time (hup,
+ * or later than our reset), hiredis keeps owning the original.  a socket
+ * dropped by corenet alone is found by the reply timeout
+ */
+static int __redis_co_register(co_conn_t *conn)
 {
-        int ret;
-        co_t *co;
+        int ret, sd;
 
-        DINFO("redis co start, redis_thread %s, polling %s\n",
-              mdsconf.redis_thread ? "on" : "off",
-              polling ? "on" : "off");
-        
-        ret = ymalloc((void **)&co, sizeof(*co));
-        if (ret)
-                GOTO(err_ret, ret);
-
-        memset(co, 0x0, sizeof(*co));
-
-        INIT_LIST_HEAD(&co->queue1);
-        co->running = 1;
-        co->polling = polling;
-
-        ret = plock_init(&co->plock, "redis_co");
-        if (ret)
+        sd = dup(conn->handler.conn->ctx->fd);
+        if (sd < 0) {
+                ret = errno;
                 GOTO(err_ret, ret);
-
-        if (mdsconf.redis_thread) {
-#if ENABLE_LOCK_FREE_LIST
-                LL_INIT(&(co->list));
-#else
-                INIT_LIST_HEAD(&co->queue2);
-                INIT_LIST_HEAD(&co->res1);
-                INIT_LIST_HEAD(&co->res2);
-
-                ret = sy_spin_init(&co->lock);
-                if (ret)
-                        UNIMPLEMENTED(__WARN__);
-#endif
-                int fd = eventfd(0, EFD_CLOEXEC);
-                if (fd < 0) {
-                        ret = errno;
-                        GOTO(err_ret, ret);
-                }
-
-                co->eventfd = fd;
-        
-                ret = sy_thread_create2(__redis_co_worker, co, "__core_worker");
-                if (ret)
-                        GOTO(err_ret, ret);
         }
 
-        ret = redis_vol_private_init();
-        if (ret)
-                GOTO(err_ret, ret);
+        conn->sockid.sd = sd;
+        conn->sockid.seq = _random();
+        conn->sockid.type = SOCKID_CORENET;
+        conn->sockid.addr = 0;
+        ret = corenet_tcp_add(NULL, &conn->sockid, conn, NULL, NULL,
+                              NULL, __redis_co_event, "redis_co");
+        if (unlikely(ret)) {
+                conn->sockid.sd = -1;
+                GOTO(err_close, ret);
+        }
 
-        variable_set(VARIABLE_REDIS, co);
-        __use_co__ = 1;
-        
         return 0;
+err_close:
+        close(sd);
 err_ret:
         return ret;
 }
 
-int redis_co_destroy()
+static int __redis_co_connect(co_t *co, const volid_t *volid, int sharding,
+                              co_conn_t **_conn)
 {
-        UNIMPLEMENTED(__WARN__);
+        int ret, count = 0;
+        struct list_head *pos;
+        co_conn_t *conn;
 
-        co_t *co = variable_get(VARIABLE_REDIS);
-        co->running = 0;
+        list_for_each(pos, &co->conn_list) {
+                conn = (void *)pos;
 
-        if (mdsconf.redis_thread) {
-#if 1
-                int ret;
-                uint64_t e = 1;
+                if (conn->volid.volid != volid->volid
+                    || conn->volid.snapvers != volid->snapvers)
+                        continue;
 
-                ret = write(co->eventfd, &e, sizeof(e));
-                if (ret < 0) {
-                        ret = errno;
-                        UNIMPLEMENTED(__DUMP__);
+                count = conn->count;
+                if (conn->handler.sharding == sharding % count) {
+                        *_conn = conn;
+                        return 0;
                 }
-#endif
-
-                close(co->eventfd);
         }
 
-        redis_vol_private_destroy(redis_conn_vol_close);
-        variable_unset(VARIABLE_REDIS);
-
-        return 0;
-}
-
-int redis_co(const volid_t *volid, const fileid_t *fileid, redisReply **reply,
-                   const char *format, ...)
-{
-        int ret;
-        redis_co_ctx_t ctx;
-        co_t *co = variable_get(VARIABLE_REDIS);
+        /*
+         * redis being down is not an answer about the file, the caller
+         * retries on EAGAIN
+         */
+        if (count == 0) {
+                ret = redis_conn_sharding(volid, &count);
+                if (unlikely(ret)) {
+                        DWARN("redis vol %ju sharding, ret %d\n", volid->volid, ret);
+                        ret = EAGAIN;
+                        GOTO(err_ret, ret);
+                }
+        }
 
-        ANALYSIS_BEGIN(0);
-        
-        YASSERT(fileid->type);
-        
-        ctx.format = format;
-        ctx.fileid = *fileid;
-        ctx.volid = *volid;
-        ctx.co = co;
-        ctx.task = schedule_task_get();
-        va_start(ctx.ap, format);
+        ret = ymalloc((void **)&conn, sizeof(*conn));
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
 
-        list_add_tail(&ctx.hook, &co->queue1);
+        ret = redis_conn_get(volid, sharding, 0, &conn->handler);
+        if (unlikely(ret)) {
+                DWARN("redis vol %ju connect, ret %d\n", volid->volid, ret);
+                ret = EAGAIN;
+                GOTO(err_free, ret);
+        }
 
-        DBUG("%s\n", format);
+        INIT_LIST_HEAD(&conn->wait);
+        conn->volid = *volid;
+        conn->count = count;
+        conn->dirty = 0;
+        conn->broken = 0;
+        conn->ltime = 0;
+        conn->sockid.sd = -1;
+        list_add_tail(&conn->hook, &co->conn_list);
+
+        if (!co->polling) {
+                ret = __redis_co_register(conn);
+                if (unlikely(ret)) {
+                        __redis_co_reset(conn, ret);
+                        ret = EAGAIN;
+                        GOTO(err_ret, ret);
+                }
+        }
 
-        ret = schedule_yield1("redis_co", NULL, NULL, NULL, -1);
-        if (ret)
-                GOTO(err_ret, ret);
+        DINFO("redis co (%d, %d) connected\n", conn->handler.sharding,
+              conn->handler.idx);
 
-        *reply = ctx.reply;
+        *_conn = conn;
 
-        ANALYSIS_QUEUE(0, 10 * 1000, NULL);
-        
         return 0;
+err_free:
+        yfree((void **)&conn);
 err_ret:
         return ret;
 }
 
-STATIC int __redis_utils_co1(const arg2_t *arg2, redis_handler_t *handler,
-                                   struct list_head *list)
+static int __redis_co_send(co_conn_t *conn)
 {
-        int ret;
-        struct list_head *pos, *n;
-        redis_co_ctx_t *ctx;
-        redis_conn_t *conn;
-
-        ret = redis_conn_get(&arg2->volid, arg2->fileid.sharding, 0, handler);
-        if(ret)
-                UNIMPLEMENTED(__DUMP__);
+        int ret, done;
 
-        conn = handler->conn;
-        
-        ret = pthread_rwlock_wrlock(&conn->rwlock);
-        if ((unlikely(ret)))
-                UNIMPLEMENTED(__DUMP__);
+        if (!conn->dirty) {
+                return 0;
+        }
 
-        ANALYSIS_BEGIN(0);
-        
-        list_for_each_safe(pos, n, list) {
-                ctx = (redis_co_ctx_t *)pos;
- 
-                ret = redisvAppendCommand(conn->ctx, ctx->format, ctx->ap);
-                if ((unlikely(ret)))
-                        UNIMPLEMENTED(__DUMP__);
+        ret = redisBufferWrite(conn->handler.conn->ctx, &done);
+        if (unlikely(ret != REDIS_OK)) {
+                ret = ECONNRESET;
+                GOTO(err_ret, ret);
         }
 
-        int done;
-        ret = redisBufferWrite(conn->ctx, &done);
-        DBUG("ret %d %d\n", ret, done);
+        if (done) {
+                conn->dirty = 0;
+        }
 
-        ANALYSIS_QUEUE(0, IO_WARN, NULL);
-        
         return 0;
+err_ret:
+        return ret;
 }
 
-STATIC int __redis_utils_co2(co_t *co, redis_handler_t *handler,
-                             struct list_head *list, int retry)
+static int __redis_co_recv(co_conn_t *conn, int *resume)
 {
         int ret;
-        struct list_head *pos, *n;
+        redisReply *reply;
         redis_co_ctx_t *ctx;
-        redis_conn_t *conn;
+        redis_ctx_t *c = conn->handler.conn->ctx;
 
-        if (list_empty(list)) {
+        if (list_empty(&conn->wait)) {
                 return 0;
         }
-        
-        conn = handler->conn;
 
-        ret = redisBufferRead(conn->ctx);
-        if (ret) {
-                DBUG("-----ret %u--\n", ret, retry);
-                return 1;
+        ret = redisBufferRead(c);
+        if (unlikely(ret != REDIS_OK)) {
+                ret = ECONNRESET;
+                GOTO(err_ret, ret);
         }
-        
-        list_for_each_safe(pos, n, list) {
-                ctx = (redis_co_ctx_t *)pos;
-
-                ret = redisGetReply(conn->ctx, (void **)&ctx->reply);
-                if (ret || ctx->reply == NULL) {
-                        DBUG("-----ret %u reply %p, retry %u--\n", ret, ctx->reply, retry);
 
-                        return 1;
-                } else {
-                        DBUG("-----ret %u reply %p, retry %u--\n", ret, ctx->reply, retry);
+        while (!list_empty(&conn->wait)) {
+                ret = redisGetReply(c, (void **)&reply);
+                if (unlikely(ret != REDIS_OK)) {
+                        ret = ECONNRESET;
+                        GOTO(err_ret, ret);
                 }
 
-                list_del(pos);
-
-                if (co->polling && mdsconf.redis_thread) {
-                        ret = sy_spin_lock(&co->lock);
-                        if (ret)
-                                UNIMPLEMENTED(__DUMP__);
-                        
-                        ctx->retval = ret;
-                        list_add_tail(&ctx->hook, &co->res1);
+                if (reply == NULL)
+                        break;
 
-                        sy_spin_unlock(&co->lock);
-                } else {
-                        schedule_resume(&ctx->task, ret, NULL);
-                }
+                ctx = (void *)conn->wait.next;
+                list_del(&ctx->hook);
+                ctx->reply = reply;
+                schedule_resume(&ctx->task, 0, NULL);
+                conn->ltime = gettime();
+                (*resume)++;
         }
 
-        DBUG("----get reply success, retry %u----\n", retry);
-        
         return 0;
+err_ret:
+        return ret;
 }
 
-static void __redis_co_recv(co_t *co, arg2_t *array,
-                            redis_handler_t *handler_array, int count)
+void redis_co_poll(void *core_ctx, void *arg)
 {
-        arg2_t *arg2;
-        redis_handler_t *handler;
+        int ret, dirty = 0, resume = 0;
+        time_t now = gettime();
+        struct list_head *pos, *n;
+        co_conn_t *conn;
+        co_t *co = variable_get_byctx(core_ctx, VARIABLE_REDIS);
+        schedule_t *schedule = variable_get_byctx(core_ctx, VARIABLE_SCHEDULE);
 
-        int retry = 0;
+        (void) arg;
 
-        ANALYSIS_BEGIN(0);
+        if (co == NULL) {
+                return;
+        }
 
-        while (1) {
-                int fail = 0;
-                for (int i = 0; i < count; i++) {
-                        handler = &handler_array[i];
-                        arg2 = &array[i];
+        list_for_each_safe(pos, n, &co->conn_list) {
+                conn = (void *)pos;
 
-                        fail += __redis_utils_co2(co, handler, &arg2->list, retry);
+                if (unlikely(conn->broken)) {
+                        __redis_co_reset(conn, conn->broken);
+                        continue;
                 }
 
-                DBUG("------------fail %u------------\n", fail);
-                
-                if (fail == 0) {
-                        break;
-                } else {
-                        retry++;
+                if (!list_empty(&conn->wait)
+                    && now - conn->ltime > gloconf.rpc_timeout) {
+                        __redis_co_reset(conn, ETIMEDOUT);
+                        continue;
                 }
-        }
-
-        ANALYSIS_QUEUE(0, IO_WARN, NULL);
-}
 
-static void __redis_co_release(redis_handler_t *handler_array, int count)
-{
-        redis_handler_t *handler;
-        redis_conn_t *conn;
-
-        for (int i = 0; i < count; i++) {
-                handler = &handler_array[i];
-                conn = handler->conn;
-                pthread_rwlock_unlock(&conn->rwlock);
-                redis_conn_release(handler);
-        }
-}
-
-STATIC int __redis_co_exec(void *core_ctx, arg2_t *array, int count)
-{
-        int ret, i;
-        redis_handler_t handler_array[512], *handler;
-        co_t *co = variable_get_byctx(core_ctx, VARIABLE_REDIS);
-        arg2_t *arg2;
+                ret = __redis_co_send(conn);
+                if (unlikely(ret)) {
+                        __redis_co_reset(conn, ret);
+                        continue;
+                }
 
-        ANALYSIS_BEGIN(0);
-        
-        for (i = 0; i < count; i++) {
-                handler = &handler_array[i];
-                arg2 = &array[i];
+                if (co->polling) {
+                        ret = __redis_co_recv(conn, &resume);
+                        if (unlikely(ret)) {
+                                __redis_co_reset(conn, ret);
+                                continue;
+                        }
+                }
 
-                ret = __redis_utils_co1(arg2, handler, &arg2->list);
-                if ((unlikely(ret)))
-                        UNIMPLEMENTED(__DUMP__);
+                dirty += conn->dirty;
         }
 
-        if (mdsconf.redis_thread) {
-                arg1_t arg1;
-                arg1.array = array;
-                arg1.handler_array = handler_array;
-                arg1.count = count;
-                arg1.task = schedule_task_get();
-        
-                ret = sy_spin_lock(&co->lock);
-                if(ret)
-                        UNIMPLEMENTED(__DUMP__);
-
-                list_add_tail(&arg1.hook, &co->queue2);
-        
-                sy_spin_unlock(&co->lock);
-
-                uint64_t e = 1;
-                ret = write(co->eventfd, &e, sizeof(e));
-                if (ret < 0) {
-                        ret = errno;
-                        UNIMPLEMENTED(__DUMP__);
-                }
+        if (resume) {
+                schedule_run(schedule);
+        }
 
-                ret = schedule_yield1("redis_co", NULL, NULL, NULL, -1);
-                if(ret)
-                        UNIMPLEMENTED(__DUMP__);
-        } else {
-                (void) core_ctx;
-                __redis_co_recv(co, array, handler_array, count);
+        /* the socket buffer is full, come back before the epoll timeout */
+        if (dirty && !co->polling) {
+                schedule_post(schedule);
         }
-        
-        __redis_co_release(handler_array, count);
-        ANALYSIS_QUEUE(0, IO_WARN, NULL);
-        
-        return 0;
 }
 
-static int __redis_co_run(void *core_ctx, struct list_head *list)
+int redis_co_init(int polling)
 {
-        int ret, count = 0;
-        struct list_head *pos, *n;
-        redis_co_ctx_t *ctx;
-        arg2_t *arg, array[512];
+        int ret;
+        co_t *co;
 
-        ANALYSIS_BEGIN(0);
-        count = 0;
-        while (!list_empty(list)) {
-                arg = &array[count];
-                count++;
-                YASSERT(count < 512);
-
-                pos = (void *)list->next;
-                ctx = (redis_co_ctx_t *)pos;
-                arg->fileid = ctx->fileid;
-                arg->volid = ctx->volid;
-                arg->finished = 0;
-                INIT_LIST_HEAD(&arg->list);
-                list_del(pos);
-                list_add_tail(pos, &arg->list);
-                YASSERT(ctx->fileid.type);
-
-                int submit = 1;
-                list_for_each_safe(pos, n, list) {
-                        ctx = (redis_co_ctx_t *)pos;
-
-                        if (ctx->fileid.sharding == arg->fileid.sharding
-                            && ctx->fileid.volid == arg->fileid.volid
-                            && ctx->volid.snapvers == arg->volid.snapvers) {
-                                list_del(pos);
-                                list_add_tail(pos, &arg->list);
-                                submit++;
-                        }
+        DINFO("redis co start, polling %s\n", polling ? "on" : "off");
 
-                        YASSERT(ctx->fileid.type);
-                }
+        ret = ymalloc((void **)&co, sizeof(*co));
+        if (ret)
+                GOTO(err_ret, ret);
 
-                DBUG("submit %u\n", submit);
-        }
+        memset(co, 0x0, sizeof(*co));
 
-        ret = __redis_co_exec(core_ctx, array, count);
-        if (unlikely(ret))
-                GOTO(err_ret, ret);
+        INIT_LIST_HEAD(&co->conn_list);
+        co->polling = polling;
+
+        ret = redis_vol_private_init();
+        if (ret)
+                GOTO(err_free, ret);
+
+        variable_set(VARIABLE_REDIS, co);
+        __use_co__ = 1;
 
-        ANALYSIS_QUEUE(0, IO_WARN, NULL);
-        
         return 0;
+err_free:
+        yfree((void **)&co);
 err_ret:
         return ret;
 }
 
-static void __redis_co_run_task(void *ctx)
+int redis_co_destroy()
 {
-        int ret;
-        struct list_head list;
-        co_t *co = variable_get_byctx(ctx, VARIABLE_REDIS);
+        co_conn_t *conn;
+        co_t *co = variable_get(VARIABLE_REDIS);
 
-        if (list_empty(&co->queue1)) {
-                return;
+        while (!list_empty(&co->conn_list)) {
+                conn = (void *)co->conn_list.next;
+                __redis_co_reset(conn, ECONNRESET);
         }
 
-        INIT_LIST_HEAD(&list);
-
-        list_splice_init(&co->queue1, &list);
-        
-        ret = plock_wrlock(&co->plock);
-        if (unlikely(ret))
-                UNIMPLEMENTED(__DUMP__);
-
-        __redis_co_run(ctx, &list);
+        redis_vol_private_destroy(redis_conn_vol_close);
+        variable_unset(VARIABLE_REDIS);
+        yfree((void **)&co);
 
-        plock_unlock(&co->plock);
+        return 0;
 }
 
-int redis_co_run(void *var)
+int redis_co(const volid_t *volid, const fileid_t *fileid, redisReply **reply,
+                   const char *format, ...)
 {
         int ret;
-        co_t *co = variable_get_byctx(var, VARIABLE_REDIS);
-        struct list_head list, *pos, *n;
-
-        if (co == NULL) {
-                return 0;
-        }
-
-        if (!list_empty(&co->queue1)) {
-                schedule_task_new("redis_co_run", __redis_co_run_task, var, -1);
-                schedule_run(variable_get_byctx(var, VARIABLE_SCHEDULE));
-        }
-
-        if (!co->polling || !mdsconf.redis_thread) {
-                return 0;
-        }
-        
-        if (!list_empty(&co->res1)) {
-                redis_co_ctx_t *ctx;
-                INIT_LIST_HEAD(&list);
+        va_list ap;
+        redis_co_ctx_t ctx;
+        co_conn_t *conn;
+        co_t *co = variable_get(VARIABLE_REDIS);
 
-                ret = sy_spin_lock(&co->lock);
-                if (unlikely(ret))
-                        UNIMPLEMENTED(__DUMP__);
+        ANALYSIS_BEGIN(0);
 
-                list_splice_init(&co->res1, &list);
-                
-                sy_spin_unlock(&co->lock);
+        YASSERT(fileid->type);
 
-                list_for_each_safe(pos, n, &list) {
-                        ctx = (redis_co_ctx_t *)pos;
-                        list_del(pos);
-                        schedule_resume(&ctx->task, ctx->retval, NULL);
-                        DBUG("resume res1\n");
-                }
+        ret = __redis_co_connect(co, volid, fileid->sharding, &conn);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
 
-                schedule_run(variable_get_byctx(var, VARIABLE_SCHEDULE));
+        va_start(ap, format);
+        ret = redisvAppendCommand(conn->handler.conn->ctx, format, ap);
+        va_end(ap);
+        if (unlikely(ret != REDIS_OK)) {
+                ret = ENOMEM;
+                GOTO(err_ret, ret);
         }
 
-        if (!list_empty(&co->res2)) {
-                arg1_t *arg1;
-                
-                INIT_LIST_HEAD(&list);
-
-                ret = sy_spin_lock(&co->lock);
-                if (unlikely(ret))
-                        UNIMPLEMENTED(__DUMP__);
-
-                list_splice_init(&co->res2, &list);
-                
-                sy_spin_unlock(&co->lock);
-
-                list_for_each_safe(pos, n, &list) {
-                        arg1 = (arg1_t *)pos;
-                        list_del(pos);
-                        schedule_resume(&arg1->task, 0, NULL);
-                        DBUG("resume res2\n");
-                }
+        DBUG("%s\n", format);
 
-                schedule_run(variable_get_byctx(var, VARIABLE_SCHEDULE));
-        }
-        
-        return 0;
-        
-#if 0        
-        
-#if ENABLE_LOCK_FREE_LIST
+        ctx.task = schedule_task_get();
+        ctx.reply = NULL;
+        if (list_empty(&conn->wait))
+                conn->ltime = gettime();
+        list_add_tail(&ctx.hook, &conn->wait);
+        conn->dirty = 1;
 
-        redis_co_ctx_t *co_ctx;
-        struct list_head *pos, *n;
+        ret = schedule_yield1("redis_co", NULL, NULL, NULL, -1);
+        if (ret)
+                GOTO(err_ret, ret);
 
-        list_for_each_safe(pos, n, &co->queue1) {
-                list_del(pos);
-                co_ctx = (redis_co_ctx_t *)pos;
-                LL_INIT_ENTRY(&co_ctx->entry);
-                co_ctx->magic = _random();
-                LL_PUSH_BACK(co_list, &co->list, co_ctx);
-                //LL_RELEASE(co_list, &co->list, co_ctx);
-                DBUG("------------push 0x%o-------------\n", co_ctx->magic);
-        }
-        
-#else
-        ret = sy_spin_lock(&co->lock);
-        if ((unlikely(ret)))
-                UNIMPLEMENTED(__DUMP__);
-                
-        list_splice_init(&co->queue1, &co->queue2);
-                
-        sy_spin_unlock(&co->lock);
-#endif
+        *reply = ctx.reply;
 
-        uint64_t e = 1;
-        ret = write(co->eventfd, &e, sizeof(e));
-        if (ret < 0) {
-                ret = errno;
-                UNIMPLEMENTED(__DUMP__);
-        }
+        ANALYSIS_QUEUE(0, 10 * 1000, NULL);
 
-#endif
+        return 0;
+err_ret:
+        return ret;
 }
 
 int co_hget(const volid_t *volid, const fileid_t *fileid, const char *key,
@@ -780,6 +562,119 @@ err_ret:
         return ret;
 }
 
+int co_hget_count(const volid_t *volid, const fileid_t *fileid, const char *key,
+                  void *buf, size_t *len, const char *counter, int64_t *count)
+{
+        int ret;
+        redisReply *reply;
+        char hash[MAX_NAME_LEN];
+
+        ANALYSIS_BEGIN(0);
+        id2key(ftype(fileid), fileid, hash);
+
+        DBUG("%s %s\n", hash, key);
+
+        ret = redis_co(volid, fileid, &reply, "HMGET %s %s %s", hash, key, counter);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
+        ret = redis_hget_count_reply(reply, buf, len, count);
+        if (unlikely(ret))
+                GOTO(err_free, ret);
+
+        freeReplyObject(reply);
+        ANALYSIS_QUEUE(0, IO_WARN, NULL);
+
+        return 0;
+err_free:
+        if (reply)
+                freeReplyObject(reply);
+err_ret:
+        return ret;
+}
+
+int co_hset_count(const volid_t *volid, const fileid_t *fileid, const char *counter,
+                  const char *key, const void *value, size_t size, int flag, uint64_t max)
+{
+        int ret;
+        redisReply *reply;
+        char hash[MAX_NAME_LEN];
+
+        ANALYSIS_BEGIN(0);
+        id2key(ftype(fileid), fileid, hash);
+
+        DBUG("%s %s, flag 0x%o\n", hash, key, flag);
+
+        ret = redis_co(volid, fileid, &reply, "EVALSHA %s 1 %s %s %s %b %d %llu",
+                       redis_script_sha(REDIS_SCRIPT_HSET_COUNT), hash, counter, key,
+                       value, size, (flag & O_EXCL) ? 1 : 0, (LLU)max);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
+        if (unlikely(redis_noscript(reply))) {
+                freeReplyObject(reply);
+                ret = redis_co(volid, fileid, &reply, "EVAL %s 1 %s %s %s %b %d %llu",
+                               REDIS_HSET_COUNT_SCRIPT, hash, counter, key,
+                               value, size, (flag & O_EXCL) ? 1 : 0, (LLU)max);
+                if (unlikely(ret))
+                        GOTO(err_ret, ret);
+        }
+
+        ret = redis_hset_count_reply(reply, flag);
+        if (unlikely(ret))
+                GOTO(err_free, ret);
+
+        freeReplyObject(reply);
+        ANALYSIS_QUEUE(0, IO_WARN, NULL);
+
+        return 0;
+err_free:
+        if (reply)
+                freeReplyObject(reply);
+err_ret:
+        return ret;
+}
+
+int co_hdel_count(const volid_t *volid, const fileid_t *fileid, const char *counter,
+                  const char *key)
+{
+        int ret;
+        redisReply *reply;
+        char hash[MAX_NAME_LEN];
+
+        ANALYSIS_BEGIN(0);
+        id2key(ftype(fileid), fileid, hash);
+
+        DBUG("%s %s\n", hash, key);
+
+        ret = redis_co(volid, fileid, &reply, "EVALSHA %s 1 %s %s %s",
+                       redis_script_sha(REDIS_SCRIPT_HDEL_COUNT), hash, counter, key);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
+        if (unlikely(redis_noscript(reply))) {
+                freeReplyObject(reply);
+                ret = redis_co(volid, fileid, &reply, "EVAL %s 1 %s %s %s",
+                               REDIS_HDEL_COUNT_SCRIPT, hash, counter, key);
+                if (unlikely(ret))
+                        GOTO(err_ret, ret);
+        }
+
+        ret = redis_hdel_count_reply(reply);
+        if (unlikely(ret))
+                GOTO(err_free, ret);
+
+        freeReplyObject(reply);
+        ANALYSIS_QUEUE(0, IO_WARN, NULL);
+
+        return 0;
+err_free:
+        if (reply)
+                freeReplyObject(reply);
+err_ret:
+        return ret;
+}
+
 STATIC int __co_kget(const volid_t *volid, const fileid_t *fileid,
                            const char *key, void *buf, size_t *len)
 {
@@ -1010,6 +905,47 @@ err_ret:
         return ret;
 }
 
+int co_klease(const volid_t *volid, const fileid_t *fileid, int op,
+              const char *owner, int ttl)
+{
+        int ret;
+        redisReply *reply;
+        char key[MAX_PATH_LEN], revoke[MAX_PATH_LEN];
+
+        ANALYSIS_BEGIN(0);
+        snprintf(key, MAX_NAME_LEN, "lease:"CHKID_FORMAT, CHKID_ARG(fileid));
+        snprintf(revoke, MAX_NAME_LEN, "lease:"CHKID_FORMAT":revoke", CHKID_ARG(fileid));
+
+        DBUG("%s op %d owner %s\n", key, op, owner);
+
+        ret = redis_co(volid, fileid, &reply, "EVALSHA %s 2 %s %s %d %s %d",
+                       redis_script_sha(REDIS_SCRIPT_LEASE), key, revoke, op, owner, ttl);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
+        if (unlikely(redis_noscript(reply))) {
+                freeReplyObject(reply);
+                ret = redis_co(volid, fileid, &reply, "EVAL %s 2 %s %s %d %s %d",
+                               REDIS_LEASE_SCRIPT, key, revoke, op, owner, ttl);
+                if (unlikely(ret))
+                        GOTO(err_ret, ret);
+        }
+
+        ret = redis_lease_reply(reply);
+        if (unlikely(ret))
+                GOTO(err_free, ret);
+
+        freeReplyObject(reply);
+        ANALYSIS_QUEUE(0, IO_WARN, NULL);
+
+        return 0;
+err_free:
+        if (reply)
+                freeReplyObject(reply);
+err_ret:
+        return ret;
+}
+
 int co_kget(const volid_t *volid, const fileid_t *fileid, void *buf, size_t *len)
 {
         int ret;
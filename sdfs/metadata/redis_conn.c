@@ -355,6 +355,24 @@ err_ret:
         return ret;
 }
 
+int redis_conn_sharding(const volid_t *volid, int *sharding)
+{
+        int ret;
+        redis_vol_t *vol;
+
+        ret = __redis_vol_get(volid, &vol, O_CREAT);
+        if(ret)
+                GOTO(err_ret, ret);
+
+        *sharding = vol->sharding;
+
+        redis_vol_release(volid);
+
+        return 0;
+err_ret:
+        return ret;
+}
+
 static int __redis_conn_new__(const volid_t *volid, uint8_t *idx)
 {
         int ret, seq;
@@ -595,6 +595,113 @@ err_ret:
         return ret;
 }
 
+int pipeline_hget_count(const volid_t *volid, const fileid_t *fileid, const char *key,
+                  void *buf, size_t *len, const char *counter, int64_t *count)
+{
+        int ret;
+        redisReply *reply;
+        char hash[MAX_NAME_LEN];
+
+        id2key(ftype(fileid), fileid, hash);
+
+        DBUG("%s %s\n", hash, key);
+
+        ret = redis_pipeline(volid, fileid, &reply, "HMGET %s %s %s", hash, key, counter);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
+        ret = redis_hget_count_reply(reply, buf, len, count);
+        if (unlikely(ret))
+                GOTO(err_free, ret);
+
+        freeReplyObject(reply);
+
+        return 0;
+err_free:
+        if (reply)
+                freeReplyObject(reply);
+err_ret:
+        return ret;
+}
+
+int pipeline_hset_count(const volid_t *volid, const fileid_t *fileid, const char *counter,
+                  const char *key, const void *value, size_t size, int flag, uint64_t max)
+{
+        int ret;
+        redisReply *reply;
+        char hash[MAX_NAME_LEN];
+
+        id2key(ftype(fileid), fileid, hash);
+
+        DBUG("%s %s, flag 0x%o\n", hash, key, flag);
+
+        ret = redis_pipeline(volid, fileid, &reply, "EVALSHA %s 1 %s %s %s %b %d %llu",
+                             redis_script_sha(REDIS_SCRIPT_HSET_COUNT), hash, counter, key,
+                             value, size, (flag & O_EXCL) ? 1 : 0, (LLU)max);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
+        if (unlikely(redis_noscript(reply))) {
+                freeReplyObject(reply);
+                ret = redis_pipeline(volid, fileid, &reply, "EVAL %s 1 %s %s %s %b %d %llu",
+                                     REDIS_HSET_COUNT_SCRIPT, hash, counter, key,
+                                     value, size, (flag & O_EXCL) ? 1 : 0, (LLU)max);
+                if (unlikely(ret))
+                        GOTO(err_ret, ret);
+        }
+
+        ret = redis_hset_count_reply(reply, flag);
+        if (unlikely(ret))
+                GOTO(err_free, ret);
+
+        freeReplyObject(reply);
+
+        return 0;
+err_free:
+        if (reply)
+                freeReplyObject(reply);
+err_ret:
+        return ret;
+}
+
+int pipeline_hdel_count(const volid_t *volid, const fileid_t *fileid, const char *counter,
+                  const char *key)
+{
+        int ret;
+        redisReply *reply;
+        char hash[MAX_NAME_LEN];
+
+        id2key(ftype(fileid), fileid, hash);
+
+        DBUG("%s %s\n", hash, key);
+
+        ret = redis_pipeline(volid, fileid, &reply, "EVALSHA %s 1 %s %s %s",
+                             redis_script_sha(REDIS_SCRIPT_HDEL_COUNT), hash, counter, key);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
+        if (unlikely(redis_noscript(reply))) {
+                freeReplyObject(reply);
+                ret = redis_pipeline(volid, fileid, &reply, "EVAL %s 1 %s %s %s",
+                                     REDIS_HDEL_COUNT_SCRIPT, hash, counter, key);
+                if (unlikely(ret))
+                        GOTO(err_ret, ret);
+        }
+
+        ret = redis_hdel_count_reply(reply);
+        if (unlikely(ret))
+                GOTO(err_free, ret);
+
+        freeReplyObject(reply);
+
+        return 0;
+err_free:
+        if (reply)
+                freeReplyObject(reply);
+err_ret:
+        return ret;
+}
+
 STATIC int __pipeline_kget(const volid_t *volid, const fileid_t *fileid, const char *key, void *buf, size_t *len)
 {
         int ret;
@@ -813,6 +920,44 @@ err_ret:
         return ret;
 }
 
+int pipeline_klease(const volid_t *volid, const fileid_t *fileid, int op,
+                    const char *owner, int ttl)
+{
+        int ret;
+        redisReply *reply;
+        char key[MAX_PATH_LEN], revoke[MAX_PATH_LEN];
+
+        snprintf(key, MAX_NAME_LEN, "lease:"CHKID_FORMAT, CHKID_ARG(fileid));
+        snprintf(revoke, MAX_NAME_LEN, "lease:"CHKID_FORMAT":revoke", CHKID_ARG(fileid));
+
+        DBUG("%s op %d owner %s\n", key, op, owner);
+
+        ret = redis_pipeline(volid, fileid, &reply, "EVALSHA %s 2 %s %s %d %s %d",
+                             redis_script_sha(REDIS_SCRIPT_LEASE), key, revoke, op, owner, ttl);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
+        if (unlikely(redis_noscript(reply))) {
+                freeReplyObject(reply);
+                ret = redis_pipeline(volid, fileid, &reply, "EVAL %s 2 %s %s %d %s %d",
+                                     REDIS_LEASE_SCRIPT, key, revoke, op, owner, ttl);
+                if (unlikely(ret))
+                        GOTO(err_ret, ret);
+        }
+
+        ret = redis_lease_reply(reply);
+        if (unlikely(ret))
+                GOTO(err_free, ret);
+
+        freeReplyObject(reply);
+        return 0;
+err_free:
+        if (reply)
+                freeReplyObject(reply);
+err_ret:
+        return ret;
+}
+
 int pipeline_kget(const volid_t *volid, const fileid_t *fileid, void *buf, size_t *len)
 {
         char key[MAX_NAME_LEN];
@@ -6,10 +6,18 @@ int pipeline_hget(const volid_t *volid, const fileid_t *fileid, const char *key,
 int pipeline_hset(const volid_t *volid, const fileid_t *fileid, const char *key, const void *value, size_t size, int flag);
 int pipeline_hdel(const volid_t *volid, const fileid_t *fileid, const char *key);
 int pipeline_hlen(const volid_t *volid, const fileid_t *fileid, uint64_t *count);
+int pipeline_hget_count(const volid_t *volid, const fileid_t *fileid, const char *key,
+                        void *buf, size_t *len, const char *counter, int64_t *count);
+int pipeline_hset_count(const volid_t *volid, const fileid_t *fileid, const char *counter,
+                        const char *key, const void *value, size_t size, int flag, uint64_t max);
+int pipeline_hdel_count(const volid_t *volid, const fileid_t *fileid, const char *counter,
+                        const char *key);
 int pipeline_kget(const volid_t *volid, const fileid_t *fileid, void *buf, size_t *len);
 int pipeline_kset(const volid_t *volid, const fileid_t *fileid, const void *value,
                   size_t size, int flag, int _ttl);
 int pipeline_kdel(const volid_t *volid, const fileid_t *fileid);
 int pipeline_klock(const volid_t *volid, const fileid_t *fileid, int ttl, int block);
 int pipeline_kunlock(const volid_t *volid, const fileid_t *fileid);
+int pipeline_klease(const volid_t *volid, const fileid_t *fileid, int op,
+                    const char *owner, int ttl);
 #endif
@@ -215,6 +215,7 @@ static int __mond_srv_diskhb(const sockid_t *sockid, const msgid_t *msgid, buffe
         const diskinfo_stat_diff_t *diff;
         const uuid_t *uuid;
         const volinfo_t *volinfo;
+        const uint64_t *load = NULL;
 
         req = (void *)buf;
         mbuffer_get(_buf, req, sizeof(*req));
@@ -229,6 +230,7 @@ static int __mond_srv_diskhb(const sockid_t *sockid, const msgid_t *msgid, buffe
                        &uuid, NULL,
                        &diff, NULL,
                        &volinfo, NULL,
+                       &load, NULL,
                        NULL);
 
         char _uuid[MAX_NAME_LEN];
@@ -239,6 +241,10 @@ static int __mond_srv_diskhb(const sockid_t *sockid, const msgid_t *msgid, buffe
                           volinfo->volrept, uuid);
         if (ret)
                 GOTO(err_ret, ret);
+
+        /* older cds send no load */
+        if (load)
+                diskpool_load(nid, *load);
         
         rpc_reply(sockid, msgid, NULL, 0);
 
@@ -252,7 +258,7 @@ err_ret:
 
 int mond_rpc_diskhb(const nid_t *nid, int tier, const uuid_t *uuid,
                     const diskinfo_stat_diff_t *diff,
-                    const volinfo_t *volinfo)
+                    const volinfo_t *volinfo, uint64_t load)
 {
         int ret;
         char *buf = mem_cache_calloc1(MEM_CACHE_4K, PAGE_SIZE);
@@ -277,6 +283,7 @@ int mond_rpc_diskhb(const nid_t *nid, int tier, const uuid_t *uuid,
                        uuid, sizeof(*uuid),
                        diff, sizeof(*diff),
                        volinfo, sizeof(*volinfo),
+                       &load, sizeof(load),
                        NULL);
 
         req->buflen = count;
@@ -326,8 +333,6 @@ static int __mond_srv_newdisk(const sockid_t *sockid, const msgid_t *msgid, buff
 
         DBUG("repnum %u hardend %u tier %u\n", *repnum, *hardend, *tier);
 
-        YASSERT(*tier == 0);
-        
         ret = nodepool_get(*repnum, array, *hardend, *tier);
         if (ret) {
                 GOTO(err_ret, ret);
@@ -22,12 +22,13 @@ typedef struct {
 
 
 #define MON_ENTRY_MAX (64 * 1024)
+#define MOND_DISKSTAT "diskstat"
 
 int mond_rpc_init();
 int mond_rpc_getstat(const nid_t *nid, instat_t *instat);
 int mond_rpc_diskhb(const nid_t *nid, int tier, const uuid_t *uuid,
                     const diskinfo_stat_diff_t *diff,
-                    const volinfo_t *volinfo);
+                    const volinfo_t *volinfo, uint64_t load);
 int mond_rpc_statvfs(const nid_t *nid, const fileid_t *fileid, struct statvfs *stbuf);
 int mond_rpc_diskjoin(const nid_t *nid, uint32_t tier, const uuid_t *uuid,
                       const diskinfo_stat_t *stat);
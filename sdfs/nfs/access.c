@@ -0,0 +1,362 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <errno.h>
+
+#define DBG_SUBSYS S_YNFS
+
+#include "adt.h"
+#include "access.h"
+#include "nfs_conf.h"
+#include "ylib.h"
+#include "swiss.h"
+#include "sdfs_lib.h"
+#include "posix_acl.h"
+#include "dbg.h"
+
+/*
+ * what ACCESS needs of a file, kept for access_timeout seconds so the
+ * checks a client makes before each open skip redis.  the decision for a
+ * given uid and gid is a few compares once the acl is compiled, so the
+ * entries are per fileid and one drop covers every user.  changes made
+ * through another server are seen once the entry expires.
+ */
+typedef struct {
+        struct list_head hook;
+        fileid_t fileid;
+        time_t ctime;
+        nfs3_ftype type;
+        uint32_t mode;
+        uint32_t uid;
+        uint32_t gid;
+        posix_acl_t *acl;
+} access_ent_t;
+
+typedef struct {
+        sy_spinlock_t lock;
+        struct list_head lru;
+        uint64_t used;
+        uint64_t gen;                   /* bumped by every drop */
+        swiss_t *tab;
+} access_table_t;
+
+static access_table_t *__access_table__ = NULL;
+
+static uint64_t __access_size(const access_ent_t *ent)
+{
+        return sizeof(*ent) + (ent->acl ? POSIX_ACL_SIZE(ent->acl->user_count
+                                                         + ent->acl->group_count) : 0);
+}
+
+static void __access_free(access_ent_t *ent)
+{
+        if (ent->acl)
+                yfree((void **)&ent->acl);
+
+        yfree((void **)&ent);
+}
+
+static void __access_free_list(struct list_head *list)
+{
+        struct list_head *pos, *n;
+
+        list_for_each_safe(pos, n, list) {
+                list_del(pos);
+                __access_free(list_entry(pos, access_ent_t, hook));
+        }
+}
+
+/* called with the table locked */
+static void __access_unlink(access_table_t *table, access_ent_t *ent)
+{
+        swiss_remove(table->tab, &ent->fileid, NULL);
+        list_del(&ent->hook);
+        table->used -= __access_size(ent);
+}
+
+/*
+ * drop expired entries and keep the table below access_cache,
+ * called with the table locked, victims are freed by the caller
+ */
+static void __access_recycle(access_table_t *table, struct list_head *list)
+{
+        access_ent_t *ent;
+        time_t now = gettime();
+
+        while (!list_empty(&table->lru)) {
+                ent = list_entry(table->lru.prev, access_ent_t, hook);
+                if (table->used <= (uint64_t)nfsconf.access_cache
+                    && now - ent->ctime < nfsconf.access_timeout) {
+                        break;
+                }
+
+                __access_unlink(table, ent);
+                list_add_tail(&ent->hook, list);
+        }
+}
+
+static uint32_t __access_mode(const access_ent_t *ent, uid_t uid, gid_t gid)
+{
+        uint32_t parm, access;
+
+#if ENABLE_MD_POSIX
+        if (ent->acl) {
+                parm = posix_acl_permission(ent->acl, ent->mode, ent->uid,
+                                            ent->gid, uid, gid);
+        } else if (uid == ent->uid) {
+                parm = (ent->mode & 0700) / 0100;
+        } else if (gid == ent->gid) {
+                parm = (ent->mode & 0070) / 010;
+        } else {
+                parm = (ent->mode & 0007) / 01;
+        }
+#else
+        /* owner, group, other, and root are allowed everything */
+        (void) uid;
+        (void) gid;
+        parm = 07;
+#endif
+
+        DBUG("mode 0%o 0%o\n", ent->mode, parm);
+
+        access = 0;
+        if (parm & 4) {
+                access |= (ACCESS_READ);
+        }
+
+        if (parm & 2) {
+                access |= (ACCESS_MODIFY | ACCESS_EXTEND);
+        }
+
+        if (parm & 1) {
+                access |= (ACCESS_EXECUTE);
+        }
+
+        if (ent->type == NFS3_DIR) {
+                if (access & ACCESS_READ)
+                        access |= ACCESS_LOOKUP;
+                if (access & ACCESS_MODIFY)
+                        access |= ACCESS_DELETE;
+                access &= ~ACCESS_EXECUTE;
+        }
+
+        return access;
+}
+
+#if ENABLE_MD_POSIX
+static int __access_acl(const fileid_t *fileid, posix_acl_t **_acl)
+{
+        int ret, count;
+        char buf[MAX_BUF_LEN];
+        size_t size = sizeof(buf);
+        posix_acl_t *acl;
+
+        *_acl = NULL;
+
+        ret = sdfs_getxattr(NULL, fileid, ACL_EA_ACCESS, buf, &size);
+        if (ret) {
+                if (ret == ENOKEY || ret == ENOENT || ret == ENODATA)
+                        return 0;
+
+                GOTO(err_ret, ret);
+        }
+
+        /* an acl equivalent to the mode is never stored */
+        count = posix_acl_check(buf, size);
+        if (count <= 0) {
+                DWARN("fileid "FID_FORMAT" bad acl, size %ju\n",
+                      FID_ARG(fileid), size);
+                return 0;
+        }
+
+        ret = ymalloc((void **)&acl, POSIX_ACL_SIZE(count));
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = posix_acl_compile(buf, size, acl);
+        YASSERT(ret == 0);
+
+        *_acl = acl;
+
+        return 0;
+err_ret:
+        return ret;
+}
+#endif
+
+static void __access_insert(access_table_t *table, access_ent_t *ent, uint64_t gen)
+{
+        int ret;
+        access_ent_t *old;
+        struct list_head list;
+
+        INIT_LIST_HEAD(&list);
+
+        ret = sy_spin_lock(&table->lock);
+        if (unlikely(ret))
+                UNIMPLEMENTED(__DUMP__);
+
+        /* dropped while we were loading, the result may be stale */
+        if (table->gen != gen) {
+                list_add_tail(&ent->hook, &list);
+                goto out;
+        }
+
+        old = swiss_find(table->tab, &ent->fileid);
+        if (old) {
+                __access_unlink(table, old);
+                list_add_tail(&old->hook, &list);
+        }
+
+        ret = swiss_insert(table->tab, &ent->fileid, ent, 0);
+        if (unlikely(ret)) {
+                list_add_tail(&ent->hook, &list);
+                goto out;
+        }
+
+        list_add(&ent->hook, &table->lru);
+        table->used += __access_size(ent);
+
+        __access_recycle(table, &list);
+
+out:
+        sy_spin_unlock(&table->lock);
+
+        __access_free_list(&list);
+}
+
+/*
+ * the access rights of uid and gid on fileid, post gets the attributes
+ * only if they were read for this call
+ */
+int access_cache_get(const fileid_t *fileid, uid_t uid, gid_t gid,
+                     uint32_t *access, post_op_attr *post)
+{
+        int ret;
+        uint64_t gen;
+        struct stat stbuf;
+        access_ent_t *ent;
+        access_table_t *table = __access_table__;
+
+        ret = sy_spin_lock(&table->lock);
+        if (unlikely(ret))
+                UNIMPLEMENTED(__DUMP__);
+
+        ent = swiss_find(table->tab, fileid);
+        if (ent && gettime() - ent->ctime < nfsconf.access_timeout) {
+                *access = __access_mode(ent, uid, gid);
+                list_del(&ent->hook);
+                list_add(&ent->hook, &table->lru);
+
+                sy_spin_unlock(&table->lock);
+
+                post->attr_follow = FALSE;
+
+                return 0;
+        }
+
+        gen = table->gen;
+
+        sy_spin_unlock(&table->lock);
+
+        ret = sdfs_getattr(NULL, fileid, &stbuf);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        get_postopattr_stat(post, &stbuf);
+
+        ret = ymalloc((void **)&ent, sizeof(*ent));
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ent->fileid = *fileid;
+        ent->ctime = gettime();
+        ent->type = post->attr.type;
+        ent->mode = post->attr.mode;
+        ent->uid = post->attr.uid;
+        ent->gid = post->attr.gid;
+        ent->acl = NULL;
+
+#if ENABLE_MD_POSIX
+        ret = __access_acl(fileid, &ent->acl);
+        if (ret)
+                GOTO(err_free, ret);
+#endif
+
+        *access = __access_mode(ent, uid, gid);
+
+        if (nfsconf.access_timeout == 0) {
+                __access_free(ent);
+                return 0;
+        }
+
+        __access_insert(table, ent, gen);
+
+        return 0;
+#if ENABLE_MD_POSIX
+err_free:
+        __access_free(ent);
+#endif
+err_ret:
+        return ret;
+}
+
+/* called after changing the mode, owner or acl of fileid, or removing it */
+void access_cache_drop(const fileid_t *fileid)
+{
+        int ret;
+        access_ent_t *ent;
+        struct list_head list;
+        access_table_t *table = __access_table__;
+
+        INIT_LIST_HEAD(&list);
+
+        ret = sy_spin_lock(&table->lock);
+        if (unlikely(ret))
+                UNIMPLEMENTED(__DUMP__);
+
+        table->gen++;
+
+        ent = swiss_find(table->tab, fileid);
+        if (ent) {
+                __access_unlink(table, ent);
+                list_add_tail(&ent->hook, &list);
+        }
+
+        sy_spin_unlock(&table->lock);
+
+        __access_free_list(&list);
+}
+
+int access_cache_init()
+{
+        int ret;
+        access_table_t *table;
+
+        ret = ymalloc((void **)&table, sizeof(*table));
+        if (ret)
+                GOTO(err_ret, ret);
+
+        memset(table, 0x0, sizeof(*table));
+
+        ret = sy_spin_init(&table->lock);
+        if (ret)
+                GOTO(err_free, ret);
+
+        ret = swiss_create(&table->tab, "access", sizeof(fileid_t));
+        if (ret)
+                GOTO(err_free, ret);
+
+        INIT_LIST_HEAD(&table->lru);
+
+        __access_table__ = table;
+
+        DINFO("access cache %ju, timeout %u\n",
+              (uint64_t)nfsconf.access_cache, nfsconf.access_timeout);
+
+        return 0;
+err_free:
+        yfree((void **)&table);
+err_ret:
+        return ret;
+}
@@ -0,0 +1,15 @@
+#ifndef __NFS_ACCESS_H__
+#define __NFS_ACCESS_H__
+
+#include <stdint.h>
+
+#include "attr.h"
+#include "sdfs_lib.h"
+#include "nfs3.h"
+
+int access_cache_init();
+int access_cache_get(const fileid_t *fileid, uid_t uid, gid_t gid,
+                     uint32_t *access, post_op_attr *post);
+void access_cache_drop(const fileid_t *fileid);
+
+#endif
@@ -272,13 +272,32 @@ retry:
         attr->attr_follow = TRUE;
 
         attr->attr.size = stbuf.st_size;
-        attr->attr.mtime.seconds = stbuf.st_mtime;
-        attr->attr.mtime.nseconds = 0;
-        attr->attr.ctime.seconds = stbuf.st_ctime;
-        attr->attr.ctime.nseconds = 0;
+        attr->attr.mtime.seconds = stbuf.st_mtim.tv_sec;
+        attr->attr.mtime.nseconds = stbuf.st_mtim.tv_nsec;
+        attr->attr.ctime.seconds = stbuf.st_ctim.tv_sec;
+        attr->attr.ctime.nseconds = stbuf.st_ctim.tv_nsec;
 
         return;
 err_ret:
         DWARN(""FID_FORMAT"\n", FID_ARG(fileid));
         return;
 }
+
+void get_preopattr_md(const md_proto_t *md, preop_attr *attr)
+{
+        attr->attr_follow = TRUE;
+
+        attr->attr.size = md->at_size;
+        attr->attr.mtime.seconds = md->at_mtime.tv_sec;
+        attr->attr.mtime.nseconds = md->at_mtime.tv_nsec;
+        attr->attr.ctime.seconds = md->at_ctime.tv_sec;
+        attr->attr.ctime.nseconds = md->at_ctime.tv_nsec;
+}
+
+void get_postopattr_md(const md_proto_t *md, post_op_attr *attr)
+{
+        struct stat stbuf;
+
+        MD2STAT(md, &stbuf);
+        get_postopattr_stat(attr, &stbuf);
+}
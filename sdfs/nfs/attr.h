@@ -8,6 +8,7 @@
 
 #include "nfs3.h"
 #include "file_proto.h"
+#include "yfs_md.h"
 
 extern int get_postopattr(uint32_t dev, uint64_t ino, const char *path,
                           post_op_attr *attr);
@@ -20,5 +21,7 @@ int sattr_utime(const fileid_t *fileid, int at, int mt, int ct);
 int sattr_set(const fileid_t *fileid, const sattr *attr, const nfs3_time *ctime);
 void get_preopattr1(const fileid_t *fileid, preop_attr *attr);
 void get_postopattr1(const fileid_t *fileid, post_op_attr *attr);
+void get_preopattr_md(const md_proto_t *md, preop_attr *attr);
+void get_postopattr_md(const md_proto_t *md, post_op_attr *attr);
 
 #endif
@@ -190,6 +190,8 @@ nfs3_stat readdir_err(int syserr)
 {
         if (syserr == EPERM)
                 return NFS3_EPERM;
+        else if (syserr == EBADR)
+                return NFS3_EBADCOOKIE;
         else if (syserr == EACCES)
                 return NFS3_EACCES;
         else if (syserr == ENOTDIR)
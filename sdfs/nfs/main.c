@@ -28,6 +28,8 @@
 #include "sdfs_quota.h"
 #include "core.h"
 #include "nfs_conf.h"
+#include "readdir.h"
+#include "access.h"
 #include "nlm_async.h"
 #include "io_analysis.h"
 #include "allocator.h"
@@ -231,6 +233,14 @@ retry:
         if (ret)
                 GOTO(err_ret, ret);
 
+        ret = readdir_init();
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = access_cache_init();
+        if (ret)
+                GOTO(err_ret, ret);
+
         DINFO("nfs started...\n");
 
         ret = rpc_start(); /*begin serivce*/
@@ -28,6 +28,7 @@
 #include "nfs_events.h"
 #include "nfs3.h"
 #include "readdir.h"
+#include "access.h"
 #include "sunrpc_proto.h"
 #include "sunrpc_reply.h"
 #include "sdfs_lib.h"
@@ -35,6 +36,8 @@
 #include "configure.h"
 #include "sdfs_lib.h"
 #include "core.h"
+#include "schedule.h"
+#include "swiss.h"
 #include "yfs_limit.h"
 #include "dbg.h"
 
@@ -216,6 +219,85 @@ err_ret:
         return ret;
 }
 
+typedef struct {
+        fileid_t fileid;
+        uint32_t batch;
+} nfs_getattr_key_t;
+
+typedef struct {
+        nfs_getattr_key_t key;
+        struct list_head wait_list;
+} nfs_getattr_t;
+
+typedef struct {
+        struct list_head hook;
+        task_t task;
+        struct stat *stbuf;
+} nfs_getattr_wait_t;
+
+/* getattr in flight on this core, by batch and fileid */
+static __thread swiss_t *__getattr_tab__;
+
+/*
+ * a client with a deep slot table often sends the same getattr several
+ * times in one burst, the later ones wait for the first to finish
+ */
+static int __nfs3_getattr(const fileid_t *fileid, struct stat *stbuf)
+{
+        int ret;
+        nfs_getattr_t *ent, _ent;
+        nfs_getattr_wait_t wait, *pos, *n;
+
+        memset(&_ent.key, 0x0, sizeof(_ent.key));
+        _ent.key.batch = nfs_batch_self();
+        if (_ent.key.batch == 0) {
+                return sdfs_getattr(NULL, fileid, stbuf);
+        }
+
+        if (unlikely(__getattr_tab__ == NULL)) {
+                ret = swiss_create(&__getattr_tab__, "getattr", sizeof(nfs_getattr_key_t));
+                if (ret)
+                        GOTO(err_ret, ret);
+        }
+
+        memcpy(&_ent.key.fileid, fileid, sizeof(*fileid));
+        ent = swiss_find(__getattr_tab__, &_ent.key);
+        if (ent) {
+                wait.task = schedule_task_get();
+                wait.stbuf = stbuf;
+                list_add_tail(&wait.hook, &ent->wait_list);
+
+                DBUG("getattr "FID_FORMAT" batch %u coalesced\n",
+                     FID_ARG(fileid), _ent.key.batch);
+
+                return schedule_yield("getattr_wait", NULL, NULL);
+        }
+
+        ent = &_ent;
+        INIT_LIST_HEAD(&ent->wait_list);
+        ret = swiss_insert(__getattr_tab__, &ent->key, ent, 0);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = sdfs_getattr(NULL, fileid, stbuf);
+
+        swiss_remove(__getattr_tab__, &ent->key, NULL);
+        list_for_each_entry_safe(pos, n, &ent->wait_list, hook) {
+                list_del(&pos->hook);
+                if (ret == 0)
+                        *pos->stbuf = *stbuf;
+
+                schedule_resume(&pos->task, ret, NULL);
+        }
+
+        if (ret)
+                GOTO(err_ret, ret);
+
+        return 0;
+err_ret:
+        return ret;
+}
+
 static int __nfs3_getattr_svc(const sockid_t *sockid, const sunrpc_request_t *req,
                      uid_t uid, gid_t gid, nfsarg_t *_arg, buffer_t *buf)
 {
@@ -233,7 +315,7 @@ static int __nfs3_getattr_svc(const sockid_t *sockid, const sunrpc_request_t *re
 
         DBUG("----NFS3---- fileid "FID_FORMAT" len %u\n", FID_ARG(fileid), args->obj.len);
 
-        ret = sdfs_getattr(NULL, fileid, &stbuf);
+        ret = __nfs3_getattr(fileid, &stbuf);
         if (ret) {
                 GOTO(err_rep, ret);
         }
@@ -316,6 +398,10 @@ static int __nfs3_setattr_svc(const sockid_t *sockid, const sunrpc_request_t *re
               ctime ? ctime->seconds : 0, ctime);
 
         ret = sattr_set(fileid, attr1, ctime);
+        if (attr1->mode.set_it || attr1->uid.set_it || attr1->gid.set_it) {
+                access_cache_drop(fileid);
+        }
+
         if (ret)
                 GOTO(err_rep, ret);
 
@@ -419,87 +505,26 @@ err_ret:
         return ret;
 }
 
-inline static int __nfs3_access(const nfs3_fattr *attr, uid_t uid, gid_t gid)
-{
-        uint32_t mode, parm, access;
-
-        mode = attr->mode & 0777;
-
-        if (uid == attr->uid) {
-                parm = (mode & 0700)  / 0100;
-        } else if (gid == attr->gid) {
-                parm = (mode & 0070) / 010;
-        } else {
-                parm = (mode & 0007) / 01;
-        }
-
-        DBUG("mode 0%o 0%o\n", mode, parm);
-        
-        access = 0;
-        if (parm & 4) {
-                access |= (ACCESS_READ);
-        }
-
-        if (parm & 2) {
-                access |= (ACCESS_MODIFY | ACCESS_EXTEND);
-        }
-
-        if (parm & 1) {
-                access |= (ACCESS_EXECUTE);
-        }
-
-        if (attr->type == NFS3_DIR) {
-                if (access & ACCESS_READ)
-                        access |= ACCESS_LOOKUP;
-                if (access & ACCESS_MODIFY)
-                        access |= ACCESS_DELETE;
-                access &= ~ACCESS_EXECUTE;
-        }
-
-        return access;
-}
 static int __nfs3_access_svc(const sockid_t *sockid, const sunrpc_request_t *req,
                              uid_t uid, gid_t gid, nfsarg_t *_arg, buffer_t *buf)
 {
-        int ret, access = 0;
-        post_op_attr post;
+        int ret;
+        uint32_t access;
         access_args *args = &_arg->access_arg ;
         fileid_t *fileid = (fileid_t *)args->obj.val;
         access_ret res;
 
         (void) req;
-        (void) uid;
-        (void) gid;
         (void) buf;
 
         DBUG("----NFS3---- fileid "FID_FORMAT" len %u\n", FID_ARG(fileid), args->obj.len);
 
-        get_postopattr1(fileid, &post);
-
-#if ENABLE_MD_POSIX
-        access = __nfs3_access(&post.attr, uid, gid);
-#else
-        mode_t mode;
-        (void) mode;
-        mode = post.attr.mode;
-
-        
-        /* owner, group, other, and root are allowed everything */
-        access |= ACCESS_READ | ACCESS_MODIFY | ACCESS_EXTEND | ACCESS_EXECUTE;
-
-        /* adjust if directory */
-        if (post.attr.type == NFS3_DIR) {
-                if (access & ACCESS_READ)
-                        access |= ACCESS_LOOKUP;
-                if (access & ACCESS_MODIFY)
-                        access |= ACCESS_DELETE;
-                access &= ~ACCESS_EXECUTE;
-        }
-#endif
+        ret = access_cache_get(fileid, uid, gid, &access, &res.u.ok.obj_attr);
+        if (ret)
+                GOTO(err_rep, ret);
 
         res.status = NFS3_OK;
         res.u.ok.access = access & args->access;
-        res.u.ok.obj_attr = post;
 
         DBUG("fileid "FID_FORMAT" len %u ok\n", FID_ARG(fileid), args->obj.len);
 
@@ -512,13 +537,11 @@ static int __nfs3_access_svc(const sockid_t *sockid, const sunrpc_request_t *req
         __FREE_ARGS(access, buf);
 
         return 0;
-#if 0
 err_rep:
-        res.status = NFS3_EIO;
+        res.status = ret == ENOENT ? NFS3_ESTALE : NFS3_EIO;
         res.u.fail.obj_attr.attr_follow = FALSE;
         sunrpc_reply(sockid, req, ACCEPT_STATE_OK,
                      &res, (xdr_ret_t)xdr_accessret);
-#endif
 err_ret:
         __FREE_ARGS(access, buf);
         return ret;
@@ -1141,6 +1164,8 @@ static int __nfs3_rmdir_svc(const sockid_t *sockid, const sunrpc_request_t *req,
                 }
         }
 
+        access_cache_drop(&fileid);
+
 rmdir_ok:
         DBUG("rmdir ok parent "FID_FORMAT" name %s\n", FID_ARG(parent), args->obj.name);
         res.status = NFS3_OK;
@@ -1366,6 +1391,8 @@ static int __nfs3_remove_svc(const sockid_t *sockid, const sunrpc_request_t *req
         }
 #endif
 
+        access_cache_drop(&fileid);
+
 remove_ok:
         DBUG("rmove ok parent "FID_FORMAT" name %s\n",
              FID_ARG(parent), args->obj.name);
@@ -1423,6 +1450,8 @@ static int __rename_proc(const fileid_t *fromdir, const char *fromname,
                 ret = sdfs_unlink(NULL, todir, toname);
                 if (ret)
                         GOTO(err_ret, ret);
+
+                access_cache_drop(&to_fileid);
         }
         else if (S_ISDIR(stfrom.st_mode) && S_ISDIR(stto.st_mode)) {
                 uint64_t count = 0;
@@ -1434,6 +1463,8 @@ static int __rename_proc(const fileid_t *fromdir, const char *fromname,
                         ret = sdfs_rmdir(NULL, todir, toname);
                         if (ret)
                                 GOTO(err_ret, ret);
+
+                        access_cache_drop(&to_fileid);
                 }
                 else {
                         ret = EEXIST;
@@ -1601,7 +1632,8 @@ static int __nfs3_read_svc(const sockid_t *sockid, const sunrpc_request_t *req,
 {
         int ret, eof = 0;
         read_args *args = &_arg->read_arg;
-        struct stat stbuf;
+        char _md[MAX_BUF_LEN];
+        md_proto_t *md = (void *)_md;
         read_ret res;
         fileid_t *fileid = (fileid_t *)args->file.val;
         buffer_t rbuf;
@@ -1614,26 +1646,26 @@ static int __nfs3_read_svc(const sockid_t *sockid, const sunrpc_request_t *req,
         DBUG("----NFS3---- read "FID_FORMAT" size %u offset %ju\n",
               FID_ARG(fileid), args->count, args->offset);
 
-        ret = sdfs_getattr(NULL, fileid, &stbuf);
+        ret = sdfs_getmd(NULL, fileid, md);
         if (unlikely(ret)) {
                 ret = (ret == ENOENT) ? ESTALE : ret;
                 GOTO(err_rep, ret);
         }
 
         mbuffer_init(&rbuf, 0);
-        if (unlikely(args->offset >= (LLU)stbuf.st_size)) {
+        if (unlikely(args->offset >= md->at_size)) {
                 DBUG("read after offset off %llu size %llu fileid "FID_FORMAT"\n",
                      (LLU)args->offset,
-                     (LLU)stbuf.st_size, FID_ARG(fileid));
+                     (LLU)md->at_size, FID_ARG(fileid));
 
                 eof = 1;
                 goto read_zero;
         }
 
-        if (args->count + args->offset >= (LLU)stbuf.st_size) {
+        if (args->count + args->offset >= md->at_size) {
                 DBUG("read offset %llu count %u, file len %llu\n", (LLU)args->offset,
-                     args->count, (LLU)stbuf.st_size);
-                args->count = stbuf.st_size - args->offset;
+                     args->count, (LLU)md->at_size);
+                args->count = md->at_size - args->offset;
                 eof = 1;
         } else
                 eof = 0;
@@ -1641,9 +1673,10 @@ static int __nfs3_read_svc(const sockid_t *sockid, const sunrpc_request_t *req,
         if (unlikely(args->count > nfs_read_max_size)) {
                 DWARN("request too big %u\n", args->count);
                 args->count = nfs_read_max_size;
+                eof = 0;
         }
 
-        ret = sdfs_read(NULL, fileid, &rbuf, args->count, args->offset);
+        ret = sdfs_read_md(NULL, md, &rbuf, args->count, args->offset);
         if (unlikely(ret))
                 GOTO(err_rep, ret);
 
@@ -1660,7 +1693,7 @@ read_zero:
 #endif
         
         /* overlaps with resfail */
-        get_postopattr1(fileid, &res.u.ok.attr);
+        get_postopattr_md(md, &res.u.ok.attr);
 
         ret = sunrpc_reply(sockid, req, ACCEPT_STATE_OK,
                            &res, (xdr_ret_t)xdr_readret);
@@ -1691,14 +1724,21 @@ static int __nfs3_write_svc(const sockid_t *sockid, const sunrpc_request_t *req,
         write_ret res;
         fileid_t *fileid = (fileid_t *)args->file.val;
         const buffer_t *wbuf = (buffer_t *)args->data.val;
-        preop_attr attr;
+        char _md[MAX_BUF_LEN];
+        md_proto_t *md = (void *)_md;
 
         (void) uid;
         (void) gid;
 
         ANALYSIS_BEGIN(0);
         
-        get_preopattr1(fileid, &attr);
+        ret = sdfs_getmd(NULL, fileid, md);
+        if (unlikely(ret)) {
+                ret = (ret == ENOENT) ? ESTALE : ret;
+                GOTO(err_rep, ret);
+        }
+
+        get_preopattr_md(md, &res.u.ok.file_wcc.before);
 
         DBUG("----NFS3---- write "FID_FORMAT" size %u offset %ju (%ju)\n",
               FID_ARG(fileid), args->count, args->offset, args->offset / 1024 / 1024);
@@ -1708,7 +1748,7 @@ static int __nfs3_write_svc(const sockid_t *sockid, const sunrpc_request_t *req,
                 DWARN("write "FID_FORMAT" off %llu size %u\n",
                       FID_ARG(fileid), (LLU)args->offset, args->data.len);
         } else {
-                ret = sdfs_write(NULL, fileid, wbuf, args->data.len, args->offset);
+                ret = sdfs_write_md(NULL, md, wbuf, args->data.len, args->offset);
                 if (ret)
                         GOTO(err_rep, ret);
         }
@@ -1720,12 +1760,8 @@ static int __nfs3_write_svc(const sockid_t *sockid, const sunrpc_request_t *req,
         _memcpy(res.u.ok.verf, wverf, NFS3_WRITEVERFSIZE);
 
         DBUG("write %u\n", res.u.ok.count);
-#if ENABLE_MD_POSIX
-        sattr_utime(fileid, 0, 1, 1);
-#endif
-        
-        res.u.ok.file_wcc.before = attr;
-        get_postopattr1(fileid, &res.u.ok.file_wcc.after);
+
+        get_postopattr_md(md, &res.u.ok.file_wcc.after);
 
         ret = sunrpc_reply(sockid, req, ACCEPT_STATE_OK,
                            &res, (xdr_ret_t)xdr_writeret);
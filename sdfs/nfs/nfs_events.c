@@ -23,6 +23,7 @@
 #include "sunrpc_proto.h"
 #include "nfs_conf.h"
 #include "ynet_rpc.h"
+#include "qos.h"
 #include "dbg.h"
 
 typedef struct {
@@ -30,9 +31,14 @@ typedef struct {
         sunrpc_request_t req;
         uid_t uid;
         gid_t gid;
+        uint32_t batch;
         buffer_t buf;
 } sunrpc_req_t;
 
+/* requests cut from one receive share a batch, see nfs_batch_begin */
+static __thread uint32_t __nfs_batch__;
+static __thread uint32_t __nfs_batch_seq__;
+
 int acl_null_svc(const sockid_t *sockid, const sunrpc_request_t *req,
                  uid_t uid, gid_t gid, nfsarg_t *arg, buffer_t *buf)
 {
@@ -107,6 +113,9 @@ static void __nfs_exec(void *ctx)
 
         DBUG("program %u version %u\n", req->program, req->progversion);
 
+        qos_client_set(rpc_request->sockid.addr);
+        schedule_value_set(TASK_VALUE_BATCH, rpc_request->batch);
+
         if (req->program == MOUNTPROG && (req->progversion == MOUNTVERS3 ||
                                           req->progversion == MOUNTVERS1)) {
                 nfs_mount(&rpc_request->sockid, &rpc_request->req,
@@ -150,9 +159,38 @@ void nfs_newtask(const sockid_t *sockid, const sunrpc_request_t *req,
         rpc_request->req = *req;
         rpc_request->uid = uid;
         rpc_request->gid = gid;
+        rpc_request->batch = __nfs_batch__;
         mbuffer_init(&rpc_request->buf, 0);
         mbuffer_merge(&rpc_request->buf, buf);
 
         schedule_task_new1("sunrpc", __nfs_exec, rpc_request, 0, 1);
 }
 
+/*
+ * the requests of one receive are queued back to back and run in the same
+ * pass of the scheduler, so their replies are flushed together by the
+ * corenet commit.  they were all in flight at once, so the handlers may
+ * answer identical ones from a single lookup
+ */
+void nfs_batch_begin()
+{
+        __nfs_batch_seq__++;
+        if (__nfs_batch_seq__ == 0)
+                __nfs_batch_seq__++;
+
+        __nfs_batch__ = __nfs_batch_seq__;
+}
+
+void nfs_batch_end()
+{
+        __nfs_batch__ = 0;
+}
+
+uint32_t nfs_batch_self()
+{
+        uint32_t batch;
+
+        schedule_value_get(TASK_VALUE_BATCH, &batch);
+
+        return batch == (uint32_t)-1 ? 0 : batch;
+}
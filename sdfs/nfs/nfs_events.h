@@ -28,5 +28,8 @@ extern int nfs_nlm4(const sockid_t *sockid, const sunrpc_request_t *req,
 
 void nfs_newtask(const sockid_t *sockid, const sunrpc_request_t *req,
                   uid_t uid, gid_t gid, buffer_t *buf);
+void nfs_batch_begin();
+void nfs_batch_end();
+uint32_t nfs_batch_self();
 
 #endif
@@ -252,7 +252,8 @@ static int __nlm4_lock_wait(const fileid_t *_fileid, const sdfs_lock_t *_lock_)
                 ret = sdfs_setlock(NULL, &fileid, lock);
                 if (ret) {
                         if (ret == EWOULDBLOCK) {
-                                schedule_sleep("nlm", 100 * 1000);
+                                /* woken by a local unlock, the timeout covers other servers */
+                                sdfs_lock_wait(NULL, &fileid, 100 * 1000);
                                 continue;
                         } else {
                                 GOTO(err_reg, ret);
@@ -49,183 +49,335 @@
 //int read_dir(const char *path, uint64_t offset, char *verf,
 //                      uint32_t count)
 
+/*
+ * the cookie handed to the client is the position itself:
+ *
+ * roff: HSCAN cursor the batch holding the entry was read from
+ * cur:  index of the entry in that batch
+ * id:   readdir cursor caching the batch, 0 only in the start cookie
+ *
+ * so a cursor missing from the table (expired, evicted or restarted
+ * server) is rebuilt by reading the batch at roff again.  the cursor
+ * keeps the whole 64 bit HSCAN cursor, one past 32 bits is sent as
+ * READDIR_ROFF_MAX and answered with NFS3ERR_BAD_COOKIE once it is gone.
+ */
 typedef struct {
-        //uint16_t fid;
-        uint8_t id;
-        uint8_t cur;
-        uint16_t __pad__;
+        uint16_t id;
+        uint16_t cur;
         uint32_t roff;
 } cookie_t;
 
-static int __readdir_save(cookie_t *_cookie, const dirlist_t *dirlist)
+#define READDIR_BATCH (UINT8_MAX / 2)
+#define READDIR_CURSOR_MAX (UINT16_MAX + 1)
+#define READDIR_ROFF_MAX UINT32_MAX
+
+typedef struct {
+        struct list_head hook;
+        uint16_t id;
+        fileid_t dirid;
+        uint64_t roff;
+        time_t atime;
+        dirlist_t *dirlist;
+} rdcursor_t;
+
+typedef struct {
+        sy_spinlock_t lock;
+        struct list_head lru;
+        uint16_t seq;
+        uint64_t used;
+        rdcursor_t *array[READDIR_CURSOR_MAX];
+} rdcursor_table_t;
+
+static rdcursor_table_t *__rdcursor_table__ = NULL;
+
+static uint32_t __rdcursor_roff(uint64_t roff)
 {
-        int ret;
-        cookie_t cookie = *_cookie;
-        char path[MAX_PATH_LEN];
-        uint8_t rand, i;
+        return roff < READDIR_ROFF_MAX ? roff : READDIR_ROFF_MAX;
+}
 
-        if (cookie.id == 0 && cookie.cur == 0) {
-                rand = _random_range(1, UINT8_MAX);
+static void __rdcursor_free(rdcursor_t *cursor)
+{
+        if (cursor->dirlist)
+                yfree((void **)&cursor->dirlist);
 
-                for (i = 0; i < UINT8_MAX; i++) {
-                        cookie.id = (rand + i) % UINT8_MAX;
-                        snprintf(path, MAX_PATH_LEN, "/dev/shm/sdfs/nfs/readdir/%u", cookie.id);
+        yfree((void **)&cursor);
+}
 
-                        ret = _set_value(path, (void *)dirlist, DIRLIST_SIZE(dirlist->count),
-                                         O_CREAT | O_EXCL);
-                        if (ret) {
-                                if (ret == EEXIST) {
-                                        //DWARN("save dir %s fail\n", path);
-                                        continue;
-                                }
+static uint64_t __rdcursor_size(const rdcursor_t *cursor)
+{
+        return sizeof(*cursor) + (cursor->dirlist ? DIRLIST_SIZE(cursor->dirlist->count) : 0);
+}
 
-                                GOTO(err_ret, ret);
-                        }
+static void __rdcursor_unlink(rdcursor_table_t *table, rdcursor_t *cursor)
+{
+        YASSERT(table->array[cursor->id] == cursor);
 
-                        DBUG("save %s\n", path);
-                        break;
-                }
+        table->array[cursor->id] = NULL;
+        list_del(&cursor->hook);
+        table->used -= __rdcursor_size(cursor);
+}
 
-                *_cookie = cookie;
-        } else {
-                snprintf(path, MAX_PATH_LEN, "/dev/shm/sdfs/nfs/readdir/%u", cookie.id);
-                
-                ret = _set_value(path, (void *)dirlist, DIRLIST_SIZE(dirlist->count), O_CREAT);
-                if (ret) {
-                        GOTO(err_ret, ret);
+/*
+ * drop expired cursors and keep the table below readdir_cache,
+ * called with the table locked, victims are freed by the caller
+ */
+static void __rdcursor_recycle(rdcursor_table_t *table, struct list_head *list)
+{
+        rdcursor_t *cursor;
+        time_t now = gettime();
+
+        while (!list_empty(&table->lru)) {
+                cursor = list_entry(table->lru.prev, rdcursor_t, hook);
+                if (table->used <= (uint64_t)nfsconf.readdir_cache
+                    && now - cursor->atime < nfsconf.readdir_timeout) {
+                        break;
                 }
 
-                DBUG("save %s\n", path);
+                DBUG("recycle cursor %u "CHKID_FORMAT"\n", cursor->id,
+                     CHKID_ARG(&cursor->dirid));
+                __rdcursor_unlink(table, cursor);
+                list_add_tail(&cursor->hook, list);
         }
+}
 
-        return 0;
-err_ret:
-        return ret;
+static void __rdcursor_free_list(struct list_head *list)
+{
+        struct list_head *pos, *n;
+
+        list_for_each_safe(pos, n, list) {
+                list_del(pos);
+                __rdcursor_free(list_entry(pos, rdcursor_t, hook));
+        }
 }
 
-static int __readdir_load(const cookie_t *cookie, dirlist_t **_dirlist)
+/*
+ * take the cursor out of the table while a request uses it, a concurrent
+ * request with the same cookie misses and rebuilds its own
+ */
+static rdcursor_t *__rdcursor_checkout(const fileid_t *dirid, const cookie_t *cookie)
 {
         int ret;
-        char path[MAX_PATH_LEN];
-        dirlist_t *dirlist;
-        struct stat stbuf;
+        rdcursor_t *cursor;
+        rdcursor_table_t *table = __rdcursor_table__;
 
-        snprintf(path, MAX_PATH_LEN, "/dev/shm/sdfs/nfs/readdir/%u", cookie->id);
+        ret = sy_spin_lock(&table->lock);
+        if (unlikely(ret))
+                UNIMPLEMENTED(__DUMP__);
 
-        ret = stat(path, &stbuf);
-        if (ret < 0) {
-                ret = errno;
-                DBUG("%s not found\n", path);
-                GOTO(err_ret, ret);
+        cursor = table->array[cookie->id];
+        if (cursor == NULL
+            || fileid_cmp(&cursor->dirid, dirid)
+            || __rdcursor_roff(cursor->roff) != cookie->roff
+            || cookie->cur >= cursor->dirlist->count) {
+                cursor = NULL;
+        } else {
+                __rdcursor_unlink(table, cursor);
         }
-                 
-        ret = ymalloc((void**)&dirlist, stbuf.st_size);
-        if (ret) {
+
+        sy_spin_unlock(&table->lock);
+
+        return cursor;
+}
+
+static void __rdcursor_checkin(rdcursor_t *cursor)
+{
+        int ret;
+        rdcursor_t *old;
+        struct list_head list;
+        rdcursor_table_t *table = __rdcursor_table__;
+
+        INIT_LIST_HEAD(&list);
+        cursor->atime = gettime();
+
+        ret = sy_spin_lock(&table->lock);
+        if (unlikely(ret))
                 UNIMPLEMENTED(__DUMP__);
+
+        old = table->array[cursor->id];
+        if (old) {
+                __rdcursor_unlink(table, old);
+                list_add_tail(&old->hook, &list);
         }
-       
-        ret = _get_value(path, (void *)dirlist, stbuf.st_size);
-        if (ret < 0) {
-                ret = -ret;
-                GOTO(err_ret, ret);
+
+        table->array[cursor->id] = cursor;
+        list_add(&cursor->hook, &table->lru);
+        table->used += __rdcursor_size(cursor);
+
+        __rdcursor_recycle(table, &list);
+
+        sy_spin_unlock(&table->lock);
+
+        __rdcursor_free_list(&list);
+}
+
+static uint16_t __rdcursor_newid()
+{
+        int ret, i;
+        uint16_t id;
+        rdcursor_table_t *table = __rdcursor_table__;
+
+        ret = sy_spin_lock(&table->lock);
+        if (unlikely(ret))
+                UNIMPLEMENTED(__DUMP__);
+
+        for (i = 0; i < READDIR_CURSOR_MAX; i++) {
+                id = ++table->seq;
+                if (id && table->array[id] == NULL)
+                        break;
         }
 
-        YASSERT(ret == stbuf.st_size);
+        /* table full, the occupant is replaced at checkin */
+        if (id == 0)
+                id = ++table->seq;
+
+        sy_spin_unlock(&table->lock);
 
-        DBUG("load %s\n", path);
+        return id;
+}
+
+static int __rdcursor_load(sdfs_ctx_t *ctx, rdcursor_t *cursor, uint64_t offset)
+{
+        int ret;
 
-        *_dirlist = dirlist;
+        if (cursor->dirlist)
+                yfree((void **)&cursor->dirlist);
+
+        ret = sdfs_dirlist(ctx, &cursor->dirid, READDIR_BATCH, offset, &cursor->dirlist);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        cursor->roff = offset;
+
+        DBUG("load "CHKID_FORMAT" offset %ju count %u next %ju\n",
+             CHKID_ARG(&cursor->dirid), offset, cursor->dirlist->count,
+             cursor->dirlist->offset);
 
         return 0;
 err_ret:
         return ret;
 }
 
-static void __readdir_remove(const cookie_t *cookie)
+static int __rdcursor_get(sdfs_ctx_t *ctx, const fileid_t *dirid, const cookie_t *cookie,
+                          rdcursor_t **_cursor)
 {
-        char path[MAX_PATH_LEN];
+        int ret;
+        rdcursor_t *cursor;
+
+        if (cookie->id) {
+                cursor = __rdcursor_checkout(dirid, cookie);
+                if (cursor) {
+                        cursor->dirlist->cursor = cookie->cur + 1;
+                        goto out;
+                }
+
+                /* the batch is past what the cookie holds, it can't be read again */
+                if (cookie->roff == READDIR_ROFF_MAX) {
+                        ret = EBADR;
+                        GOTO(err_ret, ret);
+                }
+        }
+
+        ret = ymalloc((void **)&cursor, sizeof(*cursor));
+        if (ret)
+                GOTO(err_ret, ret);
+
+        memset(cursor, 0x0, sizeof(*cursor));
+        cursor->dirid = *dirid;
+        cursor->id = cookie->id ? cookie->id : __rdcursor_newid();
+
+        ret = __rdcursor_load(ctx, cursor, cookie->id ? cookie->roff : 0);
+        if (ret)
+                GOTO(err_free, ret);
 
         if (cookie->id) {
-                snprintf(path, MAX_PATH_LEN, "/dev/shm/sdfs/nfs/readdir/%u", cookie->id);
-                unlink(path);
+                DBUG("rebuild cursor %u "CHKID_FORMAT" roff %u cur %u\n",
+                     cookie->id, CHKID_ARG(dirid), cookie->roff, cookie->cur);
+                cursor->dirlist->cursor = _min(cookie->cur + 1, cursor->dirlist->count);
         }
+
+out:
+        *_cursor = cursor;
+
+        return 0;
+err_free:
+        __rdcursor_free(cursor);
+err_ret:
+        return ret;
 }
 
-static int __readdir_getlist(sdfs_ctx_t *ctx, const dirid_t *dirid, cookie_t *_cookie, dirlist_t **_dirlist)
+/*
+ * next entry of the listing, streaming the following HSCAN batch in
+ * when the current one is used up, ENOENT at the end of the directory
+ */
+static int __rdcursor_peek(sdfs_ctx_t *ctx, rdcursor_t *cursor, const __dirlist_t **node)
 {
         int ret;
         dirlist_t *dirlist;
-        cookie_t cookie;
 
-        cookie = *_cookie;
-        if (cookie.id == 0 && cookie.cur == 0) {
-                ret = sdfs_dirlist(ctx, dirid, UINT8_MAX / 2, 0, &dirlist);
-                if (ret)
-                        GOTO(err_ret, ret);
+        while (1) {
+                dirlist = cursor->dirlist;
+                if (dirlist->cursor < dirlist->count) {
+                        *node = &dirlist->array[dirlist->cursor];
+                        break;
+                }
 
-                ret = __readdir_save(&cookie, dirlist);
-                if (ret)
-                        GOTO(err_ret, ret);
+                if (dirlist->offset == 0) {
+                        ret = ENOENT;
+                        goto err_ret;
+                }
 
-                DBUG("cookie %u\n", cookie.id);
-        } else {
-                ret = __readdir_load(&cookie, &dirlist);
+                ret = __rdcursor_load(ctx, cursor, dirlist->offset);
                 if (ret)
                         GOTO(err_ret, ret);
         }
 
-        cookie.roff = dirlist->offset;
-        *_dirlist = dirlist;
-        *_cookie = cookie;
-        DBUG("cookie %u\n", _cookie->id);
-
         return 0;
 err_ret:
         return ret;
 }
 
-static int __readdir_putlist(sdfs_ctx_t *ctx, const dirid_t *dirid, const cookie_t *cookie, dirlist_t *dirlist, int *_eof)
+static void __rdcursor_cookie(const rdcursor_t *cursor, cookie_t *cookie)
 {
-        int ret, eof;
-        uint64_t offset;
-
-        if (dirlist->cursor == dirlist->count) {//finished list
-                if ((cookie->id == 0 && cookie->cur == 0) || dirlist->offset == 0) {
-                        yfree((void **)&dirlist);
-                        __readdir_remove(cookie);
-                        eof = TRUE;
-                        goto out;
-                } else {
-                        offset = dirlist->offset;
-                        yfree((void **)&dirlist);
-                        
-                        ret = sdfs_dirlist(ctx, dirid, UINT8_MAX / 2, offset, &dirlist);
-                        if (ret) {
-#if 0
-                                ret = __readdir_save(&cookie, dirlist);
-                                if (ret)
-                                        UNIMPLEMENTED(__DUMP__);
-#endif
-                                
-                                GOTO(err_ret, ret);
-                        }
-                }
+        cookie->id = cursor->id;
+        cookie->cur = cursor->dirlist->cursor;
+        cookie->roff = __rdcursor_roff(cursor->roff);
+}
+
+static void __rdcursor_put(rdcursor_t *cursor, int eof)
+{
+        if (eof) {
+                __rdcursor_free(cursor);
+        } else {
+                __rdcursor_checkin(cursor);
         }
+}
 
-        cookie_t tmp = *cookie;
-        ret = __readdir_save(&tmp, dirlist);
+int readdir_init()
+{
+        int ret;
+        rdcursor_table_t *table;
+
+        ret = ymalloc((void **)&table, sizeof(*table));
         if (ret)
                 GOTO(err_ret, ret);
 
-        eof = FALSE;
+        memset(table, 0x0, sizeof(*table));
 
-out:
-        if (_eof)
-                *_eof = eof;
+        ret = sy_spin_init(&table->lock);
+        if (ret)
+                GOTO(err_free, ret);
+
+        INIT_LIST_HEAD(&table->lru);
+        table->seq = _random();
+
+        __rdcursor_table__ = table;
+
+        DINFO("readdir cursor cache %ju, timeout %u\n",
+              (uint64_t)nfsconf.readdir_cache, nfsconf.readdir_timeout);
 
-        DBUG("eof %d\n", eof);
-        
         return 0;
+err_free:
+        yfree((void **)&table);
 err_ret:
         return ret;
 }
@@ -277,10 +429,9 @@ int readdirplus(sdfs_ctx_t *ctx, const fileid_t *fileid, uint64_t _cookie, char
         int ret;
         uint32_t i, real_count;
         readdirplus_retok *resok;
-        //uint64_t cookie = _offset;
-        dirlist_t *dirlist;
+        rdcursor_t *cursor;
         cookie_t cookie;
-        __dirlist_t *node;
+        const __dirlist_t *node;
 
         YASSERT(sizeof(cookie) == sizeof(_cookie));
         memcpy(&cookie, &_cookie, sizeof(cookie));
@@ -309,38 +460,42 @@ int readdirplus(sdfs_ctx_t *ctx, const fileid_t *fileid, uint64_t _cookie, char
         DBUG("readdir "CHKID_FORMAT" count %u, cookie %u,%u\n",
               CHKID_ARG(fileid), count, cookie.id, cookie.cur);
 
-        ret = __readdir_getlist(ctx, fileid, &cookie, &dirlist);
+        resok = &res->u.ok;
+        resok->reply.eof = 0;
+        _entryplus[0].name = NULL;
+
+        ret = __rdcursor_get(ctx, fileid, &cookie, &cursor);
         if (ret) {
                 if (ret == ENOENT) {
-                        resok = &res->u.ok;
                         resok->reply.eof = 1;
-                        _entryplus[0].name = NULL;
                         goto out;
                 } else 
                         GOTO(err_ret, ret);
         }
 
-        if (_cookie != 0 && cookie.cur + 1 != dirlist->cursor) {
-                DWARN("readdir "FID_FORMAT" count %u, cooke.id %u cur %u -> %u\n",
-                      FID_ARG(fileid), count, cookie.id, cookie.cur, dirlist->cursor);
-                //dirlist->cursor = cookie.cur;
-        }
-
-        YASSERT(dirlist->count >= dirlist->cursor);
-
         i = 0;
-        _entryplus[0].name = NULL;
-        while (dirlist->cursor < dirlist->count) {
-                YASSERT(real_count < count);
-                YASSERT(i + 1 < MAX_DIRPLUS_ENTRIES);
+        while (1) {
+                ret = __rdcursor_peek(ctx, cursor, &node);
+                if (ret) {
+                        if (ret == ENOENT) {
+                                resok->reply.eof = 1;
+                                break;
+                        } else
+                                GOTO(err_free, ret);
+                }
 
-                node = &dirlist->array[dirlist->cursor];
                 if (strcmp(node->name, NFS_REMOVED) == 0) {
-                        dirlist->cursor++;
+                        cursor->dirlist->cursor++;
                         continue;
                 }
 
-                cookie.cur = dirlist->cursor;
+                if (i && (real_count + ENTRY_SIZE + NAME_SIZE(node->name) >= count
+                          || i + 1 >= MAX_DIRPLUS_ENTRIES)) {
+                        DBUG("overflowed %u\n", i);
+                        break;
+                }
+
+                __rdcursor_cookie(cursor, &cookie);
                 ret = __readirplus_entry(&_entryplus[i], &obj[i * MAX_NAME_LEN],
                                          &fharray[i], node, &cookie);
                 if (ret)
@@ -353,23 +508,10 @@ int readdirplus(sdfs_ctx_t *ctx, const fileid_t *fileid, uint64_t _cookie, char
                 real_count += (ENTRY_SIZE + NAME_SIZE(_entryplus[i].name));
 
                 i++;
-                dirlist->cursor++;
-                
-                if ((real_count + ENTRY_SIZE + NAME_SIZE(dirlist->array[dirlist->cursor].name)
-                     >= count && i > 0)
-                    || (i > MAX_DIRPLUS_ENTRIES)) {
-                        //_entryplus[i].next = NULL;
-                        DBUG("overflowed %u\n", i);
-                        break;
-                }
-                
+                cursor->dirlist->cursor++;
         }
 
-        resok = &res->u.ok;
-        ret = __readdir_putlist(NULL, fileid, &cookie, dirlist, &resok->reply.eof);
-        if (ret) {
-                GOTO(err_ret, ret);
-        }
+        __rdcursor_put(cursor, resok->reply.eof);
 
 out:
         if (_entryplus[0].name)
@@ -384,7 +526,7 @@ out:
 
         return 0;
 err_free:
-        __readdir_putlist(ctx, fileid, &cookie, dirlist, NULL);
+        __rdcursor_free(cursor);
 err_ret:
         res->status = readdir_err(ret);
         return ret;
@@ -417,8 +559,8 @@ static int __readir_entry(entry *entry, char *name,
         
         entry->next = NULL;
  
-        DBUG("fileid "CHKID_FORMAT" name %s mode %o cookie %ju\n", CHKID_ARG(&node->fileid),
-             node->name, stbuf.st_mode, cookie);
+        DBUG("fileid "CHKID_FORMAT" name %s mode %o cookie %u,%u\n", CHKID_ARG(&node->fileid),
+             node->name, stbuf.st_mode, cookie->id, cookie->cur);
 
         return 0;
 err_ret:
@@ -433,9 +575,9 @@ int read_dir(sdfs_ctx_t *ctx, const fileid_t *fileid, uint64_t _cookie, char *ve
         int ret;
         uint32_t i, real_count;
         readdir_retok *resok;
-        dirlist_t *dirlist;
+        rdcursor_t *cursor;
         cookie_t cookie;
-        __dirlist_t *node;
+        const __dirlist_t *node;
 
         YASSERT(sizeof(cookie) == sizeof(_cookie));
         memcpy(&cookie, &_cookie, sizeof(cookie));
@@ -464,40 +606,42 @@ int read_dir(sdfs_ctx_t *ctx, const fileid_t *fileid, uint64_t _cookie, char *ve
 
         DBUG("readdir "FID_FORMAT" count %u\n", FID_ARG(fileid), count);
 
-        ret = __readdir_getlist(ctx, fileid, &cookie, &dirlist);
+        resok = &res->u.ok;
+        resok->reply.eof = 0;
+        _entry[0].name = NULL;
+
+        ret = __rdcursor_get(ctx, fileid, &cookie, &cursor);
         if (ret) {
                 if (ret == ENOENT) {
-                        resok = &res->u.ok;
-                        
                         resok->reply.eof = 1;
-                        _entry[0].name = NULL;
                         goto out;
                 } else 
                         GOTO(err_ret, ret);
         }
 
-        if (cookie.id != 0 && cookie.cur + 1 != dirlist->cursor) {
-                DWARN("readdir "FID_FORMAT" count %u, cur %u -> %u\n",
-                      FID_ARG(fileid), count, dirlist->cursor, cookie.cur);
-                //dirlist->cursor = cookie.cur;
-        }
-
-        YASSERT(dirlist->count >= dirlist->cursor);
-        
         i = 0;
-        _entry[0].name = NULL;
-
-        while (dirlist->cursor < dirlist->count) {
-                YASSERT(real_count < count);
-                YASSERT(i + 1 < MAX_DIRPLUS_ENTRIES);
+        while (1) {
+                ret = __rdcursor_peek(ctx, cursor, &node);
+                if (ret) {
+                        if (ret == ENOENT) {
+                                resok->reply.eof = 1;
+                                break;
+                        } else
+                                GOTO(err_free, ret);
+                }
 
-                node = &dirlist->array[dirlist->cursor];
                 if (strcmp(node->name, NFS_REMOVED) == 0) {
-                        dirlist->cursor++;
+                        cursor->dirlist->cursor++;
                         continue;
                 }
-                
-                cookie.cur = dirlist->cursor;
+
+                if (i && (real_count + ENTRY_SIZE + NAME_SIZE(node->name) >= count
+                          || i + 1 >= MAX_DIRPLUS_ENTRIES)) {
+                        DBUG("overflowed %u\n", i);
+                        break;
+                }
+
+                __rdcursor_cookie(cursor, &cookie);
                 ret = __readir_entry(&_entry[i], &obj[i * NFS_PATHLEN_MAX],
                                          node, &cookie);
                 if (ret)
@@ -510,24 +654,12 @@ int read_dir(sdfs_ctx_t *ctx, const fileid_t *fileid, uint64_t _cookie, char *ve
                 real_count += (ENTRY_SIZE + NAME_SIZE(_entry[i].name));
 
                 i++;
-                dirlist->cursor++;
-                
-                if ((real_count + ENTRY_SIZE + NAME_SIZE(dirlist->array[dirlist->cursor].name)
-                     >= count && i > 0)
-                    || (i > MAX_DIRPLUS_ENTRIES)) {
-                        //_entry[i - 1].next = NULL;
-                        DBUG("overflowed %u\n", i);
-                        break;
-                }
+                cursor->dirlist->cursor++;
         }
         
         DBUG("ly_opendir "FID_FORMAT" end.\n", FID_ARG(fileid));
 
-        resok = &res->u.ok;
-        ret = __readdir_putlist(ctx, fileid, &cookie, dirlist, &resok->reply.eof);
-        if (ret) {
-                GOTO(err_ret, ret);
-        }
+        __rdcursor_put(cursor, resok->reply.eof);
 
 out:
         if (_entry[0].name)
@@ -541,7 +673,7 @@ out:
 
         return 0;
 err_free:
-        __readdir_putlist(ctx, fileid, &cookie, dirlist, NULL);
+        __rdcursor_free(cursor);
 err_ret:
         return ret;
 }
@@ -10,6 +10,8 @@
 #define MAX_ENTRIES MAX_READDIR_ENTRIES
 #define MAX_DIRPLUS_ENTRIES MAX_READDIR_ENTRIES
 
+int readdir_init();
+
 int read_dir(sdfs_ctx_t *ctx, const fileid_t *fileid, uint64_t offset, char *verf,
              uint32_t count, readdir_ret *res, entry *entrys,
              char *obj);
@@ -208,6 +208,8 @@ static int __sunrpc_recv(void *_ctx, void *buf, int *_count)
 
         DBUG("recv %u\n", mbuf->len);
 
+        nfs_batch_begin();
+
         while (mbuf->len >= sizeof(sunrpc_request_t)) {
                 mbuffer_get(buf, tmp, sizeof(sunrpc_request_t));
                 sunrpc_pack_len(tmp, sizeof(sunrpc_request_t), &msg_len, &io_len);
@@ -226,6 +228,8 @@ static int __sunrpc_recv(void *_ctx, void *buf, int *_count)
                 count++;
         }
 
+        nfs_batch_end();
+
         *_count = count;
 
         return 0;
@@ -236,6 +240,7 @@ void __sunrpc_check__(void *arg1, void *arg2)
         int ret;
         sunrpc_ctx_t *ctx = arg1;
         core_t *core = core_self();
+        xdr_stat_t decode, encode;
         
         (void) arg2;
 
@@ -246,6 +251,12 @@ void __sunrpc_check__(void *arg1, void *arg2)
               ctx->sockid.sd);
 
         mem_hugepage_private_dump();
+
+        xdr_stat(&decode, &encode);
+        DINFO("sunrpc client %s, xdr decode %ju/%ju bytes copied in %ju/%ju op,"
+              " encode %ju bytes in %ju op\n", ctx->host,
+              decode.copied, decode.bytes, decode.copy, decode.op,
+              encode.bytes, encode.op);
         
         if (ctx->running)
                 return;
@@ -16,12 +16,36 @@ int __xdr_void(void)
         return 0;
 }
 
+static __thread xdr_stat_t __xdr_decode__;
+static __thread xdr_stat_t __xdr_encode__;
+
+void xdr_stat(xdr_stat_t *decode, xdr_stat_t *encode)
+{
+        *decode = __xdr_decode__;
+        *encode = __xdr_encode__;
+}
+
+static void __xdr_stat(xdr_stat_t *stat, uint32_t len, uint64_t copied)
+{
+        stat->op++;
+        stat->bytes += len;
+        if (copied) {
+                stat->copy++;
+                stat->copied += copied;
+        }
+}
+
+/*
+ * the payload is moved between buffers by segment, pop shares the receive
+ * segments and merge chains the reply segments after the header
+ */
 int __xdr_buffer(xdr_t *xdr, char **_buf, uint32_t *size,
 			uint32_t max)
 {
         int ret;
         buffer_t *buf;
         uint32_t len, tail;
+        uint64_t copied;
         char blank[4];
 
         switch (xdr->op) {
@@ -32,7 +56,7 @@ int __xdr_buffer(xdr_t *xdr, char **_buf, uint32_t *size,
 
                 len = htonl(len);
 
-                if (len > max) {
+                if (len > max || len > xdr->buf->len) {
                         ret = EINVAL;
                         GOTO(err_ret, ret);
                 }
@@ -43,9 +67,18 @@ int __xdr_buffer(xdr_t *xdr, char **_buf, uint32_t *size,
 
                 mbuffer_init(buf, 0);
 
+                copied = mbuffer_copied();
                 ret = mbuffer_pop(xdr->buf, buf, len);
                 if (ret) {
-                        GOTO(err_ret, ret);
+                        GOTO(err_free, ret);
+                }
+
+                __xdr_stat(&__xdr_decode__, len, mbuffer_copied() - copied);
+
+                tail = len % 4;
+                tail = tail ? (4 - tail) : 0;
+                if (tail && xdr->buf->len >= tail) {
+                        mbuffer_pop(xdr->buf, NULL, tail);
                 }
 
                 *_buf = (void *)buf;
@@ -73,6 +106,7 @@ int __xdr_buffer(xdr_t *xdr, char **_buf, uint32_t *size,
 #endif
 
                 mbuffer_merge(xdr->buf, buf);
+                __xdr_stat(&__xdr_encode__, *size, 0);
 
                 if (tail) {
                         _memset(blank, 0x0, tail);
@@ -94,6 +128,9 @@ int __xdr_buffer(xdr_t *xdr, char **_buf, uint32_t *size,
         }
 
         return 0;
+err_free:
+        mbuffer_free(buf);
+        yfree((void **)&buf);
 err_ret:
         return ret;
 }
@@ -132,6 +132,10 @@ int conf_init(const char *conf_path)
         mdsconf.disk_keep = (100 * 1024 * 1024 * 1024LL); /*100G*/
         nfsconf.rsize = 1048576;
         nfsconf.wsize = 1048576;
+        nfsconf.readdir_cache = 64 * 1024 * 1024;
+        nfsconf.readdir_timeout = 60;
+        nfsconf.access_cache = 16 * 1024 * 1024;
+        nfsconf.access_timeout = 3;
         nfsconf.nfs_port = NFS_SERVICE_DEF;
         nfsconf.nlm_port = NLM_SERVICE_DEF;
         memset(sanconf.iqn, 0x0, MAXSIZE);
@@ -145,9 +149,11 @@ int conf_init(const char *conf_path)
         gloconf.hb_retry = 3;
         strcpy(gloconf.nfs_srv, "native");
         gloconf.lease_timeout = 20;
+        gloconf.write_lease = 0;
+        gloconf.inline_size = 0;
+        gloconf.corenet_stripe = 1;
         mdsconf.redis_sharding = 3;
         mdsconf.redis_replica = 2;
-        mdsconf.redis_thread = 0;
         mdsconf.ac_timeout = ATTR_QUEUE_TMO * 2;
         //mdsconf.ac_timeout = 0;
         mdsconf.redis_baseport = REDIS_BASEPORT;
@@ -164,6 +170,13 @@ int conf_init(const char *conf_path)
         cdsconf.aio_thread = 0;
         cdsconf.queue_depth = 128;
         cdsconf.cds_polling = 0;
+        cdsconf.extent_store = 0;
+        cdsconf.extent_checkpoint = 600;
+        cdsconf.extent_device[0] = '\0';
+        cdsconf.tier_move = 0;
+        cdsconf.tier_hot = 64;
+        cdsconf.tier_cold = 60 * 60 * 24;
+        cdsconf.tier_rate = 32;
         gloconf.network = 0;
         gloconf.solomode = 0;
         gloconf.memcache_count = 1024;
@@ -188,6 +201,10 @@ int conf_init(const char *conf_path)
         gloconf.valgrind = 0;
         strcpy(gloconf.master_vip, "\0");
         gloconf.polling_core = 8;
+        gloconf.task_max = TASK_MAX_DEF;
+        gloconf.qos_client_iops = 0;
+        gloconf.qos_client_bw = 0;
+        gloconf.qos_burst = 1;
         gloconf.polling_timeout = 0; //秒
         gloconf.aio_core = 0;
         gloconf.wmem_max = SO_XMITBUF;
@@ -494,6 +511,14 @@ int set_value(const char* key, const char* value, int type)
                 nfsconf.rsize = _value;
         else if (keyis("wsize", key))
                 nfsconf.wsize = _value;
+        else if (keyis("readdir_cache", key))
+                nfsconf.readdir_cache = _value;
+        else if (keyis("readdir_timeout", key))
+                nfsconf.readdir_timeout = _value;
+        else if (keyis("access_cache", key))
+                nfsconf.access_cache = _value;
+        else if (keyis("access_timeout", key))
+                nfsconf.access_timeout = _value;
         else if (keyis("nlm_port", key))
                 nfsconf.nlm_port = _value;
         else if (keyis("nfs_port", key))
@@ -536,8 +561,6 @@ int set_value(const char* key, const char* value, int type)
                 mdsconf.redis_sharding = _value;
         else if (keyis("redis_replica", key))
                 mdsconf.redis_replica = _value;
-        else if (keyis("redis_thread", key))
-                mdsconf.redis_thread = _value;
         else if (keyis("ac_timeout", key))
                 mdsconf.ac_timeout = _value;
         else if (keyis("main_loop_threads ", key)) {
@@ -561,6 +584,20 @@ int set_value(const char* key, const char* value, int type)
                 cdsconf.aio_thread = _value;
         else if (keyis("cds_polling", key))
                 cdsconf.cds_polling = _value;
+        else if (keyis("extent_store", key))
+                cdsconf.extent_store = _value;
+        else if (keyis("extent_checkpoint", key))
+                cdsconf.extent_checkpoint = _value;
+        else if (keyis("extent_device", key))
+                strncpy(cdsconf.extent_device, value, MAXSIZE);
+        else if (keyis("tier_move", key))
+                cdsconf.tier_move = _value;
+        else if (keyis("tier_hot", key))
+                cdsconf.tier_hot = _value;
+        else if (keyis("tier_cold", key))
+                cdsconf.tier_cold = _value;
+        else if (keyis("tier_rate", key))
+                cdsconf.tier_rate = _value;
         /**
          * global configure
          */
@@ -574,6 +611,22 @@ int set_value(const char* key, const char* value, int type)
                 gloconf.backtrace = _value;
         } else if (keyis("testing", key)) {
                 gloconf.testing = _value;
+        } else if (keyis("lease_timeout", key)) {
+                gloconf.lease_timeout = _value;
+        } else if (keyis("write_lease", key)) {
+                gloconf.write_lease = _value;
+        } else if (keyis("inline_size", key)) {
+                gloconf.inline_size = _value;
+
+                if (gloconf.inline_size > MD_INLINE_MAX)
+                        gloconf.inline_size = MD_INLINE_MAX;
+        } else if (keyis("corenet_stripe", key)) {
+                gloconf.corenet_stripe = _value;
+
+                if (gloconf.corenet_stripe < 1)
+                        gloconf.corenet_stripe = 1;
+                if (gloconf.corenet_stripe > CORENET_STRIPE_MAX)
+                        gloconf.corenet_stripe = CORENET_STRIPE_MAX;
         } else if (keyis("coredump", key)) {
                 gloconf.coredump = _value;
         } else if (keyis("chunk_rep", key)) {
@@ -613,6 +666,20 @@ int set_value(const char* key, const char* value, int type)
                 gloconf.polling_core = _value;
         else if (keyis("polling_timeout", key))
                 gloconf.polling_timeout = _value * 1000;
+        else if (keyis("task_max", key)) {
+                gloconf.task_max = _value;
+
+                if (gloconf.task_max < TASK_MAX_DEF / 8)
+                        gloconf.task_max = TASK_MAX_DEF / 8;
+                if (gloconf.task_max > TASK_MAX_LIMIT)
+                        gloconf.task_max = TASK_MAX_LIMIT;
+        }
+        else if (keyis("qos_client_iops", key))
+                gloconf.qos_client_iops = _value;
+        else if (keyis("qos_client_bw", key))
+                gloconf.qos_client_bw = _value;
+        else if (keyis("qos_burst", key))
+                gloconf.qos_burst = _value < 1 ? 1 : _value;
         else if (keyis("aio_core", key))
                 gloconf.aio_core = _value;
         else if (keyis("max_lvm", key))
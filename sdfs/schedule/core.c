@@ -206,6 +206,15 @@ static void __core_check(core_t *core)
         __core_check_callback(core, now);
 }
 
+static inline void __core_poller_run(core_t *core, void *ctx)
+{
+        sub_poller_t *poller;
+
+        list_for_each_entry(poller, &core->poller_list, list_entry) {
+                poller->poll(ctx, poller->user_data);
+        }
+}
+
 static inline void IO_FUNC __core_worker_run(core_t *core, void *ctx)
 {
 #if ENABLE_CORENET
@@ -241,7 +250,7 @@ static inline void IO_FUNC __core_worker_run(core_t *core, void *ctx)
         corerpc_scan(ctx);
 #endif
 
-        redis_co_run(ctx);
+        __core_poller_run(core, ctx);
         
         schedule_scan(core->schedule);
 
@@ -424,6 +433,10 @@ static int __core_worker_init(core_t *core)
                 ret = redis_co_init(core->flag & CORE_FLAG_POLLING);
                 if (unlikely(ret))
                         GOTO(err_ret, ret);
+
+                ret = core_poller_register(core, "redis_co", redis_co_poll, NULL);
+                if (unlikely(ret))
+                        GOTO(err_ret, ret);
         }
 #endif
 
@@ -501,6 +514,7 @@ int core_create(core_t **_core, const char *name, int hash, int flag)
         core->keepalive = gettime();
 
         INIT_LIST_HEAD(&core->check_list);
+        INIT_LIST_HEAD(&core->poller_list);
 
         ret = sy_spin_init(&core->keepalive_lock);
         if (unlikely(ret))
@@ -1046,7 +1060,8 @@ void __core_dump_memory(void *_core, void *_arg)
         schedule_t *schedule = core->schedule;
         *memory += sizeof(core_t) +
                    sizeof(schedule_t) +
-                   (sizeof(taskctx_t) + DEFAULT_STACK_SIZE) * schedule->size;
+                   sizeof(taskctx_t) * schedule->size +
+                   (uint64_t)DEFAULT_STACK_SIZE * schedule->stack_total;
 }
 
 /**
@@ -1056,49 +1071,63 @@ void __core_dump_memory(void *_core, void *_arg)
  */
 int core_dump_memory(uint64_t *memory)
 {
+        int i;
+        mem_cache_stat_t stat;
+
         *memory = 0;
 
         core_iterator(__core_dump_memory, memory);
 
+        for (i = 0; i < MEM_CACHE_NR; i++) {
+                mem_cache_stat(i, &stat);
+                DINFO("mem cache %u total %ju cached %ju alloc %ju free %ju remote %ju\n",
+                      mem_cache_size(i), stat.total, stat.cached, stat.alloc,
+                      stat.free, stat.remote);
+
+                *memory += stat.total * mem_cache_size(i);
+        }
+
         return 0;
 }
 
-#if 0
-int core_poller_register(core_t *core, const char *name, void (*poll)(void *,void*), void *user_data)
+int core_poller_register(core_t *core, const char *name, void (*poll)(void *, void *), void *user_data)
 {
+        int ret;
         sub_poller_t *poller;
 
-        int ret = huge_malloc((void **)&poller, sizeof(sub_poller_t));
-        if(ret)
-                return ret;
+        ret = ymalloc((void **)&poller, sizeof(sub_poller_t));
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
 
-        strncpy(poller->name, name, 64);
+        strncpy(poller->name, name, sizeof(poller->name) - 1);
+        poller->name[sizeof(poller->name) - 1] = '\0';
         poller->poll = poll;
         poller->user_data = user_data;
         list_add_tail(&poller->list_entry, &core->poller_list);
 
-        DINFO("register sub poller, core:%d, ptr=%p, name: %s\r\n", core->idx, poller, poller->name);
-        
+        DINFO("register sub poller, core:%d, ptr=%p, name: %s\n", core->idx, poller, poller->name);
+
         return 0;
+err_ret:
+        return ret;
 }
 
-int core_poller_unregister(core_t *core, void (*poll)(void *,void*))
+int core_poller_unregister(core_t *core, void (*poll)(void *, void *))
 {
         sub_poller_t *entry;
         sub_poller_t *n;
 
         /*all sub-poller should be registered in the list.*/
-	list_for_each_entry_safe(entry, n, &core->poller_list, list_entry) {
+        list_for_each_entry_safe(entry, n, &core->poller_list, list_entry) {
                 if(entry->poll == poll) {
-                        DINFO("unregister sub poller, ptr=%p, name: %s\r\n", entry, entry->name);
+                        DINFO("unregister sub poller, ptr=%p, name: %s\n", entry, entry->name);
                         list_del(&entry->list_entry);
-                        huge_free((void **)&entry);
+                        yfree((void **)&entry);
                 }
         }
-        
+
         return 0;
 }
-#endif 
 
 #if ENABLE_CORE_PIPELINE
 typedef struct __vm {
@@ -1273,6 +1302,8 @@ int core_worker_exit(core_t *core)
 #endif
 
         if (core->flag & CORE_FLAG_REDIS) {
+                core_poller_unregister(core, redis_co_poll);
+
                 ret = redis_co_destroy();
                 if (ret)
                         GOTO(err_ret, ret);
@@ -1303,6 +1334,7 @@ int core_worker_exit(core_t *core)
 
         if (core->flag & CORE_FLAG_PRIVATE) {
                 analysis_private_destroy();
+                mbuffer_pool_drain();
                 mem_cache_private_destroy();
                 mem_hugepage_private_destoy();
         }
@@ -39,13 +39,14 @@ typedef struct {
         // int ref;
 } rdma_info_t;
 
+#endif
+
 typedef struct __sub_poller {
         struct list_head list_entry;
         char name[64];
-        void (*poll)();
+        void (*poll)(void *, void *);
         void *user_data;
-}sub_poller_t;
-#endif
+} sub_poller_t;
 
 typedef struct __core {
         int interrupt_eventfd;   // === schedule->eventfd, 通知机制
@@ -124,7 +125,7 @@ void core_latency_update(uint64_t used);
 int core_dump_memory(uint64_t *memory);
 
 int core_poller_register(core_t *core, const char *name, void (*poll)(void *,void*), void *user_data);
-int core_poller_unregister(core_t *core, void (*poll)());
+int core_poller_unregister(core_t *core, void (*poll)(void *, void *));
 
 #if ENABLE_CORE_PIPELINE
 int core_pipeline_send(const sockid_t *sockid, buffer_t *buf, int flag);
@@ -48,8 +48,10 @@ static  corenet_maping_t *__corenet_maping_get_byctx(void *ctx)
         return variable_get_byctx(ctx, VARIABLE_MAPING);
 }
 
+/* sockets to addr, each address is striped over corenet_stripe sockets */
 static int __connected__(corenet_maping_t *entry, uint32_t addr)
 {
+        int count = 0;
         sockid_t *sockid;
         
         for (int i = 0; i < entry->count; i++) {
@@ -60,11 +62,11 @@ static int __connected__(corenet_maping_t *entry, uint32_t addr)
                 }                        
 
                 if (addr == sockid->addr) {
-                        return 1;
+                        count++;
                 }
         }
 
-        return 0;
+        return count;
 }
 
 int corenet_maping_loading(const nid_t *nid)
@@ -157,7 +159,7 @@ static int __corenet_maping_accept__(const nid_t *nid, const sockid_t *_sockid)
         if (unlikely(ret))
                 GOTO(err_ret, ret);
 
-        if (__connected__(entry, _sockid->addr)) {
+        if (__connected__(entry, _sockid->addr) >= gloconf.corenet_stripe) {
                 DWARN("%s @ %s already connected\n", _inet_ntoa(_sockid->addr), network_rname(nid));
                 __corenet_maping_close_finally__(_sockid);
                 goto out;
@@ -182,7 +184,6 @@ static int __corenet_maping_accept__(const nid_t *nid, const sockid_t *_sockid)
                 }
         }
 
-        YASSERT(i < netconf.count);
         YASSERT(i < CORENET_DEV_MAX);
         
         if (i == entry->count) {
@@ -266,6 +267,8 @@ STATIC int __corenet_maping_connect____(const nid_t *nid, const ynet_sock_info_t
         int count = 0;
         for (int i = 0; i < sock_count; i++) {
                 sock = &_sock[i];
+                if (count == CORENET_DEV_MAX)
+                        break;
                 
                 DINFO("connect to %s:%d @ %s [%u]\n", _inet_ntoa(sock->addr),
                       ntohs(sock->port), network_rname(nid), i);
@@ -313,7 +316,18 @@ STATIC int __corenet_maping_connect__(const nid_t *nid, sockid_t *_sockid, int *
         if (unlikely(ret))
                 GOTO(err_ret, ret);
 
-        ret = __corenet_maping_connect____(nid, info->info, info->info_count, _sockid, _count);
+        ynet_sock_info_t array[CORENET_DEV_MAX];
+        int count = 0;
+        for (int i = 0; i < info->info_count; i++) {
+                for (int j = 0; j < gloconf.corenet_stripe; j++) {
+                        if (count == CORENET_DEV_MAX)
+                                break;
+
+                        array[count++] = info->info[i];
+                }
+        }
+
+        ret = __corenet_maping_connect____(nid, array, count, _sockid, _count);
         if (unlikely(ret)) {
                 GOTO(err_ret, ret);
         }
@@ -377,12 +391,40 @@ err_ret:
         return ret;
 }
 
-static int __corenet_maping_get(const nid_t *nid, corenet_maping_t *entry, sockid_t *_sockid)
+static int __corenet_maping_get(const nid_t *nid, corenet_maping_t *entry,
+                                int bulk, sockid_t *_sockid)
 {
-        int ret, i;
+        int ret, i, small = -1;
         sockid_t *sockid;
-        
+
+        if (entry->count > 1) {
+                for (i = 0; i < entry->count; i++) {
+                        if (entry->sockid[i].sd == -1)
+                                continue;
+
+                        if (likely(__corenet_maping_connected__(&entry->sockid[i]))) {
+                                small = i;
+                                break;
+                        }
+
+                        entry->sockid[i].sd = -1;
+                }
+
+                if (small == -1) {
+                        ret = ENONET;
+                        GOTO(err_ret, ret);
+                }
+
+                if (!bulk) {
+                        *_sockid = entry->sockid[small];
+                        return 0;
+                }
+        }
+
         for (i = 0; i < entry->count; i++) {
+                if ((i + entry->cur) % entry->count == small)
+                        continue;
+
                 sockid = &entry->sockid[(i + entry->cur) % entry->count];
                 if (likely(__corenet_maping_connected__(sockid))) {
                         *_sockid = *sockid;
@@ -397,6 +439,12 @@ static int __corenet_maping_get(const nid_t *nid, corenet_maping_t *entry, socki
         }
 
         if (i == entry->count) {
+                /* bulk shares the small lane when it is the only socket left */
+                if (small != -1) {
+                        *_sockid = entry->sockid[small];
+                        return 0;
+                }
+
                 ret = ENONET;
                 GOTO(err_ret, ret);
         }
@@ -419,7 +467,7 @@ static void __corenet_maping_connect_task(void *arg)
         }
 }
 
-int corenet_maping(void *ctx, const nid_t *nid, sockid_t *sockid)
+int corenet_maping_lane(void *ctx, const nid_t *nid, int bulk, sockid_t *sockid)
 {
         int ret;
         corenet_maping_t *entry;
@@ -429,7 +477,7 @@ retry:
         entry = &__corenet_maping_get_byctx(ctx)[nid->id];
         YASSERT(entry);
 
-        ret = __corenet_maping_get(nid, entry, sockid);
+        ret = __corenet_maping_get(nid, entry, bulk, sockid);
         if (unlikely(ret)) {
                 /**
                  * 保证过程唯一性，只有一个task发起连接，其它并发task等待连接完成
@@ -473,6 +521,11 @@ err_ret:
         return ret;
 }
 
+int corenet_maping(void *ctx, const nid_t *nid, sockid_t *sockid)
+{
+        return corenet_maping_lane(ctx, nid, 0, sockid);
+}
+
 static void __corenet_maping_close__(void *_arg)
 {
         int i;
@@ -598,7 +651,7 @@ static int __corenet_maping_getlost(corenet_maping_t *entry, const ynet_net_info
                 }
         }
 
-        if (count == info->info_count) {
+        if (count >= info->info_count * gloconf.corenet_stripe) {
                 goto out;
         }
 
@@ -606,12 +659,11 @@ static int __corenet_maping_getlost(corenet_maping_t *entry, const ynet_net_info
                 //sockid = &entry->sockid[i];
                 sock = &info->info[i];
                 
-                if (__connected__(entry, sock->addr)) {
-                        continue;
+                for (int j = __connected__(entry, sock->addr);
+                     j < gloconf.corenet_stripe && lost < CORENET_DEV_MAX; j++) {
+                        array[lost] = *sock;
+                        lost++;
                 }
-
-                array[lost] = *sock;
-                lost++;
         }
 
 out:
@@ -3,7 +3,13 @@
 
 #include "core.h"
 
-#define CORENET_DEV_MAX 10
+#define CORENET_DEV_MAX 16
+
+/*
+ * with more than one socket to a peer the first connected one is kept for
+ * small rpcs, requests moving at least CORENET_BULK bytes use the others
+ */
+#define CORENET_BULK (64 * 1024)
 
 typedef struct {
         nid_t nid;
@@ -17,6 +23,7 @@ typedef struct {
 
 int corenet_maping_init(corenet_maping_t **_maping);
 int corenet_maping(void *ctx, const nid_t *nid, sockid_t *sockid);
+int corenet_maping_lane(void *ctx, const nid_t *nid, int bulk, sockid_t *sockid);
 int corenet_maping_loading(const nid_t *nid);
 int corenet_maping_accept(core_t *core, const nid_t *nid, const sockid_t *sockid, int count);
 void corenet_maping_close(const nid_t *nid, const sockid_t *sockid);
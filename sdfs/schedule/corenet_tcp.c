@@ -707,19 +707,18 @@ static void __corenet_event_set(corenet_node_t *node, int _ev)
 }
 
 
+/*
+ * everything queued on the socket since the last loop goes out in as few
+ * sendmsg calls as IOV_MAX allows, corked with MSG_MORE until the last one
+ */
 static int __corenet_tcp_thread_send(int fd, buffer_t *buf, struct iovec *iov, int iov_count)
 {
-        int ret;
+        int ret, idx, count, sent = 0;
         struct msghdr msg;
 
         ANALYSIS_BEGIN(0);
         
-        iov_count = CORE_IOV_MAX / 10;
-        ret = mbuffer_trans(iov, &iov_count, buf);
-        //YASSERT(ret == (int)newbuf.len);
-        memset(&msg, 0x0, sizeof(msg));
-        msg.msg_iov = iov;
-        msg.msg_iovlen = iov_count;
+        (void) mbuffer_trans(iov, &iov_count, buf);
 
         do {
                 struct timeval __tv__;                                
@@ -727,11 +726,34 @@ static int __corenet_tcp_thread_send(int fd, buffer_t *buf, struct iovec *iov, i
                 DBUG("begin timeval %u.%llu, buf %u\n", __tv__.tv_sec, (LLU)__tv__.tv_usec, buf->len);
         } while (0);
 
-        ret = _sendmsg(fd, &msg, MSG_DONTWAIT);
-        if (ret < 0) {
-                ret = -ret;
-                DWARN("sd %u %u %s\n", fd, ret, strerror(ret));
-                GOTO(err_ret, ret);
+        idx = 0;
+        while (idx < iov_count) {
+                count = _min(iov_count - idx, IOV_MAX);
+                memset(&msg, 0x0, sizeof(msg));
+                msg.msg_iov = &iov[idx];
+                msg.msg_iovlen = count;
+
+                ret = _sendmsg(fd, &msg, MSG_DONTWAIT
+                               | (idx + count < iov_count ? MSG_MORE : 0));
+                if (ret < 0) {
+                        ret = -ret;
+                        if (ret == EAGAIN && sent)
+                                break;
+
+                        DWARN("sd %u %u %s\n", fd, ret, strerror(ret));
+                        GOTO(err_ret, ret);
+                }
+
+                sent += ret;
+                count += idx;
+                while (idx < count && ret >= (int)iov[idx].iov_len) {
+                        ret -= iov[idx].iov_len;
+                        idx++;
+                }
+
+                /* short write, the rest waits for EPOLLOUT */
+                if (idx < count)
+                        break;
         }
 
         do {
@@ -742,7 +764,7 @@ static int __corenet_tcp_thread_send(int fd, buffer_t *buf, struct iovec *iov, i
 
         ANALYSIS_QUEUE(0, 10 * 1000, NULL);
 
-        return ret;
+        return sent;
 err_ret:
         return -ret;
 }
@@ -348,7 +348,8 @@ int IO_FUNC corerpc_postwait(const char *name, const nid_t *nid, const void *req
 
         ANALYSIS_BEGIN(0);
         
-        ret = corenet_maping(ctx, nid, &sockid);
+        ret = corenet_maping_lane(ctx, nid, (wbuf ? (int)wbuf->len : 0) + msg_size
+                                  >= CORENET_BULK, &sockid);
         if (unlikely(ret))
                 GOTO(err_ret, ret);
 
@@ -7,6 +7,7 @@
 #include <unistd.h>
 #include <setjmp.h>
 #include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>   /* For SYS_xxx definitions */
 #include <stdint.h>
 
@@ -106,6 +107,7 @@ static taskctx_t *__schedule_task_new(const char *name, func_t func, void *arg,
                                       int timeout, task_t *_parent, int priority, int tc);
 static void __schedule_backtrace__(const char *name, int id, int idx, uint32_t seq);
 static void __schedule_backtrace_set(taskctx_t *taskctx);
+static void __schedule_stack_put(schedule_t *schedule, taskctx_t *taskctx);
 
 
 #ifdef NEW_SCHED
@@ -257,7 +259,7 @@ static int __schedule_task_hasfree(schedule_t *schedule)
 #else
 static int __schedule_task_hasfree(schedule_t *schedule)
 {
-        if ((TASK_MAX - schedule->free_task.count) > TASK_MAX / 6)
+        if ((schedule->size - (int)schedule->free_task.count) > schedule->size / 6)
                 return 0;
         else
                 return 1;
@@ -345,6 +347,9 @@ static void __schedule_trampoline(taskctx_t *taskctx)
         /* list_add better than list_add_tail here, otherwise statck will malloc for each task */
         count_list_add(&taskctx->running_hook, &schedule->free_task);
 
+        /* still running on it, but nothing takes it before the swap below */
+        __schedule_stack_put(schedule, taskctx);
+
 #ifdef NEW_SCHED
         swapcontext1(&taskctx->ctx, &taskctx->main);
 #endif
@@ -652,7 +657,7 @@ static int __schedule_exec(schedule_t *schedule, const task_t  *task, int retval
         int ret;
         taskctx_t *taskctx;
 
-        YASSERT(task->taskid >= 0 && task->taskid < TASK_MAX);
+        YASSERT(task->taskid >= 0 && task->taskid < schedule->size);
         taskctx = &schedule->tasks[task->taskid];
 
         DBUG("run task %s, id [%u][%u]\n", taskctx->name, schedule->id, taskctx->id);
@@ -868,8 +873,118 @@ int schedule_priority(schedule_t *_schedule)
 
         return schedule->tasks[schedule->running_task].priority;
 }
+
+/* takes effect from the next yield, and is inherited by child tasks and rpcs */
+void schedule_priority_set(int priority)
+{
+        schedule_t *schedule = schedule_self();
+
+        YASSERT(priority >= SCHEDULE_PRIORITY0 && priority < SCHEDULE_PRIORITY_MAX);
+
+        if (schedule == NULL || schedule->running_task == -1)
+                return;
+
+        schedule->tasks[schedule->running_task].priority = priority;
+}
         
 
+/*
+ * task stacks are reserved with mmap and only take physical pages when
+ * touched, a PROT_NONE page below each stack catches overflow
+ */
+static void *__schedule_stack_map(schedule_t *schedule)
+{
+        void *addr;
+
+        addr = mmap(NULL, DEFAULT_STACK_SIZE + STACK_GUARD_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (unlikely(addr == MAP_FAILED)) {
+                DERROR("map stack errno %u\n", errno);
+                return NULL;
+        }
+
+        /* may hit vm.max_map_count with a huge task_max, run unguarded then */
+        if (unlikely(mprotect(addr, STACK_GUARD_SIZE, PROT_NONE))) {
+                DWARN("stack guard errno %u\n", errno);
+        }
+
+        schedule->stack_total++;
+
+        return addr + STACK_GUARD_SIZE;
+}
+
+static void __schedule_stack_unmap(schedule_t *schedule, void *stack)
+{
+        munmap(stack - STACK_GUARD_SIZE, DEFAULT_STACK_SIZE + STACK_GUARD_SIZE);
+        schedule->stack_total--;
+}
+
+static void *__schedule_stack_get(schedule_t *schedule, taskctx_t *taskctx)
+{
+        if (unlikely(schedule->private_mem)) {
+                return schedule->stack_addr + taskctx->id * DEFAULT_STACK_SIZE;
+        }
+
+        if (schedule->stack_count == 0) {
+                return __schedule_stack_map(schedule);
+        }
+
+        schedule->stack_count--;
+        if (schedule->stack_count < schedule->stack_low)
+                schedule->stack_low = schedule->stack_count;
+        if (schedule->stack_count < schedule->stack_trim)
+                schedule->stack_trim = schedule->stack_count;
+
+        return schedule->stack_pool[schedule->stack_count];
+}
+
+static void __schedule_stack_put(schedule_t *schedule, taskctx_t *taskctx)
+{
+        if (unlikely(schedule->private_mem)) {
+                return;
+        }
+
+        YASSERT(schedule->stack_count < schedule->size);
+        schedule->stack_pool[schedule->stack_count++] = taskctx->stack;
+        taskctx->stack = NULL;
+}
+
+/* stacks not taken out of the pool for a whole scan period give back their pages */
+static void __schedule_stack_trim(schedule_t *schedule)
+{
+        int i;
+
+        for (i = schedule->stack_trim; i < schedule->stack_low; i++) {
+                madvise(schedule->stack_pool[i], DEFAULT_STACK_SIZE, MADV_DONTNEED);
+        }
+
+        if (schedule->stack_low > schedule->stack_trim) {
+                DBUG("%s trim %u stack\n", schedule->name,
+                     schedule->stack_low - schedule->stack_trim);
+                schedule->stack_trim = schedule->stack_low;
+        }
+
+        schedule->stack_low = schedule->stack_count;
+}
+
+/* resident bytes of a stack */
+static uint64_t __schedule_stack_rss(void *stack)
+{
+        int i;
+        uint64_t rss = 0;
+        unsigned char vec[DEFAULT_STACK_SIZE / PAGE_SIZE_4K];
+
+        if (stack == NULL || mincore(stack, DEFAULT_STACK_SIZE, vec))
+                return 0;
+
+        for (i = 0; i < DEFAULT_STACK_SIZE / PAGE_SIZE_4K; i++) {
+                if (vec[i] & 0x1)
+                        rss += PAGE_SIZE_4K;
+        }
+
+        return rss;
+}
+
 static taskctx_t *__schedule_task_new(const char *name, func_t func, void *arg,
                                       int timeout, task_t *_parent, int _priority, int tc)
 {
@@ -921,15 +1036,10 @@ static taskctx_t *__schedule_task_new(const char *name, func_t func, void *arg,
         }
 
         if (taskctx->stack == NULL) {
-                if (likely(schedule->private_mem)) {
-                        taskctx->stack = schedule->stack_addr + taskctx->id * DEFAULT_STACK_SIZE;
-                } else {
-                        ret = ymalloc((void **)&taskctx->stack, DEFAULT_STACK_SIZE);
-                        if (unlikely(ret))
-                                UNIMPLEMENTED(__DUMP__);
-                }
-
-                memset(taskctx->stack, 0x0, KEEP_STACK_SIZE);
+                /* fresh or trimmed pages read as zero, KEEP_STACK_SIZE needs no memset */
+                taskctx->stack = __schedule_stack_get(schedule, taskctx);
+                if (unlikely(taskctx->stack == NULL))
+                        UNIMPLEMENTED(__DUMP__);
         }
 
         DBUG("%s\n", name);
@@ -945,6 +1055,7 @@ static taskctx_t *__schedule_task_new(const char *name, func_t func, void *arg,
         taskctx->wait_tmo = 0;
         taskctx->schedule = schedule;
         taskctx->priority = priority;
+        taskctx->value[TASK_VALUE_CLIENT] = 0;
         schedule->task_count++;
 
         list_add_tail(&taskctx->running_hook, &schedule->running_task_list);
@@ -980,7 +1091,7 @@ void schedule_task_new1(const char *name, func_t func, void *arg, int priority,
 
 static int __schedule_create__(schedule_t **_schedule, const char *name, int idx, void *private_mem, int *_eventfd)
 {
-        int ret, fd, i;
+        int ret, fd, i, size;
         schedule_t *schedule;
         taskctx_t *taskctx;
 
@@ -1059,34 +1170,40 @@ static int __schedule_create__(schedule_t **_schedule, const char *name, int idx
         schedule->suspendable = 0;
         strcpy(schedule->name, name);
 
+        size = gloconf.task_max ? gloconf.task_max : TASK_MAX;
+
+        ret = ymalloc((void **)&schedule->stack_pool, sizeof(void *) * size);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
 #if 1
-        ret = ymalloc((void **)&taskctx, sizeof(*taskctx) * TASK_MAX);
+        ret = ymalloc((void **)&taskctx, sizeof(*taskctx) * size);
         if (unlikely(ret))
                 GOTO(err_ret, ret);
 #else
         if (private_mem) {
                 int count = 0;
-                count = (sizeof(*taskctx) * TASK_MAX) / MEMPAGE_SIZE;
-                if ((sizeof(*taskctx) * TASK_MAX) % MEMPAGE_SIZE) {
+                count = (sizeof(*taskctx) * size) / MEMPAGE_SIZE;
+                if ((sizeof(*taskctx) * size) % MEMPAGE_SIZE) {
                         count = count + 1;
                 }
                 DINFO("taskctx size: %lu, mem hugepage count: %d\n", sizeof(*taskctx), count);
                 taskctx = mempages_alloc(private_mem, count * MEMPAGE_SIZE);
         } else {
 
-                ret = ymalloc((void **)&taskctx, sizeof(*taskctx) * TASK_MAX);
+                ret = ymalloc((void **)&taskctx, sizeof(*taskctx) * size);
                 if (unlikely(ret))
                         GOTO(err_ret, ret);
         }
 #endif
 
         YASSERT(taskctx);
-        memset(taskctx, 0x0, sizeof(*taskctx) * TASK_MAX);
+        memset(taskctx, 0x0, sizeof(*taskctx) * size);
 
         INIT_LIST_HEAD(&schedule->running_task_list);
         count_list_init(&schedule->free_task);
 
-        for (i = 0; i < TASK_MAX; ++i) {
+        for (i = 0; i < size; ++i) {
                 taskctx[i].id = i;
                 taskctx[i].stack = NULL;
                 taskctx[i].state = TASK_STAT_FREE;
@@ -1100,7 +1217,7 @@ static int __schedule_create__(schedule_t **_schedule, const char *name, int idx
 
         schedule->tasks = taskctx;
         schedule->running = 1;
-        schedule->size = TASK_MAX;
+        schedule->size = size;
 
         variable_set(VARIABLE_SCHEDULE, schedule);
         if (_schedule)
@@ -1123,12 +1240,18 @@ static void __schedule_destroy(schedule_t *schedule)
         
         if (reply_remote->replys)
                 yfree((void **)&reply_remote->replys);
+        if (reply_remote->spare)
+                yfree((void **)&reply_remote->spare);
 #endif
 
         if (reply_local->replys)
                 yfree((void **)&reply_local->replys);
+        if (reply_local->spare)
+                yfree((void **)&reply_local->spare);
         if (request_queue->requests)
                 yfree((void **)&request_queue->requests);
+        if (request_queue->spare)
+                yfree((void **)&request_queue->spare);
 
         YASSERT(list_empty(&schedule->wait_task.list));
         YASSERT(list_empty(&schedule->running_task_list));
@@ -1136,12 +1259,18 @@ static void __schedule_destroy(schedule_t *schedule)
                 YASSERT(taskctx->state == TASK_STAT_FREE);
                 if (taskctx->stack) {
                         if (schedule->private_mem == NULL)
-                                yfree((void **)&taskctx->stack);
-                        else
-                                taskctx->stack = NULL;
+                                __schedule_stack_unmap(schedule, taskctx->stack);
+
+                        taskctx->stack = NULL;
                 }
         }
 
+        while (schedule->stack_count) {
+                __schedule_stack_unmap(schedule, schedule->stack_pool[--schedule->stack_count]);
+        }
+
+        yfree((void **)&schedule->stack_pool);
+
         variable_unset(VARIABLE_SCHEDULE);
         
         close(schedule->eventfd);
@@ -1332,27 +1461,33 @@ void IO_FUNC schedule_task_run(schedule_t *_schedule)
 
 static void __schedule_request_queue_run(schedule_t *_schedule)
 {
-        int ret, count, i;
+        int ret, count, max, i;
         schedule_t *schedule = __schedule_self(_schedule);
         request_queue_t *request_queue = &schedule->request_queue;
-        request_t _request[REQUEST_QUEUE_MAX], *request;
+        request_t *array, *request;
 
         if (request_queue->count) {
                 ret = sy_spin_lock(&request_queue->lock);
                 if (unlikely(ret))
                         UNIMPLEMENTED(__DUMP__);
 
-                memcpy(_request, request_queue->requests, sizeof(request_t) * request_queue->count);
+                array = request_queue->requests;
+                max = request_queue->max;
                 count = request_queue->count;
+                request_queue->requests = request_queue->spare;
+                request_queue->max = request_queue->spare_max;
                 request_queue->count = 0;
                 sy_spin_unlock(&request_queue->lock);
 
                 for (i = 0; i < count; ++i) {
-                        request = &_request[i];
+                        request = &array[i];
                         __schedule_task_new(request->name, request->exec,
                                             request->buf, -1, &request->parent,
                                             request->priority, 0);
                 }
+
+                request_queue->spare = array;
+                request_queue->spare_max = max;
         }
 }
 
@@ -1417,10 +1552,10 @@ static int __schedule_reply_remote_run(schedule_t *_schedule)
 #else
 static int __schedule_reply_remote_run(schedule_t *_schedule)
 {
-        int ret, count, i;
+        int ret, count, max, i;
         schedule_t *schedule = __schedule_self(_schedule);
         reply_queue_t *reply_remote = &schedule->reply_remote;
-        reply_t _reply[REPLY_QUEUE_MAX], *reply;
+        reply_t *array, *reply;
         //core_t *core = core_self();
 
         if (schedule->running == 0) {
@@ -1437,14 +1572,17 @@ static int __schedule_reply_remote_run(schedule_t *_schedule)
                 if (unlikely(ret))
                         UNIMPLEMENTED(__DUMP__);
 
-                YASSERT(reply_remote->count <= REPLY_QUEUE_MAX);
-                memcpy(_reply, reply_remote->replys, sizeof(reply_t) * reply_remote->count);
+                YASSERT(reply_remote->count <= schedule->size);
+                array = reply_remote->replys;
+                max = reply_remote->max;
                 count = reply_remote->count;
+                reply_remote->replys = reply_remote->spare;
+                reply_remote->max = reply_remote->spare_max;
                 reply_remote->count = 0;
                 sy_spin_unlock(&reply_remote->lock);
 
                 for (i = 0; i < count; ++i) {
-                        reply = &_reply[i];
+                        reply = &array[i];
                         DBUG("**** rep %u\n", reply->task.taskid);
 
                         ret = __schedule_exec(schedule, &reply->task, reply->retval, reply->buf, 0);
@@ -1454,6 +1592,9 @@ static int __schedule_reply_remote_run(schedule_t *_schedule)
 
                         mem_cache_free(MEM_CACHE_4K, reply->buf);
                 }
+
+                reply_remote->spare = array;
+                reply_remote->spare_max = max;
         }
 
         if (schedule->running == 0) {
@@ -1467,10 +1608,10 @@ static int __schedule_reply_remote_run(schedule_t *_schedule)
 
 static int __schedule_reply_local_run(schedule_t *_schedule)
 {
-        int ret, count, i;
+        int ret, count, max, i;
         schedule_t *schedule = __schedule_self(_schedule);
         reply_queue_t *reply_local = &schedule->reply_local;
-        reply_t _reply[REPLY_QUEUE_MAX], *reply;
+        reply_t *array, *reply;
 
         if (schedule->running == 0) {
                 DINFO("reply queue %u\n", reply_local->count);
@@ -1479,13 +1620,17 @@ static int __schedule_reply_local_run(schedule_t *_schedule)
         if (reply_local->count == 0) {
                 return 0;
         } else {
-                YASSERT(reply_local->count <= REPLY_QUEUE_MAX);
-                memcpy(_reply, reply_local->replys, sizeof(reply_t) * reply_local->count);
+                /* tasks resumed from here queue into the spare array */
+                YASSERT(reply_local->count <= schedule->size);
+                array = reply_local->replys;
+                max = reply_local->max;
                 count = reply_local->count;
+                reply_local->replys = reply_local->spare;
+                reply_local->max = reply_local->spare_max;
                 reply_local->count = 0;
 
                 for (i = 0; i < count; ++i) {
-                        reply = &_reply[i];
+                        reply = &array[i];
                         DBUG("**** rep %u\n", reply->task.taskid);
                         ret = __schedule_exec(schedule, &reply->task, reply->retval, reply->buf, 0);
                         if (unlikely(ret)) {
@@ -1494,6 +1639,9 @@ static int __schedule_reply_local_run(schedule_t *_schedule)
 
                         mem_cache_free(MEM_CACHE_4K, reply->buf);
                 }
+
+                reply_local->spare = array;
+                reply_local->spare_max = max;
         }
 
         if (schedule->running == 0) {
@@ -1608,7 +1756,7 @@ void schedule_task_given(task_t *task)
 
 int schedule_request(schedule_t *schedule, int priority, func_t exec, void *buf, const char *name)
 {
-        int ret;
+        int ret, max;
         request_queue_t *request_queue = &schedule->request_queue;
         request_t *request;
 
@@ -1619,21 +1767,22 @@ int schedule_request(schedule_t *schedule, int priority, func_t exec, void *buf,
                 UNIMPLEMENTED(__DUMP__);
 
         if (request_queue->count == request_queue->max) {
-                if (request_queue->count + REQUEST_QUEUE_STEP == REQUEST_QUEUE_MAX) {
+                if (request_queue->max >= schedule->size) {
                         ret = ENOSPC;
                         UNIMPLEMENTED(__DUMP__);
                         GOTO(err_lock, ret);
                 }
 
-                DINFO("new request_queue array %u\n", request_queue->max + REQUEST_QUEUE_STEP);
+                max = _min(request_queue->max + REQUEST_QUEUE_STEP, schedule->size);
+                DINFO("new request_queue array %u\n", max);
 
                 ret = yrealloc((void **)&request_queue->requests,
                                sizeof(*request) * request_queue->max,
-                               sizeof(*request) * (request_queue->max + REQUEST_QUEUE_STEP));
+                               sizeof(*request) * max);
                 if (unlikely(ret))
                         UNIMPLEMENTED(__DUMP__);
 
-                request_queue->max += REQUEST_QUEUE_STEP;
+                request_queue->max = max;
         }
 
         DBUG("count %u max %u\n", request_queue->count, request_queue->max);
@@ -1660,15 +1809,14 @@ err_lock:
 static void __schedule_resume(schedule_t *schedule, reply_queue_t *reply_queue,
                               const task_t *task, int retval, buffer_t *buf)
 {
-        int ret;
+        int ret, max;
         buffer_t *mem = mem_cache_calloc(MEM_CACHE_4K, 1);
         reply_t *reply;
 
         YASSERT(task->scheduleid >= 0 && task->scheduleid <= SCHEDULE_MAX);
-        YASSERT(task->taskid >= 0 && task->taskid < TASK_MAX);
+        YASSERT(task->taskid >= 0 && task->taskid < TASK_MAX_LIMIT);
         YASSERT(task->fingerprint);
 
-        (void) schedule;
 #if 0
         taskctx_t *taskctx;
         taskctx = &schedule->tasks[task->taskid];
@@ -1681,21 +1829,22 @@ static void __schedule_resume(schedule_t *schedule, reply_queue_t *reply_queue,
 #endif
 
         if (unlikely(reply_queue->count == reply_queue->max)) {
-                if (unlikely(reply_queue->count + REPLY_QUEUE_STEP > REPLY_QUEUE_MAX)) {
+                if (unlikely(reply_queue->max >= schedule->size)) {
                         ret = ENOSPC;
                         GOTO(err_ret, ret);
                 }
 
-                DBUG("new reply_queue array %u\n", reply_queue->max + REPLY_QUEUE_STEP);
+                max = _min(reply_queue->max + REPLY_QUEUE_STEP, schedule->size);
+                DBUG("new reply_queue array %u\n", max);
 
                 // @note 会导致buffer.list失效, 所以reply.buffer需要是指针类型
                 ret = yrealloc((void **)&reply_queue->replys,
                                sizeof(*reply) * reply_queue->max,
-                               sizeof(*reply) * (reply_queue->max + REPLY_QUEUE_STEP));
+                               sizeof(*reply) * max);
                 if (unlikely(ret))
                         UNIMPLEMENTED(__DUMP__);
 
-                reply_queue->max += REPLY_QUEUE_STEP;
+                reply_queue->max = max;
         }
 
         reply = &reply_queue->replys[reply_queue->count];
@@ -1779,7 +1928,7 @@ static void __schedule_resume_remote(schedule_t *schedule,
         reply_remote_t *reply = mem_cache_calloc(MEM_CACHE_4K, 1);
 
         YASSERT(task->scheduleid >= 0 && task->scheduleid <= SCHEDULE_MAX);
-        YASSERT(task->taskid >= 0 && task->taskid < TASK_MAX);
+        YASSERT(task->taskid >= 0 && task->taskid < TASK_MAX_LIMIT);
         YASSERT(task->fingerprint);
 
         (void) schedule;
@@ -1882,7 +2031,7 @@ void schedule_dump(schedule_t *schedule, int block)
         int i, count = 0;
         taskctx_t *taskctx;
         struct timeval t1;
-        uint64_t used;
+        uint64_t used, rss, total = 0;
         taskctx_t *tasks = schedule->tasks;
 
         _gettimeofday(&t1, NULL);
@@ -1892,12 +2041,22 @@ void schedule_dump(schedule_t *schedule, int block)
                 if (taskctx->state != TASK_STAT_FREE) {
                         count ++;
                         used = _time_used(&taskctx->ctime, &t1);
-                        DINFO("%s[%u] %s status %u used %fms\n", schedule->name, i,
-                              taskctx->name, taskctx->state, (double)used / 1000);
+                        rss = __schedule_stack_rss(taskctx->stack);
+                        total += rss;
+                        DINFO("%s[%u] %s status %u used %fms mem %lluK\n", schedule->name, i,
+                              taskctx->name, taskctx->state, (double)used / 1000,
+                              (LLU)(rss + sizeof(*taskctx)) / 1024);
                 }
         }
 
-        DINFO("%s used %u\n", schedule->name, count);
+        for (i = 0; i < schedule->stack_count; i++) {
+                total += __schedule_stack_rss(schedule->stack_pool[i]);
+        }
+
+        DINFO("%s used %u/%u, stack %u pool %u, stack mem %lluK, task mem %lluK\n",
+              schedule->name, count, schedule->size, schedule->stack_total,
+              schedule->stack_count, (LLU)total / 1024,
+              (LLU)sizeof(*taskctx) * schedule->size / 1024);
         schedule->backtrace = 1;
         schedule_post(schedule);
 
@@ -1926,6 +2085,8 @@ void IO_FUNC schedule_scan(schedule_t *_schedule)
         schedule->last_scan = now;
         schedule->scan_seq++;
 
+        __schedule_stack_trim(schedule);
+
         (void) i;
         list_for_each_entry_safe(taskctx, tasks, &schedule->running_task_list, running_hook) {
                 i = taskctx->id;
@@ -1938,8 +2099,8 @@ void IO_FUNC schedule_scan(schedule_t *_schedule)
                 }
         }
 
-        DINFO("%s[%u] %u/%u/%u\n", schedule->name, schedule->id,
-              TASK_MAX, schedule->size, used);
+        DINFO("%s[%u] %u/%u stack %u pool %u\n", schedule->name, schedule->id,
+              schedule->size, used, schedule->stack_total, schedule->stack_count);
 }
 
 void schedule_backtrace()
@@ -1968,6 +2129,7 @@ void schedule_backtrace()
 }
 
 typedef struct {
+        timer_entry_t timer;
         task_t task;
         int free;
 } slp_task_t;
@@ -2010,7 +2172,7 @@ int schedule_sleep(const char *name, suseconds_t usec)
                 slp->task = schedule_task_get();
 
                 schedule_task_sleep(&slp->task);
-                timer_insert(name, slp, __schedule_sleep, usec);
+                timer_add(name, &slp->timer, slp, __schedule_sleep, usec);
 
                 ret = schedule_yield(name, NULL, &slp->task);
                 if (unlikely(ret)) {
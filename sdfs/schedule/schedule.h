@@ -5,11 +5,14 @@
  *
  * 协程是一种非连续执行的机制，每个core thread一个调度器
  *
- * 目前调度器的调度策略：公平调度，不支持优先级调度
- * 对并发运行的任务数有一定限制：1024
+ * 目前调度器的调度策略：SCHEDULE_PRIORITY0..2三个队列，高优先级先调度，同级公平调度，
+ * task默认继承创建者的优先级，qos按卷的class调整 (@see sdfs/qos.h)
+ * 对并发运行的任务数有一定限制：gloconf.task_max，默认8192，最大TASK_MAX_LIMIT
  *
  * 一些约束：
- * - 每个task有64K的stack，所以不能声明太大的stack上数据，特别是数量多的数组，或大对象。
+ * - 每个task有512K的stack，按需占用物理页，底部有guard page，
+ *   所以不能声明太大的stack上数据，特别是数量多的数组，或大对象。
+ * - 空闲的stack放回每个调度器的stack pool，闲置超过一个scan周期的stack归还物理页
  * - 一个任务的总执行时间不能超过180s，否则会timeout，导致进程退出
  * - IDLE状态的代码，不能加锁，会形成deadlock (@see __rpc_table_check)
  */
@@ -39,13 +42,11 @@
 
 #define SCHEDULE_CHECK_RUNTIME ENABLE_SCHEDULE_CHECK_RUNTIME
 
-#define TASK_MAX (8192)
+#define TASK_MAX TASK_MAX_DEF
 
+/* the queues grow by step up to the task count of the schedule */
 #define REQUEST_QUEUE_STEP 128
-#define REQUEST_QUEUE_MAX (TASK_MAX * 1)
-
 #define REPLY_QUEUE_STEP 128
-#define REPLY_QUEUE_MAX TASK_MAX
 #define SCHE_NAME_LEN 32
 
 #if 1
@@ -103,6 +104,8 @@ struct cpu_ctx {
 typedef enum {
         TASK_VALUE_LEASE = 0,
         TASK_VALUE_REPLICA = 1,
+        TASK_VALUE_CLIENT = 2,          /* client address, for qos */
+        TASK_VALUE_BATCH = 3,           /* nfs receive burst, 0 if none */
         TASK_VALUE_MAX,
 } taskvalue_t;
 
@@ -175,6 +178,8 @@ typedef struct {
         int count;
         int max;
         request_t *requests;
+        int spare_max;
+        request_t *spare;               /* swapped in by the consumer, no copy */
 } request_queue_t;
 
 typedef struct {
@@ -188,6 +193,8 @@ typedef struct {
         int count;
         int max;
         reply_t *replys;
+        int spare_max;
+        reply_t *spare;                 /* swapped in by the consumer, no copy */
 } reply_queue_t;
 
 #if 1
@@ -220,6 +227,13 @@ typedef struct schedule_t {
         void *stack_addr;
         int size;
 
+        // stack pool, LIFO, pool[0, stack_trim) have no resident pages
+        void **stack_pool;
+        int stack_count;
+        int stack_low;
+        int stack_trim;
+        int stack_total;
+
         // no free task count
         int task_count;
         int running_task;
@@ -366,6 +380,7 @@ void schedule_value_set(int key, uint32_t value);
 int schedule_task_uptime();
 void schedule_value_get(int key, uint32_t *value);
 int schedule_priority(schedule_t *_schedule);
+void schedule_priority_set(int priority);
 
 #if 1
 
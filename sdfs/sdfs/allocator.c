@@ -11,6 +11,7 @@
 #include <attr/attributes.h>
 #include <ctype.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <errno.h>
 
 #define DBG_SUBSYS S_YFSLIB
@@ -25,20 +26,54 @@
 #include "ylib.h"
 #include "dbg.h"
 
+/*
+ * placement picks replicas with power-of-two-choices over nodes (failure
+ * domains) and then over disks inside the node, comparing weights derived
+ * from free space and io load published by mond.  the hot path only loads
+ * the current snapshot pointer; workers build a new snapshot and swap it.
+ */
+
+#define ALLOCATOR_STAT_INTERVAL 5
+#define ALLOCATOR_GRACE 10
+#define ALLOCATOR_NODE_MAX 1024
+
+typedef struct {
+        nid_t nid;
+        uint64_t weight;
+} allocator_disk_t;
+
 typedef struct {
         int count;
-        int cursor;
-        nid_t array[0];
+        uint64_t weight;
+        allocator_disk_t array[0];
 } allocator_node_t;
 
-typedef struct {
-        sy_rwlock_t lock;
+typedef struct __allocator_snap {
+        struct __allocator_snap *next;
+        time_t retire;
         int count;
-        int cursor;
         allocator_node_t **array;
+} allocator_snap_t;
+
+typedef struct {
+        uint32_t id;
+        uint64_t free;
+        uint64_t load;
+} allocator_stat_t;
+
+typedef struct {
+        allocator_snap_t *snap;
+
+        /* worker side, protected by lock */
+        pthread_mutex_t lock;
+        allocator_snap_t *topology;
+        allocator_snap_t *retired;
+        int stat_count;
+        allocator_stat_t *stat;
 } allocator_t;
 
 static allocator_t *__allocator__ = NULL; 
+static __thread uint32_t __seed__ = 0;
 
 static int __allocator_disk(const nid_t *nid)
 {
@@ -69,12 +104,13 @@ static int __allocator_node(const char *nodeinfo, allocator_node_t **_allocator_
 
         YASSERT(disk_count);
 
-        ret = ymalloc((void **)&allocator_node, sizeof(*allocator_node) + sizeof(nid_t) * disk_count);
+        ret = ymalloc((void **)&allocator_node, sizeof(*allocator_node)
+                      + sizeof(allocator_disk_t) * disk_count);
         if (ret)
                 GOTO(err_ret, ret);
 
         allocator_node->count = 0;
-        allocator_node->cursor = _random();
+        allocator_node->weight = 0;
         for (int i = 0; i < disk_count; i++) {
                 str2nid(&nid, list[i]);
 
@@ -82,7 +118,8 @@ static int __allocator_node(const char *nodeinfo, allocator_node_t **_allocator_
                 if (ret)
                         continue;
                 
-                allocator_node->array[allocator_node->count] = nid;
+                allocator_node->array[allocator_node->count].nid = nid;
+                allocator_node->array[allocator_node->count].weight = 0;
                 allocator_node->count++;
         }
 
@@ -141,31 +178,282 @@ err_ret:
         return ret;
 }
 
-inline static int __allocator_replace(int count, allocator_node_t **array)
+static void __allocator_free(allocator_snap_t *snap)
 {
-        int ret, old;
-        allocator_node_t **old_array;
-        
-        ret = sy_rwlock_wrlock(&__allocator__->lock);
+        for (int i = 0; i < snap->count; i++) {
+                yfree((void **)&snap->array[i]);
+        }
+
+        yfree((void **)&snap->array);
+        yfree((void **)&snap);
+}
+
+static int __allocator_stat_cmp(const void *_a, const void *_b)
+{
+        const allocator_stat_t *a = _a, *b = _b;
+
+        return a->id < b->id ? -1 : (a->id > b->id ? 1 : 0);
+}
+
+static const allocator_stat_t *__allocator_stat_find(const allocator_t *allocator,
+                                                     const nid_t *nid)
+{
+        allocator_stat_t key;
+
+        if (allocator->stat == NULL)
+                return NULL;
+
+        key.id = nid->id;
+        return bsearch(&key, allocator->stat, allocator->stat_count,
+                       sizeof(key), __allocator_stat_cmp);
+}
+
+/*
+ * free MB discounted by load relative to the average,
+ * a disk twice as busy as the average counts 2/3 of its space
+ */
+static uint64_t __allocator_weight(const allocator_stat_t *stat, uint64_t avg)
+{
+        return stat->free * (avg + 1) / (avg + stat->load / 2 + 1);
+}
+
+static int __allocator_build(allocator_t *allocator, allocator_snap_t **_snap)
+{
+        int ret, known = 0;
+        allocator_snap_t *snap, *topology = allocator->topology;
+        allocator_node_t *node, *src;
+        allocator_disk_t *disk;
+        const allocator_stat_t *stat;
+        uint64_t sum = 0, avg = 0, weight_sum = 0, weight_def;
+
+        for (int i = 0; i < allocator->stat_count; i++) {
+                sum += allocator->stat[i].load;
+        }
+
+        if (allocator->stat_count)
+                avg = sum / allocator->stat_count;
+
+        ret = ymalloc((void **)&snap, sizeof(*snap));
         if (ret)
                 GOTO(err_ret, ret);
 
-        old = __allocator__->count;
-        old_array = __allocator__->array;
-        __allocator__->count = count;
-        __allocator__->array = array;
-                
-        sy_rwlock_unlock(&__allocator__->lock);
+        ret = ymalloc((void **)&snap->array, sizeof(allocator_node_t *) * topology->count);
+        if (ret)
+                GOTO(err_snap, ret);
+
+        snap->next = NULL;
+        snap->retire = 0;
+        snap->count = 0;
+        for (int i = 0; i < topology->count; i++) {
+                src = topology->array[i];
+                ret = ymalloc((void **)&node, sizeof(*node)
+                              + sizeof(allocator_disk_t) * src->count);
+                if (ret)
+                        GOTO(err_free, ret);
+
+                node->count = src->count;
+                for (int j = 0; j < src->count; j++) {
+                        disk = &node->array[j];
+                        disk->nid = src->array[j].nid;
+                        stat = __allocator_stat_find(allocator, &disk->nid);
+                        if (stat) {
+                                disk->weight = __allocator_weight(stat, avg);
+                                weight_sum += disk->weight;
+                                known++;
+                        } else {
+                                disk->weight = (uint64_t)-1;
+                        }
+                }
+
+                snap->array[snap->count] = node;
+                snap->count++;
+        }
+
+        /* disks not reported yet count as average ones */
+        weight_def = known ? weight_sum / known : 1;
+        for (int i = 0; i < snap->count; i++) {
+                node = snap->array[i];
+                node->weight = 0;
+                for (int j = 0; j < node->count; j++) {
+                        disk = &node->array[j];
+                        if (disk->weight == (uint64_t)-1)
+                                disk->weight = weight_def;
+
+                        node->weight += disk->weight;
+                }
+        }
+
+        *_snap = snap;
+
+        return 0;
+err_free:
+        __allocator_free(snap);
+        return ret;
+err_snap:
+        yfree((void **)&snap);
+err_ret:
+        return ret;
+}
+
+/* called with allocator->lock held */
+static int __allocator_update(allocator_t *allocator)
+{
+        int ret;
+        time_t now;
+        allocator_snap_t *snap, *old, *tmp, **pos;
+
+        if (allocator->topology == NULL)
+                return 0;
+
+        ret = __allocator_build(allocator, &snap);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        old = __atomic_exchange_n(&allocator->snap, snap, __ATOMIC_ACQ_REL);
+        if (old == NULL)
+                return 0;
+
+        /* readers never block, retired snapshots live on for a grace period */
+        now = gettime();
+        old->retire = now;
+        old->next = allocator->retired;
+        allocator->retired = old;
+
+        pos = &allocator->retired;
+        while (*pos) {
+                tmp = *pos;
+                if (now - tmp->retire > ALLOCATOR_GRACE) {
+                        *pos = tmp->next;
+                        __allocator_free(tmp);
+                } else {
+                        pos = &tmp->next;
+                }
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static int __allocator_replace(int count, allocator_node_t **array)
+{
+        int ret;
+        allocator_t *allocator = __allocator__;
+        allocator_snap_t *topology;
+
+        ret = ymalloc((void **)&topology, sizeof(*topology));
+        if (ret)
+                GOTO(err_ret, ret);
+
+        topology->next = NULL;
+        topology->retire = 0;
+        topology->count = count;
+        topology->array = array;
+
+        pthread_mutex_lock(&allocator->lock);
+
+        if (allocator->topology)
+                __allocator_free(allocator->topology);
+
+        allocator->topology = topology;
+
+        ret = __allocator_update(allocator);
 
-        for (int i = 0; i < old; i++) {
-                yfree((void **)&old_array[i]);
+        pthread_mutex_unlock(&allocator->lock);
+
+        if (ret)
+                GOTO(err_ret, ret);
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static int __allocator_stat_parse(char *buf, int *_count, allocator_stat_t **_stat)
+{
+        int ret, count, max;
+        char *line, *saveptr;
+        allocator_stat_t *stat;
+        unsigned int id;
+        unsigned long long free, load;
+
+        max = 1;
+        for (char *p = buf; *p; p++) {
+                if (*p == '\n')
+                        max++;
         }
 
+        ret = ymalloc((void **)&stat, sizeof(*stat) * max);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        count = 0;
+        for (line = strtok_r(buf, "\n", &saveptr); line && count < max;
+             line = strtok_r(NULL, "\n", &saveptr)) {
+                if (sscanf(line, "%u %llu %llu", &id, &free, &load) != 3)
+                        continue;
+
+                stat[count].id = id;
+                stat[count].free = free;
+                stat[count].load = load;
+                count++;
+        }
+
+        qsort(stat, count, sizeof(*stat), __allocator_stat_cmp);
+
+        *_stat = stat;
+        *_count = count;
+
         return 0;
 err_ret:
         return ret;
 }
 
+static void *__allocator_stat_worker(void *arg)
+{
+        int ret, buflen, count;
+        allocator_t *allocator = arg;
+        allocator_stat_t *stat;
+        char *buf;
+
+        ret = ymalloc((void **)&buf, MON_ENTRY_MAX + 1);
+        if (ret)
+                UNIMPLEMENTED(__DUMP__);
+
+        while (1) {
+                sleep(ALLOCATOR_STAT_INTERVAL);
+
+                buflen = MON_ENTRY_MAX;
+                ret = mond_rpc_get(net_getnid(), MOND_DISKSTAT, 0, buf, &buflen);
+                if (ret) {
+                        DBUG("get diskstat fail, ret %u\n", ret);
+                        continue;
+                }
+
+                buf[buflen] = '\0';
+                ret = __allocator_stat_parse(buf, &count, &stat);
+                if (ret)
+                        continue;
+
+                pthread_mutex_lock(&allocator->lock);
+
+                if (allocator->stat)
+                        yfree((void **)&allocator->stat);
+
+                allocator->stat = stat;
+                allocator->stat_count = count;
+
+                ret = __allocator_update(allocator);
+                if (ret) {
+                        DWARN("update fail, ret %u\n", ret);
+                }
+
+                pthread_mutex_unlock(&allocator->lock);
+        }
+
+        pthread_exit(NULL);
+}
+
 static int __allocator_apply(char *value)
 {
         int ret, count;
@@ -265,29 +553,70 @@ int allocator_init()
         if (ret)
                 GOTO(err_ret, ret);
 
-        ret = sy_rwlock_init(&__allocator__->lock, "allocator");
+        memset(__allocator__, 0x0, sizeof(*__allocator__));
+
+        ret = pthread_mutex_init(&__allocator__->lock, NULL);
         if (ret)
                 GOTO(err_ret, ret);
         
         ret = sy_thread_create2(__allocator_worker, NULL, "allocator");
         if (ret)
                 GOTO(err_ret, ret);
+
+        ret = sy_thread_create2(__allocator_stat_worker, __allocator__, "allocator_stat");
+        if (ret)
+                GOTO(err_ret, ret);
         
         return 0;
 err_ret:
         return ret;
 }
 
-static void __allocator_new_disk(allocator_node_t *node, nid_t *nid)
+static inline uint32_t __allocator_rand()
 {
-        *nid = node->array[node->cursor % node->count];
-        node->cursor++;
+        uint32_t x = __seed__;
+
+        if (unlikely(x == 0))
+                x = _random() | 1;
+
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        __seed__ = x;
+
+        return x;
+}
+
+static int __allocator_new_node(const allocator_snap_t *snap, const char *used)
+{
+        int a, b;
+
+        a = __allocator_rand() % snap->count;
+        while (used[a])
+                a = (a + 1) % snap->count;
+
+        b = __allocator_rand() % snap->count;
+        while (used[b])
+                b = (b + 1) % snap->count;
+
+        return snap->array[b]->weight > snap->array[a]->weight ? b : a;
+}
+
+static void __allocator_new_disk(const allocator_node_t *node, nid_t *nid)
+{
+        int a, b;
+
+        a = __allocator_rand() % node->count;
+        b = __allocator_rand() % node->count;
+
+        *nid = node->array[node->array[b].weight > node->array[a].weight ? b : a].nid;
 }
 
 static int __allocator_new(int repnum, int hardend, int tier, nid_t *disks)
 {
-        int ret;
-        allocator_t *allocator = __allocator__;
+        int ret, idx;
+        char _used[ALLOCATOR_NODE_MAX], *used = _used;
+        const allocator_snap_t *snap;
 
 #if 0
         return mond_rpc_newdisk(net_getnid(), tier, repnum, hardend, disks);
@@ -302,29 +631,35 @@ static int __allocator_new(int repnum, int hardend, int tier, nid_t *disks)
         }
 #endif
 
-        ret = sy_rwlock_rdlock(&allocator->lock);
-        if (ret)
-                GOTO(err_ret, ret);
+        snap = __atomic_load_n(&__allocator__->snap, __ATOMIC_ACQUIRE);
+        if (unlikely(snap == NULL)) {
+                return mond_rpc_newdisk(net_getnid(), tier, repnum, hardend, disks);
+        }
 
-        if (allocator->count < repnum) {
+        if (snap->count < repnum) {
                 ret = ENOSPC;
-                DWARN("need %u got %u\n", repnum, allocator->count);
-                GOTO(err_lock, ret);
+                DWARN("need %u got %u\n", repnum, snap->count);
+                GOTO(err_ret, ret);
         }
 
-        int cur = allocator->cursor;
+        if (unlikely(snap->count > ALLOCATOR_NODE_MAX)) {
+                ret = ymalloc((void **)&used, snap->count);
+                if (ret)
+                        GOTO(err_ret, ret);
+        }
+
+        /* one replica per node */
+        memset(used, 0x0, snap->count);
         for (int i = 0; i < repnum; i++ ) {
-                __allocator_new_disk(allocator->array[(i + cur) % allocator->count],
-                                     &disks[i]);
+                idx = __allocator_new_node(snap, used);
+                used[idx] = 1;
+                __allocator_new_disk(snap->array[idx], &disks[i]);
         }
 
-        allocator->cursor++;
-        
-        sy_rwlock_unlock(&allocator->lock);
+        if (used != _used)
+                yfree((void **)&used);
 
         return 0;
-err_lock:
-        sy_rwlock_unlock(&allocator->lock);
 err_ret:
         return ret;
 }
@@ -40,7 +40,7 @@ typedef struct {
 typedef struct {
         plock_t plock;
         time_t update;
-        hashtable_t tab;
+        swiss_t *tab;
         struct list_head list;
         int count;
 
@@ -53,6 +53,22 @@ typedef struct {
 } wait_t;
         
 
+/* the fields chkid_cmp compares, packed for the table */
+typedef struct {
+        uint64_t id;
+        uint64_t volid;
+        uint32_t idx;
+        uint32_t type;
+} attr_queue_key_t;
+
+static void __attr_queue_key(const fileid_t *fileid, attr_queue_key_t *key)
+{
+        key->id = fileid->id;
+        key->volid = fileid->volid;
+        key->idx = fileid->idx;
+        key->type = fileid->type;
+}
+
 static void __attr_queue_update(entry_t *ent, int op, const void *arg)
 {
         if (op == ATTR_OP_EXTERN) {
@@ -76,11 +92,16 @@ static void __attr_queue_update(entry_t *ent, int op, const void *arg)
                 DBUG("----truncate "CHKID_FORMAT" %u--\n",
                       CHKID_ARG(&ent->fileid), ent->size.size);
         } else if (op == ATTR_OP_SETTIME) {
+                /* a write only sets mtime and ctime, keep a queued atime */
                 const setattr_t *setattr = arg;
-                ent->atime = setattr->atime;
-                ent->btime = setattr->btime;
-                ent->ctime = setattr->ctime;
-                ent->mtime = setattr->mtime;
+                if (setattr->atime.set_it != __DONT_CHANGE)
+                        ent->atime = setattr->atime;
+                if (setattr->btime.set_it != __DONT_CHANGE)
+                        ent->btime = setattr->btime;
+                if (setattr->ctime.set_it != __DONT_CHANGE)
+                        ent->ctime = setattr->ctime;
+                if (setattr->mtime.set_it != __DONT_CHANGE)
+                        ent->mtime = setattr->mtime;
         } else {
                 UNIMPLEMENTED(__DUMP__);
         }
@@ -93,6 +114,7 @@ static int __attr_queue_create(attr_queue_t *attr_queue, const volid_t *volid,
 {
         int ret;
         entry_t *ent;
+        attr_queue_key_t key;
 
         ret = ymalloc((void **)&ent, sizeof(*ent));
         if (ret)
@@ -109,7 +131,8 @@ static int __attr_queue_create(attr_queue_t *attr_queue, const volid_t *volid,
 
         DBUG("add "CHKID_FORMAT"\n", CHKID_ARG(&ent->fileid));
 
-        ret = hash_table_insert(attr_queue->tab, (void *)ent, (void *)&ent->fileid, 0);
+        __attr_queue_key(&ent->fileid, &key);
+        ret = swiss_insert(attr_queue->tab, &key, ent, 0);
         if (ret)
                 UNIMPLEMENTED(__DUMP__);
         
@@ -127,10 +150,12 @@ static void __attr_queue_remove(attr_queue_t *attr_queue, entry_t *ent)
         struct list_head *pos, *n;
         wait_t *wait;
         entry_t *tmp;
+        attr_queue_key_t key;
 
         DBUG("remove "CHKID_FORMAT" %p\n", CHKID_ARG(&ent->fileid), ent);
         
-        ret = hash_table_remove(attr_queue->tab, (void *)&ent->fileid, (void **)&tmp);
+        __attr_queue_key(&ent->fileid, &key);
+        ret = swiss_remove(attr_queue->tab, &key, (void **)&tmp);
         YASSERT(ret == 0);
 
         list_del(&ent->hook);
@@ -168,6 +193,7 @@ static int __attr_queue(const volid_t *volid, const fileid_t *fileid, int op, co
         int ret, retry = 0;
         attr_queue_t *attr_queue = variable_get(VARIABLE_ATTR_QUEUE);
         entry_t *ent;
+        attr_queue_key_t key;
 
         if (attr_queue == NULL) {
                 return 0;
@@ -182,7 +208,8 @@ static int __attr_queue(const volid_t *volid, const fileid_t *fileid, int op, co
         }
 
 retry:
-        ent = hash_table_find(attr_queue->tab, (void *)fileid);
+        __attr_queue_key(fileid, &key);
+        ent = swiss_find(attr_queue->tab, &key);
         if (ent) {
                 if (ent->running) {
                         ret = __attr_wait(ent);
@@ -232,6 +259,7 @@ int attr_queue_update(const volid_t *volid, const fileid_t *fileid, void *_md)
 {
         attr_queue_t *attr_queue = variable_get(VARIABLE_ATTR_QUEUE);
         entry_t *ent;
+        attr_queue_key_t key;
         md_proto_t *md = _md;
 
         if (attr_queue == NULL) {
@@ -240,7 +268,8 @@ int attr_queue_update(const volid_t *volid, const fileid_t *fileid, void *_md)
         
         (void) volid;
         
-        ent = hash_table_find(attr_queue->tab, (void *)fileid);
+        __attr_queue_key(fileid, &key);
+        ent = swiss_find(attr_queue->tab, &key);
         if (ent == NULL) {
                 return 0;
         }
@@ -362,31 +391,13 @@ void attr_queue_run(void *var)
         return;
 }
 
-static uint32_t __key(const void *args)
-{
-        return ((fileid_t *)args)->id;
-}
-
-static int __cmp(const void *v1, const void *v2)
-{
-        const entry_t *ent = (entry_t *)v1;
-        const fileid_t *fileid = v2;
-
-        DBUG("cmp "CHKID_FORMAT" "CHKID_FORMAT"\n",
-              CHKID_ARG(&ent->fileid), CHKID_ARG(fileid));
-        
-        return chkid_cmp(&ent->fileid, fileid);
-}
-
 static int __attr_queue_init(attr_queue_t *attr_queue)
 {
         int ret;
 
-        attr_queue->tab = hash_create_table(__cmp, __key, "cds vol");
-        if (attr_queue->tab == NULL) {
-                ret = ENOMEM;
+        ret = swiss_create(&attr_queue->tab, "attr queue", sizeof(attr_queue_key_t));
+        if (ret)
                 GOTO(err_ret, ret);
-        }
 
         ret = plock_init(&attr_queue->plock, "attr queue");
         if (ret)
@@ -445,7 +456,7 @@ int attr_queue_destroy()
                 attr_queue->kv = NULL;
         }
         
-        hash_destroy_table(attr_queue->tab, NULL, NULL);
+        swiss_destroy(attr_queue->tab, NULL, NULL);
         attr_queue->tab = NULL;
         DBUG("attr queue %p destroy\n", attr_queue);
         yfree((void **)&attr_queue);
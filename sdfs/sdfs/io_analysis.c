@@ -26,6 +26,8 @@ typedef struct {
         uint64_t write_count;
         uint64_t read_bytes;
         uint64_t write_bytes;
+        uint64_t compress_raw;
+        uint64_t compress_stored;
         time_t last_output;
         sy_spinlock_t lock;
 
@@ -74,7 +76,10 @@ static int __io_analysis_dump()
                          "read_bytes_ps:%u\n"
                          "write_ps:%u\n"
                          "write_bytes_ps:%u\n"
-                         "latency:%ju\n",
+                         "latency:%ju\n"
+                         "compress_raw:%llu\n"
+                         "compress_stored:%llu\n"
+                         "compress_ratio:%llu%%\n",
                          (LLU)__io_analysis__->read_count,
                          (LLU)__io_analysis__->read_bytes,
                          (LLU)__io_analysis__->write_count,
@@ -83,7 +88,12 @@ static int __io_analysis_dump()
                          readbwps,
                          writeps,
                          writebwps,
-                         core_latency_get());
+                         core_latency_get(),
+                         (LLU)__io_analysis__->compress_raw,
+                         (LLU)__io_analysis__->compress_stored,
+                         __io_analysis__->compress_raw ?
+                         (LLU)(__io_analysis__->compress_stored * 100
+                               / __io_analysis__->compress_raw) : 100);
                 __io_analysis__->last_output = now;
 
                 time_t now = gettime();
@@ -194,6 +204,50 @@ err_ret:
         return ret;
 }
 
+/* bytes read and written during the last full second */
+uint64_t io_analysis_load()
+{
+        int ret;
+        uint64_t load;
+        uint32_t readps, writeps, readbwps, writebwps;
+
+        if (__io_analysis__ == NULL)
+                return 0;
+
+        ret = sy_spin_lock(&__io_analysis__->lock);
+        if (ret)
+                return 0;
+
+        if (gettime() - __io_analysis__->last > 1) {
+                load = 0;
+        } else {
+                __io_analysis_get(&readps, &writeps, &readbwps, &writebwps);
+                load = (uint64_t)readbwps + writebwps;
+        }
+
+        sy_spin_unlock(&__io_analysis__->lock);
+
+        return load;
+}
+
+/* raw bytes handed to the compressed chunk store and bytes it kept on disk */
+void io_analysis_compress(uint64_t raw, uint64_t stored)
+{
+        int ret;
+
+        if (__io_analysis__ == NULL)
+                return;
+
+        ret = sy_spin_lock(&__io_analysis__->lock);
+        if (ret)
+                return;
+
+        __io_analysis__->compress_raw += raw;
+        __io_analysis__->compress_stored += stored;
+
+        sy_spin_unlock(&__io_analysis__->lock);
+}
+
 static void *__io_analysis_rept(void *arg)
 {
         int ret;
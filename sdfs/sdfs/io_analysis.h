@@ -13,5 +13,7 @@ typedef enum {
 int io_analysis_init(const char *name, int seq);
 int io_analysis(analysis_op_t op, int count);
 int io_analysis_dump(const char *type);
+uint64_t io_analysis_load();
+void io_analysis_compress(uint64_t raw, uint64_t stored);
 
 #endif
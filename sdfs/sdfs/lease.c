@@ -0,0 +1,563 @@
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define DBG_SUBSYS S_YFSLIB
+
+#include "ylib.h"
+#include "net_global.h"
+#include "configure.h"
+#include "md_lib.h"
+#include "md_attr.h"
+#include "redis.h"
+#include "redis_util.h"
+#include "schedule.h"
+#include "lease.h"
+#include "dbg.h"
+
+/*
+ * exclusive write lease of a file, for writers that are not daemons and so
+ * have no attr queue.
+ *
+ * the first write to a file only queues a request, the lease worker asks
+ * redis for it, so the write path never waits on the lease.  while the
+ * lease is held, size and mtime of the file are kept here and pushed to the
+ * inode at renew, close, idle expiry, or once another process recalled it.
+ * writers without the lease extend the inode synchronously as before, size
+ * only grows by max so both can mix.  truncate and setattr recall the lease
+ * first, so a later push can not grow the file back, getattr recalls it so
+ * the size and mtime read are the ones written elsewhere.
+ *
+ * the table lock is a spinlock, it is taken from cores and never held
+ * across anything that blocks or yields.  only the lease worker removes
+ * entries from the table.
+ */
+
+#define LEASE_SKIP     0
+#define LEASE_RENEW    1
+#define LEASE_RELEASE  2
+#define LEASE_DROP     3
+#define LEASE_GRANT    4
+
+typedef struct {
+        struct list_head hook;
+        fileid_t fileid;
+        volid_t volid;
+        int held;
+        int want;               /* waiting for the worker to ask for it */
+        int closing;
+        int dirty;
+        time_t renew;           /* next renew */
+        time_t expire;          /* end of the lease, or of the backoff if not held */
+        time_t atime;           /* last write */
+        uint64_t size;
+        struct timespec mtime;
+} lease_t;
+
+typedef struct {
+        sy_spinlock_t lock;
+        pthread_mutex_t run;
+        hashtable_t tab;
+        struct list_head list;
+        char owner[MAX_NAME_LEN];
+        int ttl;
+} lease_table_t;
+
+static lease_table_t *__lease_table__ = NULL;
+
+static void __lease_set(lease_t *ent, time_t now, uint64_t size, const struct timespec *mtime)
+{
+        ent->size = _max(ent->size, size);
+        ent->mtime = *mtime;
+        ent->atime = now;
+        ent->dirty = 1;
+}
+
+static void __lease_grant(const lease_table_t *table, lease_t *ent, time_t begin)
+{
+        ent->held = 1;
+        ent->renew = begin + table->ttl / 3;
+        ent->expire = begin + table->ttl / 2;
+}
+
+/*
+ * record a write at mtime extending the file to size under the lease,
+ * ENOLCK if the lease is not ours and the caller has to extend the inode
+ */
+int lease_extend(const volid_t *volid, const fileid_t *fileid, uint64_t size,
+                 const struct timespec *mtime)
+{
+        int ret;
+        lease_t *ent, *new;
+        time_t now;
+        lease_table_t *table = __lease_table__;
+
+        if (table == NULL) {
+                return ENOLCK;
+        }
+
+        now = gettime();
+
+        sy_spin_lock(&table->lock);
+
+        ent = hash_table_find(table->tab, (void *)fileid);
+        if (ent) {
+                if (ent->held && now < ent->expire) {
+                        __lease_set(ent, now, size, mtime);
+                        ret = 0;
+                } else {
+                        ret = ENOLCK;
+                }
+
+                sy_spin_unlock(&table->lock);
+                return ret;
+        }
+
+        sy_spin_unlock(&table->lock);
+
+        ret = ymalloc((void **)&new, sizeof(*new));
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
+        memset(new, 0x0, sizeof(*new));
+        new->fileid = *fileid;
+        new->volid = *volid;
+        new->want = 1;
+        new->expire = now;
+
+        sy_spin_lock(&table->lock);
+
+        /* raced with another writer of the same file */
+        ent = hash_table_find(table->tab, (void *)fileid);
+        if (ent) {
+                sy_spin_unlock(&table->lock);
+                yfree((void **)&new);
+                return ENOLCK;
+        }
+
+        ret = hash_table_insert(table->tab, (void *)new, (void *)&new->fileid, 0);
+        if (unlikely(ret))
+                UNIMPLEMENTED(__DUMP__);
+
+        list_add_tail(&new->hook, &table->list);
+
+        sy_spin_unlock(&table->lock);
+
+        DBUG("lease "CHKID_FORMAT" wanted\n", CHKID_ARG(fileid));
+
+        /* this write extends the inode, the lease takes the next ones */
+        return ENOLCK;
+err_ret:
+        return ret;
+}
+
+int lease_truncate(const fileid_t *fileid, uint64_t size)
+{
+        lease_t *ent;
+        lease_table_t *table = __lease_table__;
+
+        if (table == NULL) {
+                return 0;
+        }
+
+        sy_spin_lock(&table->lock);
+
+        ent = hash_table_find(table->tab, (void *)fileid);
+        if (ent && ent->size > size) {
+                ent->size = size;
+        }
+
+        sy_spin_unlock(&table->lock);
+
+        return 0;
+}
+
+/*
+ * make the holder of the lease on fileid, if another process, push its
+ * size and mtime and give the lease up, before the caller reads or changes
+ * them.  the holder sees the recall at its next renew, or the lease
+ * expires.
+ */
+int lease_recall(const volid_t *volid, const fileid_t *fileid)
+{
+        int ret, ttl, held, retry = 0;
+        char owner[MAX_NAME_LEN];
+        lease_t *ent;
+        lease_table_t *table = __lease_table__;
+
+        if (!gloconf.write_lease) {
+                return 0;
+        }
+
+        /* ours, lease_update and lease_truncate see it */
+        if (table) {
+                sy_spin_lock(&table->lock);
+                ent = hash_table_find(table->tab, (void *)fileid);
+                held = ent && ent->held;
+                sy_spin_unlock(&table->lock);
+
+                if (held)
+                        return 0;
+        }
+
+        ttl = _max(gloconf.lease_timeout, 3);
+        snprintf(owner, MAX_NAME_LEN, "%u:%u", ng.local_nid.id, getpid());
+
+retry:
+        ret = klease(volid, fileid, REDIS_LEASE_RECALL,
+                     table ? table->owner : owner, ttl);
+        if (ret) {
+                if (ret == EAGAIN) {
+                        if (retry >= ttl * 10) {
+                                DWARN("recall "CHKID_FORMAT" timeout\n",
+                                      CHKID_ARG(fileid));
+                                return 0;
+                        }
+
+                        schedule_sleep("lease_recall", 100 * 1000);
+                        retry++;
+                        goto retry;
+                }
+
+                GOTO(err_ret, ret);
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+/*
+ * the writer is done with the file, the lease is given up at next run
+ */
+int lease_close(const fileid_t *fileid)
+{
+        lease_t *ent;
+        lease_table_t *table = __lease_table__;
+
+        if (table == NULL) {
+                return 0;
+        }
+
+        sy_spin_lock(&table->lock);
+
+        ent = hash_table_find(table->tab, (void *)fileid);
+        if (ent) {
+                ent->closing = 1;
+        }
+
+        sy_spin_unlock(&table->lock);
+
+        return 0;
+}
+
+/*
+ * merge the size and mtime known here into md, they may not be pushed yet
+ */
+int lease_update(const fileid_t *fileid, md_proto_t *md)
+{
+        lease_t *ent;
+        lease_table_t *table = __lease_table__;
+
+        if (table == NULL) {
+                return 0;
+        }
+
+        sy_spin_lock(&table->lock);
+
+        ent = hash_table_find(table->tab, (void *)fileid);
+        if (ent && ent->size) {
+                md->at_size = _max(md->at_size, ent->size);
+                md->chknum = _get_chknum(md->at_size, md->split);
+                if (ent->mtime.tv_sec > md->at_mtime.tv_sec) {
+                        md->at_mtime = ent->mtime;
+                }
+        }
+
+        sy_spin_unlock(&table->lock);
+
+        return 0;
+}
+
+static int __lease_push(const lease_t *ent, uint64_t size, const struct timespec *mtime)
+{
+        int ret, retry = 0;
+        setattr_t setattr;
+
+        setattr_init(&setattr, -1, -1, NULL, -1, -1, -1);
+        setattr.size.set_it = __SET_EXTERN;
+        setattr.size.size = size;
+        setattr.mtime.set_it = __SET_TO_CLIENT_TIME;
+        setattr.mtime.time = *mtime;
+
+        DBUG("push "CHKID_FORMAT" size %ju\n", CHKID_ARG(&ent->fileid), size);
+
+retry:
+        ret = md_setattr(&ent->volid, &ent->fileid, &setattr, 1);
+        if (ret) {
+                ret = _errno(ret);
+                if (ret == EAGAIN) {
+                        USLEEP_RETRY(err_ret, ret, retry, retry, 100, (1000 * 1000));
+                } else
+                        GOTO(err_ret, ret);
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+/*
+ * decide what the worker does with ent, called locked. a lease to give up
+ * stops taking writes here, so the snapshot taken is final
+ */
+static int __lease_check(lease_table_t *table, lease_t *ent, time_t now,
+                         int *dirty, uint64_t *size, struct timespec *mtime)
+{
+        int op;
+
+        if (!ent->held) {
+                if (ent->want && !ent->closing) {
+                        ent->want = 0;
+                        return LEASE_GRANT;
+                }
+
+                return now >= ent->expire ? LEASE_DROP : LEASE_SKIP;
+        }
+
+        if (ent->closing || now >= ent->expire
+            || now - ent->atime >= table->ttl) {
+                ent->held = 0;
+                op = LEASE_RELEASE;
+        } else if (now >= ent->renew) {
+                op = LEASE_RENEW;
+        } else {
+                return LEASE_SKIP;
+        }
+
+        *dirty = ent->dirty;
+        *size = ent->size;
+        *mtime = ent->mtime;
+        ent->dirty = 0;
+
+        return op;
+}
+
+static int __lease_run__(lease_table_t *table, lease_t *ent, int op, int dirty,
+                         uint64_t size, const struct timespec *mtime, time_t now)
+{
+        int ret;
+
+        if (op == LEASE_DROP) {
+                return 1;
+        }
+
+        if (op == LEASE_GRANT) {
+                ret = klease(&ent->volid, &ent->fileid, REDIS_LEASE_GRANT,
+                             table->owner, table->ttl);
+
+                sy_spin_lock(&table->lock);
+                if (ret == 0) {
+                        __lease_grant(table, ent, now);
+                } else {
+                        /* held elsewhere, don't ask again before the backoff */
+                        DBUG("lease "CHKID_FORMAT" fail, ret %u\n",
+                             CHKID_ARG(&ent->fileid), ret);
+                        ent->expire = now + table->ttl / 2;
+                }
+                sy_spin_unlock(&table->lock);
+
+                return 0;
+        }
+
+        if (dirty) {
+                ret = __lease_push(ent, size, mtime);
+                if (ret) {
+                        DWARN("push "CHKID_FORMAT" fail, ret %u\n",
+                              CHKID_ARG(&ent->fileid), ret);
+
+                        if (op == LEASE_RENEW) {
+                                sy_spin_lock(&table->lock);
+                                ent->size = _max(ent->size, size);
+                                ent->dirty = 1;
+                                sy_spin_unlock(&table->lock);
+                        }
+                }
+        }
+
+        if (op == LEASE_RENEW) {
+                ret = klease(&ent->volid, &ent->fileid, REDIS_LEASE_GRANT,
+                             table->owner, table->ttl);
+                if (ret == 0) {
+                        sy_spin_lock(&table->lock);
+                        __lease_grant(table, ent, now);
+                        sy_spin_unlock(&table->lock);
+                        return 0;
+                }
+
+                DBUG("lease "CHKID_FORMAT" lost, ret %u\n", CHKID_ARG(&ent->fileid), ret);
+
+                sy_spin_lock(&table->lock);
+                ent->held = 0;
+                dirty = ent->dirty;
+                size = ent->size;
+                mtime = &ent->mtime;
+                ent->dirty = 0;
+                sy_spin_unlock(&table->lock);
+
+                if (dirty) {
+                        ret = __lease_push(ent, size, mtime);
+                        if (ret) {
+                                DWARN("push "CHKID_FORMAT" fail, ret %u\n",
+                                      CHKID_ARG(&ent->fileid), ret);
+                        }
+                }
+        }
+
+        ret = klease(&ent->volid, &ent->fileid, REDIS_LEASE_RELEASE,
+                     table->owner, table->ttl);
+        if (ret) {
+                DWARN("release "CHKID_FORMAT" fail, ret %u\n",
+                      CHKID_ARG(&ent->fileid), ret);
+        }
+
+        return 1;
+}
+
+static void __lease_run(lease_table_t *table, int all)
+{
+        int ret, op, dirty, remove;
+        uint64_t size;
+        struct timespec mtime;
+        struct list_head *pos, *n;
+        lease_t *ent, *tmp;
+        time_t now = gettime();
+
+        /* the worker and the exit handler */
+        pthread_mutex_lock(&table->run);
+        sy_spin_lock(&table->lock);
+
+        pos = table->list.next;
+        while (pos != &table->list) {
+                ent = list_entry(pos, lease_t, hook);
+                if (all) {
+                        ent->closing = 1;
+                        ent->expire = now;
+                }
+
+                op = __lease_check(table, ent, now, &dirty, &size, &mtime);
+                if (op == LEASE_SKIP) {
+                        pos = pos->next;
+                        continue;
+                }
+
+                sy_spin_unlock(&table->lock);
+
+                remove = __lease_run__(table, ent, op, dirty, size, &mtime, now);
+
+                sy_spin_lock(&table->lock);
+
+                n = pos->next;
+                if (remove) {
+                        ret = hash_table_remove(table->tab, (void *)&ent->fileid,
+                                                (void **)&tmp);
+                        YASSERT(ret == 0 && tmp == ent);
+                        list_del(&ent->hook);
+                        yfree((void **)&ent);
+                }
+
+                pos = n;
+        }
+
+        sy_spin_unlock(&table->lock);
+        pthread_mutex_unlock(&table->run);
+}
+
+static void *__lease_worker(void *arg)
+{
+        lease_table_t *table = arg;
+
+        while (1) {
+                sleep(1);
+
+                __lease_run(table, 0);
+        }
+
+        return NULL;
+}
+
+static uint32_t __key(const void *args)
+{
+        return ((fileid_t *)args)->id;
+}
+
+static int __cmp(const void *v1, const void *v2)
+{
+        const lease_t *ent = (lease_t *)v1;
+        const fileid_t *fileid = v2;
+
+        return chkid_cmp(&ent->fileid, fileid);
+}
+
+/*
+ * push everything back and give up all leases, also run at exit since most
+ * clients never call ly_destroy
+ */
+void lease_destroy()
+{
+        lease_table_t *table = __lease_table__;
+
+        if (table == NULL) {
+                return;
+        }
+
+        __lease_run(table, 1);
+}
+
+int lease_init()
+{
+        int ret;
+        lease_table_t *table;
+
+        YASSERT(__lease_table__ == NULL);
+
+        ret = ymalloc((void **)&table, sizeof(*table));
+        if (ret)
+                GOTO(err_ret, ret);
+
+        memset(table, 0x0, sizeof(*table));
+
+        table->tab = hash_create_table(__cmp, __key, "write lease");
+        if (table->tab == NULL) {
+                ret = ENOMEM;
+                GOTO(err_free, ret);
+        }
+
+        ret = sy_spin_init(&table->lock);
+        if (ret)
+                GOTO(err_free, ret);
+
+        ret = pthread_mutex_init(&table->run, NULL);
+        if (ret)
+                GOTO(err_free, ret);
+
+        INIT_LIST_HEAD(&table->list);
+        table->ttl = _max(gloconf.lease_timeout, 3);
+        snprintf(table->owner, MAX_NAME_LEN, "%u:%u", ng.local_nid.id, getpid());
+
+        ret = sy_thread_create2(__lease_worker, table, "lease_worker");
+        if (ret)
+                GOTO(err_free, ret);
+
+        __lease_table__ = table;
+        atexit(lease_destroy);
+
+        DINFO("write lease %s, ttl %u\n", table->owner, table->ttl);
+
+        return 0;
+err_free:
+        yfree((void **)&table);
+err_ret:
+        return ret;
+}
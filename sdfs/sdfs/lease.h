@@ -0,0 +1,19 @@
+#ifndef __LEASE_H__
+#define __LEASE_H__
+
+#include <stdint.h>
+
+#include "ylib.h"
+#include "yfs_md.h"
+#include "dbg.h"
+
+int lease_init();
+void lease_destroy();
+int lease_extend(const volid_t *volid, const fileid_t *fileid, uint64_t size,
+                 const struct timespec *mtime);
+int lease_truncate(const fileid_t *fileid, uint64_t size);
+int lease_recall(const volid_t *volid, const fileid_t *fileid);
+int lease_close(const fileid_t *fileid);
+int lease_update(const fileid_t *fileid, md_proto_t *md);
+
+#endif
@@ -0,0 +1,386 @@
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#define DBG_SUBSYS S_YFSLIB
+
+#include "configure.h"
+#include "schedule.h"
+#include "md_lib.h"
+#include "sdfs_lib.h"
+#include "swiss.h"
+#include "qos.h"
+#include "dbg.h"
+
+#define QOS_VOLUME_TTL 10
+#define QOS_WAIT_MAX (1000 * 1000 * 5)
+#define QOS_UNIT (1000 * 1000)          /* tokens are kept as rate * usec */
+
+typedef struct {
+        uint64_t rate;                  /* per second, 0 is unlimited */
+        int64_t token;
+} qos_token_t;
+
+typedef struct {
+        uint64_t volid;
+        uint64_t client;                /* 0 for the bucket of the volume */
+} qos_key_t;
+
+typedef struct {
+        qos_key_t key;
+        time_t update;                  /* load time of the config applied */
+        int burst;
+        ytime_t last;
+        qos_token_t iops;
+        qos_token_t bw;
+} qos_bucket_t;
+
+typedef struct {
+        uint64_t iops;
+        uint64_t bw;
+        int burst;
+        int class;                      /* -1 keeps the task priority */
+} qos_conf_t;
+
+typedef struct {
+        uint64_t volid;
+        time_t update;
+        qos_conf_t conf;
+} qos_volume_t;
+
+/* token buckets of limited volumes and clients, shared by all cores */
+static swiss_t *__qos_bucket__;
+static sy_spinlock_t __qos_lock__;
+static pthread_once_t __qos_once__ = PTHREAD_ONCE_INIT;
+
+/* volume limits seen by this thread, reloaded every QOS_VOLUME_TTL */
+static __thread swiss_t *__qos_volume__ = NULL;
+
+static void __qos_init()
+{
+        int ret;
+
+        ret = sy_spin_init(&__qos_lock__);
+        if (unlikely(ret))
+                UNIMPLEMENTED(__DUMP__);
+
+        ret = swiss_create(&__qos_bucket__, "qos_bucket", sizeof(qos_key_t));
+        if (unlikely(ret))
+                UNIMPLEMENTED(__DUMP__);
+}
+
+static void __qos_conf_parse(char *value, qos_conf_t *conf)
+{
+        char *item, *saveptr = NULL, *eq;
+
+        for (item = strtok_r(value, ",", &saveptr); item;
+             item = strtok_r(NULL, ",", &saveptr)) {
+                eq = strchr(item, '=');
+                if (eq == NULL) {
+                        DWARN("bad qos item %s\n", item);
+                        continue;
+                }
+
+                *eq = '\0';
+                eq++;
+
+                if (strcmp(item, "iops") == 0) {
+                        conf->iops = atoll(eq);
+                } else if (strcmp(item, "bw") == 0) {
+                        conf->bw = (uint64_t)atoll(eq) * 1024 * 1024;
+                } else if (strcmp(item, "burst") == 0) {
+                        conf->burst = atoi(eq);
+                } else if (strcmp(item, "class") == 0) {
+                        if (strcmp(eq, "high") == 0)
+                                conf->class = SCHEDULE_PRIORITY0;
+                        else if (strcmp(eq, "normal") == 0)
+                                conf->class = SCHEDULE_PRIORITY1;
+                        else if (strcmp(eq, "low") == 0)
+                                conf->class = SCHEDULE_PRIORITY2;
+                        else
+                                DWARN("bad qos class %s\n", eq);
+                } else {
+                        DWARN("bad qos item %s\n", item);
+                }
+        }
+}
+
+static void __qos_conf_volume(uint64_t volid, qos_conf_t *conf)
+{
+        int ret;
+        volid_t _volid = {volid, 0};
+        fileid_t fileid;
+        char value[MAX_NAME_LEN];
+        size_t size;
+
+        memset(conf, 0x0, sizeof(*conf));
+        conf->burst = gloconf.qos_burst;
+        conf->class = -1;
+
+        id2vid(volid, &fileid);
+        size = sizeof(value) - 1;
+        ret = md_getxattr(&_volid, &fileid, USS_SYSTEM_ATTR_QOS, value, &size);
+        if (ret)
+                return;
+
+        value[size] = '\0';
+        __qos_conf_parse(value, conf);
+}
+
+static void __qos_conf_client(qos_conf_t *conf)
+{
+        memset(conf, 0x0, sizeof(*conf));
+        conf->iops = gloconf.qos_client_iops;
+        conf->bw = (uint64_t)gloconf.qos_client_bw * 1024 * 1024;
+        conf->burst = gloconf.qos_burst;
+        conf->class = -1;
+}
+
+static void __qos_token_set(qos_token_t *token, uint64_t rate, int burst)
+{
+        if (token->rate != rate) {
+                token->rate = rate;
+                token->token = (int64_t)rate * burst * QOS_UNIT;
+        }
+}
+
+static void __qos_token_refill(qos_token_t *token, uint64_t elapse, int burst)
+{
+        int64_t max;
+
+        if (token->rate == 0)
+                return;
+
+        max = (int64_t)token->rate * (burst ? burst : 1) * QOS_UNIT;
+        token->token += (int64_t)_min(elapse, (uint64_t)QOS_UNIT * (burst ? burst : 1))
+                * token->rate;
+        if (token->token > max)
+                token->token = max;
+}
+
+/* take cost and return the usec needed to pay off the debt */
+static uint64_t __qos_token_take(qos_token_t *token, uint64_t cost)
+{
+        if (token->rate == 0)
+                return 0;
+
+        token->token -= (int64_t)cost * QOS_UNIT;
+
+        return token->token < 0 ? (uint64_t)(-token->token) / token->rate : 0;
+}
+
+/*
+ * a client spends its own tokens and those of its volume.  once its own
+ * run out it borrows what the volume has spare, and only waits when the
+ * volume has none left either
+ */
+static uint64_t __qos_token_take2(qos_token_t *child, qos_token_t *parent, uint64_t cost)
+{
+        uint64_t wait;
+
+        if (parent == NULL || parent->rate == 0)
+                return __qos_token_take(child, cost);
+
+        if (child->rate && child->token < (int64_t)cost * QOS_UNIT
+            && parent->token >= (int64_t)cost * QOS_UNIT) {
+                return __qos_token_take(parent, cost);
+        }
+
+        wait = __qos_token_take(child, cost);
+
+        return _max(wait, __qos_token_take(parent, cost));
+}
+
+/* need lock */
+static qos_bucket_t *__qos_bucket(uint64_t volid, uint64_t client)
+{
+        int ret;
+        qos_key_t key = {volid, client};
+        qos_bucket_t *bucket;
+
+        bucket = swiss_find(__qos_bucket__, &key);
+        if (likely(bucket))
+                return bucket;
+
+        ret = ymalloc((void **)&bucket, sizeof(*bucket));
+        if (unlikely(ret))
+                return NULL;
+
+        memset(bucket, 0x0, sizeof(*bucket));
+        bucket->key = key;
+        bucket->last = ytime_gettime();
+
+        ret = swiss_insert(__qos_bucket__, &bucket->key, bucket, 0);
+        if (unlikely(ret)) {
+                yfree((void **)&bucket);
+                return NULL;
+        }
+
+        return bucket;
+}
+
+/* need lock, a config is applied once, when a core loaded a newer one */
+static qos_bucket_t *__qos_refill(uint64_t volid, uint64_t client, const qos_conf_t *conf,
+                                  time_t update, ytime_t now)
+{
+        uint64_t elapse;
+        qos_bucket_t *bucket;
+
+        bucket = __qos_bucket(volid, client);
+        if (unlikely(bucket == NULL))
+                return NULL;
+
+        if (update > bucket->update) {
+                bucket->update = update;
+                bucket->burst = conf->burst;
+                __qos_token_set(&bucket->iops, conf->iops, conf->burst);
+                __qos_token_set(&bucket->bw, conf->bw, conf->burst);
+        }
+
+        elapse = now > bucket->last ? now - bucket->last : 0;
+        bucket->last = now;
+
+        __qos_token_refill(&bucket->iops, elapse, bucket->burst);
+        __qos_token_refill(&bucket->bw, elapse, bucket->burst);
+
+        return bucket;
+}
+
+/* need lock, either bucket may be NULL */
+static uint64_t __qos_take(qos_bucket_t *client, qos_bucket_t *volume, uint32_t size)
+{
+        uint64_t wait;
+
+        if (client == NULL) {
+                if (volume == NULL)
+                        return 0;
+
+                wait = __qos_token_take(&volume->iops, 1);
+                return _max(wait, __qos_token_take(&volume->bw, size));
+        }
+
+        wait = __qos_token_take2(&client->iops, volume ? &volume->iops : NULL, 1);
+        return _max(wait, __qos_token_take2(&client->bw, volume ? &volume->bw : NULL, size));
+}
+
+static int __qos_volume(uint64_t volid, const qos_volume_t **_vol)
+{
+        int ret;
+        time_t now = gettime();
+        qos_volume_t *vol;
+        qos_conf_t conf;
+
+        if (unlikely(__qos_volume__ == NULL)) {
+                ret = swiss_create(&__qos_volume__, "qos_volume", sizeof(uint64_t));
+                if (unlikely(ret))
+                        GOTO(err_ret, ret);
+        }
+
+        vol = swiss_find(__qos_volume__, &volid);
+        if (likely(vol && now - vol->update < QOS_VOLUME_TTL)) {
+                *_vol = vol;
+                return 0;
+        }
+
+        /* md_getxattr may yield, another task may load it meanwhile */
+        __qos_conf_volume(volid, &conf);
+
+        vol = swiss_find(__qos_volume__, &volid);
+        if (vol == NULL) {
+                ret = ymalloc((void **)&vol, sizeof(*vol));
+                if (unlikely(ret))
+                        GOTO(err_ret, ret);
+
+                vol->volid = volid;
+                ret = swiss_insert(__qos_volume__, &vol->volid, vol, 0);
+                if (unlikely(ret)) {
+                        yfree((void **)&vol);
+                        GOTO(err_ret, ret);
+                }
+        }
+
+        vol->conf = conf;
+        vol->update = now;
+        *_vol = vol;
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+int qos_io(const sdfs_ctx_t *ctx, const fileid_t *fileid, uint32_t size)
+{
+        int ret, class = -1;
+        uint32_t addr = 0;
+        uint64_t volid = 0, wait = 0;
+        ytime_t now;
+        const qos_volume_t *vol = NULL;
+        qos_bucket_t *volume = NULL, *client = NULL;
+        qos_conf_t cconf;
+
+        (void) ctx;
+
+        if (fileid->type != ftype_root) {
+                volid = fileid->volid;
+                ret = __qos_volume(volid, &vol);
+                if (unlikely(ret))
+                        GOTO(err_ret, ret);
+
+                class = vol->conf.class;
+                if (vol->conf.iops == 0 && vol->conf.bw == 0)
+                        vol = NULL;
+        }
+
+        if (gloconf.qos_client_iops || gloconf.qos_client_bw) {
+                schedule_value_get(TASK_VALUE_CLIENT, &addr);
+                if (addr == (uint32_t)-1)
+                        addr = 0;
+        }
+
+        /* nothing is limited, the shared buckets are left alone */
+        if (vol || addr) {
+                pthread_once(&__qos_once__, __qos_init);
+
+                if (addr)
+                        __qos_conf_client(&cconf);
+
+                ret = sy_spin_lock(&__qos_lock__);
+                if (unlikely(ret))
+                        GOTO(err_ret, ret);
+
+                now = ytime_gettime();
+                if (vol)
+                        volume = __qos_refill(volid, 0, &vol->conf, vol->update, now);
+                if (addr) {
+                        /* the client config is static, applied once per bucket */
+                        client = __qos_refill(volid, addr, &cconf, 1, now);
+                }
+
+                wait = __qos_take(client, volume, size);
+
+                sy_spin_unlock(&__qos_lock__);
+        }
+
+        if (class != -1)
+                schedule_priority_set(class);
+
+        if (wait) {
+                DBUG("volume %ju client %u wait %ju\n", volid, addr, wait);
+                schedule_sleep("qos", _min(wait, QOS_WAIT_MAX));
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+/* metadata ops cost one io and no bandwidth */
+void qos_meta(const sdfs_ctx_t *ctx, const fileid_t *fileid)
+{
+        (void) qos_io(ctx, fileid, 0);
+}
+
+void qos_client_set(uint32_t addr)
+{
+        schedule_value_set(TASK_VALUE_CLIENT, addr);
+}
@@ -0,0 +1,28 @@
+#ifndef __QOS_H__
+#define __QOS_H__
+
+#include <stdint.h>
+
+#include "ylib.h"
+#include "sdfs_lib.h"
+#include "dbg.h"
+
+/*
+ * admission control in front of the sdfs entry points.  every request takes
+ * tokens from the bucket of its client address and of its volume, and the
+ * task sleeps off any debt, so throttling yields instead of blocking a core.
+ * the buckets are nested: each client has its own bucket under every volume
+ * it uses, the volume bucket caps all of them together, and a client out of
+ * its own tokens borrows those the volume has spare.
+ *
+ * volume limits come from USS_SYSTEM_ATTR_QOS on the volume root, e.g.
+ * "iops=2000,bw=200,burst=2,class=low", bw in MB/s, burst in seconds of
+ * credit, class high/normal/low maps onto SCHEDULE_PRIORITY0..2.  client
+ * limits come from qos_client_iops/qos_client_bw/qos_burst in the config.
+ */
+
+int qos_io(const sdfs_ctx_t *ctx, const fileid_t *fileid, uint32_t size);
+void qos_meta(const sdfs_ctx_t *ctx, const fileid_t *fileid);
+void qos_client_set(uint32_t addr);
+
+#endif
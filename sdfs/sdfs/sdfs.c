@@ -11,13 +11,16 @@
 #include "main_loop.h"
 #include "schedule.h"
 #include "md_lib.h"
+#include "redis.h"
 #include "sdfs_lib.h"
 #include "sdfs_chunk.h"
 #include "worm_cli_lib.h"
 #include "posix_acl.h"
 #include "io_analysis.h"
+#include "qos.h"
 #include "flock.h"
 #include "attr_queue.h"
+#include "lease.h"
 #include "core.h"
 #include "xattr.h"
 #include "dbg.h"
@@ -73,35 +76,68 @@ typedef struct {
         void *arg;
 } sdfs_write_ctx_t;
 
-int sdfs_read(sdfs_ctx_t *ctx, const fileid_t *fileid, buffer_t *_buf, uint32_t size, uint64_t offset)
+static int __sdfs_read_inline(sdfs_ctx_t *ctx, const md_proto_t *md, buffer_t *_buf,
+                              uint32_t size, uint64_t offset)
+{
+        int ret;
+        char *data;
+        size_t len;
+        uint32_t count;
+        volid_t volid = {md->fileid.volid, ctx ? ctx->snapvers : 0};
+
+        ret = ymalloc((void **)&data, MD_INLINE_MAX);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        len = MD_INLINE_MAX;
+        ret = md_inline_read(&volid, &md->fileid, data, &len);
+        if (ret)
+                goto err_free;
+
+        count = 0;
+        if (offset < len) {
+                count = (len - offset) < size ? (len - offset) : size;
+                ret = mbuffer_appendmem(_buf, data + offset, count);
+                if (ret)
+                        GOTO(err_free, ret);
+        }
+
+        if (count < size)
+                mbuffer_appendzero(_buf, size - count);
+
+        yfree((void **)&data);
+
+        return 0;
+err_free:
+        yfree((void **)&data);
+err_ret:
+        return ret;
+}
+
+/*
+ * read with the attributes of the file already fetched by the caller,
+ * md is not refetched
+ */
+int sdfs_read_md(sdfs_ctx_t *ctx, const md_proto_t *md, buffer_t *_buf,
+                 uint32_t size, uint64_t offset)
 {
-        int ret, retry = 0, chkno = -1;
-        fileinfo_t _md;
-        fileinfo_t *md = &_md;
+        int ret, chkno = -1;
         chkid_t chkid;
         uint32_t chk_size;
         uint32_t chk_off;
         ec_t ec;
         buffer_t buf;
+        const fileid_t *fileid = &md->fileid;
+
+        ret = qos_io(ctx, fileid, size);
+        if (ret)
+                GOTO(err_ret, ret);
 
-        (void) ctx;
-        
         ANALYSIS_BEGIN(0);
         
         DBUG("fileid "FID_FORMAT" size %llu off %llu size %u\n", FID_ARG(&md->fileid),
               (LLU)md->at_size, (LLU)offset, size);
 
-        volid_t volid = {fileid->volid, ctx ? ctx->snapvers : 0};
-retry:
-        ret = md_getattr(&volid, fileid, (void *)md);
-        if (ret) {
-                ret = _errno(ret);
-                if (ret == EAGAIN) {
-                        USLEEP_RETRY(err_ret, ret, retry, retry, 100, (1000 * 1000));
-                } else
-                        GOTO(err_ret, ret);
-        }
-
         if (offset > md->at_size) {
                 DWARN("fileid "FID_FORMAT" size %llu off %llu size %u\n", FID_ARG(&md->fileid),
                                 (LLU)md->at_size, (LLU)offset, size);
@@ -114,6 +150,15 @@ retry:
                 size = md->at_size - offset;
         }
 
+        if (md->status & __S_INLINE) {
+                /* ENOENT: nothing inline, it has been moved to chunks */
+                ret = __sdfs_read_inline(ctx, md, _buf, size, offset);
+                if (ret == 0)
+                        goto out;
+                else if (ret != ENOENT)
+                        GOTO(err_ret, ret);
+        }
+
         ec.plugin = md->plugin;
         ec.tech = md->tech;
         ec.m = md->m;
@@ -160,6 +205,25 @@ err_ret:
         return ret;
 }
 
+int sdfs_read(sdfs_ctx_t *ctx, const fileid_t *fileid, buffer_t *_buf, uint32_t size, uint64_t offset)
+{
+        int ret;
+        char buf[MAX_BUF_LEN];
+        md_proto_t *md = (void *)buf;
+
+        ret = sdfs_getmd(ctx, fileid, md);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = sdfs_read_md(ctx, md, _buf, size, offset);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        return 0;
+err_ret:
+        return ret;
+}
+
 
 static void __sdfs_read_async(void *_arg)
 {
@@ -368,30 +432,31 @@ err_ret:
         return ret;
 }
 
-int sdfs_write(sdfs_ctx_t *ctx, const fileid_t *fileid, const buffer_t *_buf, uint32_t size, uint64_t offset)
+static int __sdfs_extend(const volid_t *volid, const fileid_t *fileid, uint64_t size,
+                         const struct timespec *mtime)
 {
         int ret, retry = 0;
-        fileinfo_t _md;
-        fileinfo_t *md = &_md;
-        ec_t ec;
-        wseg_t seg_array[YFS_WRITE_SEG_MAX], *seg;
-        int i, seg_count;
-        buffer_t newbuf;
 
-        (void) ctx;
-        
-        ANALYSIS_BEGIN(0);
-        
-        YASSERT(_buf->len == size);
+#if ENABLE_ATTR_QUEUE
+        if (ng.daemon) {
+                ret = attr_queue_extern(volid, fileid, size);
+                if (ret)
+                        GOTO(err_ret, ret);
 
-        DBUG("write "CHKID_FORMAT"\n", CHKID_ARG(fileid));
+                return 0;
+        }
+#endif
+
+        if (gloconf.write_lease) {
+                ret = lease_extend(volid, fileid, size, mtime);
+                if (ret == 0)
+                        return 0;
+                else if (ret != ENOLCK)
+                        GOTO(err_ret, ret);
+        }
 
-        mbuffer_init(&newbuf, 0);
-        mbuffer_reference(&newbuf, _buf);
-        
-        volid_t volid = {fileid->volid, ctx ? ctx->snapvers : 0};
 retry:
-        ret = md_getattr(&volid, fileid, (void *)md);
+        ret = md_extend(volid, fileid, size);
         if (ret) {
                 ret = _errno(ret);
                 if (ret == EAGAIN) {
@@ -400,17 +465,49 @@ retry:
                         GOTO(err_ret, ret);
         }
 
-        if (!S_ISREG(md->at_mode)) {
-                if (S_ISDIR(md->at_mode))
-                        ret = EISDIR;
-                else
-                        ret = EINVAL;    
-                GOTO(err_ret, ret);
+        return 0;
+err_ret:
+        return ret;
+}
+
+/*
+ * queue mtime and ctime of a write with the daemon, elsewhere only a write
+ * extending the file records them, through the lease
+ */
+static int __sdfs_write_time(const volid_t *volid, const fileid_t *fileid,
+                             const struct timespec *now)
+{
+#if ENABLE_ATTR_QUEUE
+        setattr_t setattr;
+
+        if (ng.daemon) {
+                setattr_init(&setattr, -1, -1, NULL, -1, -1, -1);
+                setattr_update_time(&setattr, __DONT_CHANGE, NULL,
+                                    __SET_TO_CLIENT_TIME, now,
+                                    __SET_TO_CLIENT_TIME, now);
+
+                return attr_queue_settime(volid, fileid, &setattr);
         }
+#else
+        (void) volid;
+        (void) fileid;
+        (void) now;
+#endif
 
-        YASSERT(md->split);
-        YASSERT(md->fileid.id);
-        YASSERT(md->fileid.volid);
+        return 0;
+}
+
+static int __sdfs_write_chunk(md_proto_t *md, const buffer_t *_buf,
+                              uint32_t size, uint64_t offset)
+{
+        int ret;
+        ec_t ec;
+        wseg_t seg_array[YFS_WRITE_SEG_MAX], *seg;
+        int i, seg_count;
+        buffer_t newbuf;
+
+        mbuffer_init(&newbuf, 0);
+        mbuffer_reference(&newbuf, _buf);
 
         ret = __sdfs_write_split(seg_array, &seg_count, &newbuf, size,
                                  offset, md->split, &md->fileid);
@@ -424,7 +521,7 @@ retry:
 
         for (i = 0; i < seg_count; i++) {
                 seg = &seg_array[i];
-                ret = sdfs_chunk_write(md, &seg->head.chkid, &seg->buf,
+                ret = sdfs_chunk_write((void *)md, &seg->head.chkid, &seg->buf,
                                        seg->head.size, seg->head.offset, &ec);
                 if (ret) {
                         GOTO(err_free, ret);
@@ -436,37 +533,189 @@ retry:
                 mbuffer_free(&seg->buf);
         }
 
-        if ((offset + size > md->at_size)) {
-#if ENABLE_ATTR_QUEUE
-                if (ng.daemon) {
-                        ret = attr_queue_extern(&volid, fileid, size + offset);
-                        if (ret)
-                                GOTO(err_ret, ret);
-                } else {
-                retry1:
-                        ret = md_extend(&volid, fileid, size + offset);
-                        if (ret) {
-                                ret = _errno(ret);
-                                if (ret == EAGAIN) {
-                                        USLEEP_RETRY(err_ret, ret, retry1, retry, 100, (1000 * 1000));
-                                } else
-                                        GOTO(err_ret, ret);
-                        }
-                }
-#else
-        retry1:
-                ret = md_extend(&volid, fileid, size + offset);
+        mbuffer_free(&newbuf);
+
+        return 0;
+err_free:
+        for (i = 0; i < seg_count; i++) {
+                seg = &seg_array[i];
+                mbuffer_free(&seg->buf);
+        }
+err_ret:
+        mbuffer_free(&newbuf);
+        return ret;
+}
+
+/* copy the inline data of a grown file into chunks and drop the inline state */
+static int __sdfs_inline_migrate(const volid_t *volid, md_proto_t *md)
+{
+        int ret;
+        char _md[MAX_BUF_LEN], *data;
+        md_proto_t *newmd = (void *)_md;
+        const fileid_t *fileid = &md->fileid;
+        size_t len;
+        buffer_t buf;
+
+        ret = ymalloc((void **)&data, MD_INLINE_MAX);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = klock(volid, fileid, 10, 1);
+        if (ret)
+                GOTO(err_free, ret);
+
+        ret = md_getattr(volid, fileid, newmd);
+        if (ret)
+                GOTO(err_lock, ret);
+
+        if (newmd->status & __S_INLINE) {
+                len = MD_INLINE_MAX;
+                ret = md_inline_read(volid, fileid, data, &len);
                 if (ret) {
-                        ret = _errno(ret);
-                        if (ret == EAGAIN) {
-                                USLEEP_RETRY(err_ret, ret, retry1, retry, 100, (1000 * 1000));
+                        if (ret == ENOENT) {
+                                len = 0;
                         } else
-                                GOTO(err_ret, ret);
+                                GOTO(err_lock, ret);
                 }
-#endif
+
+                len = len < newmd->at_size ? len : newmd->at_size;
+                if (len) {
+                        DBUG("migrate "CHKID_FORMAT" size %u\n", CHKID_ARG(fileid), (int)len);
+
+                        mbuffer_init(&buf, 0);
+                        mbuffer_appendmem(&buf, data, len);
+                        ret = __sdfs_write_chunk(newmd, &buf, len, 0);
+                        mbuffer_free(&buf);
+                        if (ret)
+                                GOTO(err_lock, ret);
+                }
+
+                ret = md_inline_clear(volid, fileid);
+                if (ret)
+                        GOTO(err_lock, ret);
         }
 
-        mbuffer_free(&newbuf);
+        ret = kunlock(volid, fileid);
+        if (ret)
+                GOTO(err_free, ret);
+
+        md->status &= ~__S_INLINE;
+        yfree((void **)&data);
+
+        return 0;
+err_lock:
+        kunlock(volid, fileid);
+err_free:
+        yfree((void **)&data);
+err_ret:
+        return ret;
+}
+
+static int __sdfs_write_inline(const volid_t *volid, md_proto_t *md, const buffer_t *_buf,
+                               uint32_t size, uint64_t offset)
+{
+        int ret;
+        char *data;
+
+        if (offset + size > (uint64_t)gloconf.inline_size) {
+                ret = EFBIG;
+                goto err_ret;
+        }
+
+        ret = ymalloc((void **)&data, size);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        mbuffer_get(_buf, data, size);
+
+        ret = md_inline_write(volid, &md->fileid, data, size, offset);
+        if (ret)
+                goto err_free;
+
+        if (offset + size > md->at_size) {
+                md->at_size = offset + size;
+                md->chknum = _get_chknum(md->at_size, md->split);
+        }
+
+        yfree((void **)&data);
+
+        return 0;
+err_free:
+        yfree((void **)&data);
+err_ret:
+        return ret;
+}
+
+/*
+ * write with the attributes of the file already fetched by the caller,
+ * md is updated to the post-op attributes on success
+ */
+int sdfs_write_md(sdfs_ctx_t *ctx, md_proto_t *md, const buffer_t *_buf,
+                  uint32_t size, uint64_t offset)
+{
+        int ret;
+        const fileid_t *fileid = &md->fileid;
+        struct timespec now;
+
+        ret = qos_io(ctx, fileid, size);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ANALYSIS_BEGIN(0);
+        
+        YASSERT(_buf->len == size);
+
+        DBUG("write "CHKID_FORMAT"\n", CHKID_ARG(fileid));
+
+        volid_t volid = {fileid->volid, ctx ? ctx->snapvers : 0};
+
+        if (!S_ISREG(md->at_mode)) {
+                if (S_ISDIR(md->at_mode))
+                        ret = EISDIR;
+                else
+                        ret = EINVAL;    
+                GOTO(err_ret, ret);
+        }
+
+        YASSERT(md->split);
+        YASSERT(md->fileid.id);
+        YASSERT(md->fileid.volid);
+
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        if (md->status & __S_INLINE) {
+                ret = __sdfs_write_inline(&volid, md, _buf, size, offset);
+                if (ret == 0)
+                        goto out;
+                else if (ret != EFBIG)
+                        GOTO(err_ret, ret);
+
+                ret = __sdfs_inline_migrate(&volid, md);
+                if (ret)
+                        GOTO(err_ret, ret);
+        }
+
+        ret = __sdfs_write_chunk(md, _buf, size, offset);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        if ((offset + size > md->at_size)) {
+                ret = __sdfs_extend(&volid, fileid, size + offset, &now);
+                if (ret)
+                        GOTO(err_ret, ret);
+
+                md->at_size = size + offset;
+                md->chknum = _get_chknum(md->at_size, md->split);
+        }
+
+out:
+        ret = __sdfs_write_time(&volid, fileid, &now);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        /* post-op attributes carry the times just written */
+        md->at_mtime = now;
+        md->at_ctime = now;
 
         ANALYSIS_QUEUE(0, IO_WARN, NULL);
 
@@ -475,13 +724,26 @@ retry:
                 GOTO(err_ret, ret);
         
         return 0;
-err_free:
-        for (i = 0; i < seg_count; i++) {
-                seg = &seg_array[i];
-                mbuffer_free(&seg->buf);
-        }
 err_ret:
-        mbuffer_free(&newbuf);
+        return ret;
+}
+
+int sdfs_write(sdfs_ctx_t *ctx, const fileid_t *fileid, const buffer_t *_buf, uint32_t size, uint64_t offset)
+{
+        int ret;
+        char buf[MAX_BUF_LEN];
+        md_proto_t *md = (void *)buf;
+
+        ret = sdfs_getmd(ctx, fileid, md);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = sdfs_write_md(ctx, md, _buf, size, offset);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        return 0;
+err_ret:
         return ret;
 }
 
@@ -652,7 +914,15 @@ int sdfs_truncate(sdfs_ctx_t *ctx, const fileid_t *fileid, uint64_t length)
 #endif
 
         volid_t volid = {fileid->volid, ctx ? ctx->snapvers : 0};
-        
+
+        ret = lease_recall(&volid, fileid);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = lease_truncate(fileid, length);
+        if (ret)
+                GOTO(err_ret, ret);
+
 #if ENABLE_ATTR_QUEUE
         ret = attr_queue_truncate(&volid, fileid, length);
         if (ret)
@@ -675,6 +945,13 @@ err_ret:
         return ret;
 }
 
+int sdfs_release(sdfs_ctx_t *ctx, const fileid_t *fileid)
+{
+        (void) ctx;
+
+        return lease_close(fileid);
+}
+
 int sdfs_getxattr(sdfs_ctx_t *ctx, const fileid_t *fileid, const char *name, void *value, size_t *size)
 {
         int ret, retry = 0;
@@ -874,6 +1151,14 @@ err_ret:
         return ret;
 }
 
+/* sleep until a lock of the file is released or usec passed */
+int sdfs_lock_wait(sdfs_ctx_t *ctx, const fileid_t *fileid, suseconds_t usec)
+{
+        volid_t volid = {fileid->volid, ctx ? ctx->snapvers : 0};
+
+        return md_lock_wait(&volid, fileid, usec);
+}
+
 int sdfs_lock_equal(const fileid_t *file1, const sdfs_lock_t *lock1,
                                   const fileid_t *file2, const sdfs_lock_t *lock2)
 {
@@ -2,6 +2,7 @@
 #include <string.h>
 #include <errno.h>
 #include <dirent.h>
+#include <pthread.h>
 
 #define DBG_SUBSYS S_YFSLIB
 
@@ -41,6 +42,22 @@ typedef struct {
         int retval;
 } chunk_write_ctx_t;
 
+/*
+ * replication mode is per volume, USS_SYSTEM_ATTR_REPLICATION on the volume
+ * root set to "chain" makes the client send once and the cds forward
+ */
+#define CHUNK_VOLUME_MAX 64
+#define CHUNK_VOLUME_TTL 10
+
+typedef struct {
+        uint64_t volid;
+        time_t update;
+        int chain;
+} chunk_volume_t;
+
+static chunk_volume_t __chunk_volume__[CHUNK_VOLUME_MAX];
+static pthread_mutex_t __chunk_volume_lock__ = PTHREAD_MUTEX_INITIALIZER;
+
 inline static void __chunk_recovery(const chkid_t *chkid)
 {
         int ret, retry = 0;
@@ -88,7 +105,12 @@ retry:
                         intect = 0;
                         break;
 #else
-                        if (retry < 1) {
+                        /*
+                         * a held chunk lock is a tier move or a recovery
+                         * already working on it, writers wait for it
+                         */
+                        if (retry < 1 && klock(NULL, chkid, 10, 0) == 0) {
+                                kunlock(NULL, chkid);
                                 __chunk_recovery(chkid);
                                 retry++;
                                 goto retry;
@@ -265,6 +287,42 @@ err_ret:
         return ret;
 }
 
+static int __chunk_chain(uint64_t volid)
+{
+        int ret, chain;
+        time_t now = gettime();
+        chunk_volume_t *ent = &__chunk_volume__[volid % CHUNK_VOLUME_MAX];
+        fileid_t fileid;
+        char value[MAX_NAME_LEN];
+        size_t size;
+
+        pthread_mutex_lock(&__chunk_volume_lock__);
+        if (ent->volid == volid && now - ent->update < CHUNK_VOLUME_TTL) {
+                chain = ent->chain;
+                pthread_mutex_unlock(&__chunk_volume_lock__);
+                return chain;
+        }
+        pthread_mutex_unlock(&__chunk_volume_lock__);
+
+        id2vid(volid, &fileid);
+        size = sizeof(value);
+        ret = sdfs_getxattr(NULL, &fileid, USS_SYSTEM_ATTR_REPLICATION, value, &size);
+        if (ret == 0) {
+                value[MAX_NAME_LEN - 1] = '\0';
+                chain = (strcmp(value, "chain") == 0);
+        } else {
+                chain = 0;
+        }
+
+        pthread_mutex_lock(&__chunk_volume_lock__);
+        ent->volid = volid;
+        ent->update = now;
+        ent->chain = chain;
+        pthread_mutex_unlock(&__chunk_volume_lock__);
+
+        return chain;
+}
+
 #if 1
 
 STATIC void __chunk_replica_write__(void *arg)
@@ -319,6 +377,21 @@ static int __chunk_write__(const chkinfo_t *chkinfo, const buffer_t *buf, int si
                 online++;
         }
 
+        if (online > 1 && __chunk_chain(chkinfo->chkid.volid)) {
+                io_init(&_ctx[0].io, &chkinfo->chkid, size, offset, 0);
+                ret = cds_rpc_chain_write(array, online, &_ctx[0].io, buf);
+                if (unlikely(ret)) {
+                        DWARN("chain write "CHKID_FORMAT" fail, ret %u\n",
+                              CHKID_ARG(&chkinfo->chkid), ret);
+                        ret = EAGAIN;
+                        GOTO(err_ret, ret);
+                }
+
+                ANALYSIS_QUEUE(0, IO_WARN, NULL);
+
+                return 0;
+        }
+
         task = schedule_task_get();
         sub_task = online;
         for (i = 0; i < online; i++) {
@@ -395,6 +468,7 @@ static int __chunk_write(const fileinfo_t *md, const chkid_t *chkid,
                          const buffer_t *buf, int count, int offset)
 {
         int ret, intect;
+        uint32_t i;
         char _chkinfo[CHK_SIZE(YFS_CHK_REP_MAX)];
         chkinfo_t *chkinfo;
 
@@ -412,6 +486,22 @@ static int __chunk_write(const fileinfo_t *md, const chkid_t *chkid,
                 ret = klock(NULL, chkid, 10, 1);
                 if (unlikely(ret))
                         GOTO(err_ret, ret);
+
+                /* the holder of the lock may have moved or recovered a replica */
+                ret = md_chunk_load_check(chkid, chkinfo, 1);
+                if (unlikely(ret))
+                        GOTO(err_lock, ret);
+
+                for (i = 0; i < chkinfo->repnum; i++) {
+                        if (!(chkinfo->diskid[i].status & __S_DIRTY))
+                                break;
+                }
+
+                if (unlikely(i == chkinfo->repnum)) {
+                        ret = EAGAIN;
+                        DWARN("write "CHKID_FORMAT" no clean replica\n", CHKID_ARG(chkid));
+                        GOTO(err_lock, ret);
+                }
         }
         
         ret = __chunk_write__(chkinfo, buf, count, offset);
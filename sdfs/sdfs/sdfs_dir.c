@@ -34,6 +34,7 @@
 #include "mond_rpc.h"
 #include "schedule.h"
 #include "io_analysis.h"
+#include "qos.h"
 #include "dbg.h"
 
 int sdfs_mkdir(sdfs_ctx_t *ctx, const fileid_t *parent, const char *name, const ec_t *ec,
@@ -45,6 +46,7 @@ int sdfs_mkdir(sdfs_ctx_t *ctx, const fileid_t *parent, const char *name, const
         (void) ctx;
         
         io_analysis(ANALYSIS_OP_WRITE, 0);
+        qos_meta(ctx, parent);
         
         setattr_init(&setattr, mode, -1, ec, uid, gid, -1);
 #if 1
@@ -331,6 +333,7 @@ int sdfs_readdirplus(sdfs_ctx_t *ctx, const fileid_t *fileid, off_t offset, void
 
         DBUG(""FID_FORMAT"\n", FID_ARG(fileid));
 
+        qos_meta(ctx, fileid);
 retry:
         if (fileid->type == ftype_root) {
                 ret = __etcd_listvol(de, delen, 1);
@@ -394,6 +397,7 @@ int sdfs_rmdir(sdfs_ctx_t *ctx, const fileid_t *parent, const char *name)
         (void) ctx;
 
         io_analysis(ANALYSIS_OP_WRITE, 0);
+        qos_meta(ctx, parent);
         
         if (parent->type == ftype_root) {
                 return md_rmvol(name);
@@ -464,6 +468,7 @@ int sdfs_lookup(sdfs_ctx_t *ctx, const fileid_t *parent, const char *name, filei
         (void) ctx;
 
         io_analysis(ANALYSIS_OP_READ, 0);
+        qos_meta(ctx, parent);
         
 retry:
         if (parent->type == ftype_root) {
@@ -594,6 +599,7 @@ int sdfs_unlink(sdfs_ctx_t *ctx, const fileid_t *parent, const char *name)
         (void) ctx;
 
         io_analysis(ANALYSIS_OP_WRITE, 0);
+        qos_meta(ctx, parent);
 #if ENABLE_WORM
         fileid_t fileid;
         worm_status_t worm_status;
@@ -646,6 +652,7 @@ int sdfs_create(sdfs_ctx_t *ctx, const fileid_t *parent, const char *name,
         (void) ctx;
         
         io_analysis(ANALYSIS_OP_WRITE, 0);
+        qos_meta(ctx, parent);
         setattr_init(&setattr, mode, -1, NULL, uid, gid, -1);
 #if 1
         setattr_update_time(&setattr,
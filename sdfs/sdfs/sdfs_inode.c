@@ -25,24 +25,19 @@
 #include "network.h"
 #include "yfs_limit.h"
 #include "io_analysis.h"
+#include "qos.h"
 #include "worm_cli_lib.h"
 #include "main_loop.h"
 #include "posix_acl.h"
 #include "flock.h"
 #include "xattr.h"
+#include "lease.h"
 #include "dbg.h"
 
 
-int sdfs_getattr(sdfs_ctx_t *ctx, const fileid_t *fileid, struct stat *stbuf)
+int sdfs_getmd(sdfs_ctx_t *ctx, const fileid_t *fileid, md_proto_t *md)
 {
         int ret, retry = 0;
-        md_proto_t *md;
-        char buf[MAX_BUF_LEN];
-
-        md = (void *)buf;
-
-        io_analysis(ANALYSIS_OP_READ, 0);
-        DBUG("getattr "FID_FORMAT"\n", FID_ARG(fileid));
 
         if (fileid->type == ftype_root || fileid->type == ftype_null) {
                 ret = ENOENT;
@@ -60,6 +55,36 @@ retry:
                         GOTO(err_ret, ret);
         }
 
+        return 0;
+err_ret:
+        return ret;
+}
+
+int sdfs_getattr(sdfs_ctx_t *ctx, const fileid_t *fileid, struct stat *stbuf)
+{
+        int ret;
+        md_proto_t *md;
+        char buf[MAX_BUF_LEN];
+
+        md = (void *)buf;
+
+        io_analysis(ANALYSIS_OP_READ, 0);
+        qos_meta(ctx, fileid);
+        DBUG("getattr "FID_FORMAT"\n", FID_ARG(fileid));
+
+        /* a writer elsewhere may still hold size and mtime in its lease */
+        if (fileid->type == ftype_file) {
+                volid_t volid = {fileid->volid, ctx ? ctx->snapvers : 0};
+
+                ret = lease_recall(&volid, fileid);
+                if (ret)
+                        GOTO(err_ret, ret);
+        }
+
+        ret = sdfs_getmd(ctx, fileid, md);
+        if (ret)
+                GOTO(err_ret, ret);
+
         MD2STAT(md, stbuf);
 
         return 0;
@@ -237,6 +262,7 @@ int sdfs_setattr(sdfs_ctx_t *ctx, const fileid_t *fileid, const setattr_t *setat
 
         (void) ctx;
 
+        qos_meta(ctx, fileid);
 #if ENABLE_WORM
         worm_status_t worm_status;
 
@@ -249,6 +275,13 @@ int sdfs_setattr(sdfs_ctx_t *ctx, const fileid_t *fileid, const setattr_t *setat
 #endif
 
         volid_t volid = {fileid->volid, ctx ? ctx->snapvers : 0};
+
+        if (setattr->size.set_it || setattr->mtime.set_it) {
+                ret = lease_recall(&volid, fileid);
+                if (ret)
+                        GOTO(err_ret, ret);
+        }
+
 retry:
         ret = md_setattr(&volid, fileid, setattr, force);
         if (ret) {
@@ -30,6 +30,9 @@
 #include "proc.h"
 #include "disk.h"
 #include "replica.h"
+#include "extent.h"
+#include "compress.h"
+#include "tier.h"
 #include "schedule.h"
 #include "redis.h"
 #include "core.h"
@@ -182,6 +185,10 @@ int disk_unlink1(const chkid_t *chkid, uint64_t snapvers)
         int ret;
         char dpath[MAX_PATH_LEN] = {0}, dir[MAX_PATH_LEN];
 
+        if (cdsconf.extent_store) {
+                return extent_unlink(chkid, snapvers);
+        }
+
         chkid2path(chkid, snapvers, dpath);
 
         ret = unlink(dpath);
@@ -190,6 +197,10 @@ int disk_unlink1(const chkid_t *chkid, uint64_t snapvers)
                 GOTO(err_ret, ret);
         }
 
+        ret = compress_unlink(dpath);
+        if (ret)
+                GOTO(err_ret, ret);
+
         ret = _path_split2(dpath, dir, NULL);
         if (ret)
                 GOTO(err_ret, ret);
@@ -349,6 +360,12 @@ retry:
         if (ret)
                 GOTO(err_ret, ret);
 
+        if (cdsconf.tier_move) {
+                ret = tier_init();
+                if (ret)
+                        GOTO(err_ret, ret);
+        }
+
         /* hb_service */
         ret = hb_service_init(&cds_info.hb_service, servicenum);
         if (ret)
@@ -72,6 +72,7 @@ typedef struct {
 
 extern cds_info_t cds_info;
 extern int cds_run(void *);
+int disk_unlink1(const chkid_t *chkid, uint64_t snapvers);
 
 void cds_exit_handler(int sig);
 void cds_signal_handler(int sig);
@@ -24,6 +24,7 @@
 #include "mond_rpc.h"
 #include "net_global.h"
 #include "msgqueue.h"
+#include "io_analysis.h"
 #include "dbg.h"
 
 extern net_global_t ng;
@@ -75,7 +76,8 @@ int __hb(const diskid_t *diskid)
 
         DBUG("try to send heartbeat message diff %lld %lld\n",
               (long long)diff.ds_bfree, (long long)diff.ds_bavail);
-        ret = mond_rpc_diskhb(diskid, cds_info.tier, (const uuid_t *)&ng.nodeid, &diff, info);
+        ret = mond_rpc_diskhb(diskid, cds_info.tier, (const uuid_t *)&ng.nodeid, &diff, info,
+                              io_analysis_load());
         if (ret)
                 GOTO(err_free, ret);
 
@@ -166,6 +166,72 @@ err_ret:
         return ret;
 }
 
+typedef struct {
+        pthread_t th;
+        int ret;
+        dpool_level_t *level;
+} dpool_load_t;
+
+static void *__dpool_load(void *_arg)
+{
+        int ret;
+        dpool_load_t *load = _arg;
+        dpool_level_t *level = load->level;
+
+        ret = path_validate(level->home, 1, 1);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = _dir_iterator(level->home, __disk_iterator, level);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        DINFO("load %s count %u\n", level->home, level->len);
+
+        load->ret = 0;
+        return NULL;
+err_ret:
+        load->ret = ret;
+        return NULL;
+}
+
+/*
+ * every level sits on its own disk, scan them in parallel
+ */
+static int __dpool_load_levels(dpool_t *dpool)
+{
+        int ret, i, count;
+        dpool_load_t *array;
+
+        ret = ymalloc((void **)&array, sizeof(*array) * dpool->level_count);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        for (count = 0; count < dpool->level_count; count++) {
+                array[count].level = &dpool->array[count];
+                array[count].ret = 0;
+
+                ret = pthread_create(&array[count].th, NULL, __dpool_load, &array[count]);
+                if (ret)
+                        break;
+        }
+
+        for (i = 0; i < count; i++) {
+                pthread_join(array[i].th, NULL);
+                if (array[i].ret && ret == 0)
+                        ret = array[i].ret;
+        }
+
+        yfree((void **)&array);
+
+        if (ret)
+                GOTO(err_ret, ret);
+
+        return 0;
+err_ret:
+        return ret;
+}
+
 int dpool_init(dpool_t **_dpool, size_t size, int max, int level_count)
 {
         int ret, i;
@@ -194,18 +260,12 @@ int dpool_init(dpool_t **_dpool, size_t size, int max, int level_count)
 
                 INIT_LIST_HEAD(&level->list);
                 level->len = 0;
-
-                ret = path_validate(level->home, 1, 1);
-                if (ret)
-                        GOTO(err_ret, ret);
-
-                ret = _dir_iterator(level->home, __disk_iterator, level);
-                if (ret)
-                        GOTO(err_ret, ret);
-
-                DINFO("load level %u count %u\n", i, level->len);
         }
 
+        ret = __dpool_load_levels(dpool);
+        if (ret)
+                GOTO(err_ret, ret);
+
         (void) pthread_attr_init(&ta);
         (void) pthread_attr_setdetachstate(&ta, PTHREAD_CREATE_DETACHED);
 
@@ -0,0 +1,567 @@
+#include <sys/types.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+
+#define DBG_SUBSYS S_YFSCDS
+
+#include "configure.h"
+#include "sdfs_lib.h"
+#include "md_lib.h"
+#include "cds.h"
+#include "tier.h"
+#include "redis.h"
+#include "network.h"
+#include "net_global.h"
+#include "mond_rpc.h"
+#include "cds_rpc.h"
+#include "../../cds/replica.h"
+#include "core.h"
+#include "cpuset.h"
+#include "ylib.h"
+#include "dbg.h"
+
+#define TIER_PROBE 8
+
+typedef struct {
+        chkid_t chkid;
+        uint32_t heat;
+        uint32_t epoch;
+        time_t atime;
+} tier_ent_t;
+
+/* one table per core, the lock is only contended by the mover */
+typedef struct {
+        sy_spinlock_t lock;
+        uint32_t size;
+        tier_ent_t *array;
+} tier_t;
+
+typedef struct {
+        chkid_t chkid;
+        uint32_t heat;
+} tier_cand_t;
+
+static tier_t *__tier__ = NULL;
+static int __tier_count__ = 0;          /* cores, plus one for other threads */
+static tier_ent_t *__tier_merge__ = NULL;
+
+/*
+ * the chunk being moved, local writes to it are refused with EAGAIN from
+ * the mark on.  writes admitted before it are counted by chunk hash and
+ * drained before the copy starts
+ */
+#define TIER_INFLIGHT 1024
+#define TIER_DRAIN 1000         /* ms */
+
+static chkid_t __tier_moving__;
+static int __tier_moving_set__ = 0;
+static int __tier_inflight__[TIER_INFLIGHT];
+
+static uint32_t __tier_epoch(time_t now)
+{
+        return now / TIER_HALFLIFE;
+}
+
+/* heat halves every TIER_HALFLIFE, applied lazily */
+static uint32_t __tier_decay(const tier_ent_t *ent, uint32_t epoch)
+{
+        uint32_t diff = epoch - ent->epoch;
+
+        return diff >= 32 ? 0 : ent->heat >> diff;
+}
+
+static uint32_t __tier_hash(const chkid_t *chkid)
+{
+        return (uint32_t)(chkid->id * 31 + chkid->volid * 17 + chkid->idx);
+}
+
+static int __tier_match(const tier_ent_t *ent, const chkid_t *chkid)
+{
+        return ent->chkid.id == chkid->id && ent->chkid.volid == chkid->volid
+                && ent->chkid.idx == chkid->idx;
+}
+
+int tier_write_begin(const chkid_t *chkid)
+{
+        int *inflight;
+
+        if (__tier__ == NULL)
+                return 0;
+
+        inflight = &__tier_inflight__[__tier_hash(chkid) % TIER_INFLIGHT];
+        __atomic_add_fetch(inflight, 1, __ATOMIC_SEQ_CST);
+
+        /* pairs with the mark then drain of __tier_move */
+        if (unlikely(__atomic_load_n(&__tier_moving_set__, __ATOMIC_SEQ_CST))
+            && chkid_cmp(chkid, &__tier_moving__) == 0) {
+                __atomic_sub_fetch(inflight, 1, __ATOMIC_SEQ_CST);
+                return EAGAIN;
+        }
+
+        return 0;
+}
+
+void tier_write_end(const chkid_t *chkid)
+{
+        if (__tier__ == NULL)
+                return;
+
+        __atomic_sub_fetch(&__tier_inflight__[__tier_hash(chkid) % TIER_INFLIGHT],
+                           1, __ATOMIC_SEQ_CST);
+}
+
+static int __tier_drain(const chkid_t *chkid)
+{
+        int i;
+        const int *inflight = &__tier_inflight__[__tier_hash(chkid) % TIER_INFLIGHT];
+
+        for (i = 0; i < TIER_DRAIN; i++) {
+                if (__atomic_load_n(inflight, __ATOMIC_SEQ_CST) == 0)
+                        return 0;
+
+                usleep(1000);
+        }
+
+        return EBUSY;
+}
+
+void tier_heat(const chkid_t *chkid, uint64_t snapvers)
+{
+        int ret;
+        uint32_t i, hash, epoch, heat, min = (uint32_t)-1;
+        time_t now;
+        tier_ent_t *ent, *empty = NULL, *victim = NULL;
+        tier_t *tier;
+        core_t *core;
+
+        if (__tier__ == NULL || snapvers)
+                return;
+
+        core = core_self();
+        tier = &__tier__[(core && core->hash < __tier_count__ - 1)
+                         ? core->hash : __tier_count__ - 1];
+
+        now = gettime();
+        epoch = __tier_epoch(now);
+        hash = __tier_hash(chkid);
+
+        ret = sy_spin_lock(&tier->lock);
+        if (unlikely(ret))
+                return;
+
+        for (i = 0; i < TIER_PROBE; i++) {
+                ent = &tier->array[(hash + i) % tier->size];
+                if (__tier_match(ent, chkid))
+                        goto found;
+
+                if (ent->chkid.id == 0) {
+                        if (empty == NULL)
+                                empty = ent;
+                        continue;
+                }
+
+                heat = __tier_decay(ent, epoch);
+                if (heat < min) {
+                        min = heat;
+                        victim = ent;
+                }
+        }
+
+        /* the coldest chunk of the probe window gives way when it is full */
+        ent = empty ? empty : victim;
+        ent->chkid = *chkid;
+        ent->heat = 0;
+        ent->epoch = epoch;
+
+found:
+        ent->heat = __tier_decay(ent, epoch) + 1;
+        ent->epoch = epoch;
+        ent->atime = now;
+
+        sy_spin_unlock(&tier->lock);
+}
+
+static void __tier_forget(const chkid_t *chkid)
+{
+        int n;
+        uint32_t i, hash = __tier_hash(chkid);
+        tier_ent_t *ent;
+        tier_t *tier;
+
+        for (n = 0; n < __tier_count__; n++) {
+                tier = &__tier__[n];
+                sy_spin_lock(&tier->lock);
+
+                for (i = 0; i < TIER_PROBE; i++) {
+                        ent = &tier->array[(hash + i) % tier->size];
+                        if (__tier_match(ent, chkid)) {
+                                memset(ent, 0x0, sizeof(*ent));
+                                break;
+                        }
+                }
+
+                sy_spin_unlock(&tier->lock);
+        }
+}
+
+/* sum the heat a chunk gathered on every core */
+static void __tier_merge(tier_ent_t *merge, const tier_ent_t *ent, uint32_t epoch)
+{
+        uint32_t i, hash = __tier_hash(&ent->chkid);
+        tier_ent_t *m;
+
+        for (i = 0; i < TIER_HEAT_MAX; i++) {
+                m = &merge[(hash + i) % TIER_HEAT_MAX];
+                if (m->chkid.id == 0) {
+                        *m = *ent;
+                        m->heat = __tier_decay(ent, epoch);
+                        m->epoch = epoch;
+                        return;
+                }
+
+                if (__tier_match(m, &ent->chkid)) {
+                        m->heat += __tier_decay(ent, epoch);
+                        m->atime = _max(m->atime, ent->atime);
+                        return;
+                }
+        }
+
+        /* the tables hold at most TIER_HEAT_MAX entries together */
+        YASSERT(0);
+}
+
+/* hot chunks on hdd, hottest first, or chunks idle for tier_cold on ssd */
+static int __tier_scan(tier_cand_t *array, int *_count)
+{
+        int ret, i, j, n, count = 0;
+        uint32_t epoch, heat;
+        time_t now;
+        const tier_ent_t *ent;
+        tier_t *tier;
+
+        now = gettime();
+        epoch = __tier_epoch(now);
+
+        memset(__tier_merge__, 0x0, sizeof(*__tier_merge__) * TIER_HEAT_MAX);
+        for (n = 0; n < __tier_count__; n++) {
+                tier = &__tier__[n];
+                ret = sy_spin_lock(&tier->lock);
+                if (unlikely(ret))
+                        GOTO(err_ret, ret);
+
+                for (i = 0; i < (int)tier->size; i++) {
+                        if (tier->array[i].chkid.id)
+                                __tier_merge(__tier_merge__, &tier->array[i], epoch);
+                }
+
+                sy_spin_unlock(&tier->lock);
+        }
+
+        for (i = 0; i < TIER_HEAT_MAX; i++) {
+                ent = &__tier_merge__[i];
+                if (ent->chkid.id == 0)
+                        continue;
+
+                heat = __tier_decay(ent, epoch);
+                if (cds_info.tier == TIER_HDD) {
+                        if (heat < (uint32_t)cdsconf.tier_hot)
+                                continue;
+
+                        if (count < TIER_BATCH) {
+                                j = count++;
+                        } else {
+                                j = 0;
+                                for (int k = 1; k < count; k++) {
+                                        if (array[k].heat < array[j].heat)
+                                                j = k;
+                                }
+
+                                if (array[j].heat >= heat)
+                                        continue;
+                        }
+                } else {
+                        if (now - ent->atime < cdsconf.tier_cold)
+                                continue;
+
+                        if (count == TIER_BATCH)
+                                break;
+
+                        j = count++;
+                }
+
+                array[j].chkid = ent->chkid;
+                array[j].heat = heat;
+        }
+
+        *_count = count;
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static int __tier_copy(const chkid_t *chkid, const nid_t *target, uint32_t chksize)
+{
+        int ret;
+        uint32_t offset, size;
+        buffer_t buf;
+        io_t io;
+
+        mbuffer_init(&buf, 0);
+        for (offset = 0; offset < chksize; offset += size) {
+                size = _min(Y_BLOCK_MAX, chksize - offset);
+                io_init(&io, chkid, size, offset, 0);
+
+                ret = replica_read(&io, &buf);
+                if (ret)
+                        GOTO(err_ret, ret);
+
+                ret = cds_rpc_write(target, &io, &buf);
+                if (ret)
+                        GOTO(err_free, ret);
+
+                mbuffer_free(&buf);
+        }
+
+        return 0;
+err_free:
+        mbuffer_free(&buf);
+err_ret:
+        return ret;
+}
+
+/*
+ * the local replica is marked dirty while it is copied, so writers fall
+ * back to the locked path, wait for the chunk lock held here and reload
+ * the chunk info.  a writer that loaded it before the mark is refused here
+ * with EAGAIN and retries the same way; writes already admitted are
+ * drained before the copy, so the copy sees every acknowledged write
+ */
+static int __tier_move(const chkid_t *chkid, int tier, uint32_t *_chksize)
+{
+        int ret, i, idx = -1;
+        fileid_t fileid;
+        fileinfo_t md;
+        chkinfo_t *chkinfo;
+        char _chkinfo[CHK_SIZE(YFS_CHK_REP_MAX)];
+        nid_t target, *nid;
+        uint64_t chksize;
+        time_t begin;
+
+        chkinfo = (void *)_chkinfo;
+        cid2fid(&fileid, chkid);
+        ret = md_getattr(NULL, &fileid, (void *)&md);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        if (md.plugin != PLUGIN_NULL) {
+                ret = ENOTSUP;
+                goto err_ret;
+        }
+
+        if (md.at_size > (uint64_t)chkid->idx * md.split) {
+                chksize = _min(md.at_size - (uint64_t)chkid->idx * md.split,
+                               md.split);
+        } else {
+                chksize = 0;
+        }
+
+        ret = mond_rpc_newdisk(net_getnid(), tier | TIER_STRICT, 1, 0, &target);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = network_connect(&target, NULL, 1, 0);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        begin = gettime();
+        ret = klock(NULL, chkid, 20, 0);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = md_chunk_load(chkid, chkinfo);
+        if (ret)
+                GOTO(err_lock, ret);
+
+        for (i = 0; i < (int)chkinfo->repnum; i++) {
+                nid = &chkinfo->diskid[i];
+                if (nid->status & __S_DIRTY) {
+                        ret = EAGAIN;
+                        goto err_lock;
+                }
+
+                if (nid->id == target.id) {
+                        ret = EEXIST;
+                        goto err_lock;
+                }
+
+                if (nid->id == ng.local_nid.id)
+                        idx = i;
+        }
+
+        if (idx == -1) {
+                ret = ENOENT;
+                goto err_lock;
+        }
+
+        __tier_moving__ = *chkid;
+        __atomic_store_n(&__tier_moving_set__, 1, __ATOMIC_SEQ_CST);
+
+        ret = __tier_drain(chkid);
+        if (ret) {
+                DINFO("move "CHKID_FORMAT" writes not drained\n", CHKID_ARG(chkid));
+                goto err_moving;
+        }
+
+        chkinfo->diskid[idx].status |= __S_DIRTY;
+        ret = md_chunk_update(chkinfo);
+        if (ret)
+                GOTO(err_moving, ret);
+
+        ret = __tier_copy(chkid, &target, chksize);
+        if (ret)
+                GOTO(err_restore, ret);
+
+        if (gettime() - begin > 10) {
+                ret = ETIMEDOUT;
+                GOTO(err_restore, ret);
+        }
+
+        chkinfo->diskid[idx] = target;
+        chkinfo->diskid[idx].status = 0;
+        ret = md_chunk_update(chkinfo);
+        if (ret)
+                GOTO(err_restore, ret);
+
+        kunlock(NULL, chkid);
+
+        /* a writer still holding the old chunk info is refused until the copy is gone */
+        ret = disk_unlink1(chkid, 0);
+        if (ret) {
+                DWARN("unlink "CHKID_FORMAT" ret %u\n", CHKID_ARG(chkid), ret);
+        }
+
+        __atomic_store_n(&__tier_moving_set__, 0, __ATOMIC_RELEASE);
+
+        DINFO("move "CHKID_FORMAT" to %s, tier %u\n", CHKID_ARG(chkid),
+              network_rname(&target), tier);
+
+        *_chksize = chksize;
+
+        return 0;
+err_restore:
+        chkinfo->diskid[idx].status &= ~__S_DIRTY;
+        md_chunk_update(chkinfo);
+err_moving:
+        __atomic_store_n(&__tier_moving_set__, 0, __ATOMIC_RELEASE);
+err_lock:
+        kunlock(NULL, chkid);
+err_ret:
+        return ret;
+}
+
+static void *__tier_worker(void *arg)
+{
+        int ret, i, count, tier;
+        uint32_t chksize;
+        uint64_t rate;
+        tier_cand_t array[TIER_BATCH];
+
+        (void) arg;
+
+        while (1) {
+                sleep(TIER_INTERVAL);
+
+                ret = __tier_scan(array, &count);
+                if (ret || count == 0)
+                        continue;
+
+                tier = cds_info.tier == TIER_HDD ? TIER_SSD : TIER_HDD;
+                DINFO("tier %u, %u chunk to move\n", tier, count);
+
+                for (i = 0; i < count; i++) {
+                        ret = __tier_move(&array[i].chkid, tier, &chksize);
+                        if (ret) {
+                                DBUG("move "CHKID_FORMAT" ret %u\n",
+                                     CHKID_ARG(&array[i].chkid), ret);
+
+                                if (ret == ENOSPC)
+                                        break;
+
+                                if (ret == ENOENT || ret == ENOTSUP)
+                                        __tier_forget(&array[i].chkid);
+
+                                continue;
+                        }
+
+                        __tier_forget(&array[i].chkid);
+
+                        /* throttle to tier_rate MB/s */
+                        rate = (uint64_t)cdsconf.tier_rate * 1024 * 1024;
+                        if (rate)
+                                usleep((uint64_t)chksize * 1000 * 1000 / rate);
+                }
+        }
+
+        pthread_exit(NULL);
+}
+
+int tier_init()
+{
+        int ret, i, count;
+        uint32_t size;
+        pthread_t th;
+        pthread_attr_t ta;
+        tier_t *tier;
+
+        count = cpuset_useable() + 1;
+        size = TIER_HEAT_MAX / count;
+
+        ret = ymalloc((void **)&tier, sizeof(*tier) * count);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        memset(tier, 0x0, sizeof(*tier) * count);
+
+        for (i = 0; i < count; i++) {
+                ret = sy_spin_init(&tier[i].lock);
+                if (ret)
+                        GOTO(err_free, ret);
+
+                ret = ymalloc((void **)&tier[i].array, sizeof(tier_ent_t) * size);
+                if (ret)
+                        GOTO(err_free, ret);
+
+                memset(tier[i].array, 0x0, sizeof(tier_ent_t) * size);
+                tier[i].size = size;
+        }
+
+        ret = ymalloc((void **)&__tier_merge__, sizeof(tier_ent_t) * TIER_HEAT_MAX);
+        if (ret)
+                GOTO(err_free, ret);
+
+        __tier_count__ = count;
+        __tier__ = tier;
+
+        (void) pthread_attr_init(&ta);
+        (void) pthread_attr_setdetachstate(&ta, PTHREAD_CREATE_DETACHED);
+
+        ret = pthread_create(&th, &ta, __tier_worker, NULL);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        DINFO("tier mover started, tier %u hot %u cold %u rate %uMB/s\n",
+              cds_info.tier, cdsconf.tier_hot, cdsconf.tier_cold, cdsconf.tier_rate);
+
+        return 0;
+err_free:
+        for (i = 0; i < count; i++) {
+                if (tier[i].array)
+                        yfree((void **)&tier[i].array);
+        }
+        yfree((void **)&tier);
+err_ret:
+        return ret;
+}
@@ -0,0 +1,25 @@
+#ifndef __TIER_H__
+#define __TIER_H__
+
+#include <stdint.h>
+
+#include "sdfs_conf.h"
+#include "chk_proto.h"
+
+/*
+ * per chunk access heat on this disk. hot chunks on a hdd disk are promoted
+ * to the ssd tier, chunks idle for tier_cold seconds on a ssd disk are
+ * demoted to the hdd tier, by a throttled background mover.
+ */
+
+#define TIER_HEAT_MAX (64 * 1024)
+#define TIER_HALFLIFE 600       /* seconds */
+#define TIER_INTERVAL 60
+#define TIER_BATCH 32
+
+int tier_init();
+void tier_heat(const chkid_t *chkid, uint64_t snapvers);
+int tier_write_begin(const chkid_t *chkid);
+void tier_write_end(const chkid_t *chkid);
+
+#endif
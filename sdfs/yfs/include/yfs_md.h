@@ -12,6 +12,7 @@
 #define __S_PREALLOC                           0x00000001
 #define __S_DIRTY                        0x00000002
 #define __S_WRITEBACK                          0x00000004
+#define __S_INLINE                             0x00000008 /* data kept in the inode, see md_inline_* */
 
 
 #define ATTR_ERASURE_CODE   "erasure_code"
@@ -85,7 +86,7 @@ typedef struct {
         char name[0];
 } symlink_md_t;
 
-typedef struct {
+typedef struct md_proto {
         __MD__
 } md_proto_t;
 
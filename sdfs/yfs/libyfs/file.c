@@ -241,6 +241,24 @@ err_ret:
         return ret;
 }
 
+int ly_close(const char *path)
+{
+        int ret;
+        fileid_t fileid;
+
+        ret = sdfs_lookup_recurive(path, &fileid);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = sdfs_release(NULL, &fileid);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        return 0;
+err_ret:
+        return ret;
+}
+
 int ly_symlink(const char *link_target, const char *link_name)
 {
         int ret;
@@ -94,6 +94,96 @@ int posix_acl_check(const void *xattr, size_t size)
         return state == 0 ? count : -1;
 }
 
+/*
+ * acl must be POSIX_ACL_SIZE(posix_acl_check(xattr, size)) bytes, the
+ * entries of a valid acl are already in tag order
+ */
+int posix_acl_compile(const void *xattr, size_t size, posix_acl_t *acl)
+{
+        int i, count, user;
+        const acl_ea_entry *entry;
+
+        count = posix_acl_check(xattr, size);
+        if (count < 0)
+                return -EINVAL;
+
+        acl->group_obj = 0;
+        acl->masked = 0;
+        acl->user_count = 0;
+        acl->group_count = 0;
+
+        entry = ((const acl_ea_header *)xattr)->a_entries;
+        for (i = 0; i < count; i++, entry++) {
+                switch (entry->e_tag) {
+                case ACL_USER_OBJ:
+                case ACL_OTHER:
+                        break;
+                case ACL_GROUP_OBJ:
+                        acl->group_obj = entry->e_perm & S_IRWXO;
+                        break;
+                case ACL_MASK:
+                        acl->masked = 1;
+                        break;
+                case ACL_USER:
+                case ACL_GROUP:
+                        user = acl->user_count + acl->group_count;
+                        acl->entry[user].id = entry->e_id;
+                        acl->entry[user].perm = entry->e_perm & S_IRWXO;
+                        if (entry->e_tag == ACL_USER)
+                                acl->user_count++;
+                        else
+                                acl->group_count++;
+
+                        break;
+                default:
+                        return -EINVAL;
+                }
+        }
+
+        return 0;
+}
+
+/*
+ * the rwx bits the acl grants uid with primary group gid, on a file of the
+ * given mode.  like linux, the group bits of the mode are the mask when the
+ * acl has one and the owning group otherwise.
+ */
+int posix_acl_permission(const posix_acl_t *acl, mode_t mode, uid_t owner,
+                         gid_t group, uid_t uid, gid_t gid)
+{
+        int i, matched = 0, perm = 0, mask, group_obj;
+
+        if (uid == owner)
+                return (mode & S_IRWXU) >> 6;
+
+        if (acl->masked) {
+                mask = (mode & S_IRWXG) >> 3;
+                group_obj = acl->group_obj;
+        } else {
+                mask = S_IRWXO;
+                group_obj = (mode & S_IRWXG) >> 3;
+        }
+
+        for (i = 0; i < acl->user_count; i++) {
+                if (acl->entry[i].id == uid)
+                        return acl->entry[i].perm & mask;
+        }
+
+        if (gid == group) {
+                perm |= group_obj;
+                matched = 1;
+        }
+
+        for (; i < acl->user_count + acl->group_count; i++) {
+                if (acl->entry[i].id == gid) {
+                        perm |= acl->entry[i].perm;
+                        matched = 1;
+                }
+        }
+
+        return matched ? (perm & mask) : (int)(mode & S_IRWXO);
+}
+
 int posix_acl_equiv_mode(const void *xattr, size_t size, mode_t *mode_p)
 {
         if (posix_acl_check(xattr, size) < 0)
@@ -26,7 +26,29 @@ typedef struct {
         acl_ea_entry  a_entries[0];
 } acl_ea_header;
 
+/*
+ * an access acl parsed once for repeated permission checks, the named
+ * users come first in entry[] and the named groups after them.  the owner,
+ * other and mask bits live in the mode of the file, as chmod changes them.
+ */
+typedef struct {
+        uint16_t group_obj;
+        uint16_t masked;                /* the group bits of the mode are the mask */
+        uint16_t user_count;
+        uint16_t group_count;
+        struct {
+                uint32_t id;
+                uint16_t perm;
+        } entry[0];
+} posix_acl_t;
+
+#define POSIX_ACL_SIZE(count)                                           \
+        (sizeof(posix_acl_t) + sizeof(((posix_acl_t *)0)->entry[0]) * (count))
+
 extern int posix_acl_check(const void *xattr, size_t size);
+extern int posix_acl_compile(const void *xattr, size_t size, posix_acl_t *acl);
+extern int posix_acl_permission(const posix_acl_t *acl, mode_t mode, uid_t owner,
+                                gid_t group, uid_t uid, gid_t gid);
 extern int posix_acl_equiv_mode(const void *xattr, size_t size, mode_t *mode_p);
 extern int posix_acl_default_get(void *acl_buf, size_t acl_buf_size, mode_t mode);
 extern size_t posix_acl_ea_size(int count);
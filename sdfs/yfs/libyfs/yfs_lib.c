@@ -25,6 +25,7 @@
 #include "bh.h"
 #include "core.h"
 #include "attr_queue.h"
+#include "lease.h"
 #include "io_analysis.h"
 #include "../../cds/cds_rpc.h"
 #include "net_global.h"
@@ -700,6 +701,12 @@ int ly_init(int daemon, const char *name, int64_t maxopenfile)
         if (ret)
                 GOTO(err_ret, ret);
 
+        if (!ng.daemon && gloconf.write_lease) {
+                ret = lease_init();
+                if (ret)
+                        GOTO(err_ret, ret);
+        }
+
         ret = cds_rpc_init();
         if (ret)
                 GOTO(err_ret, ret);
@@ -956,6 +963,12 @@ int sdfs_init_verbose(const char *name, int polling_core)
         if (ret)
                 GOTO(err_ret, ret);
 
+        if (!ng.daemon && gloconf.write_lease) {
+                ret = lease_init();
+                if (ret)
+                        GOTO(err_ret, ret);
+        }
+
         ret = cds_rpc_init();
         if (ret)
                 GOTO(err_ret, ret);
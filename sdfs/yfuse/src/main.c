@@ -503,16 +503,23 @@ err_ret:
         return -ret;
 }
 
-static int yfs_release(const char *path, struct fuse_file_info *fi)
+static int yfs_release(const char *_path, struct fuse_file_info *fi)
 {
-        /* Just a stub.	 This method is optional and can safely be left
-           unimplemented */
+        int ret;
+        char path[MAX_PATH_LEN];
 
-        (void) path;
         (void) fi;
 
+        yfs_fusepath(_path, path);
         DBUG("release %s\n", path);
+
+        ret = ly_close(path);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
         return 0;
+err_ret:
+        return -ret;
 }
 
 static int yfs_fsync(const char *path, int isdatasync,
@@ -0,0 +1,36 @@
+#ifndef __ITREE_H__
+#define __ITREE_H__
+
+#include <stdint.h>
+
+/*
+ * intrusive interval tree, an avl tree ordered by start and augmented with
+ * the largest end of each subtree.  intervals are [start, end), they may
+ * overlap and repeat, nodes are told apart by address.  no locking.
+ */
+
+typedef struct __itree_node {
+        struct __itree_node *left;
+        struct __itree_node *right;
+        uint64_t start;
+        uint64_t end;
+        uint64_t max;
+        int height;
+} itree_node_t;
+
+typedef struct {
+        itree_node_t *root;
+        int count;
+} itree_t;
+
+/* stop the iteration by returning non zero, which itree_overlap returns */
+typedef int (*itree_func_t)(itree_node_t *node, void *ctx);
+
+void itree_init(itree_t *tree);
+void itree_insert(itree_t *tree, itree_node_t *node, uint64_t start, uint64_t end);
+void itree_remove(itree_t *tree, itree_node_t *node);
+int itree_overlap(const itree_t *tree, uint64_t start, uint64_t end,
+                  itree_func_t func, void *ctx);
+int itree_iterator(const itree_t *tree, itree_func_t func, void *ctx);
+
+#endif
@@ -49,31 +49,47 @@ static inline int mem_cache_size(mem_cache_type_t type)
         return array[type];
 }
 
+#define MEM_CACHE_ROUNDS 64
+
+typedef struct __mem_magazine {
+        struct __mem_magazine *next;    /* in the depot */
+        int count;
+        void *round[MEM_CACHE_ROUNDS];
+} mem_magazine_t;
+
+/*
+ * each core allocates from and frees into its own two magazines, whole
+ * magazines go through a lock free depot shared by all cores
+ */
 typedef struct {
         char *name;                     /* Name */
-        time_t last_expand;
-
-        uint32_t base_nr;                    /* The base number of current pool */
-        uint32_t max_nr;                     /* The maximum number of current pool */
-        uint32_t idx;                        /* Index of next free slot */
-        uint32_t thread;
         mem_cache_type_t type;
+        uint32_t thread;
 
-        int _private;
+        int _private;                   /* used by one core, no lock */
         uint32_t align;                      /* Align flag */
 
         uint32_t unit_size;                  /* Unit size of pool object */
         uint32_t real_size;                  /* Real size of pool object */
 
-        void **pool;                    /* Array of pointers that point to units */
+        mem_magazine_t *loaded;
+        mem_magazine_t *prev;
 
         pthread_spinlock_t lock;        /* Lock of this memory cache */
 
-        pthread_spinlock_t cross_lock;
-        struct list_head cross_list;
-        int cross_free;
+        uint64_t alloc;
+        uint64_t free;
+        uint64_t remote;                /* freed here, allocated on another core */
 } mem_cache_t;
 
+typedef struct {
+        uint64_t total;                 /* objects taken from the system */
+        uint64_t cached;                /* objects in magazines */
+        uint64_t alloc;
+        uint64_t free;
+        uint64_t remote;
+} mem_cache_stat_t;
+
 /*
  * Alloc can't fail. If there is no memory, function will block and wait for
  * memory alloc success.
@@ -89,5 +105,6 @@ int mem_cache_inited();
 void *mem_cache_calloc(mem_cache_type_t type, uint8_t flag);
 void *mem_cache_calloc1(mem_cache_type_t type, int size);
 void mem_cache_free(mem_cache_type_t, void *);
+void mem_cache_stat(mem_cache_type_t type, mem_cache_stat_t *stat);
 
 #endif /* MEM_CACHE_H */
@@ -21,6 +21,109 @@ typedef struct {
         //redisReply *reply;
 } mctx_t;
 
+/*
+ * counted hash: a hash that keeps the number of its regular fields in a
+ * dedicated counter field, updated in the same server side step as the
+ * field itself.
+ *
+ * KEYS[1] hash, ARGV[1] counter, ARGV[2] key, ARGV[3] value,
+ * ARGV[4] exclusive (0/1), ARGV[5] max
+ * return -1 if the counter is over max, else the HSET/HSETNX result
+ *
+ * max 0 sets a system field (the md): it is not counted, and creating it
+ * starts the counter at 0 in the same step.
+ *
+ * a hash created before the counter existed holds one system field (the md),
+ * so the counter is rebuilt from HLEN the first time it is touched.
+ */
+#define REDIS_HSET_COUNT_SCRIPT                                         \
+        "local m = tonumber(ARGV[5]) "                                  \
+        "local c = 0 "                                                  \
+        "if m > 0 then "                                                \
+        "  c = tonumber(redis.call('HGET', KEYS[1], ARGV[1])) "         \
+        "  if c == nil then "                                           \
+        "    c = redis.call('HLEN', KEYS[1]) - 1 "                      \
+        "    if c < 0 then c = 0 end "                                  \
+        "  end "                                                        \
+        "  if c > m then return -1 end "                                \
+        "end "                                                          \
+        "local n "                                                      \
+        "if ARGV[4] == '1' then "                                       \
+        "  n = redis.call('HSETNX', KEYS[1], ARGV[2], ARGV[3]) "        \
+        "else "                                                         \
+        "  n = redis.call('HSET', KEYS[1], ARGV[2], ARGV[3]) "          \
+        "end "                                                          \
+        "if m > 0 then "                                                \
+        "  redis.call('HSET', KEYS[1], ARGV[1], c + n) "                \
+        "elseif n == 1 then "                                           \
+        "  redis.call('HSETNX', KEYS[1], ARGV[1], 0) "                  \
+        "end "                                                          \
+        "return n"
+
+/*
+ * KEYS[1] hash, ARGV[1] counter, ARGV[2] key
+ * return the HDEL result
+ */
+#define REDIS_HDEL_COUNT_SCRIPT                                         \
+        "local n = redis.call('HDEL', KEYS[1], ARGV[2]) "               \
+        "if n == 1 then "                                               \
+        "  if redis.call('HEXISTS', KEYS[1], ARGV[1]) == 1 then "       \
+        "    redis.call('HINCRBY', KEYS[1], ARGV[1], -1) "              \
+        "  else "                                                       \
+        "    local l = redis.call('HLEN', KEYS[1]) "                    \
+        "    if l > 0 then redis.call('HSET', KEYS[1], ARGV[1], l - 1) end " \
+        "  end "                                                        \
+        "end "                                                          \
+        "return n"
+
+/*
+ * write lease: KEYS[1] lease, KEYS[2] revoke mark,
+ * ARGV[1] op, ARGV[2] owner, ARGV[3] ttl
+ *
+ * grant also renews a lease already held by owner, a grant that finds the
+ * lease held by someone else marks it revoked so the holder gives it up
+ * at its next renew.  recall only marks it, without taking the lease.
+ * return REDIS_LEASE_OK, REDIS_LEASE_BUSY or REDIS_LEASE_REVOKED
+ */
+#define REDIS_LEASE_GRANT    0
+#define REDIS_LEASE_RELEASE  1
+#define REDIS_LEASE_RECALL   2
+
+#define REDIS_LEASE_OK       0
+#define REDIS_LEASE_BUSY     1
+#define REDIS_LEASE_REVOKED  2
+
+#define REDIS_LEASE_SCRIPT                                              \
+        "local v = redis.call('GET', KEYS[1]) "                         \
+        "if ARGV[1] == '1' then "                                       \
+        "  if v == ARGV[2] then redis.call('DEL', KEYS[1], KEYS[2]) end " \
+        "  return 0 "                                                   \
+        "end "                                                          \
+        "if ARGV[1] == '2' then "                                       \
+        "  if v == false or v == ARGV[2] then return 0 end "            \
+        "  redis.call('SET', KEYS[2], ARGV[2], 'EX', ARGV[3]) "         \
+        "  return 1 "                                                   \
+        "end "                                                          \
+        "if v == false then "                                           \
+        "  redis.call('DEL', KEYS[2]) "                                 \
+        "elseif v ~= ARGV[2] then "                                     \
+        "  redis.call('SET', KEYS[2], ARGV[2], 'EX', ARGV[3]) "         \
+        "  return 1 "                                                   \
+        "elseif redis.call('EXISTS', KEYS[2]) == 1 then "               \
+        "  return 2 "                                                   \
+        "end "                                                          \
+        "redis.call('SET', KEYS[1], ARGV[2], 'EX', ARGV[3]) "           \
+        "return 0"
+
+/*
+ * the scripts go out as EVALSHA, a server that answers NOSCRIPT (restarted,
+ * SCRIPT FLUSH) gets one EVAL with the body, which caches it again
+ */
+#define REDIS_SCRIPT_HSET_COUNT 0
+#define REDIS_SCRIPT_HDEL_COUNT 1
+#define REDIS_SCRIPT_LEASE      2
+#define REDIS_SCRIPT_MAX        3
+
 typedef struct {
 #if 0
         sy_spinlock_t lock;
@@ -51,6 +154,19 @@ int redis_sdel(redis_conn_t *conn, const char *set, const char *key);
 int redis_scount(redis_conn_t *conn, const char *set, uint64_t *count);
 int redis_siterator(redis_conn_t *conn, const char *set, func1_t func, void *arg);
 int redis_hlen(redis_conn_t *conn, const char *key, uint64_t *count);
+int redis_hget_count(redis_conn_t *conn, const char *hash, const char *key, void *buf,
+                     size_t *len, const char *counter, int64_t *count);
+int redis_hset_count(redis_conn_t *conn, const char *hash, const char *counter,
+                     const char *key, const void *value, size_t size, int flag, uint64_t max);
+int redis_hdel_count(redis_conn_t *conn, const char *hash, const char *counter, const char *key);
+const char *redis_script_sha(int script);
+int redis_noscript(const redisReply *reply);
+int redis_hget_count_reply(redisReply *reply, void *buf, size_t *len, int64_t *count);
+int redis_hset_count_reply(redisReply *reply, int flag);
+int redis_hdel_count_reply(redisReply *reply);
+int redis_lease(redis_conn_t *conn, const char *key, const char *revoke, int op,
+                const char *owner, int ttl);
+int redis_lease_reply(redisReply *reply);
 int redis_iterator(redis_conn_t *conn, const char *match, func1_t func, void *arg);
 int redis_util_info(const char *addr, int port, const char *key, char *value);
 
@@ -0,0 +1,44 @@
+#ifndef __SWISS_H__
+#define __SWISS_H__
+
+#include <stdint.h>
+
+#include "sdfs_conf.h"
+
+/*
+ * open addressing hash table, a control byte per slot holds 7 bits of the
+ * hash and is matched 16 slots at a time.  keys are kept in the slot, either
+ * keysize bytes compared with memcmp, or with SWISS_KEY_STR a pointer to a
+ * string that must stay valid while the value is in the table.  growing
+ * moves the old slots over a few at a time on later inserts and removes.
+ * no locking, keep one per core or lock around it.
+ */
+
+#define SWISS_KEY_STR 0
+
+typedef struct {
+        uint8_t *ctrl;
+        char *slot;
+        uint32_t capacity;              /* power of 2, at least one group */
+        uint32_t used;
+        uint32_t deleted;
+} swiss_array_t;
+
+typedef struct {
+        char name[MAX_NAME_LEN];
+        int keysize;
+        int slotsize;
+        uint32_t count;
+        uint32_t move;                  /* next slot of old to move */
+        swiss_array_t cur;
+        swiss_array_t old;              /* being moved into cur, capacity 0 if none */
+} swiss_t;
+
+int swiss_create(swiss_t **_tab, const char *name, int keysize);
+void swiss_destroy(swiss_t *tab, void (*thunk)(void *arg, void *value), void *arg);
+void *swiss_find(const swiss_t *tab, const void *key);
+int swiss_insert(swiss_t *tab, const void *key, void *value, int overwrite);
+int swiss_remove(swiss_t *tab, const void *key, void **value);
+void swiss_iterator(const swiss_t *tab, void (*func)(void *arg, void *value), void *arg);
+
+#endif
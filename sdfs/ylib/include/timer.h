@@ -2,6 +2,7 @@
 #define __TIMER_H__
 
 #include "ytime.h"
+#include "sdfs_list.h"
 #include "worker.h"
 #include "adt.h"
 
@@ -9,9 +10,23 @@ typedef int (*resume_func)(void *ctx, int retval);
 
 typedef int (*timer_exec_t)(void *);
 
+/*
+ * timer entry embedded in the caller's context, owned by the timer from
+ * timer_add until it fires or timer_del succeeds
+ */
+typedef struct {
+        struct list_head hook;
+        ytime_t time;
+        func_t func;
+        void *obj;
+        int alloc;
+} timer_entry_t;
+
 int timer_init(int private, int polling);
 void timer_destroy();
 int timer_insert(const char *name, void *ctx, func_t func, suseconds_t usec);
+int timer_add(const char *name, timer_entry_t *ent, void *ctx, func_t func, suseconds_t usec);
+int timer_del(timer_entry_t *ent);
 void timer_expire(void *ctx);
 
 int timer1_create(worker_handler_t *handler, const char *name, timer_exec_t exec, void *_ctx);
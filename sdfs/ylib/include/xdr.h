@@ -14,6 +14,14 @@ typedef struct {
         buffer_t *buf;
 } xdr_t;
 
+/* payload buffers through __xdr_buffer, per thread */
+typedef struct {
+        uint64_t op;
+        uint64_t bytes;
+        uint64_t copy;                  /* ops that copied some of the payload */
+        uint64_t copied;
+} xdr_stat_t;
+
 typedef int enum_t;
 typedef int (*xdr_ret_t)(xdr_t *, void *);
 typedef int (*__xdrproc_t) (xdr_t *, void *,...);
@@ -37,6 +45,7 @@ extern int __xdr_reference (xdr_t *, char **__xpp, uint32_t __size,
 			     __xdrproc_t __proc);
 extern int __xdr_buffer(xdr_t *xdr, char **_buf, uint32_t *size,
 			uint32_t max);
+extern void xdr_stat(xdr_stat_t *decode, xdr_stat_t *encode);
 
 #if 0
 extern int __xdr_short (xdr_t *, short *__sp);
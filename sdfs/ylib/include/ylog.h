@@ -6,6 +6,8 @@
 #include <linux/limits.h>
 #endif
 #include <semaphore.h>
+#include <stdarg.h>
+#include <time.h>
 
 #include "ylock.h"
 #include "sdfs_list.h"
@@ -38,6 +40,26 @@ extern int ylog_init(logmode_t, const char *file);
 extern int ylog_destroy(void);
 extern int ylog_write(logtype_t type, const char *msg);
 
+/*
+ * with a log file, messages go to a per thread ring and a flusher thread
+ * writes them out with writev, so a logging core never waits on the disk.
+ * the call site only copies the message text and the binary header, the
+ * header is formatted by the flusher; a full ring drops and counts.
+ */
+typedef struct {
+        time_t time;
+        uint32_t tid;
+        int stat[6];            /* schedule_stat() of the caller */
+        const char *file;       /* string literals, kept by pointer */
+        const char *func;
+        int line;
+} ylog_head_t;
+
+extern int ylog_async();
+extern int ylog_vprintf(logtype_t type, const ylog_head_t *head, int size,
+                        const char *format, va_list ap);
+extern void ylog_flush();
+
 #define YROC_ROOT "/dev/shm/uss/proc"
 #define FILEMODE (S_IREAD | S_IWRITE | S_IRGRP | S_IROTH)
 
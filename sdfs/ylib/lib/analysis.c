@@ -48,7 +48,7 @@ static int __analysis_count(analysis_t *ana, const char *name, uint64_t _time)
                         GOTO(err_ret, ret);
         }
 
-        ent = hash_table_find(ana->tab, (void *)name);
+        ent = swiss_find(ana->tab, name);
         if (ent == NULL) {
                 ret = ymalloc((void **)&ent, sizeof(entry_t));
                 if (unlikely(ret))
@@ -60,7 +60,7 @@ static int __analysis_count(analysis_t *ana, const char *name, uint64_t _time)
                 ent->count = 1;
                 ent->prev = gettime();
 
-                ret = hash_table_insert(ana->tab, (void *)ent, ent->name, 0);
+                ret = swiss_insert(ana->tab, ent->name, ent, 0);
                 if (unlikely(ret))
                         GOTO(err_lock, ret);
         } else {
@@ -175,7 +175,7 @@ int __analysis_dump1(analysis_t *ana)
                 GOTO(err_ret, ret);
 
         DINFO("begin {{{\n");
-        hash_iterate_table_entries(ana->tab, __analysis, ana->name);
+        swiss_iterator(ana->tab, __analysis, ana->name);
         DINFO("}}} \n");
 
         sy_spin_unlock(&ana->tab_lock);
@@ -255,19 +255,6 @@ err_ret:
         return ret;
 }
 
-static int __analysis_cmp(const void *v1, const void *v2)
-{
-        const entry_t *ent = v1;
-        const char *name = v2;
-
-        return strcmp(ent->name, name);
-}
-
-static uint32_t __analysis_key(const void *i)
-{
-        return hash_str((char *)i);
-}
-
 static void *__worker(void *_args)
 {
         int ret;
@@ -357,9 +344,8 @@ int analysis_create(analysis_t **_ana, const char *_name, int private)
         snprintf(name, MAX_NAME_LEN, "%s", _name);
         strncpy(ana->name, name, MAX_NAME_LEN);
 
-        ana->tab = hash_create_table(__analysis_cmp, __analysis_key, name);
-        if (ana->tab == NULL) {
-                ret = ENOMEM;
+        ret = swiss_create(&ana->tab, name, SWISS_KEY_STR);
+        if (unlikely(ret)) {
                 DERROR("ret (%d) %s\n", ret, strerror(ret));
                 GOTO(err_ret, ret);
         }
@@ -453,20 +439,15 @@ typedef struct {
         int ret;
 } __arg_t;
 
-static void __analysis_dump2(void *_arg, void *_ent)
+static void __analysis_dump2(__arg_t *arg, entry_t *ent)
 {
-        entry_t *ent = _ent;
-        __arg_t *arg = _arg;
-
-        if (strcmp(arg->name, ent->name) == 0) {
-                arg->total = ent->time;
-                arg->count = ent->count;
-                arg->prev = ent->prev;
-                arg->ret = 0;
-                ent->count = 0;
-                ent->time = 0;
-                ent->prev = gettime();
-        }
+        arg->total = ent->time;
+        arg->count = ent->count;
+        arg->prev = ent->prev;
+        arg->ret = 0;
+        ent->count = 0;
+        ent->time = 0;
+        ent->prev = gettime();
 }
 
 int analysis_dump(const char *tab, const char *name,  char *buf)
@@ -474,6 +455,7 @@ int analysis_dump(const char *tab, const char *name,  char *buf)
         int ret;
         analysis_t *ana;
         struct list_head *pos;
+        entry_t *ent;
         __arg_t arg;
 
         if (analysis_list.inited == 0) {
@@ -496,7 +478,9 @@ int analysis_dump(const char *tab, const char *name,  char *buf)
                         if (unlikely(ret))
                                 GOTO(err_lock, ret);
 
-                        hash_iterate_table_entries(ana->tab, __analysis_dump2, &arg);
+                        ent = swiss_find(ana->tab, name);
+                        if (ent)
+                                __analysis_dump2(&arg, ent);
 
                         sy_spin_unlock(&ana->tab_lock);
                         //__analysis_dump1(ana);
@@ -530,9 +514,16 @@ void analysis_merge(void *ctx)
 }
 
 
+static void __analysis_free(void *arg, void *ent)
+{
+        (void) arg;
+
+        yfree((void **)&ent);
+}
+
 static void __analysis_destroy(analysis_t *ana)
 {
-        hash_destroy_table(ana->tab, NULL, NULL);
+        swiss_destroy(ana->tab, __analysis_free, NULL);
         yfree((void **)&ana->queue);
         yfree((void **)&ana->new_queue);
         yfree((void **)&ana);
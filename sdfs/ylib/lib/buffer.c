@@ -20,26 +20,126 @@
 
 int use_memcache = 0;
 
+#define SEG_POOL_MAX 256
+#define SEG_INLINE_MAX ((uint32_t)(MEM_CACHE_SIZE128 - sizeof(seg_t)))
+
+/*
+ * per thread cache of free seg descriptors in front of mem_cache,
+ * [0] for MEM_CACHE_64 segs, [1] for MEM_CACHE_128 segs with inline data
+ */
+static __thread seg_t *__seg_pool__[2];
+static __thread int __seg_pool_count__[2];
+static __thread int __seg_pool_exit__ = 0;
+
+static pthread_once_t __seg_pool_once__ = PTHREAD_ONCE_INIT;
+static pthread_key_t __seg_pool_key__;
+
+/* threads without a private mem_cache give their pool back when they exit */
+static void __seg_pool_exit(void *arg)
+{
+        (void) arg;
+
+        mbuffer_pool_drain();
+}
+
+static void __seg_pool_key_create()
+{
+        int ret;
+
+        ret = pthread_key_create(&__seg_pool_key__, __seg_pool_exit);
+        if (ret)
+                UNIMPLEMENTED(__DUMP__);
+}
+
+/* bytes copied by pop when a seg could not be shared */
+static __thread uint64_t __seg_copy__;
+
+static inline mem_cache_type_t __seg_cache(int is_inline)
+{
+        return is_inline ? MEM_CACHE_128 : MEM_CACHE_64;
+}
+
+static inline seg_t *__seg_get(int is_inline)
+{
+        seg_t *seg;
+
+        seg = __seg_pool__[is_inline];
+        if (likely(seg)) {
+                __seg_pool__[is_inline] = (seg_t *)seg->hook.next;
+                __seg_pool_count__[is_inline]--;
+                return seg;
+        }
+
+        return mem_cache_calloc(__seg_cache(is_inline), 1);
+}
+
+static inline void __seg_put(seg_t *seg)
+{
+        int is_inline = seg->is_inline;
+
+        if (likely(__seg_pool_count__[is_inline] < SEG_POOL_MAX)) {
+                if (unlikely(!__seg_pool_exit__)) {
+                        pthread_once(&__seg_pool_once__, __seg_pool_key_create);
+                        pthread_setspecific(__seg_pool_key__, (void *)1);
+                        __seg_pool_exit__ = 1;
+                }
+
+                seg->hook.next = (void *)__seg_pool__[is_inline];
+                __seg_pool__[is_inline] = seg;
+                __seg_pool_count__[is_inline]++;
+                return;
+        }
+
+        mem_cache_free(__seg_cache(is_inline), seg);
+}
+
+int mbuffer_pool_count()
+{
+        return __seg_pool_count__[0] + __seg_pool_count__[1];
+}
+
+/* called before the private mem_cache of a core goes away, and at thread exit */
+void mbuffer_pool_drain()
+{
+        int i;
+        seg_t *seg;
+
+        for (i = 0; i < 2; i++) {
+                while (__seg_pool__[i]) {
+                        seg = __seg_pool__[i];
+                        __seg_pool__[i] = (seg_t *)seg->hook.next;
+                        mem_cache_free(__seg_cache(i), seg);
+                }
+
+                __seg_pool_count__[i] = 0;
+        }
+}
+
 static void __seg_free(seg_t *seg)
 {
         if (seg->is_attach) {
                 if (seg->base_ptr) {
                         yfree(&seg->base_ptr);
                 }
+        } else if (seg->is_inline) {
+                YASSERT(seg->handler.idx == -1);
         } else {
                 if (seg->use_memcache) {
                         YASSERT(seg->handler.idx >= 0);
                         mem_hugepage_deref(&seg->handler);
                 } else {
                         YASSERT(seg->handler.idx == -1);
-                        YASSERT(seg->handler.pool == NULL);
-                        yfree((void **)&seg->base_ptr);
+                        YASSERT(seg->handler.pool);
+                        if (__atomic_sub_fetch((uint32_t *)seg->handler.pool, 1,
+                                               __ATOMIC_ACQ_REL) == 0)
+                                yfree((void **)&seg->base_ptr);
                 }
         }
-        mem_cache_free(MEM_CACHE_64, seg);
+
+        __seg_put(seg);
 }
 
-static seg_t *__seg_alloc__(uint32_t size, int is_attach)
+static seg_t *__seg_alloc__(uint32_t size, int is_attach, int is_inline)
 {
         seg_t *seg;
 
@@ -47,20 +147,26 @@ static seg_t *__seg_alloc__(uint32_t size, int is_attach)
                 YASSERT(size <= BUFFER_SEG_SIZE);
         }
 
+        if (is_inline) {
+                YASSERT(size <= SEG_INLINE_MAX);
+        }
+
 #ifdef HAVE_STATIC_ASSERT
         static_assert(sizeof(*seg)  < sizeof(mem_cache64_t), "seg_t");
 #endif
 
-        seg = mem_cache_calloc(MEM_CACHE_64, 1);
+        seg = __seg_get(is_inline);
         if (!seg)
                 return NULL;
 
         seg->type = BUFFER_RW;
+        seg->handler.pool = NULL;
         seg->handler.idx = -1;
-        seg->handler.ptr = NULL;
+        seg->handler.ptr = is_inline ? (void *)seg + sizeof(*seg) : NULL;
         seg->len = size;
         seg->is_attach = is_attach;
         seg->use_memcache = 0;
+        seg->is_inline = is_inline;
         seg->base_ptr = NULL;
         DBUG("ptr %p %u %u %d\n", seg->handler.ptr, seg->len, size, seg->handler.idx);
         YASSERT(seg->len == size && seg->handler.idx == -1);
@@ -82,18 +188,23 @@ static inline void __seg_add(buffer_t *buf, seg_t *seg)
         buf->len += seg->len;
 }
 
+/* heap data keeps its reference count behind the data, in handler.pool */
 static int __seg_alloc_normal(seg_t *seg, uint32_t size)
 {
         int ret;
+        uint32_t *ref;
 
-        ret = posix_memalign((void **)&seg->base_ptr, 4096, size);
-        if (ret < 0) {
-                ret = errno;
+        ret = posix_memalign((void **)&seg->base_ptr, 4096,
+                             _align_up(size, sizeof(*ref)) + sizeof(*ref));
+        if (ret) {
                 GOTO(err_ret, ret);
         }
 
+        ref = seg->base_ptr + _align_up(size, sizeof(*ref));
+        *ref = 1;
+
         seg->use_memcache = 0;
-        seg->handler.pool = NULL;
+        seg->handler.pool = ref;
         seg->handler.idx = -1;
         seg->handler.ptr = seg->base_ptr;
 
@@ -127,7 +238,11 @@ static seg_t *__seg_alloc(uint32_t size)
         int ret;
         seg_t *seg;
 
-        seg = __seg_alloc__(size, 0);
+        /* rpc headers and other small pieces never touch the page allocators */
+        if (size <= SEG_INLINE_MAX)
+                return __seg_alloc__(size, 0, 1);
+
+        seg = __seg_alloc__(size, 0, 0);
         if (!seg)
                 return NULL;
 
@@ -146,7 +261,7 @@ static seg_t *__seg_alloc(uint32_t size)
 
         return seg;
 err_free:
-        mem_cache_free(MEM_CACHE_64, seg);
+        __seg_put(seg);
         return NULL;
 }
 
@@ -154,9 +269,30 @@ static seg_t *__seg_share(seg_t *src)
 {
         seg_t *seg;
 
+        if (src->is_inline) {
+                seg = __seg_alloc__(src->len, 0, 1);
+                if (!seg)
+                        return NULL;
+
+                _memcpy(seg->handler.ptr, src->handler.ptr, src->len);
+                return seg;
+        }
+
+        if (!src->use_memcache && !src->is_attach) {
+                seg = __seg_alloc__(src->len, 0, 0);
+                if (!seg)
+                        return NULL;
+
+                seg->handler = src->handler;
+                seg->base_ptr = src->base_ptr;
+                __atomic_add_fetch((uint32_t *)seg->handler.pool, 1, __ATOMIC_RELAXED);
+
+                return seg;
+        }
+
         YASSERT(use_memcache);
         // TODO 托管的内存，不采用引用计数，由应用层自行处理
-        seg = __seg_alloc__(src->len, src->is_attach);
+        seg = __seg_alloc__(src->len, src->is_attach, 0);
         if (!seg)
                 return NULL;
 
@@ -362,7 +498,7 @@ int mbuffer_attach(buffer_t *buf, void *src, uint32_t len, void *base_ptr)
         int ret;
         seg_t *seg;
 
-        seg = __seg_alloc__(len, 1);
+        seg = __seg_alloc__(len, 1, 0);
         if (seg == NULL) {
                 ret = ENOMEM;
                 GOTO(err_ret, ret);
@@ -401,6 +537,22 @@ static int __mbuffer_appendmem(buffer_t *buf, const void *src, uint32_t len, int
 
         BUFFER_CHECK(buf);
 
+        /*
+         * xdr encodes a reply a field at a time, pack the fields into the
+         * inline tail so the reply goes out in a few iovecs
+         */
+        if (tail && !list_empty(&buf->list)) {
+                seg = (seg_t *)buf->list.prev;
+                if (seg->is_inline
+                    && seg->handler.ptr + seg->len + len <= (void *)seg + MEM_CACHE_SIZE128) {
+                        _memcpy(seg->handler.ptr + seg->len, src, len);
+                        seg->len += len;
+                        buf->len += len;
+
+                        return 0;
+                }
+        }
+
         seg = __seg_alloc(len);
         if (seg == NULL) {
                 ret = ENOMEM;
@@ -503,7 +655,7 @@ void mbuffer_reference(buffer_t *dist, const buffer_t *src)
 
         list_for_each(pos, &src->list) {
                 seg = (seg_t *)pos;
-                if (seg->use_memcache == 0) {
+                if (seg->use_memcache == 0 && seg->is_inline == 0) {
                         return __mbuffer_reference_clone(dist, src);
                 }
         }
@@ -569,11 +721,43 @@ void mbuffer_free(buffer_t *buf)
         __buffer_free1(buf);
 }
 
+/*
+ * head of a seg being split by pop, small heads are copied inline and
+ * hugepage or heap data is shared by reference, only attached data is copied
+ */
+static seg_t *__seg_split(seg_t *seg, uint32_t len)
+{
+        seg_t *head;
+
+        YASSERT(len < seg->len);
+
+        if (len > SEG_INLINE_MAX && !seg->is_attach) {
+                head = __seg_share(seg);
+                if (head)
+                        head->len = len;
+
+                return head;
+        }
+
+        head = __seg_alloc(len);
+        if (head) {
+                _memcpy(head->handler.ptr, seg->handler.ptr, len);
+                __seg_copy__ += len;
+        }
+
+        return head;
+}
+
+uint64_t mbuffer_copied()
+{
+        return __seg_copy__;
+}
+
 int mbuffer_pop(buffer_t *buf, buffer_t *newbuf, uint32_t len)
 {
         int ret;
         struct list_head *pos, *n;
-        seg_t *seg;
+        seg_t *seg, *head;
         uint32_t left, cp;
 
         BUFFER_CHECK(buf);
@@ -592,9 +776,13 @@ int mbuffer_pop(buffer_t *buf, buffer_t *newbuf, uint32_t len)
                                 DBUG("pop %u from %u\n", cp, seg->len);
 
                                 if (newbuf) {
-                                        ret = mbuffer_appendmem(newbuf, seg->handler.ptr, cp);
-                                        if (unlikely(ret))
+                                        head = __seg_split(seg, cp);
+                                        if (unlikely(head == NULL)) {
+                                                ret = ENOMEM;
                                                 GOTO(err_ret, ret);
+                                        }
+
+                                        __seg_add_tail(newbuf, head);
                                 }
 
                                 seg->handler.ptr = seg->handler.ptr + cp;
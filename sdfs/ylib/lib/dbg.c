@@ -249,7 +249,29 @@ void  __attribute__((noinline)) dbg_ylog_write(const int logtype, const int size
         int _s_id_, _taskid_, _rq_, _r_, _w_, _c_;
 
         (void) mask;
-        
+
+        if (ylog_async()) {
+                static __thread uint32_t __tid__ = 0;
+                ylog_head_t head;
+
+                if (unlikely(__tid__ == 0))
+                        __tid__ = syscall(SYS_gettid);
+
+                head.time = __t;
+                head.tid = __tid__;
+                head.file = filename;
+                head.line = line;
+                head.func = function;
+                schedule_stat(&head.stat[0], &head.stat[1], &head.stat[2],
+                              &head.stat[3], &head.stat[4], &head.stat[5]);
+
+                va_start(arg, format);
+                (void) ylog_vprintf(logtype, &head, size, format, arg);
+                va_end(arg);
+
+                return;
+        }
+
         /**
          * | __d_msg_buf(size) | __d_msg_info(size) | __d_msg_time(32) |
          */
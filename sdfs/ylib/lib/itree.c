@@ -0,0 +1,224 @@
+#include <stdint.h>
+#include <string.h>
+
+#define DBG_SUBSYS S_LIBYLIB
+
+#include "itree.h"
+#include "dbg.h"
+
+static inline int __itree_height(const itree_node_t *node)
+{
+        return node ? node->height : 0;
+}
+
+static inline uint64_t __itree_max(const itree_node_t *node)
+{
+        return node ? node->max : 0;
+}
+
+static inline int __itree_cmp(const itree_node_t *a, const itree_node_t *b)
+{
+        if (a->start != b->start)
+                return a->start < b->start ? -1 : 1;
+
+        if (a == b)
+                return 0;
+
+        return (uintptr_t)a < (uintptr_t)b ? -1 : 1;
+}
+
+static void __itree_update(itree_node_t *node)
+{
+        int lh = __itree_height(node->left), rh = __itree_height(node->right);
+        uint64_t max = node->end;
+
+        node->height = (lh > rh ? lh : rh) + 1;
+
+        if (__itree_max(node->left) > max)
+                max = __itree_max(node->left);
+        if (__itree_max(node->right) > max)
+                max = __itree_max(node->right);
+
+        node->max = max;
+}
+
+static itree_node_t *__itree_rotate_right(itree_node_t *node)
+{
+        itree_node_t *left = node->left;
+
+        node->left = left->right;
+        left->right = node;
+        __itree_update(node);
+        __itree_update(left);
+
+        return left;
+}
+
+static itree_node_t *__itree_rotate_left(itree_node_t *node)
+{
+        itree_node_t *right = node->right;
+
+        node->right = right->left;
+        right->left = node;
+        __itree_update(node);
+        __itree_update(right);
+
+        return right;
+}
+
+static itree_node_t *__itree_balance(itree_node_t *node)
+{
+        int diff;
+
+        __itree_update(node);
+        diff = __itree_height(node->left) - __itree_height(node->right);
+
+        if (diff > 1) {
+                if (__itree_height(node->left->left) < __itree_height(node->left->right))
+                        node->left = __itree_rotate_left(node->left);
+
+                return __itree_rotate_right(node);
+        } else if (diff < -1) {
+                if (__itree_height(node->right->right) < __itree_height(node->right->left))
+                        node->right = __itree_rotate_right(node->right);
+
+                return __itree_rotate_left(node);
+        }
+
+        return node;
+}
+
+static itree_node_t *__itree_insert(itree_node_t *root, itree_node_t *node)
+{
+        if (root == NULL)
+                return node;
+
+        if (__itree_cmp(node, root) < 0)
+                root->left = __itree_insert(root->left, node);
+        else
+                root->right = __itree_insert(root->right, node);
+
+        return __itree_balance(root);
+}
+
+static itree_node_t *__itree_remove_min(itree_node_t *root, itree_node_t **min)
+{
+        if (root->left == NULL) {
+                *min = root;
+                return root->right;
+        }
+
+        root->left = __itree_remove_min(root->left, min);
+
+        return __itree_balance(root);
+}
+
+static itree_node_t *__itree_remove(itree_node_t *root, itree_node_t *node)
+{
+        int cmp;
+        itree_node_t *min, *right;
+
+        YASSERT(root);
+
+        cmp = __itree_cmp(node, root);
+        if (cmp < 0) {
+                root->left = __itree_remove(root->left, node);
+        } else if (cmp > 0) {
+                root->right = __itree_remove(root->right, node);
+        } else {
+                if (root->left == NULL)
+                        return root->right;
+                if (root->right == NULL)
+                        return root->left;
+
+                right = __itree_remove_min(root->right, &min);
+                min->left = root->left;
+                min->right = right;
+                root = min;
+        }
+
+        return __itree_balance(root);
+}
+
+void itree_init(itree_t *tree)
+{
+        tree->root = NULL;
+        tree->count = 0;
+}
+
+void itree_insert(itree_t *tree, itree_node_t *node, uint64_t start, uint64_t end)
+{
+        node->left = NULL;
+        node->right = NULL;
+        node->start = start;
+        node->end = end;
+        node->max = end;
+        node->height = 1;
+
+        tree->root = __itree_insert(tree->root, node);
+        tree->count++;
+}
+
+void itree_remove(itree_t *tree, itree_node_t *node)
+{
+        tree->root = __itree_remove(tree->root, node);
+        tree->count--;
+}
+
+static int __itree_overlap(itree_node_t *node, uint64_t start, uint64_t end,
+                           itree_func_t func, void *ctx)
+{
+        int ret;
+
+        if (node == NULL || node->max <= start)
+                return 0;
+
+        ret = __itree_overlap(node->left, start, end, func, ctx);
+        if (ret)
+                return ret;
+
+        /* everything on the right starts at or after node */
+        if (node->start >= end)
+                return 0;
+
+        if (node->end > start) {
+                ret = func(node, ctx);
+                if (ret)
+                        return ret;
+        }
+
+        return __itree_overlap(node->right, start, end, func, ctx);
+}
+
+/* visit the nodes overlapping [start, end) in start order, the tree must not change */
+int itree_overlap(const itree_t *tree, uint64_t start, uint64_t end,
+                  itree_func_t func, void *ctx)
+{
+        if (start >= end)
+                return 0;
+
+        return __itree_overlap(tree->root, start, end, func, ctx);
+}
+
+static int __itree_iterator(itree_node_t *node, itree_func_t func, void *ctx)
+{
+        int ret;
+
+        if (node == NULL)
+                return 0;
+
+        ret = __itree_iterator(node->left, func, ctx);
+        if (ret)
+                return ret;
+
+        ret = func(node, ctx);
+        if (ret)
+                return ret;
+
+        return __itree_iterator(node->right, func, ctx);
+}
+
+int itree_iterator(const itree_t *tree, itree_func_t func, void *ctx)
+{
+        return __itree_iterator(tree->root, func, ctx);
+}
@@ -23,7 +23,7 @@ static int __kv_remove(kv_ctx_t *ctx, const char *key)
 
         DBUG("remove %s\n", key);
         
-        ret = hash_table_remove(ctx->tab, (void *)key, (void **)&ent);
+        ret = swiss_remove(ctx->tab, key, (void **)&ent);
         if (unlikely(ret))
                 GOTO(err_ret, ret);
         
@@ -57,7 +57,7 @@ static int __kv_create(kv_ctx_t *ctx, const char *key, const void *value, int va
         ent->valuelen = valuelen;
         ent->timeout = gettime() + ttl;
         
-        ret = hash_table_insert(ctx->tab, (void *)ent, ent->key, 0);
+        ret = swiss_insert(ctx->tab, ent->key, ent, 0);
         if (ret)
                 UNIMPLEMENTED(__DUMP__);
 
@@ -109,7 +109,7 @@ int kv_set(kv_ctx_t *ctx, const char *key, const void *value, int valuelen, int
         int ret;
         entry_t *ent;
 
-        ent = hash_table_find(ctx->tab, (void *)key);
+        ent = swiss_find(ctx->tab, key);
         if (ent) {
                 ret = __kv_update(ctx, ent, key, value, valuelen, flag, ttl);
                 if (unlikely(ret))
@@ -141,7 +141,7 @@ int kv_get(kv_ctx_t *ctx, const char *key, void *value, int *valuelen)
         entry_t *ent;
 
         DBUG("get %s\n", key);
-        ent = hash_table_find(ctx->tab, (void *)key);
+        ent = swiss_find(ctx->tab, key);
         if (ent == NULL) {
                 ret = ENOENT;
                 GOTO(err_ret, ret);
@@ -171,21 +171,6 @@ err_ret:
         return ret;
 }
 
-static uint32_t __kv_hash(const void *args)
-{
-        return hash_str((const char *)args);
-}
-
-static int __kv_cmp(const void *v1, const void *v2)
-{
-        const entry_t *ent = (entry_t *)v1;
-        const char *key = v2;
-
-        DBUG("cmp %s %s\n", ent->key, key);
-        
-        return strcmp(ent->key, key);
-}
-
 int kv_create(kv_ctx_t **_ctx)
 {
         int ret;
@@ -195,11 +180,9 @@ int kv_create(kv_ctx_t **_ctx)
         if (ret)
                 GOTO(err_ret, ret);
 
-        ctx->tab = hash_create_table(__kv_cmp, __kv_hash, "kv");
-        if (ctx->tab == NULL) {
-                ret = ENOMEM;
+        ret = swiss_create(&ctx->tab, "kv", SWISS_KEY_STR);
+        if (ret)
                 GOTO(err_ret, ret);
-        }
 
         INIT_LIST_HEAD(&ctx->list);
 
@@ -243,11 +226,11 @@ void kv_destory(kv_ctx_t *ctx)
                 YASSERT(ret == 0);
         }
 
-        hash_destroy_table(ctx->tab, NULL, NULL);
+        swiss_destroy(ctx->tab, NULL, NULL);
         yfree((void **)&ctx);
 }
 
 void kv_iterator(kv_ctx_t *ctx, func1_t func, void *arg)
 {
-        hash_iterate_table_entries(ctx->tab, func, arg);
+        swiss_iterator(ctx->tab, func, arg);
 }
@@ -11,29 +11,41 @@
 
 #if ENABLE_MEM_CACHE 
 
-#define MEM_CACHE_POOL_ID_UNUSED        -1
 #define MEM_CACHE_MAGIC  0x9dac358a
-
-#if 0
-#define ASYNC_FREE
-#endif
+#define MEM_CACHE_DEPOT_MAX (64 * 1024 * 1024)  /* bytes of full magazines kept per size */
+#define MEM_CACHE_TAG_SHIFT 48
 
 /*
  * Attach a `mem_cache_info' to tail of each structure, used for quick
  * alloc and free.
  */
 struct mem_cache_info {
-        int64_t pool_id;
         uint32_t magic;
         uint32_t thread;
         mem_cache_type_t type;
 };
 
+/*
+ * treiber stack, the top 16 bits of head count the pops against aba.
+ * magazines in the depot are never freed, so a stale next is only read,
+ * and the tag makes its cas fail
+ */
+typedef struct {
+        uint64_t head;
+        uint64_t count;
+} mem_stack_t;
+
+typedef struct {
+        mem_stack_t full;
+        mem_stack_t empty;
+        uint64_t total;
+        uint64_t max;                   /* full magazines kept */
+} mem_depot_t;
+
 static mem_cache_t **__mem_cache__ = NULL;
 static mem_cache_t ***__mem_cache_array__ = NULL;
 static sy_spinlock_t __mem_cache_array_lock__;
-
-static void __mem_cache_free_async__(mem_cache_t *cachep);
+static mem_depot_t __mem_depot__[MEM_CACHE_NR];
 
 static void *__mem_cache_private()
 {
@@ -44,12 +56,48 @@ static void *__mem_cache_private()
 #define mem_cache_info(cachep, obj) \
         ((struct mem_cache_info *)((obj) + (cachep)->unit_size))
 
+static void __mem_stack_push(mem_stack_t *stack, mem_magazine_t *mag)
+{
+        uint64_t head, new;
+
+        YASSERT(((uintptr_t)mag >> MEM_CACHE_TAG_SHIFT) == 0);
+
+        head = __atomic_load_n(&stack->head, __ATOMIC_ACQUIRE);
+        do {
+                mag->next = (void *)(uintptr_t)(head & (((uint64_t)1 << MEM_CACHE_TAG_SHIFT) - 1));
+                new = (head & ~(((uint64_t)1 << MEM_CACHE_TAG_SHIFT) - 1)) | (uintptr_t)mag;
+        } while (!__atomic_compare_exchange_n(&stack->head, &head, new, 0,
+                                              __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+
+        __atomic_add_fetch(&stack->count, 1, __ATOMIC_RELAXED);
+}
+
+static mem_magazine_t *__mem_stack_pop(mem_stack_t *stack)
+{
+        uint64_t head, new, tag;
+        mem_magazine_t *mag;
+
+        head = __atomic_load_n(&stack->head, __ATOMIC_ACQUIRE);
+        do {
+                mag = (void *)(uintptr_t)(head & (((uint64_t)1 << MEM_CACHE_TAG_SHIFT) - 1));
+                if (mag == NULL)
+                        return NULL;
+
+                tag = (head >> MEM_CACHE_TAG_SHIFT) + 1;
+                new = (tag << MEM_CACHE_TAG_SHIFT) | (uintptr_t)mag->next;
+        } while (!__atomic_compare_exchange_n(&stack->head, &head, new, 0,
+                                              __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+        __atomic_sub_fetch(&stack->count, 1, __ATOMIC_RELAXED);
+
+        return mag;
+}
+
 /*
  * mem_cache_create -
  *
  * @name: the name of this memory pool
  * @size: size of unit
- * @base_nr: basic number of unit
  * @align: is the start of memory alloced need to align with page size
  *
  * @return the address of memory on success, otherwise NULL is returned.
@@ -60,17 +108,30 @@ int mem_cache_inited()
         return (uint64_t )__mem_cache__;
 }
 
-mem_cache_t *mem_cache_create(char *name, uint32_t size, uint32_t base_nr,
-                              uint8_t align, int thread, int type, int private)
+static mem_magazine_t *__mem_magazine_new(uint8_t flag)
 {
-        int ret, i = 0;
-        void *obj;
-        mem_cache_t *cachep;
-        struct mem_cache_info *info;
+        mem_magazine_t *mag;
+
+        while (!(mag = calloc(1, sizeof(*mag)))) {
+                if (flag & __MC_FLAG_NOFAIL__) {
+                        sleep(1);
+                        DWARN("no memory, wait success !!!\n");
+                        continue;
+                }
 
-        YASSERT(size >= sizeof(struct list_head));
+                return NULL;
+        }
 
-        if (unlikely(!size || !base_nr)) {
+        return mag;
+}
+
+mem_cache_t *mem_cache_create(char *name, uint32_t size, uint8_t align,
+                              int thread, int type, int private)
+{
+        int ret;
+        mem_cache_t *cachep;
+
+        if (unlikely(!size)) {
                 ret = EINVAL;
                 GOTO(err_ret, ret);
         }
@@ -82,9 +143,6 @@ mem_cache_t *mem_cache_create(char *name, uint32_t size, uint32_t base_nr,
         }
 
         cachep->name = strdup(name);
-        cachep->base_nr = base_nr;
-        cachep->max_nr = base_nr;
-        cachep->idx = 0;
         cachep->thread = thread;
         cachep->align = align;
         cachep->unit_size = size;
@@ -92,54 +150,21 @@ mem_cache_t *mem_cache_create(char *name, uint32_t size, uint32_t base_nr,
         cachep->real_size = size + sizeof(struct mem_cache_info);
         cachep->_private = private;
 
-        cachep->pool = calloc(cachep->max_nr, sizeof(void *));
-        if (unlikely(!cachep->pool)) {
+        cachep->loaded = __mem_magazine_new(0);
+        cachep->prev = __mem_magazine_new(0);
+        if (unlikely(!cachep->loaded || !cachep->prev)) {
                 ret = ENOMEM;
                 GOTO(cachep_free, ret);
         }
 
-        for (i = 0; i < (int)cachep->max_nr; ++i) {
-                /*
-                 * NOTE ALIGN: if the @align is not zero, we need the alloced memory
-                 * address be nultiple of the page size, this is usefull when use the
-                 * O_DIRECT flag to open a file.
-                 */
-                obj = cachep->align ? valloc(cachep->real_size) : malloc(cachep->real_size);
-                if (unlikely(!obj)) {
-                        ret = ENOMEM;
-                        GOTO(pool_free, ret);
-                }
-
-                if (align) {
-                        YASSERT((LLU)obj % PAGE_SIZE == 0);
-                }
-
-                cachep->pool[i] = obj;
-
-                info = mem_cache_info(cachep, obj);
-                info->pool_id = MEM_CACHE_POOL_ID_UNUSED;
-                info->magic = MEM_CACHE_MAGIC;
-                info->type = type;
-        }
-
         ret = pthread_spin_init(&cachep->lock, PTHREAD_PROCESS_PRIVATE);
         if (unlikely(ret))
-                GOTO(pool_free, ret);
-
-        ret = pthread_spin_init(&cachep->cross_lock, PTHREAD_PROCESS_PRIVATE);
-        if (unlikely(ret))
-                GOTO(pool_free, ret);
-
-        INIT_LIST_HEAD(&cachep->cross_list);
-        cachep->cross_free = 0;
+                GOTO(cachep_free, ret);
 
         return cachep;
-pool_free:
-        for (--i; i >= 0; --i) {
-                free(cachep->pool[i]);
-        }
-        free(cachep->pool);
 cachep_free:
+        free(cachep->loaded);
+        free(cachep->prev);
         free(cachep->name);
         free(cachep);
 err_ret:
@@ -148,113 +173,66 @@ err_ret:
 
 /*
  * NOTE: Caller must hold the lock of cache.
+ *
+ * the objects are written on this core, so with the default first touch
+ * policy their pages come from the node of the core using them
  */
-static int __mem_cache_expand(mem_cache_t *cachep, uint8_t flag)
+static int __mem_cache_fill(mem_cache_t *cachep, mem_magazine_t *mag, uint8_t flag)
 {
         int ret;
-        uint32_t new_nr, old_nr, i = 0;
-        void **new, *obj;
+        uint32_t off;
+        void *obj;
         struct mem_cache_info *info;
 
-        old_nr = cachep->max_nr;
-        new_nr = old_nr * 2;
+        while (mag->count < MEM_CACHE_ROUNDS) {
+                /*
+                 * NOTE ALIGN: if the @align is not zero, we need the alloced memory
+                 * address be nultiple of the page size, this is usefull when use the
+                 * O_DIRECT flag to open a file.
+                 */
+                obj = cachep->align ? valloc(cachep->real_size) : malloc(cachep->real_size);
+                if (unlikely(!obj)) {
+                        if (flag & __MC_FLAG_NOFAIL__) {
+                                sleep(1);
+                                DWARN("no memory, wait success !!!\n");
+                                continue;
+                        }
 
-        DINFO("expand mem cache %s(%p) from %u to %u\n",
-             cachep->name, cachep, old_nr, new_nr);
+                        if (mag->count)
+                                break;
 
-        while (!(new = calloc(new_nr, sizeof(void *)))) {
-                if (flag & __MC_FLAG_NOFAIL__) {
-                        sleep(1);
-                        DWARN("no memory, wait success !!!\n");
-                        continue;
+                        ret = ENOMEM;
+                        GOTO(err_ret, ret);
                 }
-                ret = ENOMEM;
-                GOTO(err_ret, ret);
-        }
-
-        for (i = old_nr; i < new_nr; ++i) {
-                while (1) {
-                        /*
-                         * NOTE ALIGN: if the @align is not zero, we need the alloced memory
-                         * address be nultiple of the page size, this is usefull when use the
-                         * O_DIRECT flag to open a file.
-                         */
-                        obj = cachep->align ? valloc(cachep->real_size) : malloc(cachep->real_size);
-                        if (unlikely(!obj)) {
-                                if (flag & __MC_FLAG_NOFAIL__) {
-                                        sleep(1);
-                                        DWARN("no memory, wait success !!!\n");
-                                        continue;
-                                }
-                                ret = ENOMEM;
-                                GOTO(pool_free, ret);
-                        }
 
-                        break;
+                if (cachep->align) {
+                        YASSERT((LLU)obj % PAGE_SIZE == 0);
                 }
 
-                new[i] = obj;
+                for (off = 0; off < cachep->unit_size; off += PAGE_SIZE)
+                        ((char *)obj)[off] = 0;
 
                 info = mem_cache_info(cachep, obj);
-                info->pool_id = MEM_CACHE_POOL_ID_UNUSED;
                 info->magic = MEM_CACHE_MAGIC;
                 info->type = cachep->type;
-        }
 
-        memcpy(new, cachep->pool, old_nr * sizeof(void *));
-        free(cachep->pool);
+                mag->round[mag->count++] = obj;
+        }
 
-        cachep->pool = new;
-        cachep->max_nr = new_nr;
-        cachep->last_expand = gettime();
+        __atomic_add_fetch(&__mem_depot__[cachep->type].total, mag->count, __ATOMIC_RELAXED);
 
         return 0;
-pool_free:
-        for (--i; i >= old_nr;  --i) {
-                free(new[i]);
-        }
-        free(new);
 err_ret:
         return ret;
 }
 
-/*
- * NOTE: Caller must hold the lock of cache.
- */
-static int __mem_cache_shrink(mem_cache_t *cachep)
+static void __mem_cache_drain(mem_cache_t *cachep, mem_magazine_t *mag)
 {
-        int ret;
-        uint32_t new_nr, old_nr, i = 0;
-        void **new;
-
-        if (gettime() - cachep->last_expand < 60) {
-                return 0;
-        }
-
-        old_nr = cachep->max_nr;
-        new_nr = old_nr / 2;
+        __atomic_sub_fetch(&__mem_depot__[cachep->type].total, mag->count, __ATOMIC_RELAXED);
 
-        DINFO("shrink mem cache %s(%p) from %u to %u\n",
-              cachep->name, cachep, old_nr, new_nr);
-
-        new = calloc(new_nr, sizeof(void *));
-        if (unlikely(!new)) {
-                ret = ENOMEM;
-                GOTO(err_ret, ret);
+        while (mag->count) {
+                free(mag->round[--mag->count]);
         }
-
-        for (i = new_nr; i < old_nr; ++i)
-                free(cachep->pool[i]);
-
-        memcpy(new, cachep->pool, new_nr * sizeof(void *));
-        free(cachep->pool);
-
-        cachep->pool = new;
-        cachep->max_nr = new_nr;
-
-        return 0;
-err_ret:
-        return ret;
 }
 
 static int __mem_cache_lock(mem_cache_t *cachep)
@@ -274,27 +252,57 @@ static int __mem_cache_unlock(mem_cache_t *cachep)
                 return 0;
 }
 
+/*
+ * NOTE: Caller must hold the lock of cache.
+ */
+static int __mem_cache_reload(mem_cache_t *cachep, uint8_t flag)
+{
+        int ret;
+        mem_magazine_t *mag;
+        mem_depot_t *depot = &__mem_depot__[cachep->type];
+
+        if (cachep->prev->count) {
+                mag = cachep->prev;
+                cachep->prev = cachep->loaded;
+                cachep->loaded = mag;
+                return 0;
+        }
+
+        mag = __mem_stack_pop(&depot->full);
+        if (mag) {
+                __mem_stack_push(&depot->empty, cachep->prev);
+                cachep->prev = cachep->loaded;
+                cachep->loaded = mag;
+                return 0;
+        }
+
+        ret = __mem_cache_fill(cachep, cachep->loaded, flag);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
+        return 0;
+err_ret:
+        return ret;
+}
+
 void *mem_cache_alloc(mem_cache_t *cachep, uint8_t flag)
 {
         int ret;
         void *obj;
         struct mem_cache_info *info;
 
-        __mem_cache_free_async__(cachep);
-
         __mem_cache_lock(cachep);
 
-        if (unlikely(cachep->idx == cachep->max_nr)) {
-                ret = __mem_cache_expand(cachep, flag);
+        if (unlikely(cachep->loaded->count == 0)) {
+                ret = __mem_cache_reload(cachep, flag);
                 if (unlikely(ret))
                         GOTO(err_unlock, ret);
         }
 
-        obj = cachep->pool[cachep->idx];
+        obj = cachep->loaded->round[--cachep->loaded->count];
         info = mem_cache_info(cachep, obj);
-        info->pool_id = cachep->idx;
         info->thread = cachep->thread;
-        ++cachep->idx;
+        cachep->alloc++;
 
         __mem_cache_unlock(cachep);
         return obj;
@@ -303,89 +311,55 @@ err_unlock:
         return NULL;
 }
 
-void *mem_cache_calloc(mem_cache_type_t type, uint8_t flag)
+static mem_cache_t *__mem_cache_get(mem_cache_type_t type)
 {
         mem_cache_t **__mem_cache_private__ = __mem_cache_private();
-        mem_cache_t *cachep = NULL;
 
         if (likely(__mem_cache_private__)) {
-                cachep = __mem_cache_private__[type];
+                return __mem_cache_private__[type];
         } else {
-                cachep = __mem_cache__[type];
+                return __mem_cache__[type];
         }
+}
 
-        void *obj = mem_cache_alloc(cachep, flag);
+void *mem_cache_calloc(mem_cache_type_t type, uint8_t flag)
+{
+        void *obj = mem_cache_alloc(__mem_cache_get(type), flag);
         /*if (obj) {
                 //memset(obj, 0x00, cachep->unit_size);
         }*/
         return obj;
 }
 
-static void __mem_cache_free__(mem_cache_t *cachep, struct mem_cache_info *del_info, void *del_obj)
+/*
+ * NOTE: Caller must hold the lock of cache.
+ */
+static void __mem_cache_unload(mem_cache_t *cachep)
 {
-        uint32_t del_idx, last_idx;
-        void *last_obj;
-        struct mem_cache_info *last_info;
-
-        __mem_cache_lock(cachep);
-
-        del_idx = del_info->pool_id;
-
-        if (del_idx != cachep->idx - 1) {
-                YASSERT(cachep->idx > 0);
-                last_obj = cachep->pool[cachep->idx - 1];
-                last_info = mem_cache_info(cachep, last_obj);
-                last_idx = last_info->pool_id;
-
-                cachep->pool[del_idx] = last_obj;
-                last_info->pool_id = del_idx;
-                cachep->pool[last_idx] = del_obj;
+        mem_magazine_t *mag;
+        mem_depot_t *depot = &__mem_depot__[cachep->type];
+
+        if (cachep->prev->count == 0) {
+                mag = cachep->prev;
+                cachep->prev = cachep->loaded;
+                cachep->loaded = mag;
+                return;
         }
 
-        del_info->pool_id = MEM_CACHE_POOL_ID_UNUSED;
-
-        --cachep->idx;
-
-        if (unlikely(cachep->max_nr > cachep->base_nr &&
-            cachep->idx < cachep->max_nr / 8))
-                (void) __mem_cache_shrink(cachep);
-
-        __mem_cache_unlock(cachep);
-}
-
-static void __mem_cache_queue_async__(mem_cache_t *cachep, void *del_obj)
-{
-        struct list_head *list;
-
-        pthread_spin_lock(&cachep->cross_lock);
-
-        list = del_obj;
-        list_add_tail(list, &cachep->cross_list);
-        cachep->cross_free = 1;
-
-        pthread_spin_unlock(&cachep->cross_lock);
-}
-
-static void __mem_cache_free_async__(mem_cache_t *cachep)
-{
-        struct mem_cache_info *del_info;
-        struct list_head *pos, *n;
-        void *del_obj;
-
-        if (unlikely(cachep->cross_free)) {
-                pthread_spin_lock(&cachep->cross_lock);
-
-                list_for_each_safe(pos, n, &cachep->cross_list) {
-                        list_del(pos);
-                        del_obj = pos;
-
-                        del_info = mem_cache_info(cachep, del_obj);
-                        __mem_cache_free__(cachep, del_info, del_obj);
-                }
+        /* enough is cached already, give the objects back */
+        if (__atomic_load_n(&depot->full.count, __ATOMIC_RELAXED) >= depot->max) {
+                __mem_cache_drain(cachep, cachep->prev);
+                mag = cachep->prev;
+        } else {
+                __mem_stack_push(&depot->full, cachep->prev);
 
-                cachep->cross_free = 0;
-                pthread_spin_unlock(&cachep->cross_lock);
+                mag = __mem_stack_pop(&depot->empty);
+                if (mag == NULL)
+                        mag = __mem_magazine_new(__MC_FLAG_NOFAIL__);
         }
+
+        cachep->prev = cachep->loaded;
+        cachep->loaded = mag;
 }
 
 void *mem_cache_calloc1(mem_cache_type_t type, int size)
@@ -394,66 +368,79 @@ void *mem_cache_calloc1(mem_cache_type_t type, int size)
         return mem_cache_calloc(type, 1);
 }
 
+/*
+ * the object goes to the magazine of the core freeing it, whichever core
+ * allocated it
+ */
 void IO_FUNC mem_cache_free(mem_cache_type_t type, void *del_obj)
 {
-        mem_cache_t **__mem_cache_private__ = __mem_cache_private();
-        int async_free = 1;
+        mem_cache_t *cachep = __mem_cache_get(type);
         struct mem_cache_info *del_info;
-        mem_cache_t *cachep = NULL;
-
-        if (likely(__mem_cache_private__)) {
-                cachep = __mem_cache_private__[type];
-        } else {
-                cachep = __mem_cache__[type];
-        }
 
         del_info = mem_cache_info(cachep, del_obj);
-        if (unlikely(del_info->thread != cachep->thread)) {
-                DBUG("cross thread free %s, %u --> %u\n", cachep->name,
-                     cachep->thread, del_info->thread);
-                cachep = __mem_cache_array__[del_info->thread][type];
-
-                YASSERT(del_info->magic == MEM_CACHE_MAGIC);
-                YASSERT(del_info->type == type);
-
-        }
-
-#ifdef ASYNC_FREE
-        if (!cachep->private) {
-                async_free = 0;
-        } else if (__mem_cache_private__
-                   && __mem_cache_private__[type]->thread == del_info->thread) {
-                async_free = 0;
-        }
-#else
-        async_free = 0;
-#endif
-
 
         YASSERT(del_info->magic == MEM_CACHE_MAGIC);
         YASSERT(del_info->type == type);
 
+        __mem_cache_lock(cachep);
 
-        if (unlikely(async_free))
-                __mem_cache_queue_async__(cachep, del_obj);
-        else
-                __mem_cache_free__(cachep, del_info, del_obj);
+        if (unlikely(cachep->loaded->count == MEM_CACHE_ROUNDS))
+                __mem_cache_unload(cachep);
+
+        cachep->loaded->round[cachep->loaded->count++] = del_obj;
+        cachep->free++;
+        if (unlikely(del_info->thread != cachep->thread))
+                cachep->remote++;
+
+        __mem_cache_unlock(cachep);
 }
 
 void mem_cache_destroy(mem_cache_t *cachep)
 {
-        uint32_t i;
-
         pthread_spin_destroy(&cachep->lock);
 
-        for (i = 0; i < cachep->max_nr; ++i)
-                free(cachep->pool[i]);
+        __mem_cache_drain(cachep, cachep->loaded);
+        __mem_cache_drain(cachep, cachep->prev);
+
+        /* may have been in the depot, where a pop can still read them */
+        __mem_stack_push(&__mem_depot__[cachep->type].empty, cachep->loaded);
+        __mem_stack_push(&__mem_depot__[cachep->type].empty, cachep->prev);
 
         free(cachep->name);
-        free(cachep->pool);
         free(cachep);
 }
 
+void mem_cache_stat(mem_cache_type_t type, mem_cache_stat_t *stat)
+{
+        int i;
+        mem_cache_t *cachep;
+        mem_depot_t *depot = &__mem_depot__[type];
+
+        memset(stat, 0x0, sizeof(*stat));
+
+        if (__mem_cache_array__ == NULL)
+                return;
+
+        sy_spin_lock(&__mem_cache_array_lock__);
+
+        for (i = 0; i < LICH_VM_MAX; i++) {
+                if ((uintptr_t)__mem_cache_array__[i] <= 0x1)
+                        continue;
+
+                /* counters of other cores are read racily */
+                cachep = __mem_cache_array__[i][type];
+                stat->cached += cachep->loaded->count + cachep->prev->count;
+                stat->alloc += cachep->alloc;
+                stat->free += cachep->free;
+                stat->remote += cachep->remote;
+        }
+
+        sy_spin_unlock(&__mem_cache_array_lock__);
+
+        stat->total = __atomic_load_n(&depot->total, __ATOMIC_RELAXED);
+        stat->cached += __atomic_load_n(&depot->full.count, __ATOMIC_RELAXED) * MEM_CACHE_ROUNDS;
+}
+
 static mem_cache_t ** __mem_cache_init(int thread, int private)
 {
         int ret, i;
@@ -461,14 +448,13 @@ static mem_cache_t ** __mem_cache_init(int thread, int private)
         static struct mem_cache_param {
                 char *name;
                 uint32_t unit_size;
-                uint32_t base_nr;
                 uint16_t align;
         } mem_cache_params[MEM_CACHE_NR] = {
-                /*    name       |          size          | base_nr | align */
-                { "mem_cache_64", sizeof(mem_cache64_t),   1024, 0, },
-                { "mem_cache_128", sizeof(mem_cache128_t),   1024, 0, },
-                { "mem_cache_4k", MEM_CACHE_SIZE4K,   1024, 1, },
-                { "mem_cache_8k", MEM_CACHE_SIZE8K,   128, 1, },
+                /*    name       |          size          | align */
+                { "mem_cache_64", sizeof(mem_cache64_t),   0, },
+                { "mem_cache_128", sizeof(mem_cache128_t),   0, },
+                { "mem_cache_4k", MEM_CACHE_SIZE4K,   1, },
+                { "mem_cache_8k", MEM_CACHE_SIZE8K,   1, },
         };
 
         ret = ymalloc((void**)&mem_cache, sizeof(**mem_cache) * MEM_CACHE_NR);
@@ -479,7 +465,6 @@ static mem_cache_t ** __mem_cache_init(int thread, int private)
                 mem_cache[i] =
                         mem_cache_create(mem_cache_params[i].name,
                                          mem_cache_params[i].unit_size,
-                                         mem_cache_params[i].base_nr,
                                          mem_cache_params[i].align,
                                          thread,
                                          i,
@@ -500,7 +485,7 @@ err_ret:
 
 int mem_cache_init()
 {
-        int ret;
+        int ret, i;
 
         ret = ymalloc((void**)&__mem_cache_array__, sizeof(mem_cache_t ***) * LICH_VM_MAX);
         if (unlikely(ret))
@@ -512,6 +497,11 @@ int mem_cache_init()
         if (unlikely(ret))
                 GOTO(err_ret, ret);
 
+        for (i = 0; i < MEM_CACHE_NR; i++) {
+                __mem_depot__[i].max = _max(MEM_CACHE_DEPOT_MAX
+                                            / (mem_cache_size(i) * MEM_CACHE_ROUNDS), 4);
+        }
+
         __mem_cache__ = __mem_cache_init(LICH_VM_MAX - 1, 0);
         if (unlikely(!__mem_cache__)) {
                 ret = ENOMEM;
@@ -553,11 +543,8 @@ int mem_cache_private_init()
 
         sy_spin_unlock(&__mem_cache_array_lock__);
 
-#ifdef ASYNC_FREE
+        /* frees from other cores land in their own magazines, nothing is shared */
         variable_set(VARIABLE_MEMCACHE, __mem_cache_init(i, 1));
-#else
-        variable_set(VARIABLE_MEMCACHE, __mem_cache_init(i, 0));
-#endif
 
         __mem_cache_private__ = __mem_cache_private();
         if (!__mem_cache_private__) {
@@ -565,8 +552,14 @@ int mem_cache_private_init()
                 UNIMPLEMENTED(__DUMP__);
         }
 
+        ret = sy_spin_lock(&__mem_cache_array_lock__);
+        if (unlikely(ret))
+                GOTO(err_ret, ret);
+
         __mem_cache_array__[i] = __mem_cache_private__;
 
+        sy_spin_unlock(&__mem_cache_array_lock__);
+
         return 0;
 err_lock:
         sy_spin_unlock(&__mem_cache_array_lock__);
@@ -662,6 +655,12 @@ void *mem_cache_calloc1(mem_cache_type_t type, int size)
         return mem_cache_calloc(type, 1);
 }
 
+void mem_cache_stat(mem_cache_type_t type, mem_cache_stat_t *stat)
+{
+        (void)type;
+        memset(stat, 0x0, sizeof(*stat));
+}
+
 int mem_cache_private_init()
 {
         return 0;
@@ -8,6 +8,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
+#include <openssl/sha.h>
 
 #define DBG_SUBSYS S_LIBYLIB
 
@@ -918,6 +920,309 @@ err_ret:
 }
 
 
+/*
+ * HMGET hash key counter, *count is -1 if the counter is not there
+ */
+int redis_hget_count_reply(redisReply *reply, void *buf, size_t *len, int64_t *count)
+{
+        int ret;
+        redisReply *e0, *e1;
+
+        if (reply == NULL) {
+                ret = ECONNRESET;
+                DWARN("redis reset\n");
+                GOTO(err_ret, ret);
+        }
+
+        if (reply->type != REDIS_REPLY_ARRAY || reply->elements != 2) {
+                ret = redis_error(__FUNCTION__, reply);
+                GOTO(err_ret, ret);
+        }
+
+        e0 = reply->element[0];
+        e1 = reply->element[1];
+        if (e0->type == REDIS_REPLY_NIL) {
+                ret = ENOENT;
+                GOTO(err_ret, ret);
+        }
+
+        if (e0->type != REDIS_REPLY_STRING) {
+                ret = EIO;
+                GOTO(err_ret, ret);
+        }
+
+        *len = e0->len;
+        memcpy(buf, e0->str, e0->len);
+
+        if (e1->type == REDIS_REPLY_STRING) {
+                *count = atoll(e1->str);
+        } else {
+                *count = -1;
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+static pthread_once_t __redis_script_once__ = PTHREAD_ONCE_INIT;
+static char __redis_script_sha__[REDIS_SCRIPT_MAX][SHA_DIGEST_LENGTH * 2 + 1];
+
+static void __redis_script_init()
+{
+        int i, j;
+        unsigned char md[SHA_DIGEST_LENGTH];
+        const char *script[REDIS_SCRIPT_MAX] = {
+                REDIS_HSET_COUNT_SCRIPT,
+                REDIS_HDEL_COUNT_SCRIPT,
+                REDIS_LEASE_SCRIPT,
+        };
+
+        for (i = 0; i < REDIS_SCRIPT_MAX; i++) {
+                SHA1((const unsigned char *)script[i], strlen(script[i]), md);
+
+                for (j = 0; j < SHA_DIGEST_LENGTH; j++) {
+                        sprintf(&__redis_script_sha__[i][j * 2], "%02x", md[j]);
+                }
+        }
+}
+
+/*
+ * redis names a script by the sha1 of its body, so the digest is known
+ * without a SCRIPT LOAD round trip
+ */
+const char *redis_script_sha(int script)
+{
+        YASSERT(script >= 0 && script < REDIS_SCRIPT_MAX);
+
+        pthread_once(&__redis_script_once__, __redis_script_init);
+
+        return __redis_script_sha__[script];
+}
+
+int redis_noscript(const redisReply *reply)
+{
+        return reply && reply->type == REDIS_REPLY_ERROR
+                && strncmp(reply->str, "NOSCRIPT", strlen("NOSCRIPT")) == 0;
+}
+
+int redis_hset_count_reply(redisReply *reply, int flag)
+{
+        int ret;
+
+        if (reply == NULL) {
+                ret = ECONNRESET;
+                DWARN("redis reset\n");
+                GOTO(err_ret, ret);
+        }
+
+        if (reply->type != REDIS_REPLY_INTEGER) {
+                ret = redis_error(__FUNCTION__, reply);
+                GOTO(err_ret, ret);
+        }
+
+        if (reply->integer == -1) {
+                ret = EPERM;
+                GOTO(err_ret, ret);
+        }
+
+        if (flag & O_EXCL && reply->integer == 0) {
+                ret = EEXIST;
+                GOTO(err_ret, ret);
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+int redis_hdel_count_reply(redisReply *reply)
+{
+        int ret;
+
+        if (reply == NULL) {
+                ret = ECONNRESET;
+                DWARN("redis reset\n");
+                GOTO(err_ret, ret);
+        }
+
+        if (reply->type != REDIS_REPLY_INTEGER) {
+                ret = redis_error(__FUNCTION__, reply);
+                GOTO(err_ret, ret);
+        }
+
+        if (reply->integer == 0) {
+                ret = ENOENT;
+                GOTO(err_ret, ret);
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+int redis_hget_count(redis_conn_t *conn, const char *hash, const char *key, void *buf,
+                     size_t *len, const char *counter, int64_t *count)
+{
+        int ret;
+        redisReply *reply;
+
+        ret = pthread_rwlock_wrlock(&conn->rwlock);
+        if ((unlikely(ret)))
+                GOTO(err_ret, ret);
+
+        reply = redisCommand(conn->ctx, "HMGET %s %s %s", hash, key, counter);
+
+        pthread_rwlock_unlock(&conn->rwlock);
+
+        ret = redis_hget_count_reply(reply, buf, len, count);
+        if (ret)
+                GOTO(err_free, ret);
+
+        freeReplyObject(reply);
+
+        return 0;
+err_free:
+        if (reply)
+                freeReplyObject(reply);
+err_ret:
+        return ret;
+}
+
+int redis_hset_count(redis_conn_t *conn, const char *hash, const char *counter,
+                     const char *key, const void *value, size_t size, int flag, uint64_t max)
+{
+        int ret;
+        redisReply *reply;
+
+        ret = pthread_rwlock_wrlock(&conn->rwlock);
+        if ((unlikely(ret)))
+                GOTO(err_ret, ret);
+
+        reply = redisCommand(conn->ctx, "EVALSHA %s 1 %s %s %s %b %d %llu",
+                             redis_script_sha(REDIS_SCRIPT_HSET_COUNT), hash, counter, key,
+                             value, size, (flag & O_EXCL) ? 1 : 0, (LLU)max);
+        if (unlikely(redis_noscript(reply))) {
+                freeReplyObject(reply);
+                reply = redisCommand(conn->ctx, "EVAL %s 1 %s %s %s %b %d %llu",
+                                     REDIS_HSET_COUNT_SCRIPT, hash, counter, key,
+                                     value, size, (flag & O_EXCL) ? 1 : 0, (LLU)max);
+        }
+
+        pthread_rwlock_unlock(&conn->rwlock);
+
+        ret = redis_hset_count_reply(reply, flag);
+        if (ret)
+                GOTO(err_free, ret);
+
+        freeReplyObject(reply);
+
+        return 0;
+err_free:
+        if (reply)
+                freeReplyObject(reply);
+err_ret:
+        return ret;
+}
+
+int redis_hdel_count(redis_conn_t *conn, const char *hash, const char *counter, const char *key)
+{
+        int ret;
+        redisReply *reply;
+
+        ret = pthread_rwlock_wrlock(&conn->rwlock);
+        if ((unlikely(ret)))
+                GOTO(err_ret, ret);
+
+        reply = redisCommand(conn->ctx, "EVALSHA %s 1 %s %s %s",
+                             redis_script_sha(REDIS_SCRIPT_HDEL_COUNT), hash, counter, key);
+        if (unlikely(redis_noscript(reply))) {
+                freeReplyObject(reply);
+                reply = redisCommand(conn->ctx, "EVAL %s 1 %s %s %s",
+                                     REDIS_HDEL_COUNT_SCRIPT, hash, counter, key);
+        }
+
+        pthread_rwlock_unlock(&conn->rwlock);
+
+        ret = redis_hdel_count_reply(reply);
+        if (ret)
+                GOTO(err_free, ret);
+
+        freeReplyObject(reply);
+
+        return 0;
+err_free:
+        if (reply)
+                freeReplyObject(reply);
+err_ret:
+        return ret;
+}
+
+/*
+ * EAGAIN if the lease is held by someone else, ESTALE if our lease was revoked
+ */
+int redis_lease_reply(redisReply *reply)
+{
+        int ret;
+
+        if (reply == NULL) {
+                ret = ECONNRESET;
+                DWARN("redis reset\n");
+                GOTO(err_ret, ret);
+        }
+
+        if (reply->type != REDIS_REPLY_INTEGER) {
+                ret = redis_error(__FUNCTION__, reply);
+                GOTO(err_ret, ret);
+        }
+
+        if (reply->integer == REDIS_LEASE_BUSY) {
+                ret = EAGAIN;
+                goto err_ret;
+        } else if (reply->integer == REDIS_LEASE_REVOKED) {
+                ret = ESTALE;
+                goto err_ret;
+        }
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+int redis_lease(redis_conn_t *conn, const char *key, const char *revoke, int op,
+                const char *owner, int ttl)
+{
+        int ret;
+        redisReply *reply;
+
+        ret = pthread_rwlock_wrlock(&conn->rwlock);
+        if ((unlikely(ret)))
+                GOTO(err_ret, ret);
+
+        reply = redisCommand(conn->ctx, "EVALSHA %s 2 %s %s %d %s %d",
+                             redis_script_sha(REDIS_SCRIPT_LEASE), key, revoke, op, owner, ttl);
+        if (unlikely(redis_noscript(reply))) {
+                freeReplyObject(reply);
+                reply = redisCommand(conn->ctx, "EVAL %s 2 %s %s %d %s %d",
+                                     REDIS_LEASE_SCRIPT, key, revoke, op, owner, ttl);
+        }
+
+        pthread_rwlock_unlock(&conn->rwlock);
+
+        ret = redis_lease_reply(reply);
+        if (ret)
+                GOTO(err_free, ret);
+
+        freeReplyObject(reply);
+
+        return 0;
+err_free:
+        if (reply)
+                freeReplyObject(reply);
+err_ret:
+        return ret;
+}
+
 #if 0
 int redis_exec(redis_conn_t *conn, const char *buf)
 {
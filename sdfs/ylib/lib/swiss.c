@@ -0,0 +1,413 @@
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define DBG_SUBSYS S_LIBYLIB
+
+#include "swiss.h"
+#include "sysutil.h"
+#include "ylib.h"
+#include "dbg.h"
+
+#define SWISS_GROUP 16
+#define SWISS_EMPTY 0x80
+#define SWISS_DELETED 0xfe
+#define SWISS_MOVE 32                   /* old slots moved per insert or remove */
+
+typedef struct {
+        void *value;
+        uint32_t hash;
+        uint32_t __pad__;
+        char key[0];
+} swiss_slot_t;
+
+#ifdef __SSE2__
+
+static inline uint32_t __swiss_match(const uint8_t *ctrl, uint8_t h2)
+{
+        __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h2)));
+}
+
+/* empty and deleted are the only bytes with the high bit set */
+static inline uint32_t __swiss_match_free(const uint8_t *ctrl)
+{
+        return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+}
+
+#else
+
+static inline uint32_t __swiss_match(const uint8_t *ctrl, uint8_t h2)
+{
+        int i;
+        uint32_t mask = 0;
+
+        for (i = 0; i < SWISS_GROUP; i++) {
+                if (ctrl[i] == h2)
+                        mask |= 1 << i;
+        }
+
+        return mask;
+}
+
+static inline uint32_t __swiss_match_free(const uint8_t *ctrl)
+{
+        int i;
+        uint32_t mask = 0;
+
+        for (i = 0; i < SWISS_GROUP; i++) {
+                if (ctrl[i] & 0x80)
+                        mask |= 1 << i;
+        }
+
+        return mask;
+}
+
+#endif
+
+/* hash_str and hash_mem leave the low bits poorly mixed */
+static uint32_t __swiss_hash(const swiss_t *tab, const void *key)
+{
+        uint32_t hash;
+
+        if (tab->keysize == SWISS_KEY_STR)
+                hash = hash_str(key);
+        else
+                hash = hash_mem(key, tab->keysize);
+
+        hash ^= hash >> 16;
+        hash *= 0x85ebca6b;
+        hash ^= hash >> 13;
+        hash *= 0xc2b2ae35;
+        hash ^= hash >> 16;
+
+        return hash;
+}
+
+static inline swiss_slot_t *__swiss_slot(const swiss_t *tab, const swiss_array_t *array,
+                                         uint32_t idx)
+{
+        return (void *)(array->slot + (size_t)tab->slotsize * idx);
+}
+
+static inline int __swiss_keyeq(const swiss_t *tab, const swiss_slot_t *slot, const void *key)
+{
+        if (tab->keysize == SWISS_KEY_STR)
+                return strcmp(*(const char **)slot->key, key) == 0;
+        else
+                return memcmp(slot->key, key, tab->keysize) == 0;
+}
+
+static int __swiss_array_init(swiss_t *tab, swiss_array_t *array, uint32_t capacity)
+{
+        int ret;
+
+        ret = ymalloc((void **)&array->ctrl, capacity);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        ret = ymalloc((void **)&array->slot, (size_t)tab->slotsize * capacity);
+        if (ret)
+                GOTO(err_free, ret);
+
+        memset(array->ctrl, SWISS_EMPTY, capacity);
+        array->capacity = capacity;
+        array->used = 0;
+        array->deleted = 0;
+
+        return 0;
+err_free:
+        yfree((void **)&array->ctrl);
+err_ret:
+        return ret;
+}
+
+static void __swiss_array_free(swiss_array_t *array)
+{
+        if (array->capacity == 0)
+                return;
+
+        yfree((void **)&array->ctrl);
+        yfree((void **)&array->slot);
+        memset(array, 0x0, sizeof(*array));
+}
+
+/* groups are probed triangularly, which visits all of them */
+static int __swiss_lookup(const swiss_t *tab, const swiss_array_t *array,
+                          uint32_t hash, const void *key)
+{
+        uint32_t mask, group, i, bits, idx;
+        const swiss_slot_t *slot;
+
+        if (array->used == 0)
+                return -1;
+
+        mask = array->capacity / SWISS_GROUP - 1;
+        group = (hash >> 7) & mask;
+        for (i = 0; i <= mask; i++) {
+                bits = __swiss_match(array->ctrl + group * SWISS_GROUP, hash & 0x7f);
+                while (bits) {
+                        idx = group * SWISS_GROUP + __builtin_ctz(bits);
+                        slot = __swiss_slot(tab, array, idx);
+                        if (slot->hash == hash && __swiss_keyeq(tab, slot, key))
+                                return idx;
+
+                        bits &= bits - 1;
+                }
+
+                if (__swiss_match(array->ctrl + group * SWISS_GROUP, SWISS_EMPTY))
+                        return -1;
+
+                group = (group + i + 1) & mask;
+        }
+
+        return -1;
+}
+
+static swiss_slot_t *__swiss_place(const swiss_t *tab, swiss_array_t *array, uint32_t hash)
+{
+        uint32_t mask, group, i, bits, idx;
+
+        mask = array->capacity / SWISS_GROUP - 1;
+        group = (hash >> 7) & mask;
+        for (i = 0; i <= mask; i++) {
+                bits = __swiss_match_free(array->ctrl + group * SWISS_GROUP);
+                if (bits) {
+                        idx = group * SWISS_GROUP + __builtin_ctz(bits);
+                        if (array->ctrl[idx] == SWISS_DELETED)
+                                array->deleted--;
+
+                        array->ctrl[idx] = hash & 0x7f;
+                        array->used++;
+
+                        return __swiss_slot(tab, array, idx);
+                }
+
+                group = (group + i + 1) & mask;
+        }
+
+        YASSERT(0);
+        return NULL;
+}
+
+/*
+ * a lookup stops at the first group with an empty slot, so a slot only
+ * goes back to empty if its group has one already
+ */
+static void __swiss_erase(swiss_array_t *array, uint32_t idx)
+{
+        const uint8_t *group = array->ctrl + idx / SWISS_GROUP * SWISS_GROUP;
+
+        if (__swiss_match(group, SWISS_EMPTY)) {
+                array->ctrl[idx] = SWISS_EMPTY;
+        } else {
+                array->ctrl[idx] = SWISS_DELETED;
+                array->deleted++;
+        }
+
+        array->used--;
+}
+
+static void __swiss_move(swiss_t *tab, uint32_t count)
+{
+        uint32_t i;
+        swiss_slot_t *from, *to;
+        swiss_array_t *old = &tab->old;
+
+        for (i = 0; i < count && old->capacity; i++) {
+                if (!(old->ctrl[tab->move] & 0x80)) {
+                        from = __swiss_slot(tab, old, tab->move);
+                        to = __swiss_place(tab, &tab->cur, from->hash);
+                        memcpy(to, from, tab->slotsize);
+                        __swiss_erase(old, tab->move);
+                }
+
+                tab->move++;
+                if (tab->move == old->capacity || old->used == 0) {
+                        __swiss_array_free(old);
+                        tab->move = 0;
+                }
+        }
+}
+
+static int __swiss_grow(swiss_t *tab)
+{
+        int ret;
+        uint32_t capacity;
+        swiss_array_t array;
+
+        /* never happens unless SWISS_MOVE is too small for the load */
+        if (unlikely(tab->old.capacity)) {
+                __swiss_move(tab, tab->old.capacity);
+        }
+
+        capacity = tab->cur.capacity;
+        if (tab->cur.used >= capacity * 7 / 16)
+                capacity *= 2;
+
+        ret = __swiss_array_init(tab, &array, capacity);
+        if (ret)
+                GOTO(err_ret, ret);
+
+        tab->old = tab->cur;
+        tab->cur = array;
+        tab->move = 0;
+
+        DBUG("resize %s, new size %u\n", tab->name, capacity);
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+int swiss_create(swiss_t **_tab, const char *name, int keysize)
+{
+        int ret;
+        swiss_t *tab;
+
+        ret = ymalloc((void **)&tab, sizeof(*tab));
+        if (ret)
+                GOTO(err_ret, ret);
+
+        memset(tab, 0x0, sizeof(*tab));
+        strncpy(tab->name, name, MAX_NAME_LEN - 1);
+        tab->keysize = keysize;
+        tab->slotsize = sizeof(swiss_slot_t)
+                + _align_up(keysize == SWISS_KEY_STR ? sizeof(char *) : (size_t)keysize,
+                            sizeof(void *));
+
+        ret = __swiss_array_init(tab, &tab->cur, SWISS_GROUP);
+        if (ret)
+                GOTO(err_free, ret);
+
+        *_tab = tab;
+
+        return 0;
+err_free:
+        yfree((void **)&tab);
+err_ret:
+        return ret;
+}
+
+void swiss_destroy(swiss_t *tab, void (*thunk)(void *arg, void *value), void *arg)
+{
+        if (thunk)
+                swiss_iterator(tab, thunk, arg);
+
+        __swiss_array_free(&tab->old);
+        __swiss_array_free(&tab->cur);
+        yfree((void **)&tab);
+}
+
+void *swiss_find(const swiss_t *tab, const void *key)
+{
+        int idx;
+        uint32_t hash = __swiss_hash(tab, key);
+
+        idx = __swiss_lookup(tab, &tab->cur, hash, key);
+        if (idx >= 0)
+                return __swiss_slot(tab, &tab->cur, idx)->value;
+
+        if (tab->old.capacity) {
+                idx = __swiss_lookup(tab, &tab->old, hash, key);
+                if (idx >= 0)
+                        return __swiss_slot(tab, &tab->old, idx)->value;
+        }
+
+        return NULL;
+}
+
+int swiss_insert(swiss_t *tab, const void *key, void *value, int overwrite)
+{
+        int ret, idx;
+        uint32_t hash = __swiss_hash(tab, key);
+        swiss_array_t *array;
+        swiss_slot_t *slot;
+
+        __swiss_move(tab, SWISS_MOVE);
+
+        array = &tab->cur;
+        idx = __swiss_lookup(tab, array, hash, key);
+        if (idx < 0 && tab->old.capacity) {
+                array = &tab->old;
+                idx = __swiss_lookup(tab, array, hash, key);
+        }
+
+        if (idx >= 0) {
+                if (!overwrite) {
+                        ret = EEXIST;
+                        goto err_ret;
+                }
+
+                __swiss_slot(tab, array, idx)->value = value;
+                return 0;
+        }
+
+        if (tab->cur.used + tab->cur.deleted >= tab->cur.capacity * 7 / 8) {
+                ret = __swiss_grow(tab);
+                if (ret)
+                        GOTO(err_ret, ret);
+        }
+
+        slot = __swiss_place(tab, &tab->cur, hash);
+        slot->value = value;
+        slot->hash = hash;
+        if (tab->keysize == SWISS_KEY_STR)
+                *(const void **)slot->key = key;
+        else
+                memcpy(slot->key, key, tab->keysize);
+
+        tab->count++;
+
+        return 0;
+err_ret:
+        return ret;
+}
+
+int swiss_remove(swiss_t *tab, const void *key, void **value)
+{
+        int idx;
+        uint32_t hash = __swiss_hash(tab, key);
+        swiss_array_t *array;
+
+        __swiss_move(tab, SWISS_MOVE);
+
+        array = &tab->cur;
+        idx = __swiss_lookup(tab, array, hash, key);
+        if (idx < 0 && tab->old.capacity) {
+                array = &tab->old;
+                idx = __swiss_lookup(tab, array, hash, key);
+        }
+
+        if (idx < 0)
+                return ENOENT;
+
+        if (value)
+                *value = __swiss_slot(tab, array, idx)->value;
+
+        __swiss_erase(array, idx);
+        tab->count--;
+
+        return 0;
+}
+
+/* the table must not change from func */
+void swiss_iterator(const swiss_t *tab, void (*func)(void *arg, void *value), void *arg)
+{
+        int j;
+        uint32_t i;
+        const swiss_array_t *array[] = {&tab->old, &tab->cur};
+
+        for (j = 0; j < 2; j++) {
+                for (i = 0; i < array[j]->capacity; i++) {
+                        if (array[j]->ctrl[i] & 0x80)
+                                continue;
+
+                        func(arg, __swiss_slot(tab, array[j], i)->value);
+                }
+        }
+}
@@ -7,36 +7,35 @@
 #define DBG_SUBSYS S_LIBYLIB
 
 #include "ylib.h"
-#include "skiplist.h"
 #include "timer.h"
 #include "mem_cache.h"
 #include "variable.h"
 #include "dbg.h"
 
-#define TIMER_IDLE 1024 * 1024
-#define TIMER_TYPE_MISC 0
-#define TIMER_TYPE_SCHE 1
+/*
+ * hierarchical timing wheel, TIMER_LEVEL levels of TIMER_SLOT slots, a
+ * level 0 slot is one TIMER_TICK.  insert and cancel are O(1), entries of a
+ * higher level are cascaded down when the level below wraps.
+ */
+#define TIMER_TICK 1000                 /* usec */
+#define TIMER_BITS 8
+#define TIMER_SLOT (1 << TIMER_BITS)
+#define TIMER_MASK (TIMER_SLOT - 1)
+#define TIMER_LEVEL 4
+#define TIMER_SPAN ((uint64_t)1 << (TIMER_BITS * TIMER_LEVEL))
 
-typedef struct {
-        ytime_t time;
-        func_t func;
-        void *obj;
-} entry_t;
+#define TIMER_IDLE 1024 * 1024
 
 typedef struct {
-        struct skiplist *list;
+        struct list_head slot[TIMER_LEVEL][TIMER_SLOT];
+        uint64_t tick;                  /* next tick to expire */
         sy_spinlock_t lock;
         int count;
-        int seq;
         sem_t sem;
 } group_t;
 
 typedef struct {
-        ytime_t max;
-        ytime_t min;
         int thread;
-        int maxlevel;
-        int chunksize;
         int private;
         int polling;
         group_t group;
@@ -44,68 +43,129 @@ typedef struct {
 
 static ytimer_t *__timer__ = NULL;
 
-int __timer_cmp(const void *key, const void *data)
+static void __timer_queue(group_t *group, timer_entry_t *ent)
 {
-        int ret;
-        ytime_t *keyid, *dataid;
+        int level;
+        uint64_t expire, delta;
+
+        /* round up, a timer never fires early */
+        expire = (ent->time + TIMER_TICK - 1) / TIMER_TICK;
+        if (expire < group->tick)
+                expire = group->tick;
+
+        delta = expire - group->tick;
+        if (unlikely(delta >= TIMER_SPAN)) {
+                expire = group->tick + TIMER_SPAN - 1;
+                delta = TIMER_SPAN - 1;
+        }
 
-        keyid = (ytime_t *)key;
-        dataid = (ytime_t *)data;
+        for (level = 0; level < TIMER_LEVEL - 1; level++) {
+                if (delta < ((uint64_t)1 << (TIMER_BITS * (level + 1))))
+                        break;
+        }
 
-        if (*keyid < *dataid)
-                ret = -1;
-        else if (*keyid > *dataid)
-                ret = 1;
-        else
-                ret = 0;
+        list_add_tail(&ent->hook,
+                      &group->slot[level][(expire >> (TIMER_BITS * level)) & TIMER_MASK]);
+}
 
-        return ret;
+static void __timer_cascade(group_t *group, int level)
+{
+        struct list_head list, *pos, *n;
+        int idx;
+
+        idx = (group->tick >> (TIMER_BITS * level)) & TIMER_MASK;
+
+        INIT_LIST_HEAD(&list);
+        list_splice_init(&group->slot[level][idx], &list);
+
+        list_for_each_safe(pos, n, &list) {
+                list_del(pos);
+                __timer_queue(group, (timer_entry_t *)pos);
+        }
+
+        if (idx == 0 && level < TIMER_LEVEL - 1)
+                __timer_cascade(group, level + 1);
 }
 
-static void __timer_expire__(group_t *group)
+/* move everything due by now to list */
+static void __timer_due(group_t *group, ytime_t now, struct list_head *list)
 {
-        int ret;
-        ytime_t now;
-        void *first;
-        entry_t *ent;
+        uint64_t target = now / TIMER_TICK;
 
-        now = ytime_gettime();
-        while (1) {
-                ret = skiplist_get1st(group->list, (void **)&first);
-                if (unlikely(ret)) {
-                        break;
-                }
+        if (group->count == 0) {
+                if (group->tick <= target)
+                        group->tick = target + 1;
+                return;
+        }
 
-                ent = first;
+        while (group->tick <= target) {
+                if ((group->tick & TIMER_MASK) == 0)
+                        __timer_cascade(group, 1);
 
-                if (now >= ent->time) {
-                        group->count--;
-                        (void) skiplist_del(group->list, first, (void **)&first);
+                list_splice_tail_init(&group->slot[0][group->tick & TIMER_MASK], list);
+                group->tick++;
+        }
+}
 
-                        DBUG("func %p\n", ent->obj);
+/* ticks until the next level 0 entry or the next cascade */
+static uint64_t __timer_next(const group_t *group)
+{
+        uint64_t i;
 
-                        ANALYSIS_BEGIN(0);
-                        ent->func(ent->obj);
-                        ANALYSIS_END(0, 1000 * 100, NULL);
+        for (i = 0; i < TIMER_SLOT; i++) {
+                if (!list_empty(&group->slot[0][(group->tick + i) & TIMER_MASK]))
+                        return i;
 
-                        mem_cache_free(MEM_CACHE_64, ent);
-                } else {
+                if (i && ((group->tick + i) & TIMER_MASK) == 0)
                         break;
-                }
         }
+
+        return i;
 }
 
+static void __timer_run(timer_entry_t *ent)
+{
+        int alloc = ent->alloc;
+
+        DBUG("func %p\n", ent->obj);
+
+        /* the callback may free the context the entry lives in */
+        ANALYSIS_BEGIN(0);
+        ent->func(ent->obj);
+        ANALYSIS_END(0, 1000 * 100, NULL);
+
+        if (alloc)
+                mem_cache_free(MEM_CACHE_64, ent);
+}
+
+static void __timer_expire__(group_t *group)
+{
+        struct list_head list;
+        timer_entry_t *ent;
+
+        INIT_LIST_HEAD(&list);
+        __timer_due(group, ytime_gettime(), &list);
+
+        while (!list_empty(&list)) {
+                ent = (timer_entry_t *)list.next;
+                list_del_init(&ent->hook);
+                group->count--;
+
+                __timer_run(ent);
+        }
+}
 
 static void *__timer_expire(void *_args)
 {
         int ret;
         group_t *group;
         struct timespec ts;
-        ytime_t now;
-        void *first;
-        entry_t *ent;
+        struct list_head list;
+        timer_entry_t *ent;
+        uint64_t next;
 
         group = _args;
+        INIT_LIST_HEAD(&list);
 
         ret = ytime_getntime(&ts);
         if (unlikely(ret)) {
@@ -121,73 +181,53 @@ static void *__timer_expire(void *_args)
                                 YASSERT(0);
                 }
 
-                while (srv_running) {
-                        ret = sy_spin_lock(&group->lock);
-                        if (unlikely(ret))
-                                YASSERT(0);
+                ret = sy_spin_lock(&group->lock);
+                if (unlikely(ret))
+                        YASSERT(0);
 
-                        ret = skiplist_get1st(group->list, (void **)&first);
-                        if (unlikely(ret)) {
-                                if (ret == ENOENT) {
-                                        ret = sy_spin_unlock(&group->lock);
-                                        if (unlikely(ret))
-                                                YASSERT(0);
+                __timer_due(group, ytime_gettime(), &list);
 
-                                        ts.tv_sec += TIMER_IDLE;
+                /* one by one, timer_del may race with the callbacks */
+                while (!list_empty(&list)) {
+                        ent = (timer_entry_t *)list.next;
+                        list_del_init(&ent->hook);
+                        group->count--;
 
-                                        break;
-                                } else
-                                        YASSERT(0);
-                        }
+                        sy_spin_unlock(&group->lock);
+
+                        __timer_run(ent);
 
-                        ret = sy_spin_unlock(&group->lock);
+                        ret = sy_spin_lock(&group->lock);
                         if (unlikely(ret))
                                 YASSERT(0);
+                }
 
-                        now = ytime_gettime();
-
-                        ent = first;
-
-                        if (now >= ent->time) {
-                                ret = sy_spin_lock(&group->lock);
-                                if (unlikely(ret))
-                                        YASSERT(0);
-
-                                group->count--;
-                                (void) skiplist_del(group->list, first, (void **)&first);
-
-                                ret = sy_spin_unlock(&group->lock);
-                                if (unlikely(ret))
-                                        YASSERT(0);
-
-                                DBUG("func %p\n", ent->obj);
-
-                                ANALYSIS_BEGIN(0);
-                                ent->func(ent->obj);
-                                ANALYSIS_END(0, 1000 * 100, NULL);
+                if (group->count) {
+                        next = __timer_next(group);
+                        ytime_2ntime((group->tick + next) * TIMER_TICK, &ts);
+                } else {
+                        ret = ytime_getntime(&ts);
+                        if (unlikely(ret))
+                                YASSERT(0);
 
-                                mem_cache_free(MEM_CACHE_64, ent);
-                        } else {
-                                ytime_2ntime(ent->time, &ts);
-                                break;
-                        }
+                        ts.tv_sec += TIMER_IDLE;
                 }
+
+                sy_spin_unlock(&group->lock);
         }
 
 	return NULL;
 }
 
-
 int timer_init(int private, int polling)
 {
-        int ret, len;
+        int ret, len, i, j;
         void *ptr;
         ytimer_t *_timer;
         group_t *group;
         pthread_t th;
         pthread_attr_t ta;
 
-        /* group [ sche , misc ] */
         len = sizeof(ytimer_t);
 
         ret = ymalloc(&ptr, len);
@@ -195,20 +235,17 @@ int timer_init(int private, int polling)
                 GOTO(err_ret, ret);
 
         _timer = ptr;
-        _timer->min = 0;
-        _timer->max = (unsigned long long)-1;
-        _timer->maxlevel = SKIPLIST_MAX_LEVEL;
-        _timer->chunksize = SKIPLIST_CHKSIZE_DEF;
         _timer->private = private;
         _timer->polling = polling;
 
         group = &_timer->group;
-        ret = skiplist_create(__timer_cmp, _timer->maxlevel, _timer->chunksize,
-                              (void *)&_timer->min, (void *)&_timer->max,
-                              &group->list);
-        if (unlikely(ret))
-                GOTO(err_ret, ret);
+        for (i = 0; i < TIMER_LEVEL; i++) {
+                for (j = 0; j < TIMER_SLOT; j++) {
+                        INIT_LIST_HEAD(&group->slot[i][j]);
+                }
+        }
 
+        group->tick = ytime_gettime() / TIMER_TICK;
         group->count = 0;
 
         if (private) {
@@ -243,104 +280,117 @@ err_ret:
         return ret;
 }
 
-static int __timer_destroy(void *arg)
-{
-        entry_t *ent = arg;
-
-        ent->func(ent->obj);
-        mem_cache_free(MEM_CACHE_64, ent);
-
-        return 0;
-}
-
 void timer_destroy()
 {
+        int i, j;
         ytimer_t *timer;
         group_t *group;
-        
+        timer_entry_t *ent;
+        struct list_head *slot;
+
         timer = variable_get(VARIABLE_TIMER);
         group = &timer->group;
 
-        skiplist_iterate_del(group->list, __timer_destroy);
+        for (i = 0; i < TIMER_LEVEL; i++) {
+                for (j = 0; j < TIMER_SLOT; j++) {
+                        slot = &group->slot[i][j];
+                        while (!list_empty(slot)) {
+                                ent = (timer_entry_t *)slot->next;
+                                list_del_init(&ent->hook);
+                                group->count--;
+
+                                __timer_run(ent);
+                        }
+                }
+        }
 
         variable_unset(VARIABLE_TIMER);
 }
 
-static int __timer_insert(group_t *group, suseconds_t usec, void *obj, func_t func)
+static ytimer_t *__timer_self(const char *name, suseconds_t usec)
 {
-        int ret, retry = 0;
-        entry_t *ent;
-        uint64_t tmo;
-
-        tmo = ytime_gettime();
-        tmo += usec;
+        ytimer_t *timer;
 
-        ent = mem_cache_calloc(MEM_CACHE_64, 1);
-        ent->time = tmo;
-        ent->obj = obj;
-        ent->func = func;
+        (void) name;
+        (void) usec;
 
-retry:
-        ret = skiplist_put(group->list, (void *)&ent->time, (void *)ent);
-        if (unlikely(ret)) {
-                if (ret == EEXIST) {
-                        if (retry > 1024) {
-                                YASSERT(0);
-                        }
+        timer = variable_get(VARIABLE_TIMER);
+        if (likely(timer)) {
+                DBUG("timer insert %s %ju\n", name, usec);
+                YASSERT(timer->thread == variable_thread());
+        } else {
+                DBUG("timer insert %s %ju\n", name, usec);
+                timer = __timer__;
+        }
 
-                        if (retry > 256)
-                                DINFO("retry %u, count %u\n", retry, group->count);
+        return timer;
+}
 
-                        ent->time = ent->time + (group->seq ++) % 1024;
-                        retry ++;
-                        goto retry;
-                }
+static int __timer_add(ytimer_t *timer, timer_entry_t *ent)
+{
+        int ret;
+        group_t *group = &timer->group;
 
-                GOTO(err_ret, ret);
+        if (unlikely(!timer->private)) {
+                ret = sy_spin_lock(&group->lock);
+                if (unlikely(ret))
+                        GOTO(err_ret, ret);
         }
 
+        __timer_queue(group, ent);
         group->count++;
 
+        if (unlikely(!timer->private)) {
+                sy_spin_unlock(&group->lock);
+        }
+
+        if (unlikely(!timer->polling)) {
+                sem_post(&group->sem);
+        }
+
         return 0;
 err_ret:
-        mem_cache_free(MEM_CACHE_64, ent);
         return ret;
 }
 
-int timer_insert(const char *name, void *ctx, func_t func, suseconds_t usec)
+int timer_add(const char *name, timer_entry_t *ent, void *ctx, func_t func, suseconds_t usec)
+{
+        ent->time = ytime_gettime() + usec;
+        ent->obj = ctx;
+        ent->func = func;
+        ent->alloc = 0;
+
+        return __timer_add(__timer_self(name, usec), ent);
+}
+
+/* ENOENT if the entry already fired or is firing */
+int timer_del(timer_entry_t *ent)
 {
         int ret;
-        group_t *group;
         ytimer_t *timer;
+        group_t *group;
 
-        timer = variable_get(VARIABLE_TIMER);
-        if (likely(timer)) {
-                DBUG("timer insert %s %ju\n", name, usec);
-                YASSERT(timer->thread == variable_thread());
-        } else {
-                DBUG("timer insert %s %ju\n", name, usec);
-                timer = __timer__;
-        }
-
+        timer = __timer_self("del", 0);
         group = &timer->group;
+
         if (unlikely(!timer->private)) {
                 ret = sy_spin_lock(&group->lock);
                 if (unlikely(ret))
                         GOTO(err_ret, ret);
         }
-        
-        ret = __timer_insert(group, usec, ctx, func);
-        if (unlikely(ret))
-                GOTO(err_lock, ret);
+
+        if (list_empty(&ent->hook)) {
+                ret = ENOENT;
+                goto err_lock;
+        }
+
+        list_del_init(&ent->hook);
+        group->count--;
 
         if (unlikely(!timer->private)) {
                 sy_spin_unlock(&group->lock);
         }
 
-        if (unlikely(!timer->polling)) {
-                sem_post(&group->sem);
-        }
-                
         return 0;
 err_lock:
         if (unlikely(!timer->private)) {
@@ -350,6 +400,37 @@ err_ret:
         return ret;
 }
 
+int timer_insert(const char *name, void *ctx, func_t func, suseconds_t usec)
+{
+        int ret;
+        timer_entry_t *ent;
+
+#ifdef HAVE_STATIC_ASSERT
+        static_assert(sizeof(*ent) <= sizeof(mem_cache64_t), "timer_entry_t");
+#endif
+
+        ent = mem_cache_calloc(MEM_CACHE_64, 1);
+        if (unlikely(ent == NULL)) {
+                ret = ENOMEM;
+                GOTO(err_ret, ret);
+        }
+
+        ent->time = ytime_gettime() + usec;
+        ent->obj = ctx;
+        ent->func = func;
+        ent->alloc = 1;
+
+        ret = __timer_add(__timer_self(name, usec), ent);
+        if (unlikely(ret))
+                GOTO(err_free, ret);
+
+        return 0;
+err_free:
+        mem_cache_free(MEM_CACHE_64, ent);
+err_ret:
+        return ret;
+}
+
 void timer_expire(void *ctx)
 {
         ytimer_t *timer;
@@ -9,6 +9,8 @@
 #include <sys/types.h>
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sys/uio.h>
 
 #define DBG_SUBSYS S_LIBYLIB
 
@@ -30,6 +32,336 @@ ylog_t *ylog = NULL;
 
 ylog_t __ylog__;
 
+#define YLOG_RING_SIZE (256 * 1024)
+#define YLOG_BATCH 64
+#define YLOG_INTERVAL (10 * 1000)
+#define YLOG_HEAD_LEN 256
+
+#define YLOG_REC_HEAD 0
+#define YLOG_REC_RAW 1
+#define YLOG_REC_PAD 2          /* skip to the start of the ring */
+
+#define YLOG_REC_LEN(__size__) \
+        ((sizeof(ylog_rec_t) + (__size__) + 7) & ~((uint32_t)7))
+
+typedef struct {
+        uint32_t len;
+        uint16_t type;
+        uint16_t flag;
+        uint32_t msglen;
+        uint32_t __pad__;
+        ylog_head_t head;
+        char msg[0];
+} ylog_rec_t;
+
+/* single producer, the owner thread, and single consumer under __ylog_lock__ */
+typedef struct __ylog_ring {
+        struct __ylog_ring *next;
+        uint64_t head;
+        uint64_t tail;
+        uint64_t drop;
+        uint64_t drop_report;
+        int dead;
+        char buf[YLOG_RING_SIZE];
+} ylog_ring_t;
+
+static ylog_ring_t *__ylog_rings__ = NULL;
+static __thread ylog_ring_t *__ylog_ring__ = NULL;
+static pthread_key_t __ylog_key__;
+static pthread_mutex_t __ylog_lock__ = PTHREAD_MUTEX_INITIALIZER;
+static int __ylog_flusher__ = 0;
+static char __ylog_line__[YLOG_BATCH][YLOG_HEAD_LEN];
+
+static void __ylog_ring_exit(void *arg)
+{
+        ylog_ring_t *ring = arg;
+
+        /* a later message from this thread gets a new ring */
+        __ylog_ring__ = NULL;
+        __atomic_store_n(&ring->dead, 1, __ATOMIC_RELEASE);
+}
+
+static ylog_ring_t *__ylog_ring()
+{
+        ylog_ring_t *ring = __ylog_ring__;
+
+        if (likely(ring))
+                return ring;
+
+        ring = calloc(1, sizeof(*ring));
+        if (ring == NULL)
+                return NULL;
+
+        ring->next = __atomic_load_n(&__ylog_rings__, __ATOMIC_ACQUIRE);
+        while (!__atomic_compare_exchange_n(&__ylog_rings__, &ring->next, ring, 0,
+                                            __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+        }
+
+        (void) pthread_setspecific(__ylog_key__, ring);
+        __ylog_ring__ = ring;
+
+        return ring;
+}
+
+static ylog_rec_t *__ylog_reserve(ylog_ring_t *ring, uint32_t len)
+{
+        uint64_t tail, off, left, need;
+        ylog_rec_t *pad;
+
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        off = ring->head % YLOG_RING_SIZE;
+        left = YLOG_RING_SIZE - off;
+        need = left < len ? left + len : len;
+
+        if (ring->head + need - tail > YLOG_RING_SIZE) {
+                __atomic_store_n(&ring->drop, ring->drop + 1, __ATOMIC_RELAXED);
+                return NULL;
+        }
+
+        if (left < len) {
+                pad = (void *)ring->buf + off;
+                pad->len = left;
+                pad->flag = YLOG_REC_PAD;
+                __atomic_store_n(&ring->head, ring->head + left, __ATOMIC_RELEASE);
+                off = 0;
+        }
+
+        return (void *)ring->buf + off;
+}
+
+static void __ylog_commit(ylog_ring_t *ring, ylog_rec_t *rec)
+{
+        rec->len = YLOG_REC_LEN(rec->msglen);
+        __atomic_store_n(&ring->head, ring->head + rec->len, __ATOMIC_RELEASE);
+}
+
+static int __ylog_format(const ylog_head_t *head, char *buf)
+{
+        int ret;
+        struct tm tm;
+        static time_t last = 0;
+        static char now[32];
+
+        if (head->time != last) {
+                last = head->time;
+                strftime(now, sizeof(now), "%F %T", localtime_safe(&last, &tm));
+        }
+
+        ret = snprintf(buf, YLOG_HEAD_LEN, "%s/%lu %lu/%lu %d/%d %d/%d/%d/%d %s:%d %s ",
+                       now, (unsigned long)head->time,
+                       (unsigned long)getpid(), (unsigned long)head->tid,
+                       head->stat[0], head->stat[1], head->stat[2],
+                       head->stat[3], head->stat[4], head->stat[5],
+                       head->file, head->line, head->func);
+
+        return ret < YLOG_HEAD_LEN ? ret : YLOG_HEAD_LEN - 1;
+}
+
+static void __ylog_writev(struct iovec *iov, int count)
+{
+        int ret;
+
+        ret = writev(ylog->logfd, iov, count);
+        if (ret < 0) {
+                ret = errno;
+                fprintf(stderr, "ylog write error %u\n", ret);
+        }
+}
+
+static int __ylog_drain(ylog_ring_t *ring)
+{
+        int i, count, total = 0;
+        uint64_t head, tail, drop;
+        ylog_rec_t *rec;
+        struct iovec iov[YLOG_BATCH * 2];
+
+        drop = __atomic_load_n(&ring->drop, __ATOMIC_RELAXED);
+        if (unlikely(drop != ring->drop_report)) {
+                i = snprintf(__ylog_line__[0], YLOG_HEAD_LEN,
+                             "%lu WARNING: ylog dropped %llu messages\n",
+                             (unsigned long)time(NULL),
+                             (unsigned long long)(drop - ring->drop_report));
+                iov[0].iov_base = __ylog_line__[0];
+                iov[0].iov_len = i;
+                __ylog_writev(iov, 1);
+                ring->drop_report = drop;
+        }
+
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        tail = ring->tail;
+        while (tail != head) {
+                i = 0;
+                count = 0;
+                while (tail != head && i < YLOG_BATCH) {
+                        rec = (void *)ring->buf + tail % YLOG_RING_SIZE;
+                        tail += rec->len;
+
+                        if (rec->flag == YLOG_REC_PAD)
+                                continue;
+
+                        if (rec->flag == YLOG_REC_HEAD) {
+                                iov[count].iov_base = __ylog_line__[i];
+                                iov[count].iov_len = __ylog_format(&rec->head,
+                                                                   __ylog_line__[i]);
+                                count++;
+                        }
+
+                        iov[count].iov_base = rec->msg;
+                        iov[count].iov_len = rec->msglen;
+                        count++;
+                        i++;
+                }
+
+                if (count)
+                        __ylog_writev(iov, count);
+
+                total += i;
+                __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        }
+
+        return total;
+}
+
+static int __ylog_flush()
+{
+        int dead, total = 0;
+        ylog_ring_t *ring, *prev = NULL, *next;
+
+        pthread_mutex_lock(&__ylog_lock__);
+
+        ring = __atomic_load_n(&__ylog_rings__, __ATOMIC_ACQUIRE);
+        while (ring) {
+                next = ring->next;
+                dead = __atomic_load_n(&ring->dead, __ATOMIC_ACQUIRE);
+
+                total += __ylog_drain(ring);
+
+                /* producers only touch the list head, so others can be unlinked */
+                if (dead && prev) {
+                        prev->next = next;
+                        free(ring);
+                } else
+                        prev = ring;
+
+                ring = next;
+        }
+
+        pthread_mutex_unlock(&__ylog_lock__);
+
+        return total;
+}
+
+void ylog_flush()
+{
+        if (ylog_async())
+                (void) __ylog_flush();
+}
+
+static void *__ylog_flusher(void *arg)
+{
+        (void) arg;
+
+        while (1) {
+                if (__ylog_flush() == 0)
+                        usleep(YLOG_INTERVAL);
+        }
+
+        pthread_exit(NULL);
+}
+
+static void __ylog_flusher_start()
+{
+        int ret, expect = 0;
+        pthread_t th;
+        pthread_attr_t ta;
+
+        if (likely(__atomic_load_n(&__ylog_flusher__, __ATOMIC_RELAXED)))
+                return;
+
+        if (!__atomic_compare_exchange_n(&__ylog_flusher__, &expect, 1, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+                return;
+
+        (void) pthread_attr_init(&ta);
+        (void) pthread_attr_setdetachstate(&ta, PTHREAD_CREATE_DETACHED);
+
+        ret = pthread_create(&th, &ta, __ylog_flusher, NULL);
+        if (ret) {
+                fprintf(stderr, "ylog flusher create error %u\n", ret);
+                __atomic_store_n(&__ylog_flusher__, 0, __ATOMIC_RELAXED);
+        }
+}
+
+/* the flusher does not survive fork, the child starts its own on demand */
+static void __ylog_atfork_child()
+{
+        pthread_mutex_init(&__ylog_lock__, NULL);
+        __ylog_flusher__ = 0;
+}
+
+int ylog_async()
+{
+        return ylog && ylog->logmode == YLOG_FILE && ylog->logfd != -1;
+}
+
+int ylog_vprintf(logtype_t type, const ylog_head_t *head, int size,
+                 const char *format, va_list ap)
+{
+        int len;
+        ylog_ring_t *ring;
+        ylog_rec_t *rec;
+
+        ring = __ylog_ring();
+        if (unlikely(ring == NULL))
+                return ENOMEM;
+
+        __ylog_flusher_start();
+
+        rec = __ylog_reserve(ring, YLOG_REC_LEN(size));
+        if (unlikely(rec == NULL))
+                return ENOSPC;
+
+        len = vsnprintf(rec->msg, size, format, ap);
+        if (unlikely(len < 0))
+                len = 0;
+
+        rec->msglen = len < size ? len : size - 1;
+        rec->type = type;
+        rec->flag = YLOG_REC_HEAD;
+        rec->head = *head;
+
+        __ylog_commit(ring, rec);
+
+        return 0;
+}
+
+static int __ylog_write_async(logtype_t type, const char *msg)
+{
+        uint32_t len;
+        ylog_ring_t *ring;
+        ylog_rec_t *rec;
+
+        ring = __ylog_ring();
+        if (unlikely(ring == NULL))
+                return ENOMEM;
+
+        __ylog_flusher_start();
+
+        len = _min(strlen(msg), YLOG_RING_SIZE / 4);
+        rec = __ylog_reserve(ring, YLOG_REC_LEN(len));
+        if (unlikely(rec == NULL))
+                return ENOSPC;
+
+        memcpy(rec->msg, msg, len);
+        rec->msglen = len;
+        rec->type = type;
+        rec->flag = YLOG_REC_RAW;
+
+        __ylog_commit(ring, rec);
+
+        return 0;
+}
+
 int ylog_init(logmode_t logmode, const char *file)
 {
         int ret, fd;
@@ -47,6 +379,15 @@ int ylog_init(logmode_t logmode, const char *file)
                         __ylog__.count = 0;
                         __ylog__.time = 0;
 
+                        ret = pthread_key_create(&__ylog_key__, __ylog_ring_exit);
+                        if (ret) {
+                                fprintf(stderr, "ylog init %u", ret);
+                                goto err_ret;
+                        }
+
+                        (void) pthread_atfork(NULL, NULL, __ylog_atfork_child);
+                        (void) atexit(ylog_flush);
+
                         fd = _open(file, O_APPEND | O_CREAT | O_WRONLY, 0644);
                         if (fd == -1) {
                                 ret = errno;
@@ -70,6 +411,8 @@ err_ret:
 int ylog_destroy(void)
 {
         if (ylog) {
+                ylog_flush();
+
                 if (ylog->logmode == YLOG_FILE && ylog->logfd != -1)
                         (void) sy_close(ylog->logfd);
 
@@ -81,54 +424,8 @@ int ylog_destroy(void)
 
 int ylog_write(logtype_t type, const char *_msg)
 {
-        int ret;
-        //time_t now;
-        //char msg_buf[MAX_BUF_LEN];
-
-        (void) type;
-        
-        if (ylog && ylog->logmode == YLOG_FILE && ylog->logfd != -1) {
-#if 0
-                ret = sy_rwlock_wrlock(&ylog->lock);
-                if (ret) {
-                        fprintf(stderr, "ylog write error %u", ret);
-                        EXIT(ret);
-                }
-
-                ylog->count++;
-
-                if (ylog->count % 100 == 0) {
-                        now = time(NULL);
-                        if (now - ylog->time < 10) {
-                                snprintf(msg_buf, MAX_BUF_LEN,
-                                         "%lu:%s:%s( ):%4d:%6lu:%6lu: WARNING: too many log, sleep 2, count %u, diff %u\n",
-                                         (unsigned long)time(NULL),            
-                                         __FILE__, __FUNCTION__, __LINE__, 
-                                         (unsigned long)getpid( ),
-                                         (unsigned long)pthread_self( ), ylog->count, (int)(now - ylog->time));
-
-                                ret = write(ylog->logfd, msg_buf, strlen(msg_buf));
-                                if (ret < 0) {
-                                        ret = errno;
-                                        fprintf(stderr, "ylog write error %u", ret);
-                                        EXIT(ret);
-                                }
-
-                                //sleep(2);
-                        }
-
-                        ylog->time = time(NULL);
-                }
-
-                sy_rwlock_unlock(&ylog->lock);
-#endif
-
-                ret = write(ylog->logfd, _msg, strlen(_msg));
-                if (ret < 0) {
-                        ret = errno;
-                        fprintf(stderr, "ylog write error %u", ret);
-                        EXIT(ret);
-                }
+        if (ylog_async()) {
+                (void) __ylog_write_async(type, _msg);
         } else
                 fprintf(stderr, "%s", _msg);
 
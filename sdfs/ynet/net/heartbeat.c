@@ -33,6 +33,7 @@
 typedef ynet_net_conn_t entry_t;
 
 typedef struct {
+        timer_entry_t timer;
         nid_t parent;
         sockid_t sockid;
         uint64_t timeout;
@@ -154,7 +155,8 @@ static void __heartbeat(void *_ent)
          *
          * @todo 高负载情况下，为了减少误判的可能性，此方案有待改进
          */
-        ret = timer_insert("heartbeat", hb_ent, __heartbeat, hb_ent->timeout / gloconf.hb_retry);
+        ret = timer_add("heartbeat", &hb_ent->timer, hb_ent, __heartbeat,
+                        hb_ent->timeout / gloconf.hb_retry);
         if (unlikely(ret))
                 UNIMPLEMENTED(__DUMP__);
 
@@ -194,7 +196,7 @@ int heartbeat_add(const sockid_t *sockid, const nid_t *parent, suseconds_t timeo
              _inet_ntoa(hb_ent->sockid.addr), hb_ent->sockid.sd);
 #endif
 
-        ret = timer_insert("heartbeat", hb_ent, __heartbeat, timeout);
+        ret = timer_add("heartbeat", &hb_ent->timer, hb_ent, __heartbeat, timeout);
         if (unlikely(ret))
                 GOTO(err_free, ret);
 